@@ -0,0 +1,416 @@
+/*
+ * Copyright (c) 2015-2017 Hanspeter Portner (dev@open-music-kontrollers.ch)
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the Artistic License 2.0 as published by
+ * The Perl Foundation.
+ *
+ * This source is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Artistic License 2.0 for more details.
+ *
+ * You should have received a copy of the Artistic License 2.0
+ * along the source as a COPYING file. If not, obtain it from
+ * http://www.perlfoundation.org/artistic_license_2_0.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <espressivo.h>
+#include <props.h>
+
+#define MAX_NPROPS (1 + PERF_NPROPS)
+
+typedef struct _targetB_t targetB_t;
+typedef struct _targetO_t targetO_t;
+typedef struct _plugstate_t plugstate_t;
+typedef struct _plughandle_t plughandle_t;
+
+struct _targetB_t {
+	xpress_handle_t voice;
+	uint32_t stamp;
+};
+
+struct _targetO_t {
+	//empty
+};
+
+struct _plugstate_t {
+	int32_t channel;
+
+	perf_state_t perf;
+};
+
+struct _plughandle_t {
+	LV2_URID_Map *map;
+	LV2_Atom_Forge forge;
+	LV2_Atom_Forge_Ref ref;
+
+	PROPS_T(props, MAX_NPROPS);
+	xpress_t *xpressB;
+	xpress_t *xpressO;
+	targetB_t *targetB;
+	targetO_t *targetO;
+	void *pool;
+
+	const LV2_Atom_Sequence *event_in;
+	LV2_Atom_Sequence *event_out;
+
+	plugstate_t state;
+	plugstate_t stash;
+	plugstate_t restore [PROPS_NRESTORE];
+	perf_t perf;
+
+	xpress_bus_t *bus;
+	int32_t subscribed;
+	uint32_t cursor;
+	uint32_t stamp;
+};
+
+static const props_def_t defs [MAX_NPROPS] = {
+	{
+		.property = ESPRESSIVO_URI"#bus_channel",
+		.offset = offsetof(plugstate_t, channel),
+		.type = LV2_ATOM__Int,
+	},
+	PERF_DEFS(plugstate_t, perf)
+};
+
+static const xpress_iface_t ifaceB = {
+	.size = sizeof(targetB_t)
+};
+
+static const xpress_iface_t ifaceO = {
+	.size = sizeof(targetO_t)
+};
+
+static void
+_subscribe(plughandle_t *handle)
+{
+	const int32_t channel = handle->state.channel;
+
+	if(channel == handle->subscribed)
+		return; // nothing to do
+
+	// drop voices of former channel, next xpress#Alive will release them
+	XPRESS_VOICE_FREE(handle->xpressB, voice)
+	{
+		targetB_t *src = voice->target;
+
+		xpress_free_h(handle->xpressO, &src->voice);
+	}
+
+	if( (channel < 0) || (channel >= XPRESS_BUS_NCHANNELS) )
+	{
+		handle->subscribed = -1; // disabled
+		return;
+	}
+
+	// only follow new items, late joiners sync up on next keyframe
+	handle->subscribed = channel;
+	handle->cursor = xpress_bus_cursor(handle->bus, channel);
+}
+
+static void
+_token(plughandle_t *handle, const xpress_bus_item_t *item)
+{
+	LV2_Atom_Forge *forge = &handle->forge;
+
+	targetB_t *src = xpress_get(handle->xpressB, item->uuid);
+	if(!src)
+	{
+		src = xpress_add(handle->xpressB, item->uuid);
+		if(!src)
+			return; // voice table full
+
+		xpress_create_h(handle->xpressO, &src->voice);
+	}
+
+	src->stamp = handle->stamp;
+
+	if(handle->ref)
+		handle->ref = xpress_token_h(handle->xpressO, forge, 0, &src->voice, &item->state);
+}
+
+static void
+_release(plughandle_t *handle, const xpress_bus_item_t *item)
+{
+	LV2_Atom_Forge *forge = &handle->forge;
+
+	targetB_t *src = xpress_get(handle->xpressB, item->uuid);
+	if(!src)
+		return; // unknown voice
+
+	xpress_free_h(handle->xpressO, &src->voice);
+
+	if(handle->ref)
+		handle->ref = xpress_release(handle->xpressO, forge, 0, &src->voice.uuid, 1);
+
+	xpress_free(handle->xpressB, item->uuid);
+}
+
+static void
+_alive(plughandle_t *handle)
+{
+	// sweep voices whose release got lost in an overrun
+	XPRESS_VOICE_FOREACH(handle->xpressB, voice)
+	{
+		targetB_t *src = voice->target;
+
+		if(src->stamp != handle->stamp)
+		{
+			xpress_free_h(handle->xpressO, &src->voice);
+			xpress_free(handle->xpressB, voice->uuid);
+		}
+	}
+
+	handle->stamp++;
+}
+
+static void
+_poll(plughandle_t *handle)
+{
+	if(handle->subscribed == -1)
+		return; // disabled
+
+	xpress_bus_item_t item;
+
+	// bounded, thus wait-free
+	for(unsigned i = 0; i < XPRESS_BUS_NSLOTS; i++)
+	{
+		const xpress_bus_status_t status = xpress_bus_poll(handle->bus,
+			handle->subscribed, &handle->cursor, &item);
+
+		if(status == XPRESS_BUS_EMPTY)
+			break;
+		else if(status == XPRESS_BUS_OVERRUN)
+			continue; // lapped, next keyframe resyncs
+
+		switch(item.type)
+		{
+			case XPRESS_BUS_TOKEN:
+				_token(handle, &item);
+				break;
+			case XPRESS_BUS_RELEASE:
+				_release(handle, &item);
+				break;
+			case XPRESS_BUS_ALIVE:
+				_alive(handle);
+				break;
+		}
+	}
+}
+
+static LV2_Handle
+instantiate(const LV2_Descriptor* descriptor, double rate,
+	const char *bundle_path, const LV2_Feature *const *features)
+{
+	plughandle_t *handle = calloc(1, sizeof(plughandle_t));
+	if(!handle)
+		return NULL;
+
+	xpress_map_t *voice_map = NULL;
+
+	for(unsigned i=0; features[i]; i++)
+	{
+		if(!strcmp(features[i]->URI, LV2_URID__map))
+			handle->map = features[i]->data;
+		else if(!strcmp(features[i]->URI, XPRESS__voiceMap))
+			voice_map = features[i]->data;
+	}
+
+	if(!handle->map)
+	{
+		fprintf(stderr, "%s: Host does not support urid:map\n", descriptor->URI);
+		free(handle);
+		return NULL;
+	}
+
+	handle->map = espressivo_map_ref(handle->map);
+
+	handle->bus = xpress_bus_init();
+	if(!handle->bus)
+	{
+		fprintf(stderr, "%s: failed to map voice bus\n", descriptor->URI);
+		espressivo_map_unref(handle->map);
+		free(handle);
+		return NULL;
+	}
+
+	const unsigned max_nvoices = xpress_max_nvoices(handle->map, features,
+		MAX_NVOICES, MAX_NVOICES_LIMIT);
+	const size_t pool_size = _pool_size(max_nvoices, sizeof(targetB_t))
+		+ _pool_size(max_nvoices, sizeof(targetO_t));
+	uint8_t *pool = handle->pool = calloc(1, pool_size);
+	if(!pool)
+	{
+		xpress_bus_deinit(handle->bus);
+		espressivo_map_unref(handle->map);
+		free(handle);
+		return NULL;
+	}
+
+	handle->xpressB = _pool_alloc(&pool, XPRESS_SIZE(max_nvoices));
+	handle->targetB = _pool_alloc(&pool, max_nvoices*sizeof(targetB_t));
+	handle->xpressO = _pool_alloc(&pool, XPRESS_SIZE(max_nvoices));
+	handle->targetO = _pool_alloc(&pool, max_nvoices*sizeof(targetO_t));
+
+	lv2_atom_forge_init(&handle->forge, handle->map);
+
+	if(  !xpress_init(handle->xpressB, max_nvoices, handle->map, voice_map,
+			XPRESS_EVENT_NONE, &ifaceB, handle->targetB, handle)
+		|| !xpress_init(handle->xpressO, max_nvoices, handle->map, voice_map,
+			XPRESS_EVENT_NONE, &ifaceO, handle->targetO, handle) )
+	{
+		xpress_bus_deinit(handle->bus);
+		free(handle->pool);
+		espressivo_map_unref(handle->map);
+		free(handle);
+		return NULL;
+	}
+
+	if(!props_init(&handle->props, descriptor->URI,
+		defs, MAX_NPROPS, &handle->state, &handle->stash,
+		handle->restore, sizeof(plugstate_t), handle->map, handle))
+	{
+		fprintf(stderr, "failed to allocate property structure\n");
+		xpress_deinit(handle->xpressB);
+		xpress_deinit(handle->xpressO);
+		xpress_bus_deinit(handle->bus);
+		free(handle->pool);
+		espressivo_map_unref(handle->map);
+		free(handle);
+		return NULL;
+	}
+
+	_perf_init(&handle->perf, &handle->props, rate);
+
+	handle->subscribed = -1;
+
+	return handle;
+}
+
+static void
+connect_port(LV2_Handle instance, uint32_t port, void *data)
+{
+	plughandle_t *handle = instance;
+
+	switch(port)
+	{
+		case 0:
+			handle->event_in = (const LV2_Atom_Sequence *)data;
+			break;
+		case 1:
+			handle->event_out = (LV2_Atom_Sequence *)data;
+			break;
+		default:
+			break;
+	}
+}
+
+static void
+run(LV2_Handle instance, uint32_t nsamples)
+{
+	plughandle_t *handle = instance;
+
+	_perf_begin(&handle->perf);
+
+	// prepare notify atom forge
+	const uint32_t capacity = handle->event_out->atom.size;
+	LV2_Atom_Forge *forge = &handle->forge;
+	lv2_atom_forge_set_buffer(forge, (uint8_t *)handle->event_out, capacity);
+	LV2_Atom_Forge_Frame frame;
+	handle->ref = lv2_atom_forge_sequence_head(forge, &frame, 0);
+
+	props_idle(&handle->props, forge, 0, &handle->ref);
+	xpress_rst(handle->xpressO);
+
+	// bus items are forged at frame 0, thus before any property events
+	_subscribe(handle);
+	_poll(handle);
+
+	LV2_ATOM_SEQUENCE_FOREACH(handle->event_in, ev)
+	{
+		const LV2_Atom_Object *obj = (const LV2_Atom_Object *)&ev->body;
+		const int64_t frames = ev->time.frames;
+
+		props_advance(&handle->props, forge, frames, obj, &handle->ref);
+	}
+
+	xpress_flush(handle->xpressO, forge, nsamples, &handle->ref);
+
+	if(handle->ref && !xpress_synced(handle->xpressO))
+		handle->ref = xpress_alive(handle->xpressO, forge, nsamples-1);
+
+	_perf_end(&handle->perf, &handle->state.perf, &handle->props, forge, nsamples,
+		handle->event_in, handle->event_out, handle->xpressO, &handle->ref);
+
+	if(handle->ref)
+		lv2_atom_forge_pop(forge, &frame);
+	else
+	{
+		lv2_atom_sequence_clear(handle->event_out);
+		xpress_discard(handle->xpressO);
+	}
+}
+
+static void
+cleanup(LV2_Handle instance)
+{
+	plughandle_t *handle = instance;
+
+	if(handle)
+	{
+		xpress_bus_deinit(handle->bus);
+		xpress_deinit(handle->xpressB);
+		xpress_deinit(handle->xpressO);
+		free(handle->pool);
+		espressivo_map_unref(handle->map);
+		free(handle);
+	}
+}
+static LV2_State_Status
+_state_save(LV2_Handle instance, LV2_State_Store_Function store,
+	LV2_State_Handle state, uint32_t flags,
+	const LV2_Feature *const *features)
+{
+	plughandle_t *handle = instance;
+
+	return props_save(&handle->props, store, state, flags, features);
+}
+
+static LV2_State_Status
+_state_restore(LV2_Handle instance, LV2_State_Retrieve_Function retrieve,
+	LV2_State_Handle state, uint32_t flags,
+	const LV2_Feature *const *features)
+{
+	plughandle_t *handle = instance;
+
+	return props_restore(&handle->props, retrieve, state, flags, features);
+}
+
+static const LV2_State_Interface state_iface = {
+	.save = _state_save,
+	.restore = _state_restore
+};
+
+static const void *
+extension_data(const char *uri)
+{
+	if(!strcmp(uri, LV2_STATE__interface))
+		return &state_iface;
+	return NULL;
+}
+
+const LV2_Descriptor bus_in = {
+	.URI						= ESPRESSIVO_BUS_IN_URI,
+	.instantiate		= instantiate,
+	.connect_port		= connect_port,
+	.activate				= NULL,
+	.run						= run,
+	.deactivate			= NULL,
+	.cleanup				= cleanup,
+	.extension_data	= extension_data
+};
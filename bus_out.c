@@ -0,0 +1,386 @@
+/*
+ * Copyright (c) 2015-2017 Hanspeter Portner (dev@open-music-kontrollers.ch)
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the Artistic License 2.0 as published by
+ * The Perl Foundation.
+ *
+ * This source is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Artistic License 2.0 for more details.
+ *
+ * You should have received a copy of the Artistic License 2.0
+ * along the source as a COPYING file. If not, obtain it from
+ * http://www.perlfoundation.org/artistic_license_2_0.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <espressivo.h>
+#include <props.h>
+
+#define MAX_NPROPS (1 + PERF_NPROPS)
+#define KEYFRAME_RATE 10.f // full snapshots per second for late or lapped consumers
+
+typedef struct _targetI_t targetI_t;
+typedef struct _plugstate_t plugstate_t;
+typedef struct _plughandle_t plughandle_t;
+
+struct _targetI_t {
+	xpress_state_t state;
+};
+
+struct _plugstate_t {
+	int32_t channel;
+
+	perf_state_t perf;
+};
+
+struct _plughandle_t {
+	LV2_URID_Map *map;
+	LV2_Atom_Forge forge;
+	LV2_Atom_Forge_Ref ref;
+
+	PROPS_T(props, MAX_NPROPS);
+	xpress_t *xpressI;
+	targetI_t *targetI;
+	void *pool;
+
+	const LV2_Atom_Sequence *event_in;
+	LV2_Atom_Sequence *event_out;
+
+	plugstate_t state;
+	plugstate_t stash;
+	plugstate_t restore [PROPS_NRESTORE];
+	perf_t perf;
+
+	xpress_bus_t *bus;
+	uint32_t token;
+	int32_t claimed;
+	uint32_t keyframe;
+	uint32_t counter;
+};
+
+static const props_def_t defs [MAX_NPROPS] = {
+	{
+		.property = ESPRESSIVO_URI"#bus_channel",
+		.offset = offsetof(plugstate_t, channel),
+		.type = LV2_ATOM__Int,
+	},
+	PERF_DEFS(plugstate_t, perf)
+};
+
+static inline void
+_publish(plughandle_t *handle, xpress_bus_type_t type, xpress_uuid_t uuid,
+	const xpress_state_t *state)
+{
+	if(handle->claimed == -1)
+		return; // not a producer
+
+	const xpress_bus_item_t item = {
+		.type = type,
+		.uuid = uuid,
+		.state = *state
+	};
+
+	xpress_bus_publish(handle->bus, handle->claimed, &item);
+}
+
+static void
+_add(void *data, int64_t frames, const xpress_state_t *state,
+	xpress_uuid_t uuid, void *target)
+{
+	plughandle_t *handle = data;
+	targetI_t *src = target;
+
+	src->state = *state;
+
+	_publish(handle, XPRESS_BUS_TOKEN, uuid, state);
+}
+
+static void
+_set(void *data, int64_t frames, const xpress_state_t *state,
+	xpress_uuid_t uuid, void *target)
+{
+	plughandle_t *handle = data;
+	targetI_t *src = target;
+
+	src->state = *state;
+
+	_publish(handle, XPRESS_BUS_TOKEN, uuid, state);
+}
+
+static void
+_del(void *data, int64_t frames,
+	xpress_uuid_t uuid, void *target)
+{
+	plughandle_t *handle = data;
+
+	_publish(handle, XPRESS_BUS_RELEASE, uuid, &xpress_vanilla);
+}
+
+static const xpress_iface_t ifaceI = {
+	.size = sizeof(targetI_t),
+
+	.add = _add,
+	.set = _set,
+	.del = _del
+};
+
+static void
+_claim(plughandle_t *handle)
+{
+	const int32_t channel = handle->state.channel;
+
+	if(channel == handle->claimed)
+	{
+		// renew, the claim may have been taken over after a stall
+		if( (channel != -1) && !xpress_bus_claim(handle->bus, channel, handle->token) )
+			handle->claimed = -1;
+		return;
+	}
+
+	if(handle->claimed != -1)
+	{
+		xpress_bus_unclaim(handle->bus, handle->claimed, handle->token);
+		handle->claimed = -1;
+	}
+
+	if( (channel < 0) || (channel >= XPRESS_BUS_NCHANNELS) )
+		return; // disabled
+
+	// retried every cycle until the other producer has left
+	if(xpress_bus_claim(handle->bus, channel, handle->token))
+	{
+		handle->claimed = channel;
+		handle->counter = handle->keyframe; // snapshot right away
+	}
+}
+
+static void
+_snapshot(plughandle_t *handle)
+{
+	XPRESS_VOICE_FOREACH(handle->xpressI, voice)
+	{
+		targetI_t *src = voice->target;
+
+		_publish(handle, XPRESS_BUS_TOKEN, voice->uuid, &src->state);
+	}
+
+	_publish(handle, XPRESS_BUS_ALIVE, 0, &xpress_vanilla);
+}
+
+static LV2_Handle
+instantiate(const LV2_Descriptor* descriptor, double rate,
+	const char *bundle_path, const LV2_Feature *const *features)
+{
+	plughandle_t *handle = calloc(1, sizeof(plughandle_t));
+	if(!handle)
+		return NULL;
+
+	xpress_map_t *voice_map = NULL;
+
+	for(unsigned i=0; features[i]; i++)
+	{
+		if(!strcmp(features[i]->URI, LV2_URID__map))
+			handle->map = features[i]->data;
+		else if(!strcmp(features[i]->URI, XPRESS__voiceMap))
+			voice_map = features[i]->data;
+	}
+
+	if(!handle->map)
+	{
+		fprintf(stderr, "%s: Host does not support urid:map\n", descriptor->URI);
+		free(handle);
+		return NULL;
+	}
+
+	handle->map = espressivo_map_ref(handle->map);
+
+	handle->bus = xpress_bus_init();
+	if(!handle->bus)
+	{
+		fprintf(stderr, "%s: failed to map voice bus\n", descriptor->URI);
+		espressivo_map_unref(handle->map);
+		free(handle);
+		return NULL;
+	}
+
+	const unsigned max_nvoices = xpress_max_nvoices(handle->map, features,
+		MAX_NVOICES, MAX_NVOICES_LIMIT);
+	const size_t pool_size = _pool_size(max_nvoices, sizeof(targetI_t));
+	uint8_t *pool = handle->pool = calloc(1, pool_size);
+	if(!pool)
+	{
+		xpress_bus_deinit(handle->bus);
+		espressivo_map_unref(handle->map);
+		free(handle);
+		return NULL;
+	}
+
+	handle->xpressI = _pool_alloc(&pool, XPRESS_SIZE(max_nvoices));
+	handle->targetI = _pool_alloc(&pool, max_nvoices*sizeof(targetI_t));
+
+	lv2_atom_forge_init(&handle->forge, handle->map);
+
+	if(  !xpress_init(handle->xpressI, max_nvoices, handle->map, voice_map,
+			XPRESS_EVENT_ALL, &ifaceI, handle->targetI, handle) )
+	{
+		xpress_bus_deinit(handle->bus);
+		free(handle->pool);
+		espressivo_map_unref(handle->map);
+		free(handle);
+		return NULL;
+	}
+
+	if(!props_init(&handle->props, descriptor->URI,
+		defs, MAX_NPROPS, &handle->state, &handle->stash,
+		handle->restore, sizeof(plugstate_t), handle->map, handle))
+	{
+		fprintf(stderr, "failed to allocate property structure\n");
+		xpress_deinit(handle->xpressI);
+		xpress_bus_deinit(handle->bus);
+		free(handle->pool);
+		espressivo_map_unref(handle->map);
+		free(handle);
+		return NULL;
+	}
+
+	_perf_init(&handle->perf, &handle->props, rate);
+
+	// uuids are unique across processes, thus usable as claim token
+	handle->token = xpress_map(handle->xpressI);
+	handle->claimed = -1;
+	handle->keyframe = rate / KEYFRAME_RATE;
+
+	return handle;
+}
+
+static void
+connect_port(LV2_Handle instance, uint32_t port, void *data)
+{
+	plughandle_t *handle = instance;
+
+	switch(port)
+	{
+		case 0:
+			handle->event_in = (const LV2_Atom_Sequence *)data;
+			break;
+		case 1:
+			handle->event_out = (LV2_Atom_Sequence *)data;
+			break;
+		default:
+			break;
+	}
+}
+
+static void
+run(LV2_Handle instance, uint32_t nsamples)
+{
+	plughandle_t *handle = instance;
+
+	_perf_begin(&handle->perf);
+
+	// prepare notify atom forge
+	const uint32_t capacity = handle->event_out->atom.size;
+	LV2_Atom_Forge *forge = &handle->forge;
+	lv2_atom_forge_set_buffer(forge, (uint8_t *)handle->event_out, capacity);
+	LV2_Atom_Forge_Frame frame;
+	handle->ref = lv2_atom_forge_sequence_head(forge, &frame, 0);
+
+	props_idle(&handle->props, forge, 0, &handle->ref);
+	xpress_pre(handle->xpressI);
+
+	LV2_ATOM_SEQUENCE_FOREACH(handle->event_in, ev)
+	{
+		const LV2_Atom_Object *obj = (const LV2_Atom_Object *)&ev->body;
+		const int64_t frames = ev->time.frames;
+
+		if(!props_advance(&handle->props, forge, frames, obj, &handle->ref))
+		{
+			xpress_advance(handle->xpressI, forge, frames, obj, &handle->ref);
+		}
+	}
+
+	xpress_post(handle->xpressI, nsamples-1);
+
+	_claim(handle);
+
+	handle->counter += nsamples;
+	if(handle->counter >= handle->keyframe)
+	{
+		_snapshot(handle);
+		handle->counter = 0;
+	}
+
+	_perf_end(&handle->perf, &handle->state.perf, &handle->props, forge, nsamples,
+		handle->event_in, handle->event_out, handle->xpressI, &handle->ref);
+
+	if(handle->ref)
+		lv2_atom_forge_pop(forge, &frame);
+	else
+		lv2_atom_sequence_clear(handle->event_out);
+}
+
+static void
+cleanup(LV2_Handle instance)
+{
+	plughandle_t *handle = instance;
+
+	if(handle)
+	{
+		if(handle->claimed != -1)
+			xpress_bus_unclaim(handle->bus, handle->claimed, handle->token);
+		xpress_bus_deinit(handle->bus);
+		xpress_deinit(handle->xpressI);
+		free(handle->pool);
+		espressivo_map_unref(handle->map);
+		free(handle);
+	}
+}
+
+static LV2_State_Status
+_state_save(LV2_Handle instance, LV2_State_Store_Function store,
+	LV2_State_Handle state, uint32_t flags,
+	const LV2_Feature *const *features)
+{
+	plughandle_t *handle = instance;
+
+	return props_save(&handle->props, store, state, flags, features);
+}
+
+static LV2_State_Status
+_state_restore(LV2_Handle instance, LV2_State_Retrieve_Function retrieve,
+	LV2_State_Handle state, uint32_t flags,
+	const LV2_Feature *const *features)
+{
+	plughandle_t *handle = instance;
+
+	return props_restore(&handle->props, retrieve, state, flags, features);
+}
+
+static const LV2_State_Interface state_iface = {
+	.save = _state_save,
+	.restore = _state_restore
+};
+
+static const void *
+extension_data(const char *uri)
+{
+	if(!strcmp(uri, LV2_STATE__interface))
+		return &state_iface;
+	return NULL;
+}
+
+const LV2_Descriptor bus_out = {
+	.URI						= ESPRESSIVO_BUS_OUT_URI,
+	.instantiate		= instantiate,
+	.connect_port		= connect_port,
+	.activate				= NULL,
+	.run						= run,
+	.deactivate			= NULL,
+	.cleanup				= cleanup,
+	.extension_data	= extension_data
+};
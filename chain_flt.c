@@ -0,0 +1,729 @@
+/*
+ * Copyright (c) 2015-2017 Hanspeter Portner (dev@open-music-kontrollers.ch)
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the Artistic License 2.0 as published by
+ * The Perl Foundation.
+ *
+ * This source is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Artistic License 2.0 for more details.
+ *
+ * You should have received a copy of the Artistic License 2.0
+ * along the source as a COPYING file. If not, obtain it from
+ * http://www.perlfoundation.org/artistic_license_2_0.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include <espressivo.h>
+#include <props.h>
+
+#define MAX_STAGES 6
+#define MAX_CHORDS 4
+#define MAX_NPROPS (MAX_STAGES + 6 + 2 + 9 + MAX_CHORDS + 2 + 6 + PERF_NPROPS)
+
+typedef enum _stage_t stage_t;
+typedef struct _targetI_t targetI_t;
+typedef struct _targetO_t targetO_t;
+typedef struct _plugstate_t plugstate_t;
+typedef struct _plughandle_t plughandle_t;
+
+enum _stage_t {
+	STAGE_NONE = 0,
+	STAGE_SQEW,
+	STAGE_DISCRETO,
+	STAGE_MODULATOR,
+	STAGE_CHORD,
+	STAGE_THROUGH,
+	STAGE_SNH
+};
+
+struct _targetI_t {
+	xpress_handle_t voice [MAX_CHORDS];
+	xpress_state_t state; // last input state
+	xpress_state_t hold [MAX_CHORDS];
+	int32_t zone_mask;
+	uint32_t mask; // outputs that passed the zone masks on add
+};
+
+struct _targetO_t {
+	//empty
+};
+
+struct _plugstate_t {
+	int32_t stage [MAX_STAGES];
+
+	sqew_state_t sqew;
+
+	discreto_state_t discreto;
+
+	int32_t zone_mask_src;
+	int32_t zone_mask_mod;
+	int32_t zone_offset_mod;
+	modulator_state_t mod;
+	int32_t reset;
+
+	float offset [MAX_CHORDS];
+
+	int32_t zone_mask;
+	int32_t zone_offset;
+
+	hold_state_t hold;
+
+	perf_state_t perf;
+};
+
+struct _plughandle_t {
+	LV2_URID_Map *map;
+	LV2_Atom_Forge forge;
+	LV2_Atom_Forge_Ref ref;
+
+	PROPS_T(props, MAX_NPROPS);
+	xpress_t *xpressI;
+	xpress_t *xpressO;
+	targetI_t *targetI;
+	targetO_t *targetO;
+	void *pool;
+
+	const LV2_Atom_Sequence *event_in;
+	LV2_Atom_Sequence *event_out;
+
+	plugstate_t state;
+	plugstate_t stash;
+	plugstate_t restore [PROPS_NRESTORE];
+	perf_t perf;
+
+	xpress_uuid_t uuid;
+	xpress_state_t modu;
+};
+
+static const xpress_state_t empty_state = {
+	.zone = 0,
+
+	.pitch = 0.f,
+	.pressure = 0.f,
+	.timbre = 0.f,
+
+	.dPitch = 0.f,
+	.dPressure = 0.f,
+	.dTimbre = 0.f
+};
+
+// sample-and-hold kernel, holds maxima while the voice is alive
+static inline void
+_stage_snh(plughandle_t *handle, xpress_state_t *state, xpress_state_t *hold,
+	bool add)
+{
+	if(add)
+		*hold = *state;
+	else
+		_hold_apply(&handle->state.hold, state, hold);
+
+	hold->zone = state->zone;
+	*state = *hold;
+}
+
+// run input state through all stages, zone masks are only evaluated on add
+static uint32_t
+_chain(plughandle_t *handle, targetI_t *src, xpress_state_t out [MAX_CHORDS],
+	bool add)
+{
+	uint32_t mask = add ? 0x1 : src->mask;
+	unsigned n = 1;
+
+	for(unsigned i = 0; i < MAX_CHORDS; i++)
+		out[i] = src->state;
+
+	for(unsigned s = 0; s < MAX_STAGES; s++)
+	{
+		switch((stage_t)handle->state.stage[s])
+		{
+			case STAGE_NONE:
+			{
+				// skip
+			}	break;
+			case STAGE_SQEW:
+			{
+				for(unsigned i = 0; i < n; i++)
+					_sqew_apply(&handle->state.sqew, &out[i]);
+			}	break;
+			case STAGE_DISCRETO:
+			{
+				for(unsigned i = 0; i < n; i++)
+					_discreto_apply(&handle->state.discreto, &out[i]);
+			}	break;
+			case STAGE_MODULATOR:
+			{
+				for(unsigned i = 0; i < n; i++)
+				{
+					if(add && !(_zone_bit(out[i].zone) & handle->state.zone_mask_src) )
+						mask &= ~(1 << i);
+
+					out[i].zone = _zone_shift(out[i].zone, handle->state.zone_offset_mod);
+					_modulator_apply(&handle->state.mod, &handle->modu, &out[i]);
+				}
+			}	break;
+			case STAGE_CHORD:
+			{
+				if(n == 1)
+				{
+					for(unsigned i = 1; i < MAX_CHORDS; i++)
+						out[i] = out[0];
+					if(add && (mask & 0x1) )
+						mask = (1 << MAX_CHORDS) - 1;
+					n = MAX_CHORDS;
+				}
+
+				for(unsigned i = 0; i < n; i++)
+					out[i].pitch += handle->state.offset[i] / 0x7f;
+			}	break;
+			case STAGE_THROUGH:
+			{
+				for(unsigned i = 0; i < n; i++)
+				{
+					if(add && !(_zone_bit(out[i].zone) & handle->state.zone_mask) )
+						mask &= ~(1 << i);
+
+					out[i].zone = _zone_shift(out[i].zone, handle->state.zone_offset);
+				}
+			}	break;
+			case STAGE_SNH:
+			{
+				for(unsigned i = 0; i < n; i++)
+					_stage_snh(handle, &out[i], &src->hold[i], add);
+			}	break;
+		}
+	}
+
+	return mask;
+}
+
+static bool
+_has_stage(plughandle_t *handle, stage_t stage)
+{
+	for(unsigned s = 0; s < MAX_STAGES; s++)
+	{
+		if(handle->state.stage[s] == (int32_t)stage)
+			return true;
+	}
+
+	return false;
+}
+
+// re-run all voices, e.g. after the modulation has changed
+static inline bool
+_upd(plughandle_t *handle, int64_t frames)
+{
+	LV2_Atom_Forge *forge = &handle->forge;
+	LV2_Atom_Forge_Frame frame;
+
+	if( (handle->xpressO->nvoices == 0) || !_has_stage(handle, STAGE_MODULATOR) )
+		return false; // nothing to update
+
+	if(handle->ref)
+		handle->ref = xpress_batch_head(handle->xpressO, forge, frames, &frame);
+
+	XPRESS_VOICE_FOREACH(handle->xpressI, voice)
+	{
+		targetI_t *src = voice->target;
+		xpress_state_t out [MAX_CHORDS];
+
+		const uint32_t mask = _chain(handle, src, out, false);
+
+		for(unsigned i = 0; i < MAX_CHORDS; i++)
+		{
+			if( (mask & (1 << i)) && handle->ref)
+				handle->ref = xpress_batch_token(handle->xpressO, forge, src->voice[i].uuid, &out[i]);
+		}
+	}
+
+	if(handle->ref)
+		xpress_batch_pop(handle->xpressO, forge, &frame);
+
+	return true;
+}
+
+static void
+_intercept(void *data, int64_t frames, props_impl_t *impl)
+{
+	plughandle_t *handle = data;
+
+	_upd(handle, frames);
+}
+
+#define CHAIN_STAGE(NUM) \
+{ \
+	.property = ESPRESSIVO_URI"#chain_stage_"#NUM, \
+	.offset = offsetof(plugstate_t, stage) + (NUM-1)*sizeof(int32_t), \
+	.type = LV2_ATOM__Int, \
+}
+
+#define CHAIN_OFFSET(NUM) \
+{ \
+	.property = ESPRESSIVO_URI"#chord_offset_"#NUM, \
+	.offset = offsetof(plugstate_t, offset) + (NUM-1)*sizeof(float), \
+	.type = LV2_ATOM__Float, \
+}
+
+static const props_def_t defs [MAX_NPROPS] = {
+	CHAIN_STAGE(1),
+	CHAIN_STAGE(2),
+	CHAIN_STAGE(3),
+	CHAIN_STAGE(4),
+	CHAIN_STAGE(5),
+	CHAIN_STAGE(6),
+	{
+		.property = ESPRESSIVO_URI"#pitchExp",
+		.offset = offsetof(plugstate_t, sqew.pitch),
+		.type = LV2_ATOM__Float,
+	},
+	{
+		.property = ESPRESSIVO_URI"#pressureExp",
+		.offset = offsetof(plugstate_t, sqew.pressure),
+		.type = LV2_ATOM__Float,
+	},
+	{
+		.property = ESPRESSIVO_URI"#timbreExp",
+		.offset = offsetof(plugstate_t, sqew.timbre),
+		.type = LV2_ATOM__Float,
+	},
+	{
+		.property = ESPRESSIVO_URI"#dPitchExp",
+		.offset = offsetof(plugstate_t, sqew.dPitch),
+		.type = LV2_ATOM__Float,
+	},
+	{
+		.property = ESPRESSIVO_URI"#dPressureExp",
+		.offset = offsetof(plugstate_t, sqew.dPressure),
+		.type = LV2_ATOM__Float,
+	},
+	{
+		.property = ESPRESSIVO_URI"#dTimbreExp",
+		.offset = offsetof(plugstate_t, sqew.dTimbre),
+		.type = LV2_ATOM__Float,
+	},
+	{
+		.property = ESPRESSIVO_URI"#discreto_position_order",
+		.offset = offsetof(plugstate_t, discreto.position_order),
+		.type = LV2_ATOM__Int,
+	},
+	{
+		.property = ESPRESSIVO_URI"#discreto_velocity_order",
+		.offset = offsetof(plugstate_t, discreto.velocity_order),
+		.type = LV2_ATOM__Int,
+	},
+	{
+		.property = ESPRESSIVO_URI"#modulator_zone_mask_src",
+		.offset = offsetof(plugstate_t, zone_mask_src),
+		.type = LV2_ATOM__Int
+	},
+	{
+		.property = ESPRESSIVO_URI"#modulator_zone_mask_mod",
+		.offset = offsetof(plugstate_t, zone_mask_mod),
+		.type = LV2_ATOM__Int
+	},
+	{
+		.property = ESPRESSIVO_URI"#modulator_enum_src",
+		.offset = offsetof(plugstate_t, mod.enum_src),
+		.type = LV2_ATOM__Int,
+		.event_cb = _intercept
+	},
+	{
+		.property = ESPRESSIVO_URI"#modulator_enum_mod",
+		.offset = offsetof(plugstate_t, mod.enum_mod),
+		.type = LV2_ATOM__Int,
+		.event_cb = _intercept
+	},
+	{
+		.property = ESPRESSIVO_URI"#modulator_zone_offset",
+		.offset = offsetof(plugstate_t, zone_offset_mod),
+		.type = LV2_ATOM__Int
+	},
+	{
+		.property = ESPRESSIVO_URI"#modulator_multiplier",
+		.offset = offsetof(plugstate_t, mod.multiplier),
+		.type = LV2_ATOM__Float,
+		.event_cb = _intercept
+	},
+	{
+		.property = ESPRESSIVO_URI"#modulator_adder",
+		.offset = offsetof(plugstate_t, mod.adder),
+		.type = LV2_ATOM__Float,
+		.event_cb = _intercept
+	},
+	{
+		.property = ESPRESSIVO_URI"#modulator_op",
+		.offset = offsetof(plugstate_t, mod.op),
+		.type = LV2_ATOM__Int,
+		.event_cb = _intercept
+	},
+	{
+		.property = ESPRESSIVO_URI"#modulator_reset",
+		.offset = offsetof(plugstate_t, reset),
+		.type = LV2_ATOM__Bool
+	},
+	CHAIN_OFFSET(1),
+	CHAIN_OFFSET(2),
+	CHAIN_OFFSET(3),
+	CHAIN_OFFSET(4),
+	{
+		.property = ESPRESSIVO_URI"#through_zone_mask",
+		.offset = offsetof(plugstate_t, zone_mask),
+		.type = LV2_ATOM__Int,
+	},
+	{
+		.property = ESPRESSIVO_URI"#through_zone_offset",
+		.offset = offsetof(plugstate_t, zone_offset),
+		.type = LV2_ATOM__Int,
+	},
+	{
+		.property = ESPRESSIVO_URI"#snh_hold_pitch",
+		.offset = offsetof(plugstate_t, hold.pitch),
+		.type = LV2_ATOM__Bool,
+	},
+	{
+		.property = ESPRESSIVO_URI"#snh_hold_pressure",
+		.offset = offsetof(plugstate_t, hold.pressure),
+		.type = LV2_ATOM__Bool,
+	},
+	{
+		.property = ESPRESSIVO_URI"#snh_hold_timbre",
+		.offset = offsetof(plugstate_t, hold.timbre),
+		.type = LV2_ATOM__Bool,
+	},
+	{
+		.property = ESPRESSIVO_URI"#snh_hold_dPitch",
+		.offset = offsetof(plugstate_t, hold.dPitch),
+		.type = LV2_ATOM__Bool,
+	},
+	{
+		.property = ESPRESSIVO_URI"#snh_hold_dPressure",
+		.offset = offsetof(plugstate_t, hold.dPressure),
+		.type = LV2_ATOM__Bool,
+	},
+	{
+		.property = ESPRESSIVO_URI"#snh_hold_dTimbre",
+		.offset = offsetof(plugstate_t, hold.dTimbre),
+		.type = LV2_ATOM__Bool,
+	},
+	PERF_DEFS(plugstate_t, perf)
+};
+
+static void
+_add(void *data, int64_t frames, const xpress_state_t *state,
+	xpress_uuid_t uuid, void *target)
+{
+	plughandle_t *handle = data;
+	targetI_t *src = target;
+	LV2_Atom_Forge *forge = &handle->forge;
+	xpress_state_t out [MAX_CHORDS];
+
+	src->zone_mask = _zone_bit(state->zone);
+	src->state = *state;
+
+	if(src->zone_mask & handle->state.zone_mask_mod)
+	{
+		if(handle->uuid == 0) // no modulator registered, yet
+		{
+			handle->uuid = uuid;
+			handle->modu = *state;
+
+			_upd(handle, frames);
+		}
+	}
+
+	src->mask = _chain(handle, src, out, true);
+
+	for(unsigned i = 0; i < MAX_CHORDS; i++)
+	{
+		if( !(src->mask & (1 << i)) )
+			continue;
+
+		targetO_t *dst = xpress_create_h(handle->xpressO, &src->voice[i]);
+		(void)dst;
+
+		if(handle->ref)
+			handle->ref = xpress_token_h(handle->xpressO, forge, frames, &src->voice[i], &out[i]);
+	}
+}
+
+static void
+_set(void *data, int64_t frames, const xpress_state_t *state,
+	xpress_uuid_t uuid, void *target)
+{
+	plughandle_t *handle = data;
+	targetI_t *src = target;
+	LV2_Atom_Forge *forge = &handle->forge;
+	xpress_state_t out [MAX_CHORDS];
+
+	src->state = *state;
+
+	if(src->zone_mask & handle->state.zone_mask_mod)
+	{
+		if(handle->uuid == uuid) // this is our modulator
+		{
+			handle->modu = *state;
+
+			if(_upd(handle, frames))
+				return; // all voices already updated
+		}
+	}
+
+	_chain(handle, src, out, false);
+
+	for(unsigned i = 0; i < MAX_CHORDS; i++)
+	{
+		if( (src->mask & (1 << i)) && handle->ref)
+			handle->ref = xpress_token_h(handle->xpressO, forge, frames, &src->voice[i], &out[i]);
+	}
+}
+
+static void
+_del(void *data, int64_t frames,
+	xpress_uuid_t uuid, void *target)
+{
+	plughandle_t *handle = data;
+	targetI_t *src = target;
+	LV2_Atom_Forge *forge = &handle->forge;
+
+	xpress_uuid_t uuids [MAX_CHORDS];
+	unsigned n = 0;
+
+	for(unsigned i = 0; i < MAX_CHORDS; i++)
+	{
+		if( !(src->mask & (1 << i)) )
+			continue;
+
+		uuids[n++] = src->voice[i].uuid;
+		xpress_free_h(handle->xpressO, &src->voice[i]);
+	}
+
+	if(n && handle->ref)
+		handle->ref = xpress_release(handle->xpressO, forge, frames, uuids, n);
+
+	if(src->zone_mask & handle->state.zone_mask_mod)
+	{
+		if(handle->uuid == uuid) // this is our modulator
+		{
+			handle->uuid = 0;
+			if(handle->state.reset)
+				handle->modu = empty_state;
+
+			_upd(handle, frames);
+		}
+	}
+}
+
+static const xpress_iface_t ifaceI = {
+	.size = sizeof(targetI_t),
+
+	.add = _add,
+	.set = _set,
+	.del = _del
+};
+
+static const xpress_iface_t ifaceO = {
+	.size = sizeof(targetO_t)
+};
+
+static LV2_Handle
+instantiate(const LV2_Descriptor* descriptor, double rate,
+	const char *bundle_path, const LV2_Feature *const *features)
+{
+	plughandle_t *handle = calloc(1, sizeof(plughandle_t));
+	if(!handle)
+		return NULL;
+
+	xpress_map_t *voice_map = NULL;
+
+	for(unsigned i=0; features[i]; i++)
+	{
+		if(!strcmp(features[i]->URI, LV2_URID__map))
+			handle->map = features[i]->data;
+		else if(!strcmp(features[i]->URI, XPRESS__voiceMap))
+			voice_map = features[i]->data;
+	}
+
+	if(!handle->map)
+	{
+		fprintf(stderr, "%s: Host does not support urid:map\n", descriptor->URI);
+		free(handle);
+		return NULL;
+	}
+
+	handle->map = espressivo_map_ref(handle->map);
+
+	// each input voice may fan out to a full chord
+	const unsigned max_nvoices = xpress_max_nvoices(handle->map, features,
+		MAX_NVOICES, MAX_NVOICES_LIMIT);
+	const size_t pool_size = _pool_size(max_nvoices, sizeof(targetI_t))
+		+ _pool_size(max_nvoices*MAX_CHORDS, sizeof(targetO_t));
+	uint8_t *pool = handle->pool = calloc(1, pool_size);
+	if(!pool)
+	{
+		espressivo_map_unref(handle->map);
+		free(handle);
+		return NULL;
+	}
+
+	handle->xpressI = _pool_alloc(&pool, XPRESS_SIZE(max_nvoices));
+	handle->targetI = _pool_alloc(&pool, max_nvoices*sizeof(targetI_t));
+	handle->xpressO = _pool_alloc(&pool, XPRESS_SIZE(max_nvoices*MAX_CHORDS));
+	handle->targetO = _pool_alloc(&pool, max_nvoices*MAX_CHORDS*sizeof(targetO_t));
+
+	lv2_atom_forge_init(&handle->forge, handle->map);
+
+	if(  !xpress_init(handle->xpressI, max_nvoices, handle->map, voice_map,
+			XPRESS_EVENT_ALL, &ifaceI, handle->targetI, handle)
+		|| !xpress_init(handle->xpressO, max_nvoices*MAX_CHORDS, handle->map, voice_map,
+			XPRESS_EVENT_NONE, &ifaceO, handle->targetO, handle) )
+	{
+		free(handle->pool);
+		espressivo_map_unref(handle->map);
+		free(handle);
+		return NULL;
+	}
+
+	if(!props_init(&handle->props, descriptor->URI,
+		defs, MAX_NPROPS, &handle->state, &handle->stash,
+		handle->restore, sizeof(plugstate_t), handle->map, handle))
+	{
+		fprintf(stderr, "failed to allocate property structure\n");
+		free(handle->pool);
+		espressivo_map_unref(handle->map);
+		free(handle);
+		return NULL;
+	}
+
+	_perf_init(&handle->perf, &handle->props, rate);
+
+	return handle;
+}
+
+static void
+connect_port(LV2_Handle instance, uint32_t port, void *data)
+{
+	plughandle_t *handle = instance;
+
+	switch(port)
+	{
+		case 0:
+			handle->event_in = (const LV2_Atom_Sequence *)data;
+			break;
+		case 1:
+			handle->event_out = (LV2_Atom_Sequence *)data;
+			break;
+		default:
+			break;
+	}
+}
+
+static void
+run(LV2_Handle instance, uint32_t nsamples)
+{
+	plughandle_t *handle = instance;
+
+	_perf_begin(&handle->perf);
+
+	// prepare midi atom forge
+	const uint32_t capacity = handle->event_out->atom.size;
+	LV2_Atom_Forge *forge = &handle->forge;
+	lv2_atom_forge_set_buffer(forge, (uint8_t *)handle->event_out, capacity);
+	LV2_Atom_Forge_Frame frame;
+	handle->ref = lv2_atom_forge_sequence_head(forge, &frame, 0);
+
+	props_idle(&handle->props, forge, 0, &handle->ref);
+	xpress_pre(handle->xpressI);
+	xpress_rst(handle->xpressO);
+
+	LV2_ATOM_SEQUENCE_FOREACH(handle->event_in, ev)
+	{
+		const LV2_Atom_Object *obj = (const LV2_Atom_Object *)&ev->body;
+		const int64_t frames = ev->time.frames;
+
+		if(!props_advance(&handle->props, forge, frames, obj, &handle->ref))
+		{
+			xpress_advance(handle->xpressI, forge, frames, obj, &handle->ref);
+		}
+	}
+
+	xpress_flush(handle->xpressO, forge, nsamples, &handle->ref);
+
+	xpress_post(handle->xpressI, nsamples-1);
+	if(handle->ref && !xpress_synced(handle->xpressO))
+		handle->ref = xpress_alive(handle->xpressO, forge, nsamples-1);
+
+	_perf_end(&handle->perf, &handle->state.perf, &handle->props, forge, nsamples,
+		handle->event_in, handle->event_out, handle->xpressO, &handle->ref);
+
+	if(handle->ref)
+		lv2_atom_forge_pop(forge, &frame);
+	else
+	{
+		lv2_atom_sequence_clear(handle->event_out);
+		xpress_discard(handle->xpressO);
+	}
+}
+
+static void
+cleanup(LV2_Handle instance)
+{
+	plughandle_t *handle = instance;
+
+	if(handle)
+	{
+		xpress_deinit(handle->xpressI);
+		xpress_deinit(handle->xpressO);
+		free(handle->pool);
+		espressivo_map_unref(handle->map);
+		free(handle);
+	}
+}
+
+static LV2_State_Status
+_state_save(LV2_Handle instance, LV2_State_Store_Function store,
+	LV2_State_Handle state, uint32_t flags,
+	const LV2_Feature *const *features)
+{
+	plughandle_t *handle = instance;
+
+	return props_save(&handle->props, store, state, flags, features);
+}
+
+static LV2_State_Status
+_state_restore(LV2_Handle instance, LV2_State_Retrieve_Function retrieve,
+	LV2_State_Handle state, uint32_t flags,
+	const LV2_Feature *const *features)
+{
+	plughandle_t *handle = instance;
+
+	return props_restore(&handle->props, retrieve, state, flags, features);
+}
+
+static const LV2_State_Interface state_iface = {
+	.save = _state_save,
+	.restore = _state_restore
+};
+
+static const void *
+extension_data(const char *uri)
+{
+	if(!strcmp(uri, LV2_STATE__interface))
+		return &state_iface;
+	return NULL;
+}
+
+const LV2_Descriptor chain = {
+	.URI						= ESPRESSIVO_CHAIN_URI,
+	.instantiate		= instantiate,
+	.connect_port		= connect_port,
+	.activate				= NULL,
+	.run						= run,
+	.deactivate			= NULL,
+	.cleanup				= cleanup,
+	.extension_data	= extension_data
+};
@@ -22,7 +22,7 @@
 #include <espressivo.h>
 #include <props.h>
 
-#define MAX_NPROPS 4
+#define MAX_NPROPS (4 + PERF_NPROPS)
 #define MAX_CHORDS 4
 
 typedef struct _targetI_t targetI_t;
@@ -31,7 +31,7 @@ typedef struct _plugstate_t plugstate_t;
 typedef struct _plughandle_t plughandle_t;
 
 struct _targetI_t {
-	xpress_uuid_t uuid [4];
+	xpress_handle_t voice [4];
 };
 
 struct _targetO_t {
@@ -40,6 +40,8 @@ struct _targetO_t {
 
 struct _plugstate_t {
 	float offset [MAX_CHORDS];
+
+	perf_state_t perf;
 };
 
 struct _plughandle_t {
@@ -48,16 +50,19 @@ struct _plughandle_t {
 	LV2_Atom_Forge_Ref ref;
 
 	PROPS_T(props, MAX_NPROPS);
-	XPRESS_T(xpressI, MAX_NVOICES);
-	XPRESS_T(xpressO, MAX_NVOICES);
-	targetI_t targetI [MAX_NVOICES];
-	targetO_t targetO [MAX_NVOICES];
+	xpress_t *xpressI;
+	xpress_t *xpressO;
+	targetI_t *targetI;
+	targetO_t *targetO;
+	void *pool;
 
 	const LV2_Atom_Sequence *event_in;
 	LV2_Atom_Sequence *event_out;
 
 	plugstate_t state;
 	plugstate_t stash;
+	plugstate_t restore [PROPS_NRESTORE];
+	perf_t perf;
 };
 
 #define CHORD_OFFSET(NUM) \
@@ -71,7 +76,8 @@ static const props_def_t defs [MAX_NPROPS] = {
 	CHORD_OFFSET(1),
 	CHORD_OFFSET(2),
 	CHORD_OFFSET(3),
-	CHORD_OFFSET(4)
+	CHORD_OFFSET(4),
+	PERF_DEFS(plugstate_t, perf)
 };
 
 static void
@@ -84,14 +90,14 @@ _add(void *data, int64_t frames, const xpress_state_t *state,
 
 	for(unsigned i=0; i<MAX_CHORDS; i++)
 	{
-		targetO_t *dst = xpress_create(&handle->xpressO, &src->uuid[i]);
+		targetO_t *dst = xpress_create_h(handle->xpressO, &src->voice[i]);
 		(void)dst;
 
 		xpress_state_t new_state = *state;
 		new_state.pitch += (float)handle->state.offset[i] / 0x7f;
 
 		if(handle->ref)
-			handle->ref = xpress_token(&handle->xpressO, forge, frames, src->uuid[i], &new_state);
+			handle->ref = xpress_token_h(handle->xpressO, forge, frames, &src->voice[i], &new_state);
 	}
 }
 
@@ -109,7 +115,7 @@ _set(void *data, int64_t frames, const xpress_state_t *state,
 		new_state.pitch += (float)handle->state.offset[i] / 0x7f;
 
 		if(handle->ref)
-			handle->ref = xpress_token(&handle->xpressO, forge, frames, src->uuid[i], &new_state);
+			handle->ref = xpress_token_h(handle->xpressO, forge, frames, &src->voice[i], &new_state);
 	}
 }
 
@@ -121,13 +127,16 @@ _del(void *data, int64_t frames,
 	targetI_t *src = target;
 	LV2_Atom_Forge *forge = &handle->forge;
 
+	xpress_uuid_t uuids [MAX_CHORDS];
+
 	for(unsigned i=0; i<MAX_CHORDS; i++)
 	{
-		xpress_free(&handle->xpressO, src->uuid[i]);
+		uuids[i] = src->voice[i].uuid;
+		xpress_free_h(handle->xpressO, &src->voice[i]);
 	}
 
 	if(handle->ref)
-		handle->ref = xpress_alive(&handle->xpressO, forge, frames);
+		handle->ref = xpress_release(handle->xpressO, forge, frames, uuids, MAX_CHORDS);
 }
 
 static const xpress_iface_t ifaceI = {
@@ -167,26 +176,51 @@ instantiate(const LV2_Descriptor* descriptor, double rate,
 		return NULL;
 	}
 
+	handle->map = espressivo_map_ref(handle->map);
+
+	const unsigned max_nvoices = xpress_max_nvoices(handle->map, features,
+		MAX_NVOICES, MAX_NVOICES_LIMIT);
+	const size_t pool_size = _pool_size(max_nvoices, sizeof(targetI_t))
+		+ _pool_size(max_nvoices, sizeof(targetO_t));
+	uint8_t *pool = handle->pool = calloc(1, pool_size);
+	if(!pool)
+	{
+		espressivo_map_unref(handle->map);
+		free(handle);
+		return NULL;
+	}
+
+	handle->xpressI = _pool_alloc(&pool, XPRESS_SIZE(max_nvoices));
+	handle->targetI = _pool_alloc(&pool, max_nvoices*sizeof(targetI_t));
+	handle->xpressO = _pool_alloc(&pool, XPRESS_SIZE(max_nvoices));
+	handle->targetO = _pool_alloc(&pool, max_nvoices*sizeof(targetO_t));
+
 	lv2_atom_forge_init(&handle->forge, handle->map);
 
-	if(  !xpress_init(&handle->xpressI, MAX_NVOICES, handle->map, voice_map,
+	if(  !xpress_init(handle->xpressI, max_nvoices, handle->map, voice_map,
 			XPRESS_EVENT_ALL, &ifaceI, handle->targetI, handle)
-		|| !xpress_init(&handle->xpressO, MAX_NVOICES, handle->map, voice_map,
+		|| !xpress_init(handle->xpressO, max_nvoices, handle->map, voice_map,
 			XPRESS_EVENT_NONE, &ifaceO, handle->targetO, handle) )
 	{
+		free(handle->pool);
+		espressivo_map_unref(handle->map);
 		free(handle);
 		return NULL;
 	}
 
 	if(!props_init(&handle->props, descriptor->URI,
 		defs, MAX_NPROPS, &handle->state, &handle->stash,
-		handle->map, handle))
+		handle->restore, sizeof(plugstate_t), handle->map, handle))
 	{
 		fprintf(stderr, "failed to allocate property structure\n");
+		free(handle->pool);
+		espressivo_map_unref(handle->map);
 		free(handle);
 		return NULL;
 	}
 
+	_perf_init(&handle->perf, &handle->props, rate);
+
 	return handle;
 }
 
@@ -213,6 +247,8 @@ run(LV2_Handle instance, uint32_t nsamples)
 {
 	plughandle_t *handle = instance;
 
+	_perf_begin(&handle->perf);
+
 	// prepare midi atom forge
 	const uint32_t capacity = handle->event_out->atom.size;
 	LV2_Atom_Forge *forge = &handle->forge;
@@ -221,8 +257,8 @@ run(LV2_Handle instance, uint32_t nsamples)
 	handle->ref = lv2_atom_forge_sequence_head(forge, &frame, 0);
 
 	props_idle(&handle->props, forge, 0, &handle->ref);
-	xpress_pre(&handle->xpressI);
-	xpress_rst(&handle->xpressO);
+	xpress_pre(handle->xpressI);
+	xpress_rst(handle->xpressO);
 
 	LV2_ATOM_SEQUENCE_FOREACH(handle->event_in, ev)
 	{
@@ -231,18 +267,26 @@ run(LV2_Handle instance, uint32_t nsamples)
 
 		if(!props_advance(&handle->props, forge, frames, obj, &handle->ref))
 		{
-			xpress_advance(&handle->xpressI, forge, frames, obj, &handle->ref);
+			xpress_advance(handle->xpressI, forge, frames, obj, &handle->ref);
 		}
 	}
 
-	xpress_post(&handle->xpressI, nsamples-1);
-	if(handle->ref && !xpress_synced(&handle->xpressO))
-		handle->ref = xpress_alive(&handle->xpressO, forge, nsamples-1);
+	xpress_flush(handle->xpressO, forge, nsamples, &handle->ref);
+
+	xpress_post(handle->xpressI, nsamples-1);
+	if(handle->ref && !xpress_synced(handle->xpressO))
+		handle->ref = xpress_alive(handle->xpressO, forge, nsamples-1);
+
+	_perf_end(&handle->perf, &handle->state.perf, &handle->props, forge, nsamples,
+		handle->event_in, handle->event_out, handle->xpressO, &handle->ref);
 
 	if(handle->ref)
 		lv2_atom_forge_pop(forge, &frame);
 	else
+	{
 		lv2_atom_sequence_clear(handle->event_out);
+		xpress_discard(handle->xpressO);
+	}
 }
 
 static void
@@ -252,8 +296,10 @@ cleanup(LV2_Handle instance)
 
 	if(handle)
 	{
-		xpress_deinit(&handle->xpressI);
-		xpress_deinit(&handle->xpressO);
+		xpress_deinit(handle->xpressI);
+		xpress_deinit(handle->xpressO);
+		free(handle->pool);
+		espressivo_map_unref(handle->map);
 		free(handle);
 	}
 }
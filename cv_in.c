@@ -0,0 +1,549 @@
+/*
+ * Copyright (c) 2015-2017 Hanspeter Portner (dev@open-music-kontrollers.ch)
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the Artistic License 2.0 as published by
+ * The Perl Foundation.
+ *
+ * This source is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Artistic License 2.0 for more details.
+ *
+ * You should have received a copy of the Artistic License 2.0
+ * along the source as a COPYING file. If not, obtain it from
+ * http://www.perlfoundation.org/artistic_license_2_0.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <espressivo.h>
+#include <props.h>
+
+#define MAX_NPROPS (2 + PERF_NPROPS)
+#define MAX_SLOTS 4
+#define DEFAULT_RATE 200.f // tokens per second
+#define DEFAULT_THRESHOLD 0.5f
+
+typedef float v4f_t __attribute__((vector_size(16)));
+
+typedef enum _field_t field_t;
+typedef struct _window_t window_t;
+typedef struct _slot_t slot_t;
+typedef struct _targetO_t targetO_t;
+typedef struct _plugstate_t plugstate_t;
+typedef struct _plughandle_t plughandle_t;
+
+enum _field_t {
+	FIELD_GATE			= 0,
+	FIELD_PITCH			= 1,
+	FIELD_PRESSURE	= 2,
+
+	FIELD_MAX
+};
+
+// running sums for a least-squares slope over the samples since last token
+struct _window_t {
+	double sx;
+	double sjx;
+	float last;
+};
+
+struct _slot_t {
+	const float *ports [FIELD_MAX];
+	bool gate; // gate level as of last edge
+	xpress_uuid_t uuid; // 0 while gate is low or voice table was full
+	uint32_t n; // samples in window
+	window_t pitch;
+	window_t pressure;
+	uint32_t next; // frame of next edge or token in current cycle
+};
+
+struct _targetO_t {
+	int32_t slot;
+};
+
+struct _plugstate_t {
+	float threshold;
+	float rate;
+
+	perf_state_t perf;
+};
+
+struct _plughandle_t {
+	LV2_URID_Map *map;
+	LV2_Atom_Forge forge;
+	LV2_Atom_Forge_Ref ref;
+
+	PROPS_T(props, MAX_NPROPS);
+	xpress_t *xpressO;
+	targetO_t *targetO;
+	void *pool;
+
+	const LV2_Atom_Sequence *event_in;
+	LV2_Atom_Sequence *event_out;
+
+	plugstate_t state;
+	plugstate_t stash;
+	plugstate_t restore [PROPS_NRESTORE];
+	perf_t perf;
+
+	float sample_rate;
+	uint32_t period; // frames between tokens
+	float threshold; // gate threshold
+	slot_t slots [MAX_SLOTS];
+};
+
+static void
+_intercept_threshold(void *data, int64_t frames, props_impl_t *impl)
+{
+	plughandle_t *handle = data;
+
+	// comparisons against nan do not hold up under -ffast-math
+	handle->threshold = xpress_isfinite(handle->state.threshold)
+		? handle->state.threshold
+		: DEFAULT_THRESHOLD;
+}
+
+static void
+_intercept_rate(void *data, int64_t frames, props_impl_t *impl)
+{
+	plughandle_t *handle = data;
+
+	float rate = handle->state.rate;
+
+	// between one token per second and one per sample
+	if(!xpress_isfinite(rate) || (rate < 1.f) )
+		rate = 1.f;
+	else if(rate > handle->sample_rate)
+		rate = handle->sample_rate;
+
+	handle->period = handle->sample_rate / rate;
+	if(handle->period < 1)
+		handle->period = 1;
+}
+
+static const props_def_t defs [MAX_NPROPS] = {
+	{
+		.property = ESPRESSIVO_URI"#cv_in_threshold",
+		.offset = offsetof(plugstate_t, threshold),
+		.type = LV2_ATOM__Float,
+		.event_cb = _intercept_threshold
+	},
+	{
+		.property = ESPRESSIVO_URI"#cv_in_rate",
+		.offset = offsetof(plugstate_t, rate),
+		.type = LV2_ATOM__Float,
+		.event_cb = _intercept_rate
+	},
+	PERF_DEFS(plugstate_t, perf)
+};
+
+static const xpress_iface_t ifaceO = {
+	.size = sizeof(targetO_t)
+};
+
+static inline void
+_window_reset(window_t *window)
+{
+	window->sx = 0.0;
+	window->sjx = 0.0;
+}
+
+// add samples x[0, n) at window positions [j0, j0+n)
+static inline void
+_window_add(window_t *window, const float *x, uint32_t n, uint32_t j0)
+{
+	const v4f_t K0 = {0.f, 1.f, 2.f, 3.f};
+	const v4f_t FOUR = {4.f, 4.f, 4.f, 4.f};
+	v4f_t sx = {0.f, 0.f, 0.f, 0.f};
+	v4f_t skx = sx;
+	v4f_t k = K0;
+	uint32_t i = 0;
+
+	for( ; i + 4 <= n; i += 4, k += FOUR)
+	{
+		v4f_t v;
+		memcpy(&v, &x[i], sizeof(v4f_t));
+
+		sx += v;
+		skx += k*v;
+	}
+
+	float s = sx[0] + sx[1] + sx[2] + sx[3];
+	float sk = skx[0] + skx[1] + skx[2] + skx[3];
+
+	for( ; i < n; i++)
+	{
+		s += x[i];
+		sk += i*x[i];
+	}
+
+	// positions relative to chunk start keep the float sums small
+	window->sx += s;
+	window->sjx += sk + (double)j0*s;
+
+	if(n)
+		window->last = x[n - 1];
+}
+
+// least-squares slope per sample over window positions [0, n)
+static inline float
+_window_slope(const window_t *window, uint32_t n)
+{
+	if(n < 2)
+		return 0.f;
+
+	const double sj = 0.5 * n * (n - 1);
+	const double den = (double)n * n * ((double)n * n - 1) / 12.0;
+
+	return (n*window->sjx - sj*window->sx) / den;
+}
+
+static inline bool
+_gate(plughandle_t *handle, const slot_t *slot, uint32_t i)
+{
+	return slot->ports[FIELD_GATE][i] > handle->threshold;
+}
+
+// frame of next gate edge or due token in [from, to), to if none
+static uint32_t
+_slot_next(plughandle_t *handle, const slot_t *slot, uint32_t from, uint32_t to)
+{
+	if(slot->uuid)
+	{
+		const uint32_t due = slot->n < handle->period
+			? from + (handle->period - slot->n)
+			: from;
+
+		if(due < to)
+			to = due;
+	}
+
+	for(uint32_t i = from; i < to; i++)
+	{
+		if(_gate(handle, slot, i) != slot->gate)
+			return i;
+	}
+
+	return to;
+}
+
+static void
+_slot_token(plughandle_t *handle, LV2_Atom_Forge *forge, slot_t *slot,
+	int32_t zone, uint32_t frames)
+{
+	const xpress_state_t state = {
+		.zone = zone,
+		.pitch = slot->pitch.last,
+		.pressure = slot->pressure.last,
+		.dPitch = _window_slope(&slot->pitch, slot->n) * handle->sample_rate,
+		.dPressure = _window_slope(&slot->pressure, slot->n) * handle->sample_rate
+	};
+
+	if(handle->ref)
+		handle->ref = xpress_token(handle->xpressO, forge, frames, slot->uuid, &state);
+
+	_window_reset(&slot->pitch);
+	_window_reset(&slot->pressure);
+	slot->n = 0;
+}
+
+static void
+_slot_event(plughandle_t *handle, LV2_Atom_Forge *forge, slot_t *slot,
+	uint32_t frames)
+{
+	const int32_t zone = slot - handle->slots;
+	const bool gate = _gate(handle, slot, frames);
+
+	if(slot->gate && !gate) // falling edge
+	{
+		slot->gate = false;
+
+		if(!slot->uuid)
+			return; // never got a voice
+
+		xpress_free(handle->xpressO, slot->uuid);
+
+		if(handle->ref)
+			handle->ref = xpress_release(handle->xpressO, forge, frames, &slot->uuid, 1);
+
+		slot->uuid = 0;
+	}
+	else if(!slot->gate && gate) // rising edge
+	{
+		slot->gate = true;
+
+		xpress_uuid_t uuid;
+		targetO_t *dst = xpress_create(handle->xpressO, &uuid);
+		if(!dst)
+			return; // voice table full, wait for next edge
+
+		slot->uuid = uuid;
+
+		dst->slot = zone;
+
+		slot->n = 0;
+		slot->pitch.last = slot->ports[FIELD_PITCH][frames];
+		slot->pressure.last = slot->ports[FIELD_PRESSURE][frames];
+		_slot_token(handle, forge, slot, zone, frames);
+	}
+	else if(slot->uuid) // decimated update
+	{
+		_slot_token(handle, forge, slot, zone, frames);
+	}
+}
+
+// process CV input in [from, to), all slots in lockstep to keep events ordered
+static void
+_process(plughandle_t *handle, LV2_Atom_Forge *forge, uint32_t from, uint32_t to)
+{
+	for(unsigned s = 0; s < MAX_SLOTS; s++)
+	{
+		slot_t *slot = &handle->slots[s];
+
+		slot->next = _slot_next(handle, slot, from, to);
+	}
+
+	for(uint32_t i = from; i < to; )
+	{
+		uint32_t end = to;
+
+		for(unsigned s = 0; s < MAX_SLOTS; s++)
+		{
+			if(handle->slots[s].next < end)
+				end = handle->slots[s].next;
+		}
+
+		for(unsigned s = 0; s < MAX_SLOTS; s++)
+		{
+			slot_t *slot = &handle->slots[s];
+
+			if(!slot->uuid)
+				continue;
+
+			_window_add(&slot->pitch, &slot->ports[FIELD_PITCH][i], end - i, slot->n);
+			_window_add(&slot->pressure, &slot->ports[FIELD_PRESSURE][i], end - i, slot->n);
+			slot->n += end - i;
+		}
+
+		if(end == to)
+			break; // tokens due at end of range are forged at start of next range
+
+		for(unsigned s = 0; s < MAX_SLOTS; s++)
+		{
+			slot_t *slot = &handle->slots[s];
+
+			if(slot->next != end)
+				continue;
+
+			_slot_event(handle, forge, slot, end);
+			slot->next = _slot_next(handle, slot, end, to);
+		}
+
+		i = end;
+	}
+}
+
+static LV2_Handle
+instantiate(const LV2_Descriptor* descriptor, double rate,
+	const char *bundle_path, const LV2_Feature *const *features)
+{
+	plughandle_t *handle = calloc(1, sizeof(plughandle_t));
+	if(!handle)
+		return NULL;
+
+	xpress_map_t *voice_map = NULL;
+
+	for(unsigned i=0; features[i]; i++)
+	{
+		if(!strcmp(features[i]->URI, LV2_URID__map))
+			handle->map = features[i]->data;
+		else if(!strcmp(features[i]->URI, XPRESS__voiceMap))
+			voice_map = features[i]->data;
+	}
+
+	if(!handle->map)
+	{
+		fprintf(stderr, "%s: Host does not support urid:map\n", descriptor->URI);
+		free(handle);
+		return NULL;
+	}
+
+	handle->map = espressivo_map_ref(handle->map);
+
+	const unsigned max_nvoices = xpress_max_nvoices(handle->map, features,
+		MAX_NVOICES, MAX_NVOICES_LIMIT);
+	const size_t pool_size = _pool_size(max_nvoices, sizeof(targetO_t));
+	uint8_t *pool = handle->pool = calloc(1, pool_size);
+	if(!pool)
+	{
+		espressivo_map_unref(handle->map);
+		free(handle);
+		return NULL;
+	}
+
+	handle->xpressO = _pool_alloc(&pool, XPRESS_SIZE(max_nvoices));
+	handle->targetO = _pool_alloc(&pool, max_nvoices*sizeof(targetO_t));
+
+	lv2_atom_forge_init(&handle->forge, handle->map);
+
+	if(  !xpress_init(handle->xpressO, max_nvoices, handle->map, voice_map,
+			XPRESS_EVENT_NONE, &ifaceO, handle->targetO, handle) )
+	{
+		free(handle->pool);
+		espressivo_map_unref(handle->map);
+		free(handle);
+		return NULL;
+	}
+
+	if(!props_init(&handle->props, descriptor->URI,
+		defs, MAX_NPROPS, &handle->state, &handle->stash,
+		handle->restore, sizeof(plugstate_t), handle->map, handle))
+	{
+		fprintf(stderr, "failed to allocate property structure\n");
+		xpress_deinit(handle->xpressO);
+		free(handle->pool);
+		espressivo_map_unref(handle->map);
+		free(handle);
+		return NULL;
+	}
+
+	_perf_init(&handle->perf, &handle->props, rate);
+
+	handle->sample_rate = rate;
+	handle->period = rate / DEFAULT_RATE; // until state has been restored
+	handle->threshold = DEFAULT_THRESHOLD;
+
+	return handle;
+}
+
+static void
+connect_port(LV2_Handle instance, uint32_t port, void *data)
+{
+	plughandle_t *handle = instance;
+
+	switch(port)
+	{
+		case 0:
+			handle->event_in = (const LV2_Atom_Sequence *)data;
+			break;
+		case 1:
+			handle->event_out = (LV2_Atom_Sequence *)data;
+			break;
+		default:
+		{
+			const unsigned idx = port - 2;
+
+			if(idx < MAX_SLOTS*FIELD_MAX)
+				handle->slots[idx / FIELD_MAX].ports[idx % FIELD_MAX] = data;
+		}	break;
+	}
+}
+
+static void
+run(LV2_Handle instance, uint32_t nsamples)
+{
+	plughandle_t *handle = instance;
+
+	_perf_begin(&handle->perf);
+
+	// prepare notify atom forge
+	const uint32_t capacity = handle->event_out->atom.size;
+	LV2_Atom_Forge *forge = &handle->forge;
+	lv2_atom_forge_set_buffer(forge, (uint8_t *)handle->event_out, capacity);
+	LV2_Atom_Forge_Frame frame;
+	handle->ref = lv2_atom_forge_sequence_head(forge, &frame, 0);
+
+	props_idle(&handle->props, forge, 0, &handle->ref);
+	xpress_rst(handle->xpressO);
+
+	uint32_t cursor = 0;
+	LV2_ATOM_SEQUENCE_FOREACH(handle->event_in, ev)
+	{
+		const LV2_Atom_Object *obj = (const LV2_Atom_Object *)&ev->body;
+		const int64_t frames = ev->time.frames;
+
+		_process(handle, forge, cursor, frames);
+		cursor = frames;
+
+		props_advance(&handle->props, forge, frames, obj, &handle->ref);
+	}
+
+	_process(handle, forge, cursor, nsamples);
+
+	xpress_flush(handle->xpressO, forge, nsamples, &handle->ref);
+
+	if(handle->ref && !xpress_synced(handle->xpressO))
+		handle->ref = xpress_alive(handle->xpressO, forge, nsamples-1);
+
+	_perf_end(&handle->perf, &handle->state.perf, &handle->props, forge, nsamples,
+		handle->event_in, handle->event_out, handle->xpressO, &handle->ref);
+
+	if(handle->ref)
+		lv2_atom_forge_pop(forge, &frame);
+	else
+	{
+		lv2_atom_sequence_clear(handle->event_out);
+		xpress_discard(handle->xpressO);
+	}
+}
+
+static void
+cleanup(LV2_Handle instance)
+{
+	plughandle_t *handle = instance;
+
+	if(handle)
+	{
+		xpress_deinit(handle->xpressO);
+		free(handle->pool);
+		espressivo_map_unref(handle->map);
+		free(handle);
+	}
+}
+
+static LV2_State_Status
+_state_save(LV2_Handle instance, LV2_State_Store_Function store,
+	LV2_State_Handle state, uint32_t flags,
+	const LV2_Feature *const *features)
+{
+	plughandle_t *handle = instance;
+
+	return props_save(&handle->props, store, state, flags, features);
+}
+
+static LV2_State_Status
+_state_restore(LV2_Handle instance, LV2_State_Retrieve_Function retrieve,
+	LV2_State_Handle state, uint32_t flags,
+	const LV2_Feature *const *features)
+{
+	plughandle_t *handle = instance;
+
+	return props_restore(&handle->props, retrieve, state, flags, features);
+}
+
+static const LV2_State_Interface state_iface = {
+	.save = _state_save,
+	.restore = _state_restore
+};
+
+static const void *
+extension_data(const char *uri)
+{
+	if(!strcmp(uri, LV2_STATE__interface))
+		return &state_iface;
+	return NULL;
+}
+
+const LV2_Descriptor cv_in = {
+	.URI						= ESPRESSIVO_CV_IN_URI,
+	.instantiate		= instantiate,
+	.connect_port		= connect_port,
+	.activate				= NULL,
+	.run						= run,
+	.deactivate			= NULL,
+	.cleanup				= cleanup,
+	.extension_data	= extension_data
+};
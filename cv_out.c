@@ -0,0 +1,557 @@
+/*
+ * Copyright (c) 2015-2017 Hanspeter Portner (dev@open-music-kontrollers.ch)
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the Artistic License 2.0 as published by
+ * The Perl Foundation.
+ *
+ * This source is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Artistic License 2.0 for more details.
+ *
+ * You should have received a copy of the Artistic License 2.0
+ * along the source as a COPYING file. If not, obtain it from
+ * http://www.perlfoundation.org/artistic_license_2_0.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <espressivo.h>
+#include <props.h>
+
+#define MAX_NPROPS (2 + PERF_NPROPS)
+#define MAX_SLOTS 4
+#define MAX_RAMP 0.05f // longest ramp between tokens in seconds
+#define MAX_VALUE 1e30f // largest magnitude of a target
+
+typedef float v4f_t __attribute__((vector_size(16)));
+
+typedef enum _mapping_t mapping_t;
+typedef enum _interpolation_t interpolation_t;
+typedef enum _field_t field_t;
+typedef struct _ramp_t ramp_t;
+typedef struct _slot_t slot_t;
+typedef struct _targetI_t targetI_t;
+typedef struct _plugstate_t plugstate_t;
+typedef struct _plughandle_t plughandle_t;
+
+enum _mapping_t {
+	MAPPING_ALLOCATION	= 0, // first voices in order of allocation
+	MAPPING_ZONE				= 1 // latest voice of zone N
+};
+
+enum _interpolation_t {
+	INTERPOLATION_STEP				= 0,
+	INTERPOLATION_LINEAR			= 1,
+	INTERPOLATION_SMOOTHSTEP	= 2
+};
+
+enum _field_t {
+	FIELD_GATE			= 0,
+	FIELD_PITCH			= 1,
+	FIELD_PRESSURE	= 2,
+	FIELD_TIMBRE		= 3,
+
+	FIELD_MAX
+};
+
+struct _ramp_t {
+	float from;
+	float to;
+	uint64_t start; // frame time of ramp start
+	uint32_t duration; // in frames, 0 for a step
+};
+
+struct _slot_t {
+	xpress_uuid_t uuid; // 0 for unassigned slot
+	uint64_t last; // frame time of last token
+	ramp_t ramps [FIELD_MAX];
+	float *ports [FIELD_MAX];
+};
+
+struct _targetI_t {
+	int32_t slot; // -1 for voices not mapped to a slot
+};
+
+struct _plugstate_t {
+	int32_t mapping;
+	int32_t interpolation;
+
+	perf_state_t perf;
+};
+
+struct _plughandle_t {
+	LV2_URID_Map *map;
+	LV2_Atom_Forge forge;
+	LV2_Atom_Forge_Ref ref;
+
+	PROPS_T(props, MAX_NPROPS);
+	xpress_t *xpressI;
+	targetI_t *targetI;
+	void *pool;
+
+	const LV2_Atom_Sequence *event_in;
+	LV2_Atom_Sequence *event_out;
+
+	plugstate_t state;
+	plugstate_t stash;
+	plugstate_t restore [PROPS_NRESTORE];
+	perf_t perf;
+
+	slot_t slots [MAX_SLOTS];
+	uint64_t clock; // frame time at start of cycle
+	uint32_t cursor; // frames rendered in current cycle
+	uint32_t max_ramp; // in frames
+};
+
+static const props_def_t defs [MAX_NPROPS] = {
+	{
+		.property = ESPRESSIVO_URI"#cv_out_mapping",
+		.offset = offsetof(plugstate_t, mapping),
+		.type = LV2_ATOM__Int,
+	},
+	{
+		.property = ESPRESSIVO_URI"#cv_out_interpolation",
+		.offset = offsetof(plugstate_t, interpolation),
+		.type = LV2_ATOM__Int,
+	},
+	PERF_DEFS(plugstate_t, perf)
+};
+
+static inline void
+_fill_const(float *dst, uint32_t n, float v)
+{
+	const v4f_t V = {v, v, v, v};
+	uint32_t i = 0;
+
+	for( ; i + 4 <= n; i += 4)
+		memcpy(&dst[i], &V, sizeof(v4f_t));
+	for( ; i < n; i++)
+		dst[i] = v;
+}
+
+// ramp from x0 in steps of dx, with x in [0, 1) mapped to [from, from+delta)
+static inline void
+_fill_ramp(float *dst, uint32_t n, float x0, float dx, float from, float delta,
+	bool smooth)
+{
+	const v4f_t X = {x0, x0 + dx, x0 + 2.f*dx, x0 + 3.f*dx};
+	const v4f_t DX = {4.f*dx, 4.f*dx, 4.f*dx, 4.f*dx};
+	const v4f_t FROM = {from, from, from, from};
+	const v4f_t DELTA = {delta, delta, delta, delta};
+	const v4f_t THREE = {3.f, 3.f, 3.f, 3.f};
+	const v4f_t TWO = {2.f, 2.f, 2.f, 2.f};
+	v4f_t x = X;
+	uint32_t i = 0;
+
+	if(smooth)
+	{
+		for( ; i + 4 <= n; i += 4, x += DX)
+		{
+			const v4f_t v = FROM + DELTA*x*x*(THREE - TWO*x);
+			memcpy(&dst[i], &v, sizeof(v4f_t));
+		}
+	}
+	else
+	{
+		for( ; i + 4 <= n; i += 4, x += DX)
+		{
+			const v4f_t v = FROM + DELTA*x;
+			memcpy(&dst[i], &v, sizeof(v4f_t));
+		}
+	}
+
+	for( ; i < n; i++)
+	{
+		const float xi = x0 + dx*i;
+
+		dst[i] = smooth
+			? from + delta*xi*xi*(3.f - 2.f*xi)
+			: from + delta*xi;
+	}
+}
+
+static inline float
+_ramp_value(const ramp_t *ramp, bool smooth, uint64_t t)
+{
+	if(t >= ramp->start + ramp->duration)
+		return ramp->to;
+
+	const float x = (float)(t - ramp->start) / ramp->duration;
+
+	return ramp->from + (ramp->to - ramp->from)
+		* (smooth ? x*x*(3.f - 2.f*x) : x);
+}
+
+// write ramp into port buffer for frames [from, to) of current cycle
+static inline void
+_ramp_render(plughandle_t *handle, const ramp_t *ramp, float *dst,
+	uint32_t from, uint32_t to)
+{
+	const uint64_t t0 = handle->clock + from;
+	const uint64_t end = ramp->start + ramp->duration;
+	uint32_t n = 0;
+
+	if(t0 < end)
+	{
+		const bool smooth = handle->state.interpolation == INTERPOLATION_SMOOTHSTEP;
+		const float dx = 1.f / ramp->duration;
+
+		n = end - t0;
+		if(n > to - from)
+			n = to - from;
+
+		_fill_ramp(&dst[from], n, (t0 - ramp->start)*dx, dx,
+			ramp->from, ramp->to - ramp->from, smooth);
+	}
+
+	_fill_const(&dst[from + n], to - from - n, ramp->to);
+}
+
+static void
+_render(plughandle_t *handle, uint32_t to)
+{
+	const uint32_t from = handle->cursor;
+
+	if(to <= from)
+		return;
+
+	for(unsigned s = 0; s < MAX_SLOTS; s++)
+	{
+		slot_t *slot = &handle->slots[s];
+
+		for(unsigned f = 0; f < FIELD_MAX; f++)
+		{
+			if(slot->ports[f])
+				_ramp_render(handle, &slot->ramps[f], slot->ports[f], from, to);
+		}
+	}
+
+	handle->cursor = to;
+}
+
+static inline void
+_ramp_set(plughandle_t *handle, ramp_t *ramp, uint64_t t, uint32_t duration,
+	float value)
+{
+	const bool smooth = handle->state.interpolation == INTERPOLATION_SMOOTHSTEP;
+
+	// keep previous target for non-finite values, bound the others, so that the
+	// distance of two targets cannot overflow while ramping
+	if(!xpress_isfinite(value))
+		value = ramp->to;
+	else if(value > MAX_VALUE)
+		value = MAX_VALUE;
+	else if(value < -MAX_VALUE)
+		value = -MAX_VALUE;
+
+	ramp->from = _ramp_value(ramp, smooth, t); // continue from where we are
+	ramp->to = value;
+	ramp->start = t;
+	ramp->duration = duration;
+}
+
+static void
+_slot_update(plughandle_t *handle, slot_t *slot, int64_t frames,
+	const xpress_state_t *state, bool attack)
+{
+	const uint64_t t = handle->clock + frames;
+	uint32_t duration = 0;
+
+	// ramp over the distance of the last two tokens, jump on note on
+	if(!attack && (handle->state.interpolation != INTERPOLATION_STEP))
+	{
+		duration = t - slot->last;
+		if(duration > handle->max_ramp)
+			duration = handle->max_ramp;
+	}
+
+	_ramp_set(handle, &slot->ramps[FIELD_GATE], t, 0, 1.f);
+	_ramp_set(handle, &slot->ramps[FIELD_PITCH], t, duration, state->pitch);
+	_ramp_set(handle, &slot->ramps[FIELD_PRESSURE], t, duration, state->pressure);
+	_ramp_set(handle, &slot->ramps[FIELD_TIMBRE], t, duration, state->timbre);
+
+	slot->last = t;
+}
+
+static void
+_add(void *data, int64_t frames, const xpress_state_t *state,
+	xpress_uuid_t uuid, void *target)
+{
+	plughandle_t *handle = data;
+	targetI_t *src = target;
+
+	src->slot = -1;
+
+	if(handle->state.mapping == MAPPING_ZONE)
+	{
+		if( (state->zone < 0) || (state->zone >= MAX_SLOTS) )
+			return; // not mapped
+
+		src->slot = state->zone; // latest voice steals slot
+	}
+	else
+	{
+		for(unsigned s = 0; s < MAX_SLOTS; s++)
+		{
+			if(!handle->slots[s].uuid)
+			{
+				src->slot = s;
+				break;
+			}
+		}
+
+		if(src->slot == -1)
+			return; // all slots busy
+	}
+
+	_render(handle, frames);
+
+	slot_t *slot = &handle->slots[src->slot];
+	slot->uuid = uuid;
+	_slot_update(handle, slot, frames, state, true);
+}
+
+static void
+_set(void *data, int64_t frames, const xpress_state_t *state,
+	xpress_uuid_t uuid, void *target)
+{
+	plughandle_t *handle = data;
+	targetI_t *src = target;
+
+	if(src->slot == -1)
+		return; // not mapped
+
+	slot_t *slot = &handle->slots[src->slot];
+	if(slot->uuid != uuid)
+		return; // slot was stolen
+
+	_render(handle, frames);
+
+	_slot_update(handle, slot, frames, state, false);
+}
+
+static void
+_del(void *data, int64_t frames,
+	xpress_uuid_t uuid, void *target)
+{
+	plughandle_t *handle = data;
+	targetI_t *src = target;
+
+	if(src->slot == -1)
+		return; // not mapped
+
+	slot_t *slot = &handle->slots[src->slot];
+	if(slot->uuid != uuid)
+		return; // slot was stolen
+
+	_render(handle, frames);
+
+	// gate off, other fields hold their last value for release phases
+	slot->uuid = 0;
+	_ramp_set(handle, &slot->ramps[FIELD_GATE], handle->clock + frames, 0, 0.f);
+}
+
+static const xpress_iface_t ifaceI = {
+	.size = sizeof(targetI_t),
+
+	.add = _add,
+	.set = _set,
+	.del = _del
+};
+
+static LV2_Handle
+instantiate(const LV2_Descriptor* descriptor, double rate,
+	const char *bundle_path, const LV2_Feature *const *features)
+{
+	plughandle_t *handle = calloc(1, sizeof(plughandle_t));
+	if(!handle)
+		return NULL;
+
+	xpress_map_t *voice_map = NULL;
+
+	for(unsigned i=0; features[i]; i++)
+	{
+		if(!strcmp(features[i]->URI, LV2_URID__map))
+			handle->map = features[i]->data;
+		else if(!strcmp(features[i]->URI, XPRESS__voiceMap))
+			voice_map = features[i]->data;
+	}
+
+	if(!handle->map)
+	{
+		fprintf(stderr, "%s: Host does not support urid:map\n", descriptor->URI);
+		free(handle);
+		return NULL;
+	}
+
+	handle->map = espressivo_map_ref(handle->map);
+
+	const unsigned max_nvoices = xpress_max_nvoices(handle->map, features,
+		MAX_NVOICES, MAX_NVOICES_LIMIT);
+	const size_t pool_size = _pool_size(max_nvoices, sizeof(targetI_t));
+	uint8_t *pool = handle->pool = calloc(1, pool_size);
+	if(!pool)
+	{
+		espressivo_map_unref(handle->map);
+		free(handle);
+		return NULL;
+	}
+
+	handle->xpressI = _pool_alloc(&pool, XPRESS_SIZE(max_nvoices));
+	handle->targetI = _pool_alloc(&pool, max_nvoices*sizeof(targetI_t));
+
+	lv2_atom_forge_init(&handle->forge, handle->map);
+
+	if(  !xpress_init(handle->xpressI, max_nvoices, handle->map, voice_map,
+			XPRESS_EVENT_ALL, &ifaceI, handle->targetI, handle) )
+	{
+		free(handle->pool);
+		espressivo_map_unref(handle->map);
+		free(handle);
+		return NULL;
+	}
+
+	if(!props_init(&handle->props, descriptor->URI,
+		defs, MAX_NPROPS, &handle->state, &handle->stash,
+		handle->restore, sizeof(plugstate_t), handle->map, handle))
+	{
+		fprintf(stderr, "failed to allocate property structure\n");
+		xpress_deinit(handle->xpressI);
+		free(handle->pool);
+		espressivo_map_unref(handle->map);
+		free(handle);
+		return NULL;
+	}
+
+	_perf_init(&handle->perf, &handle->props, rate);
+
+	handle->max_ramp = rate * MAX_RAMP;
+
+	return handle;
+}
+
+static void
+connect_port(LV2_Handle instance, uint32_t port, void *data)
+{
+	plughandle_t *handle = instance;
+
+	switch(port)
+	{
+		case 0:
+			handle->event_in = (const LV2_Atom_Sequence *)data;
+			break;
+		case 1:
+			handle->event_out = (LV2_Atom_Sequence *)data;
+			break;
+		default:
+		{
+			const unsigned idx = port - 2;
+
+			if(idx < MAX_SLOTS*FIELD_MAX)
+				handle->slots[idx / FIELD_MAX].ports[idx % FIELD_MAX] = data;
+		}	break;
+	}
+}
+
+static void
+run(LV2_Handle instance, uint32_t nsamples)
+{
+	plughandle_t *handle = instance;
+
+	_perf_begin(&handle->perf);
+
+	// prepare notify atom forge
+	const uint32_t capacity = handle->event_out->atom.size;
+	LV2_Atom_Forge *forge = &handle->forge;
+	lv2_atom_forge_set_buffer(forge, (uint8_t *)handle->event_out, capacity);
+	LV2_Atom_Forge_Frame frame;
+	handle->ref = lv2_atom_forge_sequence_head(forge, &frame, 0);
+
+	props_idle(&handle->props, forge, 0, &handle->ref);
+	xpress_pre(handle->xpressI);
+	handle->cursor = 0;
+
+	LV2_ATOM_SEQUENCE_FOREACH(handle->event_in, ev)
+	{
+		const LV2_Atom_Object *obj = (const LV2_Atom_Object *)&ev->body;
+		const int64_t frames = ev->time.frames;
+
+		if(!props_advance(&handle->props, forge, frames, obj, &handle->ref))
+		{
+			xpress_advance(handle->xpressI, forge, frames, obj, &handle->ref);
+		}
+	}
+
+	xpress_post(handle->xpressI, nsamples-1);
+	_render(handle, nsamples);
+	handle->clock += nsamples;
+
+	_perf_end(&handle->perf, &handle->state.perf, &handle->props, forge, nsamples,
+		handle->event_in, handle->event_out, handle->xpressI, &handle->ref);
+
+	if(handle->ref)
+		lv2_atom_forge_pop(forge, &frame);
+	else
+		lv2_atom_sequence_clear(handle->event_out);
+}
+
+static void
+cleanup(LV2_Handle instance)
+{
+	plughandle_t *handle = instance;
+
+	if(handle)
+	{
+		xpress_deinit(handle->xpressI);
+		free(handle->pool);
+		espressivo_map_unref(handle->map);
+		free(handle);
+	}
+}
+
+static LV2_State_Status
+_state_save(LV2_Handle instance, LV2_State_Store_Function store,
+	LV2_State_Handle state, uint32_t flags,
+	const LV2_Feature *const *features)
+{
+	plughandle_t *handle = instance;
+
+	return props_save(&handle->props, store, state, flags, features);
+}
+
+static LV2_State_Status
+_state_restore(LV2_Handle instance, LV2_State_Retrieve_Function retrieve,
+	LV2_State_Handle state, uint32_t flags,
+	const LV2_Feature *const *features)
+{
+	plughandle_t *handle = instance;
+
+	return props_restore(&handle->props, retrieve, state, flags, features);
+}
+
+static const LV2_State_Interface state_iface = {
+	.save = _state_save,
+	.restore = _state_restore
+};
+
+static const void *
+extension_data(const char *uri)
+{
+	if(!strcmp(uri, LV2_STATE__interface))
+		return &state_iface;
+	return NULL;
+}
+
+const LV2_Descriptor cv_out = {
+	.URI						= ESPRESSIVO_CV_OUT_URI,
+	.instantiate		= instantiate,
+	.connect_port		= connect_port,
+	.activate				= NULL,
+	.run						= run,
+	.deactivate			= NULL,
+	.cleanup				= cleanup,
+	.extension_data	= extension_data
+};
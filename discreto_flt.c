@@ -22,7 +22,7 @@
 #include <espressivo.h>
 #include <props.h>
 
-#define MAX_NPROPS 2
+#define MAX_NPROPS (2 + PERF_NPROPS)
 
 typedef struct _targetI_t targetI_t;
 typedef struct _targetO_t targetO_t;
@@ -30,7 +30,7 @@ typedef struct _plugstate_t plugstate_t;
 typedef struct _plughandle_t plughandle_t;
 
 struct _targetI_t {
-	xpress_uuid_t uuid;
+	xpress_handle_t voice;
 };
 
 struct _targetO_t {
@@ -38,8 +38,9 @@ struct _targetO_t {
 };
 
 struct _plugstate_t {
-	int32_t position_order;
-	int32_t velocity_order;
+	discreto_state_t discreto;
+
+	perf_state_t perf;
 };
 
 struct _plughandle_t {
@@ -48,29 +49,33 @@ struct _plughandle_t {
 	LV2_Atom_Forge_Ref ref;
 
 	PROPS_T(props, MAX_NPROPS);
-	XPRESS_T(xpressI, MAX_NVOICES);
-	XPRESS_T(xpressO, MAX_NVOICES);
-	targetI_t targetI [MAX_NVOICES];
-	targetO_t targetO [MAX_NVOICES];
+	xpress_t *xpressI;
+	xpress_t *xpressO;
+	targetI_t *targetI;
+	targetO_t *targetO;
+	void *pool;
 
 	const LV2_Atom_Sequence *event_in;
 	LV2_Atom_Sequence *event_out;
 
 	plugstate_t state;
 	plugstate_t stash;
+	plugstate_t restore [PROPS_NRESTORE];
+	perf_t perf;
 };
 
 static const props_def_t defs [MAX_NPROPS] = {
 	{
 		.property = ESPRESSIVO_URI"#discreto_position_order",
-		.offset = offsetof(plugstate_t, position_order),
+		.offset = offsetof(plugstate_t, discreto.position_order),
 		.type = LV2_ATOM__Int,
 	},
 	{
 		.property = ESPRESSIVO_URI"#discreto_velocity_order",
-		.offset = offsetof(plugstate_t, velocity_order),
+		.offset = offsetof(plugstate_t, discreto.velocity_order),
 		.type = LV2_ATOM__Int,
-	}
+	},
+	PERF_DEFS(plugstate_t, perf)
 };
 
 
@@ -83,57 +88,10 @@ _upd(plughandle_t *handle, int64_t frames, const xpress_state_t *state,
 	xpress_state_t new_state;
 	memcpy(&new_state, state, sizeof(xpress_state_t));
 
-	float x = state->pitch * 0x7f;
-
-	switch(handle->state.position_order)
-	{
-		case 0:
-		{
-			const float ro = floor(x + 0.5f);
-			x = ro;
-			break;
-		}
-
-		case 1:
-		{
-			// do nothing, e.g. (x = x)
-			break;
-		}
-
-		default:
-		{
-			const float v_abs = fabsf(state->dPitch);
-			const float v2 = v_abs >= 1.f
-				? 0.f
-				: 1.f - v_abs;
-			float k2;
-			switch(handle->state.velocity_order)
-			{
-				case 0:
-					k2 = handle->state.position_order;
-					break;
-				case 1:
-					k2 = 1.f + (handle->state.position_order - 1.f) * v2;
-					break;
-				default:
-					k2 = 1.f + (handle->state.position_order - 1.f) * powf(v2, handle->state.velocity_order);
-					break;
-			}
-			const float ex = exp2f( (k2 - 1.f) / k2);
-
-			const float ro = floor(x + 0.5f);
-			float rel = x - ro;
-			const float sign = rel < 0.f ? -1.f : 1.f;
-			rel = powf(fabsf(rel)* ex, k2) * sign;
-			x = ro + rel;
-			break;
-		}
-	}
-
-	new_state.pitch = x / 0x7f;
+	_discreto_apply(&handle->state.discreto, &new_state);
 
 	if(handle->ref)
-		handle->ref = xpress_token(&handle->xpressO, forge, frames, src->uuid, &new_state);
+		handle->ref = xpress_token_h(handle->xpressO, forge, frames, &src->voice, &new_state);
 }
 
 static void
@@ -143,7 +101,7 @@ _add(void *data, int64_t frames, const xpress_state_t *state,
 	plughandle_t *handle = data;
 	targetI_t *src = target;
 
-	xpress_create(&handle->xpressO, &src->uuid);
+	xpress_create_h(handle->xpressO, &src->voice);
 
 	_upd(handle, frames, state, src);
 }
@@ -167,10 +125,10 @@ _del(void *data, int64_t frames,
 
 	LV2_Atom_Forge *forge = &handle->forge;
 
-	xpress_free(&handle->xpressO, src->uuid);
+	xpress_free_h(handle->xpressO, &src->voice);
 
 	if(handle->ref)
-		handle->ref = xpress_alive(&handle->xpressO, forge, frames);
+		handle->ref = xpress_release(handle->xpressO, forge, frames, &src->voice.uuid, 1);
 }
 
 static const xpress_iface_t ifaceI = {
@@ -210,26 +168,51 @@ instantiate(const LV2_Descriptor* descriptor, double rate,
 		return NULL;
 	}
 
+	handle->map = espressivo_map_ref(handle->map);
+
+	const unsigned max_nvoices = xpress_max_nvoices(handle->map, features,
+		MAX_NVOICES, MAX_NVOICES_LIMIT);
+	const size_t pool_size = _pool_size(max_nvoices, sizeof(targetI_t))
+		+ _pool_size(max_nvoices, sizeof(targetO_t));
+	uint8_t *pool = handle->pool = calloc(1, pool_size);
+	if(!pool)
+	{
+		espressivo_map_unref(handle->map);
+		free(handle);
+		return NULL;
+	}
+
+	handle->xpressI = _pool_alloc(&pool, XPRESS_SIZE(max_nvoices));
+	handle->targetI = _pool_alloc(&pool, max_nvoices*sizeof(targetI_t));
+	handle->xpressO = _pool_alloc(&pool, XPRESS_SIZE(max_nvoices));
+	handle->targetO = _pool_alloc(&pool, max_nvoices*sizeof(targetO_t));
+
 	lv2_atom_forge_init(&handle->forge, handle->map);
 
-	if(  !xpress_init(&handle->xpressI, MAX_NVOICES, handle->map, voice_map,
+	if(  !xpress_init(handle->xpressI, max_nvoices, handle->map, voice_map,
 			XPRESS_EVENT_ALL, &ifaceI, handle->targetI, handle)
-		|| !xpress_init(&handle->xpressO, MAX_NVOICES, handle->map, voice_map,
+		|| !xpress_init(handle->xpressO, max_nvoices, handle->map, voice_map,
 			XPRESS_EVENT_NONE, &ifaceO, handle->targetO, handle) )
 	{
+		free(handle->pool);
+		espressivo_map_unref(handle->map);
 		free(handle);
 		return NULL;
 	}
 
 	if(!props_init(&handle->props, descriptor->URI,
 		defs, MAX_NPROPS, &handle->state, &handle->stash,
-		handle->map, handle))
+		handle->restore, sizeof(plugstate_t), handle->map, handle))
 	{
 		fprintf(stderr, "failed to allocate property structure\n");
+		free(handle->pool);
+		espressivo_map_unref(handle->map);
 		free(handle);
 		return NULL;
 	}
 
+	_perf_init(&handle->perf, &handle->props, rate);
+
 	return handle;
 }
 
@@ -256,6 +239,8 @@ run(LV2_Handle instance, uint32_t nsamples)
 {
 	plughandle_t *handle = instance;
 
+	_perf_begin(&handle->perf);
+
 	// prepare midi atom forge
 	const uint32_t capacity = handle->event_out->atom.size;
 	LV2_Atom_Forge *forge = &handle->forge;
@@ -264,8 +249,8 @@ run(LV2_Handle instance, uint32_t nsamples)
 	handle->ref = lv2_atom_forge_sequence_head(forge, &frame, 0);
 
 	props_idle(&handle->props, forge, 0, &handle->ref);
-	xpress_pre(&handle->xpressI);
-	xpress_rst(&handle->xpressO);
+	xpress_pre(handle->xpressI);
+	xpress_rst(handle->xpressO);
 
 	LV2_ATOM_SEQUENCE_FOREACH(handle->event_in, ev)
 	{
@@ -274,18 +259,26 @@ run(LV2_Handle instance, uint32_t nsamples)
 
 		if(!props_advance(&handle->props, forge, frames, obj, &handle->ref))
 		{
-			xpress_advance(&handle->xpressI, forge, frames, obj, &handle->ref);
+			xpress_advance(handle->xpressI, forge, frames, obj, &handle->ref);
 		}
 	}
 
-	xpress_post(&handle->xpressI, nsamples-1);
-	if(handle->ref && !xpress_synced(&handle->xpressO))
-		handle->ref = xpress_alive(&handle->xpressO, forge, nsamples-1);
+	xpress_flush(handle->xpressO, forge, nsamples, &handle->ref);
+
+	xpress_post(handle->xpressI, nsamples-1);
+	if(handle->ref && !xpress_synced(handle->xpressO))
+		handle->ref = xpress_alive(handle->xpressO, forge, nsamples-1);
+
+	_perf_end(&handle->perf, &handle->state.perf, &handle->props, forge, nsamples,
+		handle->event_in, handle->event_out, handle->xpressO, &handle->ref);
 
 	if(handle->ref)
 		lv2_atom_forge_pop(forge, &frame);
 	else
+	{
 		lv2_atom_sequence_clear(handle->event_out);
+		xpress_discard(handle->xpressO);
+	}
 }
 
 static void
@@ -295,8 +288,10 @@ cleanup(LV2_Handle instance)
 
 	if(handle)
 	{
-		xpress_deinit(&handle->xpressI);
-		xpress_deinit(&handle->xpressO);
+		xpress_deinit(handle->xpressI);
+		xpress_deinit(handle->xpressO);
+		free(handle->pool);
+		espressivo_map_unref(handle->map);
 		free(handle);
 	}
 }
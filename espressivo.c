@@ -15,8 +15,185 @@
  * http://www.perlfoundation.org/artistic_license_2_0.
  */
 
+#include <stdatomic.h>
+
 #include <espressivo.h>
 
+#define CACHE_SIZE 0x400 // power of two
+#define CACHE_MASK (CACHE_SIZE - 1)
+#define CACHE_FILL (CACHE_SIZE * 3 / 4) // keeps probe sequences short
+#define CACHE_ARENA 0x10000 // bytes for entries, ~80 per URI
+#define CACHE_UUID "urn:uuid:"
+
+typedef struct _cache_entry_t cache_entry_t;
+typedef struct _cache_t cache_t;
+
+struct _cache_entry_t {
+	LV2_URID urid;
+	char uri [];
+};
+
+// URIDs of one host map, entries are bump-allocated from the arena and
+// published into their slot via CAS, thus neither lookups nor insertions
+// take a lock and both are safe to call from the rt thread
+struct _cache_t {
+	LV2_URID_Map map; // handed out to instances, must be first
+	LV2_URID_Map host;
+	cache_t *next;
+	unsigned refs;
+	atomic_uint nentries;
+	atomic_size_t used;
+	_Atomic(cache_entry_t *) entries [CACHE_SIZE];
+	_Alignas(cache_entry_t) uint8_t arena [CACHE_ARENA];
+};
+
+// guards list of caches and their reference counts, never taken by the rt thread
+static atomic_flag cache_lock = ATOMIC_FLAG_INIT;
+static cache_t *caches = NULL;
+
+static inline void
+_cache_lock(void)
+{
+	while(atomic_flag_test_and_set_explicit(&cache_lock, memory_order_acquire))
+	{
+		// spin, hosts instantiate concurrently at most
+	}
+}
+
+static inline void
+_cache_unlock(void)
+{
+	atomic_flag_clear_explicit(&cache_lock, memory_order_release);
+}
+
+// FNV-1a
+static inline uint32_t
+_cache_hash(const char *uri)
+{
+	uint32_t hash = 0x811c9dc5;
+
+	for(const char *c = uri; *c; c++)
+		hash = (hash ^ (uint8_t)*c) * 0x01000193;
+
+	return hash;
+}
+
+static LV2_URID
+_cache_map(LV2_URID_Map_Handle instance, const char *uri)
+{
+	cache_t *cache = instance;
+	const uint32_t hash = _cache_hash(uri);
+	uint32_t idx = hash & CACHE_MASK;
+
+	for(cache_entry_t *entry;
+		(entry = atomic_load_explicit(&cache->entries[idx], memory_order_acquire));
+		idx = (idx + 1) & CACHE_MASK)
+	{
+		if(!strcmp(entry->uri, uri))
+			return entry->urid;
+	}
+
+	const LV2_URID urid = cache->host.map(cache->host.handle, uri);
+
+	// instance-unique uuids are never shared, thus not worth caching
+	if(!urid || !strncmp(uri, CACHE_UUID, sizeof(CACHE_UUID) - 1)
+		|| (atomic_load_explicit(&cache->nentries, memory_order_relaxed) >= CACHE_FILL) )
+	{
+		return urid;
+	}
+
+	const size_t len = strlen(uri) + 1;
+	const size_t size = (sizeof(cache_entry_t) + len + _Alignof(cache_entry_t) - 1)
+		& ~(_Alignof(cache_entry_t) - 1);
+	const size_t offset = atomic_fetch_add_explicit(&cache->used, size, memory_order_relaxed);
+
+	if(offset + size > CACHE_ARENA)
+		return urid; // arena exhausted
+
+	cache_entry_t *entry = (cache_entry_t *)&cache->arena[offset];
+	entry->urid = urid;
+	memcpy(entry->uri, uri, len);
+
+	// continue probe, another thread may insert concurrently
+	for(unsigned i = 0; i < CACHE_SIZE; i++, idx = (idx + 1) & CACHE_MASK)
+	{
+		cache_entry_t *other = NULL;
+
+		if(atomic_compare_exchange_strong_explicit(&cache->entries[idx], &other, entry,
+			memory_order_release, memory_order_acquire))
+		{
+			atomic_fetch_add_explicit(&cache->nentries, 1, memory_order_relaxed);
+			break;
+		}
+
+		if(!strcmp(other->uri, uri))
+			break; // lost the race, entry stays unused in the arena
+	}
+
+	return urid;
+}
+
+LV2_URID_Map *
+espressivo_map_ref(LV2_URID_Map *host)
+{
+	cache_t *cache;
+
+	_cache_lock();
+
+	for(cache = caches; cache; cache = cache->next)
+	{
+		if( (cache->host.handle == host->handle) && (cache->host.map == host->map) )
+			break;
+	}
+
+	if(!cache && (cache = calloc(1, sizeof(cache_t))) )
+	{
+		cache->map.handle = cache;
+		cache->map.map = _cache_map;
+		cache->host = *host; // hosts may free their feature before the cache
+		cache->next = caches;
+		caches = cache;
+	}
+
+	if(cache)
+		cache->refs++;
+
+	_cache_unlock();
+
+	return cache ? &cache->map : host;
+}
+
+void
+espressivo_map_unref(LV2_URID_Map *map)
+{
+	if(map->map != _cache_map)
+		return; // host map fall-back
+
+	cache_t *cache = map->handle;
+	bool unused = false;
+
+	_cache_lock();
+
+	if(--cache->refs == 0)
+	{
+		for(cache_t **ptr = &caches; *ptr; ptr = &(*ptr)->next)
+		{
+			if(*ptr == cache)
+			{
+				*ptr = cache->next;
+				break;
+			}
+		}
+
+		unused = true;
+	}
+
+	_cache_unlock();
+
+	if(unused)
+		free(cache);
+}
+
 #ifdef _WIN32
 __declspec(dllexport)
 #else
@@ -59,6 +236,16 @@ lv2_descriptor(uint32_t index)
 			return &redirector;
 		case 15:
 			return &midi_out;
+		case 16:
+			return &chain;
+		case 17:
+			return &bus_out;
+		case 18:
+			return &bus_in;
+		case 19:
+			return &cv_out;
+		case 20:
+			return &cv_in;
 		default:
 			return NULL;
 	}
@@ -20,8 +20,10 @@
 
 #include <math.h>
 #include <stdlib.h>
+#include <time.h>
 
 #include <xpress.lv2/xpress.h>
+#include <props.h>
 
 #include <lv2/lv2plug.in/ns/lv2core/lv2.h>
 #include <lv2/lv2plug.in/ns/ext/atom/atom.h>
@@ -71,8 +73,621 @@
 #define ESPRESSIVO_SC_OUT_URI				ESPRESSIVO_URI"#sc_out"
 #define ESPRESSIVO_SQEW_URI					ESPRESSIVO_URI"#sqew"
 #define ESPRESSIVO_MONITOR_OUT_URI	ESPRESSIVO_URI"#monitor_out"
+#define ESPRESSIVO_CHAIN_URI				ESPRESSIVO_URI"#chain"
+#define ESPRESSIVO_BUS_OUT_URI			ESPRESSIVO_URI"#bus_out"
+#define ESPRESSIVO_BUS_IN_URI				ESPRESSIVO_URI"#bus_in"
+#define ESPRESSIVO_CV_OUT_URI				ESPRESSIVO_URI"#cv_out"
+#define ESPRESSIVO_CV_IN_URI				ESPRESSIVO_URI"#cv_in"
 
-#define MAX_NVOICES 64
+#define MAX_NVOICES 64 // default, may be overridden with xpress:maxNVoices option
+#define MAX_NVOICES_LIMIT XPRESS_MAX_NVOICES
+
+#define POOL_ALIGN(SIZE) (((SIZE) + 0xf) & ~((size_t)0xf))
+
+// size of pool for one voice table and its targets
+static inline size_t
+_pool_size(unsigned max_nvoices, size_t target_size)
+{
+	return POOL_ALIGN(XPRESS_SIZE(max_nvoices))
+		+ POOL_ALIGN(max_nvoices * target_size);
+}
+
+// carve aligned chunk from contiguous pool allocated in instantiate
+static inline void *
+_pool_alloc(uint8_t **pool, size_t size)
+{
+	void *ptr = *pool;
+
+	*pool += POOL_ALIGN(size);
+
+	return ptr;
+}
+
+// zones arrive unchecked from upstream and are used as table indices
+static inline bool
+_zone_valid(int32_t zone, unsigned nzones)
+{
+	return (zone >= 0) && ( (unsigned)zone < nzones);
+}
+
+// bit of given zone in a zone mask property, none for zones beyond
+static inline int32_t
+_zone_bit(int32_t zone)
+{
+	return _zone_valid(zone, 31) ? (INT32_C(1) << zone) : 0;
+}
+
+// zone shifted by an offset property, saturated instead of overflown
+static inline int32_t
+_zone_shift(int32_t zone, int32_t offset)
+{
+	int32_t shifted;
+
+	if(__builtin_add_overflow(zone, offset, &shifted))
+		return offset < 0 ? INT32_MIN : INT32_MAX;
+
+	return shifted;
+}
+
+// integer properties arrive unchecked via patch:Set
+static inline int32_t
+_clamp_int(int32_t val, int32_t min, int32_t max)
+{
+	return val < min ? min : (val > max ? max : val);
+}
+
+// scaled float to 14-bit MIDI value, saturated instead of wrapped
+static inline uint16_t
+_midi_14bit(float val)
+{
+	return val <= 0.f ? 0x0 : (val >= 0x3fff ? 0x3fff : (uint16_t)val);
+}
+
+// whether continuous MIDI updates would eat into the space kept for the
+// given number of note events, e.g. the note-offs of all active voices
+static inline bool
+_midi_tight(LV2_Atom_Forge *forge, unsigned nevents)
+{
+	const uint32_t size = sizeof(LV2_Atom_Event) + lv2_atom_pad_size(3);
+
+	return forge->offset + nevents*size > forge->size;
+}
+
+// whether a MIDI event holds exactly one complete channel voice message with
+// all data bytes in range, as these are used as table indices
+static inline bool
+_midi_is_voice_message(const LV2_Atom *atom)
+{
+	const uint8_t *m = LV2_ATOM_BODY_CONST(atom);
+	uint32_t size;
+
+	if(atom->size < 1)
+		return false;
+
+	switch(m[0] & 0xf0)
+	{
+		case LV2_MIDI_MSG_NOTE_OFF:
+		case LV2_MIDI_MSG_NOTE_ON:
+		case LV2_MIDI_MSG_NOTE_PRESSURE:
+		case LV2_MIDI_MSG_CONTROLLER:
+		case LV2_MIDI_MSG_BENDER:
+			size = 3;
+			break;
+		case LV2_MIDI_MSG_PGM_CHANGE:
+		case LV2_MIDI_MSG_CHANNEL_PRESSURE:
+			size = 2;
+			break;
+		default:
+			return false;
+	}
+
+	if(atom->size != size)
+		return false;
+
+	for(uint32_t i = 1; i < size; i++)
+	{
+		if(m[i] & 0x80)
+			return false;
+	}
+
+	return true;
+}
+
+// filter kernels, shared by the single filter plugins and chain
+typedef enum _modulator_enum_t modulator_enum_t;
+typedef enum _modulator_op_t modulator_op_t;
+typedef struct _sqew_state_t sqew_state_t;
+typedef struct _discreto_state_t discreto_state_t;
+typedef struct _modulator_state_t modulator_state_t;
+typedef struct _hold_state_t hold_state_t;
+
+enum _modulator_enum_t {
+	ENUM_PITCH = 0,
+	ENUM_PRESSURE,
+	ENUM_TIMBRE,
+	ENUM_DPITCH,
+	ENUM_DPRESSURE,
+	ENUM_DTIMBRE
+};
+
+enum _modulator_op_t {
+	OP_ADD = 0,
+	OP_SUB,
+	OP_MUL,
+	OP_DIV,
+	OP_POW,
+	OP_SET
+};
+
+// exponents, part of plugstate_t
+struct _sqew_state_t {
+	float pitch;
+	float pressure;
+	float timbre;
+	float dPitch;
+	float dPressure;
+	float dTimbre;
+};
+
+// part of plugstate_t
+struct _discreto_state_t {
+	int32_t position_order;
+	int32_t velocity_order;
+};
+
+// part of plugstate_t
+struct _modulator_state_t {
+	int32_t enum_src;
+	int32_t enum_mod;
+	float multiplier;
+	float adder;
+	int32_t op;
+};
+
+// dimensions to hold, part of plugstate_t
+struct _hold_state_t {
+	int32_t pitch;
+	int32_t pressure;
+	int32_t timbre;
+	int32_t dPitch;
+	int32_t dPressure;
+	int32_t dTimbre;
+};
+
+static inline float
+_sqew(float val, float exponent)
+{
+	if(exponent == 0.f)
+		return val;
+
+	return powf(val, expf(exponent));
+}
+
+static inline void
+_sqew_apply(const sqew_state_t *sqew, xpress_state_t *state)
+{
+	state->pitch = _sqew(state->pitch, sqew->pitch);
+	state->pressure = _sqew(state->pressure, sqew->pressure);
+	state->timbre = _sqew(state->timbre, sqew->timbre);
+	state->dPitch = _sqew(state->dPitch, sqew->dPitch);
+	state->dPressure = _sqew(state->dPressure, sqew->dPressure);
+	state->dTimbre = _sqew(state->dTimbre, sqew->dTimbre);
+}
+
+static inline void
+_discreto_apply(const discreto_state_t *discreto, xpress_state_t *state)
+{
+	float x = state->pitch * 0x7f;
+
+	switch(discreto->position_order)
+	{
+		case 0:
+		{
+			x = floor(x + 0.5f);
+			break;
+		}
+
+		case 1:
+		{
+			// do nothing, e.g. (x = x)
+			return;
+		}
+
+		default:
+		{
+			const float v_abs = fabsf(state->dPitch);
+			const float v2 = v_abs >= 1.f
+				? 0.f
+				: 1.f - v_abs;
+			float k2;
+			switch(discreto->velocity_order)
+			{
+				case 0:
+					k2 = discreto->position_order;
+					break;
+				case 1:
+					k2 = 1.f + (discreto->position_order - 1.f) * v2;
+					break;
+				default:
+					k2 = 1.f + (discreto->position_order - 1.f) * powf(v2, discreto->velocity_order);
+					break;
+			}
+			const float ex = exp2f( (k2 - 1.f) / k2);
+
+			const float ro = floor(x + 0.5f);
+			float rel = x - ro;
+			const float sign = rel < 0.f ? -1.f : 1.f;
+			rel = powf(fabsf(rel)* ex, k2) * sign;
+			x = ro + rel;
+			break;
+		}
+	}
+
+	state->pitch = x / 0x7f;
+}
+
+static inline float
+_clip(float min, float val, float max)
+{
+	if(val < min)
+		return min;
+	else if(val > max)
+		return max;
+	return val;
+}
+
+static inline float
+_op(int32_t op, float dst, float val)
+{
+	switch((modulator_op_t)op)
+	{
+		case OP_ADD:
+			return dst + val;
+		case OP_SUB:
+			return dst - val;
+		case OP_MUL:
+			return dst * val;
+		case OP_DIV:
+			return (val == 0.f) ? 0.f : dst / val;
+		case OP_POW:
+			return powf(dst, val);
+		case OP_SET:
+			return val;
+	}
+
+	return 0.f;
+}
+
+// modulate one dimension of state by one dimension of modu
+static inline void
+_modulator_apply(const modulator_state_t *mod, const xpress_state_t *modu,
+	xpress_state_t *state)
+{
+	float val = 0.f;
+
+	switch((modulator_enum_t)mod->enum_mod)
+	{
+		case ENUM_PITCH:
+		{
+			val = modu->pitch;
+		}	break;
+		case ENUM_PRESSURE:
+		{
+			val = modu->pressure;
+		}	break;
+		case ENUM_TIMBRE:
+		{
+			val = modu->timbre;
+		}	break;
+		case ENUM_DPITCH:
+		{
+			val = modu->dPitch;
+		}	break;
+		case ENUM_DPRESSURE:
+		{
+			val = modu->dPressure;
+		}	break;
+		case ENUM_DTIMBRE:
+		{
+			val = modu->dTimbre;
+		}	break;
+	}
+
+	val *= mod->multiplier;
+	val += mod->adder;
+
+	switch((modulator_enum_t)mod->enum_src)
+	{
+		case ENUM_PITCH:
+		{
+			state->pitch = _op(mod->op, state->pitch, val);
+			state->pitch = _clip(0.f, state->pitch, 1.f);
+		}	break;
+		case ENUM_PRESSURE:
+		{
+			state->pressure = _op(mod->op, state->pressure, val);
+			state->pressure = _clip(0.f, state->pressure, 1.f);
+		}	break;
+		case ENUM_TIMBRE:
+		{
+			state->timbre = _op(mod->op, state->timbre, val);
+			state->timbre = _clip(0.f, state->timbre, 1.f);
+		}	break;
+		case ENUM_DPITCH:
+		{
+			state->dPitch = _op(mod->op, state->dPitch, val);
+		}	break;
+		case ENUM_DPRESSURE:
+		{
+			state->dPressure = _op(mod->op, state->dPressure, val);
+		}	break;
+		case ENUM_DTIMBRE:
+		{
+			state->dTimbre = _op(mod->op, state->dTimbre, val);
+		}	break;
+	}
+}
+
+// update held state, held dimensions only follow state upwards
+static inline void
+_hold_apply(const hold_state_t *hold, const xpress_state_t *state,
+	xpress_state_t *held)
+{
+	if(!(hold->pitch && (state->pitch < held->pitch) ))
+		held->pitch = state->pitch;
+
+	if(!(hold->pressure && (state->pressure < held->pressure) ))
+		held->pressure = state->pressure;
+
+	if(!(hold->timbre && (state->timbre < held->timbre) ))
+		held->timbre = state->timbre;
+
+	if(!(hold->dPitch && (state->dPitch < held->dPitch) ))
+		held->dPitch = state->dPitch;
+
+	if(!(hold->dPressure && (state->dPressure < held->dPressure) ))
+		held->dPressure = state->dPressure;
+
+	if(!(hold->dTimbre && (state->dTimbre < held->dTimbre) ))
+		held->dTimbre = state->dTimbre;
+}
+
+// performance counter uris, published read-only by all plugins while enabled
+#define ESPRESSIVO_PERF_ENABLE_URI			ESPRESSIVO_URI"#perf_enable"
+#define ESPRESSIVO_PERF_EVENTS_IN_URI		ESPRESSIVO_URI"#perf_eventsIn"
+#define ESPRESSIVO_PERF_EVENTS_OUT_URI	ESPRESSIVO_URI"#perf_eventsOut"
+#define ESPRESSIVO_PERF_TOKENS_URI			ESPRESSIVO_URI"#perf_tokens"
+#define ESPRESSIVO_PERF_ALIVES_URI			ESPRESSIVO_URI"#perf_alives"
+#define ESPRESSIVO_PERF_OVERFLOWS_URI		ESPRESSIVO_URI"#perf_overflows"
+#define ESPRESSIVO_PERF_PEAK_VOICES_URI	ESPRESSIVO_URI"#perf_peakVoices"
+#define ESPRESSIVO_PERF_WORST_RUN_URI		ESPRESSIVO_URI"#perf_worstRunTime"
+
+#define PERF_NCOUNTERS 7
+#define PERF_NPROPS (PERF_NCOUNTERS + 1)
+#define PERF_PROP_SIZE 128 // upper bound of a forged patch:Set of a counter
+
+typedef struct _perf_state_t perf_state_t;
+typedef struct _perf_t perf_t;
+
+// published counters, part of plugstate_t
+struct _perf_state_t {
+	int32_t events_in; // per second
+	int32_t events_out; // per second
+	int32_t tokens; // per second
+	int32_t alives; // per second
+	int32_t overflows; // per second
+	int32_t peak_voices; // since last publication
+	int64_t worst_run; // in ns since last publication
+	int32_t enable; // writable, off by default
+};
+
+// accumulated counters, part of plughandle_t
+struct _perf_t {
+	LV2_URID urids [PERF_NCOUNTERS];
+	bool enabled; // counters are being collected
+	uint32_t period; // publish every second
+	uint32_t counter;
+	struct timespec t0;
+	perf_state_t acc;
+};
+
+#define PERF_DEF(STATE, MEMBER, URI, TYPE) \
+	{ \
+		.access = LV2_PATCH__readable, \
+		.property = (URI), \
+		.offset = offsetof(STATE, MEMBER), \
+		.type = (TYPE) \
+	}
+
+#define PERF_DEFS(STATE, PERF) \
+	PERF_DEF(STATE, PERF.events_in, ESPRESSIVO_PERF_EVENTS_IN_URI, LV2_ATOM__Int), \
+	PERF_DEF(STATE, PERF.events_out, ESPRESSIVO_PERF_EVENTS_OUT_URI, LV2_ATOM__Int), \
+	PERF_DEF(STATE, PERF.tokens, ESPRESSIVO_PERF_TOKENS_URI, LV2_ATOM__Int), \
+	PERF_DEF(STATE, PERF.alives, ESPRESSIVO_PERF_ALIVES_URI, LV2_ATOM__Int), \
+	PERF_DEF(STATE, PERF.overflows, ESPRESSIVO_PERF_OVERFLOWS_URI, LV2_ATOM__Int), \
+	PERF_DEF(STATE, PERF.peak_voices, ESPRESSIVO_PERF_PEAK_VOICES_URI, LV2_ATOM__Int), \
+	PERF_DEF(STATE, PERF.worst_run, ESPRESSIVO_PERF_WORST_RUN_URI, LV2_ATOM__Long), \
+	{ \
+		.property = ESPRESSIVO_PERF_ENABLE_URI, \
+		.offset = offsetof(STATE, PERF.enable), \
+		.type = LV2_ATOM__Bool \
+	}
+
+// to be called after props_init
+static inline void
+_perf_init(perf_t *perf, props_t *props, double rate)
+{
+	static const char *uris [PERF_NCOUNTERS] = {
+		ESPRESSIVO_PERF_EVENTS_IN_URI,
+		ESPRESSIVO_PERF_EVENTS_OUT_URI,
+		ESPRESSIVO_PERF_TOKENS_URI,
+		ESPRESSIVO_PERF_ALIVES_URI,
+		ESPRESSIVO_PERF_OVERFLOWS_URI,
+		ESPRESSIVO_PERF_PEAK_VOICES_URI,
+		ESPRESSIVO_PERF_WORST_RUN_URI
+	};
+
+	for(unsigned i = 0; i < PERF_NCOUNTERS; i++)
+		perf->urids[i] = props_map(props, uris[i]);
+
+	perf->enabled = false;
+	perf->period = rate;
+	perf->counter = 0;
+	memset(&perf->acc, 0x0, sizeof(perf_state_t));
+}
+
+static inline int64_t
+_perf_ns(const struct timespec *ts)
+{
+	return ts->tv_sec*INT64_C(1000000000) + ts->tv_nsec;
+}
+
+// to be called at the beginning of run
+static inline void
+_perf_begin(perf_t *perf)
+{
+	if(perf->enabled)
+		clock_gettime(CLOCK_MONOTONIC, &perf->t0);
+}
+
+// to be called at the end of run, before the output sequence is closed
+static inline void
+_perf_end(perf_t *perf, perf_state_t *state, props_t *props,
+	LV2_Atom_Forge *forge, uint32_t nsamples, const LV2_Atom_Sequence *seq_in,
+	const LV2_Atom_Sequence *seq_out, xpress_t *xpress, LV2_Atom_Forge_Ref *ref)
+{
+	perf_state_t *acc = &perf->acc;
+
+	// collect nothing while disabled, start afresh once enabled
+	if(!state->enable || !perf->enabled)
+	{
+		xpress->ntokens = 0;
+		xpress->nalives = 0;
+
+		if(perf->enabled || state->enable)
+		{
+			perf->enabled = state->enable;
+			perf->counter = 0;
+			memset(acc, 0x0, sizeof(perf_state_t));
+		}
+
+		return;
+	}
+
+	LV2_ATOM_SEQUENCE_FOREACH(seq_in, ev)
+		acc->events_in++;
+	LV2_ATOM_SEQUENCE_FOREACH(seq_out, ev)
+		acc->events_out++;
+
+	acc->tokens += xpress->ntokens;
+	acc->alives += xpress->nalives;
+	xpress->ntokens = 0;
+	xpress->nalives = 0;
+
+	if(!*ref)
+		acc->overflows++;
+	if((int32_t)xpress->nvoices > acc->peak_voices)
+		acc->peak_voices = xpress->nvoices;
+
+	struct timespec t1;
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	const int64_t dt = _perf_ns(&t1) - _perf_ns(&perf->t0);
+	if(dt > acc->worst_run)
+		acc->worst_run = dt;
+
+	perf->counter += nsamples;
+
+	if(perf->counter < perf->period) // update every sec
+		return;
+
+	// postpone rather than overflow and thus drop the events of this cycle
+	if(forge->offset + PERF_NCOUNTERS*PERF_PROP_SIZE > forge->size)
+		return;
+
+	const float scale = (float)perf->period / perf->counter;
+
+	state->events_in = acc->events_in * scale;
+	state->events_out = acc->events_out * scale;
+	state->tokens = acc->tokens * scale;
+	state->alives = acc->alives * scale;
+	state->overflows = acc->overflows * scale;
+	state->peak_voices = acc->peak_voices;
+	state->worst_run = acc->worst_run;
+
+	for(unsigned i = 0; i < PERF_NCOUNTERS; i++)
+		props_set(props, forge, nsamples - 1, perf->urids[i], ref);
+
+	perf->counter = 0;
+	memset(acc, 0x0, sizeof(perf_state_t));
+}
+
+// deadband and rate limit uris, opt-in for plugins forging tokens
+#define ESPRESSIVO_LIMIT_PITCH_URI			ESPRESSIVO_URI"#limit_pitch"
+#define ESPRESSIVO_LIMIT_PRESSURE_URI		ESPRESSIVO_URI"#limit_pressure"
+#define ESPRESSIVO_LIMIT_TIMBRE_URI			ESPRESSIVO_URI"#limit_timbre"
+#define ESPRESSIVO_LIMIT_DPITCH_URI			ESPRESSIVO_URI"#limit_dPitch"
+#define ESPRESSIVO_LIMIT_DPRESSURE_URI	ESPRESSIVO_URI"#limit_dPressure"
+#define ESPRESSIVO_LIMIT_DTIMBRE_URI		ESPRESSIVO_URI"#limit_dTimbre"
+#define ESPRESSIVO_LIMIT_RATE_URI				ESPRESSIVO_URI"#limit_rate"
+
+#define LIMIT_NPROPS 7
+
+typedef struct _limit_state_t limit_state_t;
+
+// part of plugstate_t, all zero disables limiting
+struct _limit_state_t {
+	float pitch; // in cents
+	float pressure;
+	float timbre;
+	float dPitch;
+	float dPressure;
+	float dTimbre;
+	float rate; // maximal tokens per voice per second, 0 for unlimited
+};
+
+#define LIMIT_DEF(STATE, MEMBER, URI, CB) \
+	{ \
+		.property = (URI), \
+		.offset = offsetof(STATE, MEMBER), \
+		.type = LV2_ATOM__Float, \
+		.event_cb = (CB) \
+	}
+
+#define LIMIT_DEFS(STATE, LIMIT, CB) \
+	LIMIT_DEF(STATE, LIMIT.pitch, ESPRESSIVO_LIMIT_PITCH_URI, CB), \
+	LIMIT_DEF(STATE, LIMIT.pressure, ESPRESSIVO_LIMIT_PRESSURE_URI, CB), \
+	LIMIT_DEF(STATE, LIMIT.timbre, ESPRESSIVO_LIMIT_TIMBRE_URI, CB), \
+	LIMIT_DEF(STATE, LIMIT.dPitch, ESPRESSIVO_LIMIT_DPITCH_URI, CB), \
+	LIMIT_DEF(STATE, LIMIT.dPressure, ESPRESSIVO_LIMIT_DPRESSURE_URI, CB), \
+	LIMIT_DEF(STATE, LIMIT.dTimbre, ESPRESSIVO_LIMIT_DTIMBRE_URI, CB), \
+	LIMIT_DEF(STATE, LIMIT.rate, ESPRESSIVO_LIMIT_RATE_URI, CB)
+
+// to be called from event callback of LIMIT_DEFS, xpress_flush must be
+// called once per cycle for the final values to be sent on settle
+static inline void
+_limit_apply(xpress_t *xpress, const limit_state_t *state, double rate)
+{
+	const xpress_limit_t limit = {
+		.deadband = {
+			.pitch = state->pitch / 100.f / 0x7f, // pitch is normalized by 0x7f
+			.pressure = state->pressure,
+			.timbre = state->timbre,
+			.dPitch = state->dPitch,
+			.dPressure = state->dPressure,
+			.dTimbre = state->dTimbre
+		},
+		.interval = state->rate > 0.f
+			? rate / state->rate
+			: 0
+	};
+
+	const bool enabled = (state->pitch > 0.f) || (state->pressure > 0.f)
+		|| (state->timbre > 0.f) || (state->dPitch > 0.f)
+		|| (state->dPressure > 0.f) || (state->dTimbre > 0.f)
+		|| (limit.interval > 0);
+
+	xpress_limit(xpress, enabled ? &limit : NULL);
+}
 
 extern const LV2_Descriptor tuio2_in;
 extern const LV2_Descriptor tuio2_out;
@@ -90,6 +705,22 @@ extern const LV2_Descriptor discreto;
 extern const LV2_Descriptor sc_out;
 extern const LV2_Descriptor sqew;
 extern const LV2_Descriptor monitor_out;
+extern const LV2_Descriptor chain;
+extern const LV2_Descriptor bus_out;
+extern const LV2_Descriptor bus_in;
+extern const LV2_Descriptor cv_out;
+extern const LV2_Descriptor cv_in;
+
+// module-wide URID cache, shared by all instances instantiated with the same
+// host map, to be called in instantiate and cleanup, falls back to the host
+// map if the cache cannot be allocated
+// non-rt
+LV2_URID_Map *
+espressivo_map_ref(LV2_URID_Map *host);
+
+// non-rt
+void
+espressivo_map_unref(LV2_URID_Map *map);
 
 static inline float
 _midi2cps(float pitch)
@@ -0,0 +1,1181 @@
+/*
+ * Copyright (c) 2015 Hanspeter Portner (dev@open-music-kontrollers.ch)
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the Artistic License 2.0 as published by
+ * The Perl Foundation.
+ *
+ * This source is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Artistic License 2.0 for more details.
+ *
+ * You should have received a copy of the Artistic License 2.0
+ * along the source as a COPYING file. If not, obtain it from
+ * http://www.perlfoundation.org/artistic_license_2_0.
+ */
+
+// minimal offline host, drives the plugins of the espressivo module with
+// synthetic gesture streams and reports cost per run() call
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <dlfcn.h>
+
+#include <espressivo.h>
+#include <osc.lv2/util.h>
+#include <osc.lv2/forge.h>
+
+#include <lv2/lv2plug.in/ns/ext/options/options.h>
+
+#define MAX_URIDS 0x4000
+#define SEQ_SIZE 0x40000
+#define NWARMUP 16
+#define MAX_NPORTS 32
+#define MAX_BASELINES 64
+
+typedef enum _stream_t stream_t;
+typedef struct _setting_t setting_t;
+typedef struct _baseline_t baseline_t;
+typedef struct _bench_t bench_t;
+
+enum _stream_t {
+	STREAM_XPRESS,
+	STREAM_MIDI,
+	STREAM_MPE,
+	STREAM_TUIO2
+};
+
+// property values to send as patch:Set before measuring, as a real host
+// would have loaded the default state
+struct _setting_t {
+	const char *plugin;
+	const char *property;
+	const char *type;
+	double value;
+};
+
+// median cost per run() of a plugin as recorded by an earlier invocation
+struct _baseline_t {
+	char name [64];
+	double median;
+};
+
+struct _bench_t {
+	unsigned nvoices;
+	unsigned nupdates; // updates per voice per cycle
+	unsigned ncycles;
+	unsigned nsamples;
+	double rate;
+	bool packed;
+	unsigned ninstances; // instances kept alive at once in instantiate mode
+
+	LV2_Atom_Forge forge;
+	LV2_OSC_URID osc_urid;
+	LV2_URID patch_Set;
+	LV2_URID patch_property;
+	LV2_URID patch_value;
+	LV2_URID midi_MidiEvent;
+
+	xpress_t *xpress; // synthetic upstream voices
+	void *targets;
+	xpress_uuid_t *uuids;
+	uint32_t fid;
+
+	float *cv; // scratch buffer shared by all CV ports
+	int64_t *dts; // run times of measured cycles
+
+	double tolerance; // allowed slowdown against baseline [%]
+	baseline_t baselines [MAX_BASELINES];
+	unsigned nbaselines;
+	FILE *record; // baseline file to record to, if none present yet
+	unsigned nregressions;
+
+	union {
+		LV2_Atom_Sequence seq;
+		uint64_t align; // events are 64-bit aligned
+		uint8_t buf [SEQ_SIZE];
+	} in;
+	union {
+		LV2_Atom_Sequence seq;
+		uint64_t align;
+		uint8_t buf [SEQ_SIZE];
+	} out;
+};
+
+static const setting_t settings [] = {
+	{ESPRESSIVO_THROUGH_URI, ESPRESSIVO_URI"#through_zone_mask", LV2_ATOM__Int, 0xff},
+	{ESPRESSIVO_MODULATOR_URI, ESPRESSIVO_URI"#modulator_zone_mask_src", LV2_ATOM__Int, 0x1},
+	{ESPRESSIVO_MODULATOR_URI, ESPRESSIVO_URI"#modulator_zone_mask_mod", LV2_ATOM__Int, 0x2},
+	{ESPRESSIVO_MODULATOR_URI, ESPRESSIVO_URI"#modulator_multiplier", LV2_ATOM__Float, 1.0},
+	{ESPRESSIVO_CHORD_URI, ESPRESSIVO_URI"#chord_offset_2", LV2_ATOM__Float, 4.0},
+	{ESPRESSIVO_CHORD_URI, ESPRESSIVO_URI"#chord_offset_3", LV2_ATOM__Float, 7.0},
+	{ESPRESSIVO_CHORD_URI, ESPRESSIVO_URI"#chord_offset_4", LV2_ATOM__Float, 12.0},
+	{ESPRESSIVO_REDUCTO_URI, ESPRESSIVO_URI"#reducto_position_threshold", LV2_ATOM__Float, 1.0},
+	{ESPRESSIVO_REDUCTO_URI, ESPRESSIVO_URI"#reducto_velocity_threshold", LV2_ATOM__Float, 0.2},
+	{ESPRESSIVO_DISCRETO_URI, ESPRESSIVO_URI"#discreto_position_order", LV2_ATOM__Int, 1},
+	{ESPRESSIVO_SNH_URI, ESPRESSIVO_URI"#snh_hold_dimension_1", LV2_ATOM__Bool, 1},
+	{ESPRESSIVO_TUIO2_IN_URI, ESPRESSIVO_URI"#tuio2_octave", LV2_ATOM__Int, 2},
+	{ESPRESSIVO_TUIO2_IN_URI, ESPRESSIVO_URI"#tuio2_sensorsPerSemitone", LV2_ATOM__Int, 3},
+	{ESPRESSIVO_TUIO2_IN_URI, ESPRESSIVO_URI"#tuio2_filterStiffness", LV2_ATOM__Int, 32},
+	{ESPRESSIVO_MIDI_IN_URI, ESPRESSIVO_URI"#midi_range", LV2_ATOM__Vector, 2.0},
+	{ESPRESSIVO_MIDI_OUT_URI, ESPRESSIVO_URI"#midi_range", LV2_ATOM__Vector, 2.0},
+	{ESPRESSIVO_SC_OUT_URI, ESPRESSIVO_URI"#sc_allocate", LV2_ATOM__Bool, 1},
+	{ESPRESSIVO_SC_OUT_URI, ESPRESSIVO_URI"#sc_gate", LV2_ATOM__Bool, 1},
+	{ESPRESSIVO_CHAIN_URI, ESPRESSIVO_URI"#chain_stage_1", LV2_ATOM__Int, 1}, // sqew
+	{ESPRESSIVO_CHAIN_URI, ESPRESSIVO_URI"#chain_stage_2", LV2_ATOM__Int, 2}, // discreto
+	{ESPRESSIVO_CHAIN_URI, ESPRESSIVO_URI"#chain_stage_3", LV2_ATOM__Int, 3}, // modulator
+	{ESPRESSIVO_CHAIN_URI, ESPRESSIVO_URI"#chain_stage_4", LV2_ATOM__Int, 5}, // through
+	{ESPRESSIVO_CHAIN_URI, ESPRESSIVO_URI"#through_zone_mask", LV2_ATOM__Int, 0xff},
+	{ESPRESSIVO_CHAIN_URI, ESPRESSIVO_URI"#modulator_zone_mask_src", LV2_ATOM__Int, 0x1},
+	{ESPRESSIVO_CHAIN_URI, ESPRESSIVO_URI"#modulator_zone_mask_mod", LV2_ATOM__Int, 0x2},
+	{ESPRESSIVO_CHAIN_URI, ESPRESSIVO_URI"#modulator_multiplier", LV2_ATOM__Float, 1.0},
+	{ESPRESSIVO_CHAIN_URI, ESPRESSIVO_URI"#discreto_position_order", LV2_ATOM__Int, 1},
+	{ESPRESSIVO_CHAIN_URI, ESPRESSIVO_URI"#chord_offset_2", LV2_ATOM__Float, 4.0},
+	{ESPRESSIVO_CHAIN_URI, ESPRESSIVO_URI"#chord_offset_3", LV2_ATOM__Float, 7.0},
+	{ESPRESSIVO_CHAIN_URI, ESPRESSIVO_URI"#chord_offset_4", LV2_ATOM__Float, 12.0},
+	{ESPRESSIVO_CV_OUT_URI, ESPRESSIVO_URI"#cv_out_interpolation", LV2_ATOM__Int, 2}, // smoothstep
+	{ESPRESSIVO_CV_IN_URI, ESPRESSIVO_URI"#cv_in_threshold", LV2_ATOM__Float, 0.5},
+	{ESPRESSIVO_CV_IN_URI, ESPRESSIVO_URI"#cv_in_rate", LV2_ATOM__Float, 200.0},
+	{NULL, NULL, NULL, 0.0}
+};
+
+static char *uris [MAX_URIDS];
+static LV2_URID nuris;
+static uint64_t nmaps; // calls into host map
+
+static LV2_URID
+_map(LV2_URID_Map_Handle instance __attribute__((unused)), const char *uri)
+{
+	nmaps++;
+
+	for(LV2_URID i = 0; i < nuris; i++)
+	{
+		if(!strcmp(uris[i], uri))
+			return i + 1;
+	}
+
+	if(nuris >= MAX_URIDS)
+		return 0;
+
+	uris[nuris] = strdup(uri);
+
+	return ++nuris;
+}
+
+static const char *
+_unmap(LV2_URID_Unmap_Handle instance __attribute__((unused)), LV2_URID urid)
+{
+	if(urid && (urid <= nuris) )
+		return uris[urid - 1];
+
+	return NULL;
+}
+
+static LV2_URID_Map map = {
+	.handle = NULL,
+	.map = _map
+};
+
+static LV2_URID_Unmap unmap = {
+	.handle = NULL,
+	.unmap = _unmap
+};
+
+static xpress_uuid_t counter = 1;
+
+static xpress_uuid_t
+_new_uuid(void *handle __attribute__((unused)),
+	uint32_t flag __attribute__((unused)))
+{
+	return counter++;
+}
+
+static xpress_map_t voice_map = {
+	.handle = NULL,
+	.new_uuid = _new_uuid
+};
+
+static inline int64_t
+_now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec*INT64_C(1000000000) + ts.tv_nsec;
+}
+
+static stream_t
+_stream(const char *uri)
+{
+	if(!strcmp(uri, ESPRESSIVO_MIDI_IN_URI))
+		return STREAM_MIDI;
+	else if(!strcmp(uri, ESPRESSIVO_MPE_IN_URI))
+		return STREAM_MPE;
+	else if(!strcmp(uri, ESPRESSIVO_TUIO2_IN_URI))
+		return STREAM_TUIO2;
+
+	return STREAM_XPRESS;
+}
+
+static LV2_Atom_Forge_Ref
+_midi(bench_t *bench, uint32_t frames, uint8_t a, uint8_t b, uint8_t c)
+{
+	LV2_Atom_Forge *forge = &bench->forge;
+	const uint8_t m [3] = {a, b, c};
+	const uint32_t size = ( (a & 0xf0) == LV2_MIDI_MSG_CHANNEL_PRESSURE) ? 2 : 3;
+
+	LV2_Atom_Forge_Ref ref = lv2_atom_forge_frame_time(forge, frames);
+	if(ref)
+		ref = lv2_atom_forge_atom(forge, size, bench->midi_MidiEvent);
+	if(ref)
+		ref = lv2_atom_forge_write(forge, m, size);
+
+	return ref;
+}
+
+static LV2_Atom_Forge_Ref
+_settings(bench_t *bench, const char *plugin)
+{
+	LV2_Atom_Forge *forge = &bench->forge;
+	LV2_Atom_Forge_Ref ref = 1;
+
+	for(const setting_t *setting = settings; setting->plugin; setting++)
+	{
+		if(strcmp(setting->plugin, plugin))
+			continue;
+
+		const LV2_URID type = map.map(map.handle, setting->type);
+		LV2_Atom_Forge_Frame frame;
+
+		if(ref)
+			ref = lv2_atom_forge_frame_time(forge, 0);
+		if(ref)
+			ref = lv2_atom_forge_object(forge, &frame, 0, bench->patch_Set);
+		if(ref)
+			ref = lv2_atom_forge_key(forge, bench->patch_property);
+		if(ref)
+			ref = lv2_atom_forge_urid(forge, map.map(map.handle, setting->property));
+		if(ref)
+			ref = lv2_atom_forge_key(forge, bench->patch_value);
+		if(ref)
+		{
+			if(type == forge->Int)
+				ref = lv2_atom_forge_int(forge, setting->value);
+			else if(type == forge->Bool)
+				ref = lv2_atom_forge_bool(forge, setting->value);
+			else if(type == forge->Vector) // same float for all MIDI channels
+			{
+				float elems [0x10];
+
+				for(unsigned i = 0; i < 0x10; i++)
+					elems[i] = setting->value;
+
+				ref = lv2_atom_forge_vector(forge, sizeof(float), forge->Float,
+					0x10, elems);
+			}
+			else
+				ref = lv2_atom_forge_float(forge, setting->value);
+		}
+		if(ref)
+			lv2_atom_forge_pop(forge, &frame);
+	}
+
+	return ref;
+}
+
+// one voice per note on a single channel, driven by polyphonic aftertouch
+static LV2_Atom_Forge_Ref
+_cycle_midi(bench_t *bench, unsigned cycle, LV2_Atom_Forge_Ref ref)
+{
+	const unsigned nvoices = bench->nvoices < 0x60 ? bench->nvoices : 0x60;
+
+	for(unsigned v = 0; v < nvoices; v++)
+	{
+		const uint8_t note = 0x10 + v;
+
+		// retrigger one voice per cycle
+		if( (cycle == 0) || (v == cycle % nvoices) )
+		{
+			if(ref && cycle)
+				ref = _midi(bench, 0, LV2_MIDI_MSG_NOTE_OFF, note, 0x0);
+			if(ref)
+				ref = _midi(bench, 0, LV2_MIDI_MSG_NOTE_ON, note, 0x7f);
+		}
+	}
+
+	for(unsigned u = 0; u < bench->nupdates; u++)
+	{
+		const uint32_t frames = u * bench->nsamples / bench->nupdates;
+
+		for(unsigned v = 0; v < nvoices; v++)
+		{
+			if(ref)
+				ref = _midi(bench, frames, LV2_MIDI_MSG_NOTE_PRESSURE, 0x10 + v,
+					(cycle + u + v) & 0x7f);
+		}
+	}
+
+	return ref;
+}
+
+// one voice per member channel of a single lower zone
+static LV2_Atom_Forge_Ref
+_cycle_mpe(bench_t *bench, unsigned cycle, LV2_Atom_Forge_Ref ref)
+{
+	const unsigned nvoices = bench->nvoices < 0xf ? bench->nvoices : 0xf;
+
+	for(unsigned v = 0; v < nvoices; v++)
+	{
+		const uint8_t chan = 1 + v;
+		const uint8_t note = 0x30 + v;
+
+		if( (cycle == 0) || (v == cycle % nvoices) )
+		{
+			if(ref && cycle)
+				ref = _midi(bench, 0, LV2_MIDI_MSG_NOTE_OFF | chan, note, 0x0);
+			if(ref)
+				ref = _midi(bench, 0, LV2_MIDI_MSG_NOTE_ON | chan, note, 0x7f);
+		}
+	}
+
+	for(unsigned u = 0; u < bench->nupdates; u++)
+	{
+		const uint32_t frames = u * bench->nsamples / bench->nupdates;
+
+		for(unsigned v = 0; v < nvoices; v++)
+		{
+			const uint8_t chan = 1 + v;
+			const uint8_t val = (cycle + u + v) & 0x7f;
+
+			if(ref)
+				ref = _midi(bench, frames, LV2_MIDI_MSG_BENDER | chan, 0x0, val);
+			if(ref)
+				ref = _midi(bench, frames, LV2_MIDI_MSG_CHANNEL_PRESSURE | chan, val, 0x0);
+			if(ref)
+				ref = _midi(bench, frames, LV2_MIDI_MSG_CONTROLLER | chan, 74, val);
+		}
+	}
+
+	return ref;
+}
+
+// one TUIO2 frame bundle per update
+static LV2_Atom_Forge_Ref
+_cycle_tuio2(bench_t *bench, unsigned cycle, LV2_Atom_Forge_Ref ref)
+{
+	LV2_Atom_Forge *forge = &bench->forge;
+	LV2_OSC_URID *osc_urid = &bench->osc_urid;
+	const unsigned width = 160;
+
+	for(unsigned u = 0; u < bench->nupdates; u++)
+	{
+		const uint32_t frames = u * bench->nsamples / bench->nupdates;
+		LV2_Atom_Forge_Frame bndl [2];
+		LV2_Atom_Forge_Frame msg [2];
+		LV2_OSC_Timetag stamp;
+
+		lv2_osc_timetag_create(&stamp, LV2_OSC_IMMEDIATE + bench->fid);
+
+		if(ref)
+			ref = lv2_atom_forge_frame_time(forge, frames);
+		if(ref)
+			ref = lv2_osc_forge_bundle_head(forge, osc_urid, bndl, &stamp);
+		if(ref)
+			ref = lv2_osc_forge_message_vararg(forge, osc_urid, "/tuio2/frm", "itis",
+				++bench->fid, stamp.integral, stamp.fraction, (width << 16) | 1, "bench");
+
+		// sids are retired and replaced one at a time
+		for(unsigned v = 0; v < bench->nvoices; v++)
+		{
+			const int32_t sid = v + 1 + (v == cycle % bench->nvoices ? cycle : 0)*bench->nvoices;
+			const float x = (float)(v % width) / width;
+			const float z = (float)((cycle + u + v) & 0xff) / 0xff;
+
+			if(ref)
+				ref = lv2_osc_forge_message_vararg(forge, osc_urid, "/tuio2/tok", "iiifff",
+					sid, 0, 0, x, z, 0.f);
+		}
+
+		if(ref)
+			ref = lv2_osc_forge_message_head(forge, osc_urid, msg, "/tuio2/alv");
+		for(unsigned v = 0; v < bench->nvoices; v++)
+		{
+			const int32_t sid = v + 1 + (v == cycle % bench->nvoices ? cycle : 0)*bench->nvoices;
+
+			if(ref)
+				ref = lv2_osc_forge_int(forge, osc_urid, sid);
+		}
+		if(ref)
+			lv2_osc_forge_pop(forge, msg);
+
+		if(ref)
+			lv2_osc_forge_pop(forge, bndl);
+	}
+
+	return ref;
+}
+
+// tokens of upstream voices followed by the per-cycle alive heartbeat
+static LV2_Atom_Forge_Ref
+_cycle_xpress(bench_t *bench, unsigned cycle, LV2_Atom_Forge_Ref ref)
+{
+	LV2_Atom_Forge *forge = &bench->forge;
+	xpress_t *xpress = bench->xpress;
+
+	if(cycle == 0)
+	{
+		for(unsigned v = 0; v < bench->nvoices; v++)
+			xpress_create(xpress, &bench->uuids[v]);
+	}
+	else
+	{
+		// retire and replace one voice per cycle
+		const unsigned v = cycle % bench->nvoices;
+
+		xpress_free(xpress, bench->uuids[v]);
+		xpress_create(xpress, &bench->uuids[v]);
+	}
+
+	for(unsigned u = 0; u < bench->nupdates; u++)
+	{
+		const uint32_t frames = u * bench->nsamples / bench->nupdates;
+
+		for(unsigned v = 0; v < bench->nvoices; v++)
+		{
+			const xpress_state_t state = {
+				.zone = v % 2,
+				.pitch = (float)(0x30 + v % 0x30) / 0x7f,
+				.pressure = (float)((cycle + u + v) & 0xff) / 0xff,
+				.timbre = 0.5f
+			};
+
+			if(ref)
+				ref = xpress_token(xpress, forge, frames, bench->uuids[v], &state);
+		}
+	}
+
+	if(ref)
+		ref = xpress_alive(xpress, forge, bench->nsamples - 1);
+
+	return ref;
+}
+
+static void
+_cycle(bench_t *bench, stream_t stream, unsigned cycle)
+{
+	LV2_Atom_Forge *forge = &bench->forge;
+	LV2_Atom_Forge_Frame frame;
+
+	lv2_atom_forge_set_buffer(forge, bench->in.buf, SEQ_SIZE);
+	LV2_Atom_Forge_Ref ref = lv2_atom_forge_sequence_head(forge, &frame, 0);
+
+	switch(stream)
+	{
+		case STREAM_MIDI:
+			ref = _cycle_midi(bench, cycle, ref);
+			break;
+		case STREAM_MPE:
+			ref = _cycle_mpe(bench, cycle, ref);
+			break;
+		case STREAM_TUIO2:
+			ref = _cycle_tuio2(bench, cycle, ref);
+			break;
+		case STREAM_XPRESS:
+			ref = _cycle_xpress(bench, cycle, ref);
+			break;
+	}
+
+	if(ref)
+		lv2_atom_forge_pop(forge, &frame);
+	else
+		fprintf(stderr, "input sequence overflow, reduce voices or updates\n");
+}
+
+static unsigned
+_nevents(const LV2_Atom_Sequence *seq)
+{
+	unsigned n = 0;
+
+	LV2_ATOM_SEQUENCE_FOREACH(seq, ev)
+		n++;
+
+	return n;
+}
+
+static inline void
+_reset(LV2_Atom_Sequence *seq)
+{
+	seq->atom.type = 0;
+	seq->atom.size = SEQ_SIZE - sizeof(LV2_Atom);
+}
+
+static LV2_Handle
+_instantiate(bench_t *bench, const LV2_Descriptor *desc,
+	const LV2_Feature *const *features, LV2_Atom_Sequence *in, LV2_Atom_Sequence *out)
+{
+	LV2_Handle instance = desc->instantiate(desc, bench->rate, "/tmp", features);
+	if(!instance)
+	{
+		fprintf(stderr, "failed to instantiate <%s>\n", desc->URI);
+		return NULL;
+	}
+
+	desc->connect_port(instance, 0, in);
+	desc->connect_port(instance, 1, out);
+	for(uint32_t port = 2; port < MAX_NPORTS; port++)
+		desc->connect_port(instance, port, bench->cv);
+	if(desc->activate)
+		desc->activate(instance);
+
+	// setup run with settings only
+	LV2_Atom_Forge *forge = &bench->forge;
+	LV2_Atom_Forge_Frame frame;
+
+	lv2_atom_forge_set_buffer(forge, (uint8_t *)in, SEQ_SIZE);
+	LV2_Atom_Forge_Ref ref = lv2_atom_forge_sequence_head(forge, &frame, 0);
+	if(ref)
+		ref = _settings(bench, desc->URI);
+	if(ref)
+		lv2_atom_forge_pop(forge, &frame);
+
+	_reset(out);
+	desc->run(instance, bench->nsamples);
+
+	return instance;
+}
+
+static void
+_cleanup(const LV2_Descriptor *desc, LV2_Handle instance)
+{
+	if(desc->deactivate)
+		desc->deactivate(instance);
+	desc->cleanup(instance);
+}
+
+static int
+_source_init(bench_t *bench)
+{
+	static const xpress_iface_t iface = {
+		.size = sizeof(uint64_t)
+	};
+
+	bench->xpress = calloc(1, XPRESS_SIZE(bench->nvoices));
+	bench->targets = calloc(bench->nvoices, sizeof(uint64_t));
+	bench->uuids = calloc(bench->nvoices, sizeof(xpress_uuid_t));
+	bench->fid = 0;
+	if(!bench->xpress || !bench->targets || !bench->uuids)
+		return -1;
+
+	xpress_init(bench->xpress, bench->nvoices, &map, &voice_map,
+		XPRESS_EVENT_NONE, &iface, bench->targets, NULL);
+	xpress_packed(bench->xpress, bench->packed);
+
+	return 0;
+}
+
+static void
+_source_deinit(bench_t *bench)
+{
+	if(bench->xpress)
+		xpress_deinit(bench->xpress);
+	free(bench->uuids);
+	free(bench->targets);
+	free(bench->xpress);
+}
+
+static int
+_cmp_dt(const void *a, const void *b)
+{
+	const int64_t *A = a;
+	const int64_t *B = b;
+
+	return (*A > *B) - (*A < *B);
+}
+
+// median is robust against outliers caused by scheduling, unlike the mean
+static double
+_median(int64_t *dts, unsigned n)
+{
+	qsort(dts, n, sizeof(int64_t), _cmp_dt);
+
+	return (n % 2)
+		? dts[n / 2]
+		: (dts[n / 2 - 1] + dts[n / 2]) * 0.5;
+}
+
+static int
+_baseline_load(bench_t *bench, const char *path)
+{
+	FILE *f = fopen(path, "r");
+	if(!f)
+		return -1;
+
+	baseline_t *baseline = bench->baselines;
+	while( (bench->nbaselines < MAX_BASELINES)
+		&& (fscanf(f, "%63s %lf", baseline->name, &baseline->median) == 2) )
+	{
+		bench->nbaselines++;
+		baseline++;
+	}
+
+	fclose(f);
+
+	return 0;
+}
+
+// record the median when creating a baseline, compare against it otherwise
+static void
+_baseline_check(bench_t *bench, const char *name, double median)
+{
+	if(bench->record)
+	{
+		fprintf(bench->record, "%s %.1f\n", name, median);
+		return;
+	}
+
+	for(unsigned i = 0; i < bench->nbaselines; i++)
+	{
+		const baseline_t *baseline = &bench->baselines[i];
+
+		if(strcmp(baseline->name, name))
+			continue;
+
+		const double limit = baseline->median * (1.0 + bench->tolerance / 100.0);
+		if(median > limit)
+		{
+			fprintf(stderr, "%s: regression, %.1f ns/run exceeds baseline %.1f ns/run by %.1f%%\n",
+				name, median, baseline->median,
+				100.0 * (median - baseline->median) / baseline->median);
+			bench->nregressions++;
+		}
+
+		return;
+	}
+}
+
+static int
+_bench(bench_t *bench, const LV2_Descriptor *desc, const LV2_Feature *const *features)
+{
+	const stream_t stream = _stream(desc->URI);
+
+	LV2_Handle instance = _instantiate(bench, desc, features,
+		&bench->in.seq, &bench->out.seq);
+	if(!instance)
+		return -1;
+
+	if(_source_init(bench))
+	{
+		_source_deinit(bench);
+		_cleanup(desc, instance);
+		return -1;
+	}
+
+	int64_t sum = 0;
+	int64_t worst = 0;
+	uint64_t nin = 0;
+	uint64_t nout = 0;
+	uint64_t bytes = 0;
+
+	for(unsigned c = 0; c < NWARMUP + bench->ncycles; c++)
+	{
+		_cycle(bench, stream, c);
+		_reset(&bench->out.seq);
+
+		const int64_t t0 = _now();
+		desc->run(instance, bench->nsamples);
+		const int64_t dt = _now() - t0;
+
+		if(c < NWARMUP)
+			continue;
+
+		sum += dt;
+		if(dt > worst)
+			worst = dt;
+		bench->dts[c - NWARMUP] = dt;
+		nin += _nevents(&bench->in.seq);
+		nout += _nevents(&bench->out.seq);
+		bytes += bench->out.seq.atom.size;
+	}
+
+	const char *name = strrchr(desc->URI, '#');
+	const double median = _median(bench->dts, bench->ncycles);
+	printf("%-12s %10.1f %10.1f %10.1f %12.0f %12.0f %12.1f\n",
+		name ? name + 1 : desc->URI,
+		(double)sum / bench->ncycles,
+		median,
+		(double)worst,
+		sum ? nin * 1e9 / sum : 0.0,
+		sum ? nout * 1e9 / sum : 0.0,
+		(double)bytes / bench->ncycles);
+
+	_baseline_check(bench, name ? name + 1 : desc->URI, median);
+
+	_cleanup(desc, instance);
+	_source_deinit(bench);
+
+	return 0;
+}
+
+// instantiate a number of instances kept alive at once, as a host reloading
+// a session would, and report the cost of the first and following instances
+static int
+_bench_instantiate(bench_t *bench, const LV2_Descriptor *desc,
+	const LV2_Feature *const *features)
+{
+	LV2_Handle *instances = calloc(bench->ninstances, sizeof(LV2_Handle));
+	int64_t *dts = calloc(bench->ninstances, sizeof(int64_t));
+	if(!instances || !dts)
+	{
+		free(instances);
+		free(dts);
+		return -1;
+	}
+
+	int status = 0;
+	uint64_t maps_first = 0;
+	uint64_t maps = 0;
+
+	for(unsigned i = 0; i < bench->ninstances; i++)
+	{
+		const uint64_t nmaps0 = nmaps;
+		const int64_t t0 = _now();
+		instances[i] = desc->instantiate(desc, bench->rate, "/tmp", features);
+		dts[i] = _now() - t0;
+
+		if(!instances[i])
+		{
+			fprintf(stderr, "failed to instantiate <%s>\n", desc->URI);
+			status = -1;
+			break;
+		}
+
+		if(i == 0)
+			maps_first = nmaps - nmaps0;
+		else
+			maps += nmaps - nmaps0;
+	}
+
+	if(status == 0)
+	{
+		const char *name = strrchr(desc->URI, '#');
+		const unsigned n = bench->ninstances - 1;
+
+		printf("%-12s %12.1f %12.1f %12.1f %12.1f\n",
+			name ? name + 1 : desc->URI,
+			(double)dts[0],
+			n ? _median(&dts[1], n) : 0.0,
+			(double)maps_first,
+			n ? (double)maps / n : 0.0);
+	}
+
+	for(unsigned i = 0; i < bench->ninstances; i++)
+	{
+		if(instances[i])
+			desc->cleanup(instances[i]);
+	}
+
+	free(instances);
+	free(dts);
+
+	return status;
+}
+
+static const LV2_Descriptor *
+_descriptor(LV2_Descriptor_Function lv2_descriptor, const char *uri)
+{
+	const LV2_Descriptor *desc;
+
+	for(uint32_t i = 0; (desc = lv2_descriptor(i)); i++)
+	{
+		if(!strcmp(desc->URI, uri))
+			return desc;
+	}
+
+	return NULL;
+}
+
+// run the same xpress stream through separate filter instances, passing
+// serialized tokens from stage to stage, and through a single fused chain
+static int
+_bench_chain(bench_t *bench, LV2_Descriptor_Function lv2_descriptor,
+	const LV2_Feature *const *features)
+{
+	static const char *uris [] = {
+		ESPRESSIVO_SQEW_URI,
+		ESPRESSIVO_DISCRETO_URI,
+		ESPRESSIVO_MODULATOR_URI,
+		ESPRESSIVO_THROUGH_URI
+	};
+	const unsigned nstages = sizeof(uris) / sizeof(*uris);
+	const LV2_Descriptor *descs [nstages];
+	LV2_Handle instances [nstages];
+	LV2_Atom_Sequence *seqs [nstages];
+	int64_t sums [nstages];
+	uint64_t bytes [nstages];
+	int status = 0;
+
+	for(unsigned s = 0; s < nstages; s++)
+	{
+		descs[s] = _descriptor(lv2_descriptor, uris[s]);
+		seqs[s] = calloc(1, SEQ_SIZE);
+		instances[s] = NULL;
+		sums[s] = 0;
+		bytes[s] = 0;
+
+		if(!descs[s] || !seqs[s])
+			status = -1;
+		else
+			instances[s] = _instantiate(bench, descs[s], features,
+				s ? seqs[s - 1] : &bench->in.seq, seqs[s]);
+
+		if(!instances[s])
+			status = -1;
+	}
+
+	if(!status && !_source_init(bench))
+	{
+		for(unsigned c = 0; c < NWARMUP + bench->ncycles; c++)
+		{
+			_cycle(bench, STREAM_XPRESS, c);
+
+			for(unsigned s = 0; s < nstages; s++)
+			{
+				_reset(seqs[s]);
+
+				const int64_t t0 = _now();
+				descs[s]->run(instances[s], bench->nsamples);
+				const int64_t dt = _now() - t0;
+
+				if(c < NWARMUP)
+					continue;
+
+				sums[s] += dt;
+				bytes[s] += seqs[s]->atom.size;
+			}
+		}
+	}
+	else
+	{
+		status = -1;
+	}
+	_source_deinit(bench);
+
+	int64_t sum = 0;
+	for(unsigned s = 0; (s < nstages) && !status; s++)
+	{
+		printf("%-12s %10.1f %12.1f\n", strrchr(uris[s], '#') + 1,
+			(double)sums[s] / bench->ncycles, (double)bytes[s] / bench->ncycles);
+		sum += sums[s];
+	}
+
+	for(unsigned s = 0; s < nstages; s++)
+	{
+		if(instances[s])
+			_cleanup(descs[s], instances[s]);
+		free(seqs[s]);
+	}
+
+	if(status)
+		return status;
+
+	printf("%-12s %10.1f\n", "# separate", (double)sum / bench->ncycles);
+
+	const LV2_Descriptor *desc = _descriptor(lv2_descriptor, ESPRESSIVO_CHAIN_URI);
+	LV2_Handle instance = desc
+		? _instantiate(bench, desc, features, &bench->in.seq, &bench->out.seq)
+		: NULL;
+	if(!instance || _source_init(bench))
+	{
+		_source_deinit(bench);
+		if(instance)
+			_cleanup(desc, instance);
+		return -1;
+	}
+
+	int64_t fused = 0;
+	uint64_t fused_bytes = 0;
+	for(unsigned c = 0; c < NWARMUP + bench->ncycles; c++)
+	{
+		_cycle(bench, STREAM_XPRESS, c);
+		_reset(&bench->out.seq);
+
+		const int64_t t0 = _now();
+		desc->run(instance, bench->nsamples);
+		const int64_t dt = _now() - t0;
+
+		if(c < NWARMUP)
+			continue;
+
+		fused += dt;
+		fused_bytes += bench->out.seq.atom.size;
+	}
+
+	_cleanup(desc, instance);
+	_source_deinit(bench);
+
+	printf("%-12s %10.1f %12.1f\n", "# chain",
+		(double)fused / bench->ncycles, (double)fused_bytes / bench->ncycles);
+	printf("%-12s %10.1f %11.1f%%\n", "# saved",
+		(double)(sum - fused) / bench->ncycles,
+		sum ? 100.0 * (sum - fused) / sum : 0.0);
+
+	return 0;
+}
+
+static void
+_usage(const char *argv0)
+{
+	fprintf(stderr,
+		"usage: %s [OPTIONS] MODULE [PLUGIN ...]\n"
+		"\n"
+		"OPTIONS\n"
+		"  [-v] NVOICES  number of concurrent voices (16)\n"
+		"  [-u] NUPDATES updates per voice per cycle (1)\n"
+		"  [-c] NCYCLES  number of measured cycles (10000)\n"
+		"  [-n] NSAMPLES samples per cycle (64)\n"
+		"  [-r] RATE     sample rate (48000)\n"
+		"  [-p]          send xpress#Packed tokens\n"
+		"  [-C]          compare separate filters against the fused chain\n"
+		"  [-I] NINST    measure instantiate with NINST instances alive at once\n"
+		"  [-b] FILE     record median ns/run to baseline FILE and exit with 77,\n"
+		"                or compare against it if present\n"
+		"  [-t] PERCENT  tolerated slowdown against baseline (25)\n"
+		"  [-h]          print usage information\n"
+		"\n"
+		"PLUGIN is the URI fragment, e.g. through, all plugins if none given\n",
+		argv0);
+}
+
+int
+main(int argc, char **argv)
+{
+	static bench_t bench = {
+		.nvoices = 16,
+		.nupdates = 1,
+		.ncycles = 10000,
+		.nsamples = 64,
+		.rate = 48000.0,
+		.packed = false,
+		.tolerance = 25.0
+	};
+	bool compare = false;
+	const char *baseline = NULL;
+
+	int c;
+	while( (c = getopt(argc, argv, "v:u:c:n:r:pCI:b:t:h")) != -1)
+	{
+		switch(c)
+		{
+			case 'v':
+				bench.nvoices = atoi(optarg);
+				break;
+			case 'u':
+				bench.nupdates = atoi(optarg);
+				break;
+			case 'c':
+				bench.ncycles = atoi(optarg);
+				break;
+			case 'n':
+				bench.nsamples = atoi(optarg);
+				break;
+			case 'r':
+				bench.rate = atof(optarg);
+				break;
+			case 'p':
+				bench.packed = true;
+				break;
+			case 'C':
+				compare = true;
+				break;
+			case 'I':
+				bench.ninstances = atoi(optarg);
+				break;
+			case 'b':
+				baseline = optarg;
+				break;
+			case 't':
+				bench.tolerance = atof(optarg);
+				break;
+			case 'h':
+			default:
+				_usage(argv[0]);
+				return c == 'h' ? 0 : -1;
+		}
+	}
+
+	if( (optind >= argc) || !bench.nvoices || !bench.nupdates || !bench.ncycles
+		|| !bench.nsamples || (bench.nvoices > MAX_NVOICES_LIMIT) )
+	{
+		_usage(argv[0]);
+		return -1;
+	}
+
+	bench.cv = calloc(bench.nsamples, sizeof(float));
+	bench.dts = calloc(bench.ncycles, sizeof(int64_t));
+	if(!bench.cv || !bench.dts)
+	{
+		free(bench.cv);
+		free(bench.dts);
+		return -1;
+	}
+
+	if(baseline && !compare && !bench.ninstances
+		&& _baseline_load(&bench, baseline))
+	{
+		bench.record = fopen(baseline, "w");
+		if(!bench.record)
+		{
+			fprintf(stderr, "failed to create baseline: %s\n", baseline);
+			free(bench.cv);
+			free(bench.dts);
+			return -1;
+		}
+	}
+
+	void *lib = dlopen(argv[optind], RTLD_NOW | RTLD_LOCAL);
+	if(!lib)
+	{
+		fprintf(stderr, "failed to open module: %s\n", dlerror());
+		if(bench.record)
+			fclose(bench.record);
+		free(bench.cv);
+		free(bench.dts);
+		return -1;
+	}
+
+	LV2_Descriptor_Function lv2_descriptor = (LV2_Descriptor_Function)
+		dlsym(lib, "lv2_descriptor");
+	if(!lv2_descriptor)
+	{
+		fprintf(stderr, "module has no lv2_descriptor\n");
+		dlclose(lib);
+		if(bench.record)
+			fclose(bench.record);
+		free(bench.cv);
+		free(bench.dts);
+		return -1;
+	}
+
+	lv2_atom_forge_init(&bench.forge, &map);
+	lv2_osc_urid_init(&bench.osc_urid, &map);
+	bench.patch_Set = map.map(map.handle, LV2_PATCH__Set);
+	bench.patch_property = map.map(map.handle, LV2_PATCH__property);
+	bench.patch_value = map.map(map.handle, LV2_PATCH__value);
+	bench.midi_MidiEvent = map.map(map.handle, LV2_MIDI__MidiEvent);
+
+	const int32_t max_nvoices = bench.nvoices > MAX_NVOICES
+		? bench.nvoices
+		: MAX_NVOICES;
+	const LV2_Options_Option opts [] = {
+		{
+			.key = map.map(map.handle, XPRESS__maxNVoices),
+			.size = sizeof(int32_t),
+			.type = bench.forge.Int,
+			.value = &max_nvoices
+		},
+		{
+			.key = 0,
+			.value = NULL
+		}
+	};
+
+	const LV2_Feature feature_map = {
+		.URI = LV2_URID__map,
+		.data = &map
+	};
+	const LV2_Feature feature_unmap = {
+		.URI = LV2_URID__unmap,
+		.data = &unmap
+	};
+	const LV2_Feature feature_voice_map = {
+		.URI = XPRESS__voiceMap,
+		.data = &voice_map
+	};
+	const LV2_Feature feature_opts = {
+		.URI = LV2_OPTIONS__options,
+		.data = (void *)opts
+	};
+	const LV2_Feature feature_default_state = {
+		.URI = LV2_STATE__loadDefaultState,
+		.data = NULL
+	};
+	const LV2_Feature *const features [] = {
+		&feature_map,
+		&feature_unmap,
+		&feature_voice_map,
+		&feature_opts,
+		&feature_default_state,
+		NULL
+	};
+
+	printf("# %u voices, %u updates/cycle, %u samples/cycle @ %.0f Hz%s\n",
+		bench.nvoices, bench.nupdates, bench.nsamples, bench.rate,
+		bench.packed ? ", packed" : "");
+
+	int status = 0;
+	if(compare)
+	{
+		printf("%-12s %10s %12s\n", "# stage", "[ns/run]", "[bytes/run]");
+
+		status = _bench_chain(&bench, lv2_descriptor, features);
+	}
+	else if(bench.ninstances)
+	{
+		printf("%-12s %12s %12s %12s %12s\n",
+			"# plugin", "[ns/first]", "[ns/inst]", "[maps/first]", "[maps/inst]");
+	}
+	else
+	{
+		printf("%-12s %10s %10s %10s %12s %12s %12s\n",
+			"# plugin", "[ns/run]", "[ns/med]", "[ns/worst]", "[ev_in/s]", "[ev_out/s]", "[bytes/run]");
+	}
+
+	const LV2_Descriptor *desc;
+	for(uint32_t i = 0; !compare && (desc = lv2_descriptor(i)); i++)
+	{
+		const char *name = strrchr(desc->URI, '#');
+		bool selected = optind + 1 >= argc;
+
+		for(int a = optind + 1; a < argc; a++)
+		{
+			if(name && !strcmp(name + 1, argv[a]))
+				selected = true;
+		}
+
+		if(!selected)
+			continue;
+
+		if(bench.ninstances
+			? _bench_instantiate(&bench, desc, features)
+			: _bench(&bench, desc, features))
+		{
+			status = -1;
+		}
+	}
+
+	if(bench.record)
+	{
+		fclose(bench.record);
+		printf("# recorded baseline: %s\n", baseline);
+
+		if(!status)
+			status = 77; // nothing compared, report as skipped
+	}
+	else if(bench.nregressions)
+	{
+		status = -1;
+	}
+
+	dlclose(lib);
+	free(bench.cv);
+	free(bench.dts);
+
+	for(LV2_URID i = 0; i < nuris; i++)
+		free(uris[i]);
+
+	return status;
+}
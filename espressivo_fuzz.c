@@ -0,0 +1,1487 @@
+/*
+ * Copyright (c) 2015 Hanspeter Portner (dev@open-music-kontrollers.ch)
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the Artistic License 2.0 as published by
+ * The Perl Foundation.
+ *
+ * This source is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Artistic License 2.0 for more details.
+ *
+ * You should have received a copy of the Artistic License 2.0
+ * along the source as a COPYING file. If not, obtain it from
+ * http://www.perlfoundation.org/artistic_license_2_0.
+ */
+
+// minimal offline host, drives every plugin of the espressivo module with
+// randomized and partly malformed event streams, checks the output ports
+// for sanity and that no voice outlives its input once the stream has
+// been quiesced, meant to be run under address and undefined sanitizers
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <dlfcn.h>
+#include <math.h>
+
+#include <espressivo.h>
+#include <osc.lv2/util.h>
+#include <osc.lv2/forge.h>
+
+#include <lv2/lv2plug.in/ns/ext/options/options.h>
+
+#define MAX_URIDS 1024
+#define SEQ_SIZE 0x10000
+#define OUT_SIZE 0x2000 // small enough to overflow now and then
+#define CANARY_SIZE 0x100
+#define CANARY 0xa5
+#define MAX_NSAMPLES 256
+#define MAX_NPORTS 32
+#define MAX_NEVENTS 24
+#define MAX_NPROPS 256
+#define FUZZ_NVOICES 16 // voice capacity of the plugins, reached quickly
+#define FUZZ_NSOURCES 3
+#define FUZZ_NUUIDS 24
+#define FUZZ_NSIDS 24
+#define NQUIESCE 4
+
+typedef enum _stream_t stream_t;
+typedef enum _sink_t sink_t;
+typedef struct _fuzz_t fuzz_t;
+
+enum _stream_t {
+	STREAM_XPRESS,
+	STREAM_MIDI,
+	STREAM_MPE,
+	STREAM_TUIO2,
+	STREAM_CV,
+	STREAM_NONE
+};
+
+enum _sink_t {
+	SINK_XPRESS,
+	SINK_MIDI,
+	SINK_CV,
+	SINK_OTHER
+};
+
+struct _fuzz_t {
+	uint64_t rng;
+	unsigned ncycles;
+	unsigned nsessions;
+	bool verbose;
+
+	LV2_Atom_Forge forge;
+	LV2_OSC_URID osc_urid;
+	LV2_URID patch_Set;
+	LV2_URID patch_Get;
+	LV2_URID patch_property;
+	LV2_URID patch_value;
+	LV2_URID patch_sequence;
+	LV2_URID midi_MidiEvent;
+	LV2_URID xpress_Token;
+	LV2_URID xpress_Delta;
+	LV2_URID xpress_Alive;
+	LV2_URID xpress_Release;
+	LV2_URID xpress_Packed;
+	LV2_URID xpress_Batch;
+	LV2_URID xpress_source;
+	LV2_URID xpress_uuid;
+	LV2_URID xpress_zone;
+	LV2_URID xpress_body;
+	LV2_URID xpress_pitch;
+	LV2_URID xpress_pressure;
+	LV2_URID xpress_timbre;
+	LV2_URID snh_sample;
+	LV2_URID cv_in_threshold;
+
+	// synthetic upstream
+	LV2_URID sources [FUZZ_NSOURCES];
+	uint32_t alive [FUZZ_NSOURCES]; // bitmask of uuids kept alive per source
+	uint32_t fid;
+	uint32_t max_fid;
+	bool gates [4];
+
+	// downstream
+	xpress_t *xpress;
+	void *targets;
+	uint8_t notes [0x10][0x80];
+
+	LV2_URID props [MAX_NPROPS];
+	unsigned nprops;
+
+	unsigned nsamples;
+	unsigned nfailures;
+	const char *name;
+	unsigned session;
+	unsigned cycle;
+
+	float cv [MAX_NPORTS][MAX_NSAMPLES];
+	union {
+		LV2_Atom_Sequence seq;
+		uint64_t align; // events are 64-bit aligned
+		uint8_t buf [SEQ_SIZE];
+	} in;
+};
+
+static char *uris [MAX_URIDS];
+static LV2_URID nuris;
+
+static LV2_URID
+_map(LV2_URID_Map_Handle instance __attribute__((unused)), const char *uri)
+{
+	for(LV2_URID i = 0; i < nuris; i++)
+	{
+		if(!strcmp(uris[i], uri))
+			return i + 1;
+	}
+
+	if(nuris >= MAX_URIDS)
+		return 0;
+
+	uris[nuris] = strdup(uri);
+
+	return ++nuris;
+}
+
+static const char *
+_unmap(LV2_URID_Unmap_Handle instance __attribute__((unused)), LV2_URID urid)
+{
+	if(urid && (urid <= nuris) )
+		return uris[urid - 1];
+
+	return NULL;
+}
+
+static LV2_URID_Map map = {
+	.handle = NULL,
+	.map = _map
+};
+
+static LV2_URID_Unmap unmap = {
+	.handle = NULL,
+	.unmap = _unmap
+};
+
+static xpress_uuid_t counter = 1;
+
+static xpress_uuid_t
+_new_uuid(void *handle __attribute__((unused)),
+	uint32_t flag __attribute__((unused)))
+{
+	return counter++;
+}
+
+static xpress_map_t voice_map = {
+	.handle = NULL,
+	.new_uuid = _new_uuid
+};
+
+// xorshift64*, reproducible for a given seed on all platforms
+static inline uint32_t
+_rand(fuzz_t *fuzz)
+{
+	fuzz->rng ^= fuzz->rng >> 12;
+	fuzz->rng ^= fuzz->rng << 25;
+	fuzz->rng ^= fuzz->rng >> 27;
+
+	return (fuzz->rng * UINT64_C(2685821657736338717)) >> 32;
+}
+
+static inline unsigned
+_below(fuzz_t *fuzz, unsigned n)
+{
+	return n ? _rand(fuzz) % n : 0;
+}
+
+static inline bool
+_chance(fuzz_t *fuzz, unsigned percent)
+{
+	return _below(fuzz, 100) < percent;
+}
+
+static inline float
+_unit(fuzz_t *fuzz)
+{
+	return (float)_rand(fuzz) / UINT32_MAX;
+}
+
+// mostly within range, sometimes way beyond or non-finite, the plugins have
+// to cope with the latter even though they are built with -ffast-math
+static float
+_float(fuzz_t *fuzz)
+{
+	static const float extremes [] = {
+		0.f, 1.f, -1.f, 0.5f, 2.f, -0.001f, 127.f, 1e6f, -1e6f, 1e-9f,
+		3e38f, -3e38f
+	};
+	static const float nonfinite [] = {
+		INFINITY, -INFINITY, NAN
+	};
+
+	if(_chance(fuzz, 80))
+		return _unit(fuzz);
+	if(_chance(fuzz, 5))
+		return nonfinite[_below(fuzz, sizeof(nonfinite) / sizeof(*nonfinite))];
+	if(_chance(fuzz, 50))
+		return extremes[_below(fuzz, sizeof(extremes) / sizeof(*extremes))];
+
+	return (_unit(fuzz) - 0.5f) * 8.f;
+}
+
+static int32_t
+_int(fuzz_t *fuzz)
+{
+	static const int32_t extremes [] = {
+		0, 1, 2, 3, 4, 7, 8, 15, 16, 17, 63, 64, 127, 128, 255, 256, 1023, 1024,
+		-1, -2, -128, INT32_MAX, INT32_MIN
+	};
+
+	if(_chance(fuzz, 50))
+		return _below(fuzz, 8);
+	if(_chance(fuzz, 70))
+		return extremes[_below(fuzz, sizeof(extremes) / sizeof(*extremes))];
+
+	return _rand(fuzz);
+}
+
+static void
+_fail(fuzz_t *fuzz, const char *fmt, ...)
+{
+	va_list args;
+
+	fprintf(stderr, "FAIL %s (session %u, cycle %u): ", fuzz->name, fuzz->session,
+		fuzz->cycle);
+	va_start(args, fmt);
+	vfprintf(stderr, fmt, args);
+	va_end(args);
+	fputc('\n', stderr);
+
+	fuzz->nfailures++;
+}
+
+static stream_t
+_stream(const char *uri)
+{
+	if(!strcmp(uri, ESPRESSIVO_MIDI_IN_URI))
+		return STREAM_MIDI;
+	else if(!strcmp(uri, ESPRESSIVO_MPE_IN_URI))
+		return STREAM_MPE;
+	else if(!strcmp(uri, ESPRESSIVO_TUIO2_IN_URI))
+		return STREAM_TUIO2;
+	else if(!strcmp(uri, ESPRESSIVO_CV_IN_URI))
+		return STREAM_CV;
+	else if(!strcmp(uri, ESPRESSIVO_BUS_IN_URI))
+		return STREAM_NONE;
+
+	return STREAM_XPRESS;
+}
+
+static sink_t
+_sink(const char *uri)
+{
+	if(  !strcmp(uri, ESPRESSIVO_MIDI_OUT_URI)
+		|| !strcmp(uri, ESPRESSIVO_MPE_OUT_URI) )
+	{
+		return SINK_MIDI;
+	}
+	else if(!strcmp(uri, ESPRESSIVO_CV_OUT_URI))
+	{
+		return SINK_CV;
+	}
+	else if(  !strcmp(uri, ESPRESSIVO_SC_OUT_URI)
+		|| !strcmp(uri, ESPRESSIVO_TUIO2_OUT_URI)
+		|| !strcmp(uri, ESPRESSIVO_MONITOR_OUT_URI)
+		|| !strcmp(uri, ESPRESSIVO_BUS_OUT_URI)
+		|| !strcmp(uri, ESPRESSIVO_BUS_IN_URI) ) // voices stem from the bus
+	{
+		return SINK_OTHER;
+	}
+
+	return SINK_XPRESS;
+}
+
+static LV2_Atom_Forge_Ref
+_raw(fuzz_t *fuzz, LV2_URID type, unsigned size)
+{
+	LV2_Atom_Forge *forge = &fuzz->forge;
+	uint8_t body [64];
+
+	for(unsigned i = 0; i < size; i++)
+		body[i] = _rand(fuzz);
+
+	LV2_Atom_Forge_Ref ref = lv2_atom_forge_atom(forge, size, type);
+	if(ref)
+		ref = lv2_atom_forge_write(forge, body, size);
+
+	return ref;
+}
+
+// a patch:Set of any known property or a patch:Get, value types and sizes
+// do not necessarily match the property
+static LV2_Atom_Forge_Ref
+_patch(fuzz_t *fuzz)
+{
+	LV2_Atom_Forge *forge = &fuzz->forge;
+	LV2_Atom_Forge_Frame frame;
+	const bool get = _chance(fuzz, 20);
+	const LV2_URID property = fuzz->nprops && _chance(fuzz, 95)
+		? fuzz->props[_below(fuzz, fuzz->nprops)]
+		: _below(fuzz, nuris + 2);
+
+	LV2_Atom_Forge_Ref ref = lv2_atom_forge_object(forge, &frame, 0,
+		get ? fuzz->patch_Get : fuzz->patch_Set);
+	if(ref && _chance(fuzz, 10))
+		ref = lv2_atom_forge_key(forge, fuzz->patch_sequence)
+			&& lv2_atom_forge_int(forge, _int(fuzz));
+	if(ref && (!get || _chance(fuzz, 50)) && _chance(fuzz, 98))
+	{
+		ref = lv2_atom_forge_key(forge, fuzz->patch_property);
+		if(ref)
+			ref = _chance(fuzz, 98)
+				? lv2_atom_forge_urid(forge, property)
+				: lv2_atom_forge_int(forge, property);
+	}
+	if(ref && !get && _chance(fuzz, 98))
+	{
+		ref = lv2_atom_forge_key(forge, fuzz->patch_value);
+		if(ref)
+		{
+			switch(_below(fuzz, 10))
+			{
+				case 0:
+				case 1:
+				case 2:
+					ref = lv2_atom_forge_int(forge, _int(fuzz));
+					break;
+				case 3:
+				case 4:
+				case 5:
+					ref = lv2_atom_forge_float(forge, _float(fuzz));
+					break;
+				case 6:
+					ref = lv2_atom_forge_bool(forge, _rand(fuzz) & 1);
+					break;
+				case 7:
+					ref = lv2_atom_forge_long(forge, (int64_t)( ((uint64_t)(uint32_t)_int(fuzz) << 32) | _rand(fuzz)));
+					break;
+				case 8:
+					ref = lv2_atom_forge_string(forge, "fuzz", 4);
+					break;
+				case 9: // oversized or truncated
+					ref = _raw(fuzz, _chance(fuzz, 50) ? forge->Int : forge->Float,
+						_below(fuzz, 64));
+					break;
+			}
+		}
+	}
+	if(ref)
+		lv2_atom_forge_pop(forge, &frame);
+
+	return ref;
+}
+
+static LV2_Atom_Forge_Ref
+_midi(fuzz_t *fuzz, uint8_t status)
+{
+	LV2_Atom_Forge *forge = &fuzz->forge;
+	uint8_t m [4] = {
+		status,
+		_chance(fuzz, 95) ? _below(fuzz, 0x80) : _rand(fuzz),
+		_chance(fuzz, 95) ? _below(fuzz, 0x80) : _rand(fuzz),
+		_rand(fuzz)
+	};
+	uint32_t size;
+
+	switch(status & 0xf0)
+	{
+		case LV2_MIDI_MSG_PGM_CHANGE:
+		case LV2_MIDI_MSG_CHANNEL_PRESSURE:
+			size = 2;
+			break;
+		case 0xf0:
+			size = 1;
+			break;
+		default:
+			size = 3;
+			break;
+	}
+
+	// focus on a few keys, thus retriggers and overlaps are common
+	if( ((status & 0xf0) != LV2_MIDI_MSG_CONTROLLER) && _chance(fuzz, 80) )
+		m[1] = 0x30 + _below(fuzz, 8);
+
+	if(_chance(fuzz, 5))
+		size = _below(fuzz, 5); // truncated or overlong
+
+	LV2_Atom_Forge_Ref ref = lv2_atom_forge_atom(forge, size, fuzz->midi_MidiEvent);
+	if(ref)
+		ref = lv2_atom_forge_write(forge, m, size);
+
+	return ref;
+}
+
+static LV2_Atom_Forge_Ref
+_midi_event(fuzz_t *fuzz, bool mpe)
+{
+	static const uint8_t comms [] = {
+		LV2_MIDI_MSG_NOTE_ON, LV2_MIDI_MSG_NOTE_ON, LV2_MIDI_MSG_NOTE_OFF,
+		LV2_MIDI_MSG_NOTE_OFF, LV2_MIDI_MSG_NOTE_PRESSURE, LV2_MIDI_MSG_CONTROLLER,
+		LV2_MIDI_MSG_PGM_CHANGE, LV2_MIDI_MSG_CHANNEL_PRESSURE, LV2_MIDI_MSG_BENDER,
+		0xf0
+	};
+
+	const uint8_t comm = comms[_below(fuzz, sizeof(comms))];
+	const uint8_t chan = mpe && _chance(fuzz, 70)
+		? 1 + _below(fuzz, 4) // members of a lower zone
+		: _below(fuzz, 0x10);
+
+	if(mpe && _chance(fuzz, 3))
+	{
+		// MPE configuration message on a master channel (RPN 6)
+		LV2_Atom_Forge *forge = &fuzz->forge;
+		const uint8_t master = _chance(fuzz, 50) ? 0x0 : 0xf;
+		const uint8_t m [12] = {
+			LV2_MIDI_MSG_CONTROLLER | master, 101, 0,
+			LV2_MIDI_MSG_CONTROLLER | master, 100, 6,
+			LV2_MIDI_MSG_CONTROLLER | master, 6, _below(fuzz, 0x11),
+			LV2_MIDI_MSG_CONTROLLER | master, 38, 0
+		};
+		LV2_Atom_Forge_Ref ref = 1;
+
+		for(unsigned i = 0; (i < sizeof(m)) && ref; i += 3)
+		{
+			if(i)
+				ref = lv2_atom_forge_frame_time(forge, 0);
+			if(ref)
+				ref = lv2_atom_forge_atom(forge, 3, fuzz->midi_MidiEvent);
+			if(ref)
+				ref = lv2_atom_forge_write(forge, &m[i], 3);
+		}
+
+		return ref;
+	}
+
+	return _midi(fuzz, comm | (comm == 0xf0 ? _below(fuzz, 0x10) : chan));
+}
+
+static LV2_Atom_Forge_Ref
+_osc_arg(fuzz_t *fuzz, bool is_int)
+{
+	LV2_Atom_Forge *forge = &fuzz->forge;
+
+	if(_chance(fuzz, 3))
+		return lv2_atom_forge_string(forge, "fuzz", 4);
+	if(_chance(fuzz, 3))
+		is_int = !is_int;
+
+	return is_int
+		? lv2_atom_forge_int(forge, _int(fuzz))
+		: lv2_atom_forge_float(forge, _float(fuzz));
+}
+
+// TUIO2 frame with fids running mostly forward, sometimes back or ahead
+static LV2_Atom_Forge_Ref
+_tuio2_event(fuzz_t *fuzz)
+{
+	LV2_Atom_Forge *forge = &fuzz->forge;
+	LV2_OSC_URID *osc_urid = &fuzz->osc_urid;
+	LV2_Atom_Forge_Frame bndl [2];
+	LV2_Atom_Forge_Frame msg [2];
+	LV2_OSC_Timetag stamp;
+
+	if(_chance(fuzz, 80))
+		fuzz->fid += 1;
+	else if(_chance(fuzz, 50))
+		fuzz->fid -= fuzz->fid < 8 ? fuzz->fid : _below(fuzz, 8);
+	else
+		fuzz->fid += _below(fuzz, 64);
+	if(fuzz->fid > fuzz->max_fid)
+		fuzz->max_fid = fuzz->fid;
+
+	lv2_osc_timetag_create(&stamp, LV2_OSC_IMMEDIATE + fuzz->fid);
+
+	LV2_Atom_Forge_Ref ref = lv2_osc_forge_bundle_head(forge, osc_urid, bndl, &stamp);
+
+	if(ref && _chance(fuzz, 95))
+	{
+		ref = lv2_osc_forge_message_head(forge, osc_urid, msg, "/tuio2/frm");
+		if(ref && _chance(fuzz, 98))
+			ref = lv2_atom_forge_int(forge, fuzz->fid);
+		if(ref && _chance(fuzz, 98))
+			ref = lv2_osc_forge_timetag(forge, osc_urid, &stamp);
+		if(ref && _chance(fuzz, 95))
+			ref = lv2_atom_forge_int(forge, _chance(fuzz, 90)
+				? (int32_t)((160 << 16) | 1) : _int(fuzz));
+		if(ref && _chance(fuzz, 95))
+			ref = lv2_atom_forge_string(forge, "fuzz", 4);
+		if(ref)
+			lv2_osc_forge_pop(forge, msg);
+	}
+
+	const unsigned ntoks = _below(fuzz, 6);
+	uint32_t sids = 0;
+	for(unsigned t = 0; (t < ntoks) && ref; t++)
+	{
+		const unsigned sid = 1 + _below(fuzz, FUZZ_NSIDS);
+		const unsigned nargs = _chance(fuzz, 90) ? 6 : _below(fuzz, 12);
+
+		sids |= 1 << sid;
+
+		ref = lv2_osc_forge_message_head(forge, osc_urid, msg, "/tuio2/tok");
+		if(ref && nargs)
+			ref = lv2_atom_forge_int(forge, sid);
+		for(unsigned a = 1; (a < nargs) && ref; a++)
+			ref = _osc_arg(fuzz, a < 3);
+		if(ref)
+			lv2_osc_forge_pop(forge, msg);
+	}
+
+	if(ref && _chance(fuzz, 90))
+	{
+		ref = lv2_osc_forge_message_head(forge, osc_urid, msg, "/tuio2/alv");
+		for(unsigned sid = 0; (sid <= FUZZ_NSIDS) && ref; sid++)
+		{
+			if( (sids & (1 << sid)) && _chance(fuzz, 90) )
+				ref = _osc_arg(fuzz, true);
+		}
+		if(ref)
+			lv2_osc_forge_pop(forge, msg);
+	}
+
+	if(ref)
+		lv2_osc_forge_pop(forge, bndl);
+
+	return ref;
+}
+
+static inline LV2_URID
+_source(fuzz_t *fuzz, unsigned *s)
+{
+	*s = _below(fuzz, FUZZ_NSOURCES);
+
+	return fuzz->sources[*s];
+}
+
+static inline xpress_uuid_t
+_uuid(fuzz_t *fuzz)
+{
+	// outside of the range handed out by the voice map
+	return 0x40000000 + _below(fuzz, FUZZ_NUUIDS);
+}
+
+static LV2_Atom_Forge_Ref
+_xpress_list(fuzz_t *fuzz, LV2_URID otype, unsigned s, uint32_t uuids)
+{
+	LV2_Atom_Forge *forge = &fuzz->forge;
+	LV2_Atom_Forge_Frame frame [2];
+
+	LV2_Atom_Forge_Ref ref = lv2_atom_forge_object(forge, &frame[0], 0, otype);
+	if(ref && _chance(fuzz, 99))
+		ref = lv2_atom_forge_key(forge, fuzz->xpress_source)
+			&& lv2_atom_forge_urid(forge, fuzz->sources[s]);
+	if(ref && _chance(fuzz, 99))
+	{
+		ref = lv2_atom_forge_key(forge, fuzz->xpress_body);
+		if(ref && _chance(fuzz, 99))
+		{
+			ref = lv2_atom_forge_tuple(forge, &frame[1]);
+			for(unsigned u = 0; (u < FUZZ_NUUIDS) && ref; u++)
+			{
+				if(!(uuids & (1 << u)))
+					continue;
+
+				ref = _chance(fuzz, 99)
+					? lv2_atom_forge_int(forge, 0x40000000 + u)
+					: lv2_atom_forge_float(forge, u);
+			}
+			if(ref)
+				lv2_atom_forge_pop(forge, &frame[1]);
+		}
+		else if(ref)
+		{
+			ref = lv2_atom_forge_int(forge, _uuid(fuzz));
+		}
+	}
+	if(ref)
+		lv2_atom_forge_pop(forge, &frame[0]);
+
+	return ref;
+}
+
+static LV2_Atom_Forge_Ref
+_xpress_event(fuzz_t *fuzz)
+{
+	LV2_Atom_Forge *forge = &fuzz->forge;
+	unsigned s;
+	const LV2_URID source = _source(fuzz, &s);
+
+	switch(_below(fuzz, 10))
+	{
+		case 0:
+		case 1:
+		case 2:
+		case 3:
+		{
+			LV2_Atom_Forge_Frame frame;
+			const LV2_URID keys [] = {
+				fuzz->xpress_zone, fuzz->xpress_pitch, fuzz->xpress_pressure,
+				fuzz->xpress_timbre
+			};
+			const xpress_uuid_t uuid = _uuid(fuzz);
+
+			LV2_Atom_Forge_Ref ref = lv2_atom_forge_object(forge, &frame, 0,
+				_chance(fuzz, 50) ? fuzz->xpress_Token : fuzz->xpress_Delta);
+			if(ref && _chance(fuzz, 98))
+				ref = lv2_atom_forge_key(forge, fuzz->xpress_source)
+					&& (_chance(fuzz, 98)
+						? lv2_atom_forge_urid(forge, source)
+						: lv2_atom_forge_int(forge, source));
+			if(ref && _chance(fuzz, 98))
+				ref = lv2_atom_forge_key(forge, fuzz->xpress_uuid)
+					&& (_chance(fuzz, 98)
+						? lv2_atom_forge_int(forge, uuid)
+						: lv2_atom_forge_long(forge, uuid));
+			for(unsigned k = 0; (k < sizeof(keys) / sizeof(*keys)) && ref; k++)
+			{
+				if(_chance(fuzz, 10))
+					continue; // as in delta tokens
+
+				ref = lv2_atom_forge_key(forge, keys[k]);
+				if(ref)
+					ref = _osc_arg(fuzz, k == 0);
+			}
+			if(ref)
+				lv2_atom_forge_pop(forge, &frame);
+
+			// keep the voice alive from now on
+			if(_chance(fuzz, 80))
+				fuzz->alive[s] |= 1 << (uuid - 0x40000000);
+
+			return ref;
+		}
+		case 4:
+		{
+			const uint32_t uuids = fuzz->alive[s] & _rand(fuzz);
+
+			// voices released upstream are gone
+			fuzz->alive[s] &= ~uuids;
+
+			return _xpress_list(fuzz, fuzz->xpress_Release, s, uuids);
+		}
+		case 5:
+		{
+			// some voices leave without a release
+			if(_chance(fuzz, 30))
+				fuzz->alive[s] &= _rand(fuzz);
+
+			return _xpress_list(fuzz, fuzz->xpress_Alive, s, fuzz->alive[s]);
+		}
+		case 6:
+		case 7:
+		{
+			const xpress_packed_t packed = {
+				.source = source,
+				.uuid = _uuid(fuzz),
+				.state = {
+					.zone = _int(fuzz),
+					.pitch = _float(fuzz),
+					.pressure = _float(fuzz),
+					.timbre = _float(fuzz)
+				}
+			};
+			const uint32_t size = _chance(fuzz, 95)
+				? sizeof(packed)
+				: _below(fuzz, sizeof(packed));
+
+			LV2_Atom_Forge_Ref ref = lv2_atom_forge_atom(forge, size, fuzz->xpress_Packed);
+			if(ref)
+				ref = lv2_atom_forge_write(forge, &packed, size);
+
+			return ref;
+		}
+		case 8:
+		{
+			static const uint32_t strides [] = {
+				sizeof(xpress_batch_item_t), sizeof(xpress_batch_item_t),
+				sizeof(xpress_batch_item_t) + 8, 0, 4, 0x10000
+			};
+			const xpress_batch_t batch = {
+				.source = source,
+				.stride = strides[_below(fuzz, sizeof(strides) / sizeof(*strides))]
+			};
+			uint8_t items [4*(sizeof(xpress_batch_item_t) + 8)];
+			uint32_t size = sizeof(batch) + _below(fuzz, 5) * (batch.stride < 0x100
+				? batch.stride : sizeof(xpress_batch_item_t));
+
+			if(size > sizeof(batch) + sizeof(items))
+				size = sizeof(batch) + sizeof(items);
+			if(_chance(fuzz, 10))
+				size -= _below(fuzz, size + 1);
+
+			// stride may leave gaps between items, which must not be garbage
+			memset(items, 0x0, sizeof(items));
+
+			for(unsigned i = 0; i < sizeof(items); i += sizeof(xpress_batch_item_t))
+			{
+				if(i + sizeof(xpress_batch_item_t) > sizeof(items))
+					break;
+
+				const xpress_batch_item_t item = {
+					.uuid = _uuid(fuzz),
+					.state = {
+						.zone = _int(fuzz),
+						.pitch = _float(fuzz),
+						.pressure = _float(fuzz),
+						.timbre = _float(fuzz)
+					}
+				};
+
+				memcpy(&items[i], &item, sizeof(item));
+			}
+
+			LV2_Atom_Forge_Ref ref = lv2_atom_forge_atom(forge, size, fuzz->xpress_Batch);
+			if(ref && (size >= sizeof(batch)) )
+				ref = lv2_atom_forge_write(forge, &batch, sizeof(batch))
+					&& lv2_atom_forge_write(forge, items, size - sizeof(batch));
+			else if(ref)
+				ref = lv2_atom_forge_write(forge, &batch, size);
+
+			return ref;
+		}
+		default:
+		{
+			const LV2_URID types [] = {
+				fuzz->xpress_Packed, fuzz->xpress_Batch, fuzz->midi_MidiEvent,
+				forge->Int, forge->Float, forge->String, forge->Chunk, nuris + 1
+			};
+
+			return _raw(fuzz, types[_below(fuzz, sizeof(types) / sizeof(*types))],
+				_below(fuzz, 64));
+		}
+	}
+}
+
+static int
+_cmp_frames(const void *a, const void *b)
+{
+	const uint32_t *A = a;
+	const uint32_t *B = b;
+
+	return (*A > *B) - (*A < *B);
+}
+
+// random events at ascending frame times, followed by heartbeats
+static void
+_cycle(fuzz_t *fuzz, stream_t stream)
+{
+	LV2_Atom_Forge *forge = &fuzz->forge;
+	LV2_Atom_Forge_Frame frame;
+	uint32_t frames [MAX_NEVENTS];
+	const unsigned nevents = _below(fuzz, MAX_NEVENTS);
+
+	for(unsigned e = 0; e < nevents; e++)
+		frames[e] = _below(fuzz, fuzz->nsamples);
+	qsort(frames, nevents, sizeof(*frames), _cmp_frames);
+
+	lv2_atom_forge_set_buffer(forge, fuzz->in.buf, SEQ_SIZE);
+	LV2_Atom_Forge_Ref ref = lv2_atom_forge_sequence_head(forge, &frame, 0);
+
+	for(unsigned e = 0; (e < nevents) && ref; e++)
+	{
+		ref = lv2_atom_forge_frame_time(forge, frames[e]);
+		if(!ref)
+			break;
+
+		if(_chance(fuzz, 8))
+		{
+			ref = _patch(fuzz);
+			continue;
+		}
+
+		switch(stream)
+		{
+			case STREAM_MIDI:
+				ref = _midi_event(fuzz, false);
+				break;
+			case STREAM_MPE:
+				ref = _midi_event(fuzz, true);
+				break;
+			case STREAM_TUIO2:
+				ref = _tuio2_event(fuzz);
+				break;
+			case STREAM_XPRESS:
+				ref = _xpress_event(fuzz);
+				break;
+			case STREAM_CV:
+			case STREAM_NONE:
+				ref = _patch(fuzz);
+				break;
+		}
+	}
+
+	// upstream heartbeat, now and then missed
+	for(unsigned s = 0; (s < FUZZ_NSOURCES) && ref && (stream == STREAM_XPRESS); s++)
+	{
+		if(_chance(fuzz, 90))
+		{
+			ref = lv2_atom_forge_frame_time(forge, fuzz->nsamples - 1);
+			if(ref)
+				ref = _xpress_list(fuzz, fuzz->xpress_Alive, s, fuzz->alive[s]);
+		}
+	}
+
+	if(ref)
+		lv2_atom_forge_pop(forge, &frame);
+	else
+		lv2_atom_sequence_clear(&fuzz->in.seq);
+
+	// gates toggle rarely, pitch and pressure move freely
+	for(unsigned slot = 0; slot < 4; slot++)
+	{
+		float *gate = fuzz->cv[2 + 3*slot];
+		float *pitch = fuzz->cv[2 + 3*slot + 1];
+		float *pressure = fuzz->cv[2 + 3*slot + 2];
+		const unsigned edge = _chance(fuzz, 20) ? _below(fuzz, fuzz->nsamples) : fuzz->nsamples;
+		const float from = _float(fuzz);
+		const float to = _float(fuzz);
+
+		for(unsigned i = 0; i < fuzz->nsamples; i++)
+		{
+			if(i == edge)
+				fuzz->gates[slot] = !fuzz->gates[slot];
+
+			gate[i] = fuzz->gates[slot] ? 1.f : 0.f;
+			pitch[i] = from + (to - from) * i / fuzz->nsamples;
+			pressure[i] = _chance(fuzz, 1) ? _float(fuzz) : to;
+		}
+	}
+}
+
+// release whatever the stream may have left behind
+static void
+_quiesce(fuzz_t *fuzz, stream_t stream, unsigned q)
+{
+	LV2_Atom_Forge *forge = &fuzz->forge;
+	LV2_OSC_URID *osc_urid = &fuzz->osc_urid;
+	LV2_Atom_Forge_Frame frame;
+
+	lv2_atom_forge_set_buffer(forge, fuzz->in.buf, SEQ_SIZE);
+	LV2_Atom_Forge_Ref ref = lv2_atom_forge_sequence_head(forge, &frame, 0);
+
+	// stop sampling, so that voices on hold get released
+	if(ref && !q)
+	{
+		LV2_Atom_Forge_Frame obj;
+
+		ref = lv2_atom_forge_frame_time(forge, 0);
+		if(ref)
+			ref = lv2_atom_forge_object(forge, &obj, 0, fuzz->patch_Set);
+		if(ref)
+			ref = lv2_atom_forge_key(forge, fuzz->patch_property);
+		if(ref)
+			ref = lv2_atom_forge_urid(forge, fuzz->snh_sample);
+		if(ref)
+			ref = lv2_atom_forge_key(forge, fuzz->patch_value);
+		if(ref)
+			ref = lv2_atom_forge_bool(forge, false);
+		if(ref)
+			lv2_atom_forge_pop(forge, &obj);
+	}
+
+	// and a sane gate threshold, so that zeroed gates get released
+	if(ref && !q)
+	{
+		LV2_Atom_Forge_Frame obj;
+
+		ref = lv2_atom_forge_frame_time(forge, 0);
+		if(ref)
+			ref = lv2_atom_forge_object(forge, &obj, 0, fuzz->patch_Set);
+		if(ref)
+			ref = lv2_atom_forge_key(forge, fuzz->patch_property);
+		if(ref)
+			ref = lv2_atom_forge_urid(forge, fuzz->cv_in_threshold);
+		if(ref)
+			ref = lv2_atom_forge_key(forge, fuzz->patch_value);
+		if(ref)
+			ref = lv2_atom_forge_float(forge, 0.5f);
+		if(ref)
+			lv2_atom_forge_pop(forge, &obj);
+	}
+
+	switch(stream)
+	{
+		case STREAM_MIDI:
+		case STREAM_MPE:
+		{
+			for(unsigned chan = 0; (chan < 0x10) && ref && !q; chan++)
+			{
+				for(unsigned key = 0; (key < 0x80) && ref; key++)
+				{
+					const uint8_t m [3] = {LV2_MIDI_MSG_NOTE_OFF | chan, key, 0x0};
+
+					ref = lv2_atom_forge_frame_time(forge, 0);
+					if(ref)
+						ref = lv2_atom_forge_atom(forge, sizeof(m), fuzz->midi_MidiEvent);
+					if(ref)
+						ref = lv2_atom_forge_write(forge, m, sizeof(m));
+				}
+			}
+		} break;
+		case STREAM_TUIO2:
+		{
+			LV2_Atom_Forge_Frame bndl [2];
+			LV2_Atom_Forge_Frame msg [2];
+			LV2_OSC_Timetag stamp;
+
+			fuzz->fid = ++fuzz->max_fid;
+			lv2_osc_timetag_create(&stamp, LV2_OSC_IMMEDIATE + fuzz->fid);
+
+			if(ref)
+				ref = lv2_atom_forge_frame_time(forge, 0);
+			if(ref)
+				ref = lv2_osc_forge_bundle_head(forge, osc_urid, bndl, &stamp);
+			if(ref)
+				ref = lv2_osc_forge_message_vararg(forge, osc_urid, "/tuio2/frm", "itis",
+					fuzz->fid, stamp.integral, stamp.fraction, (160 << 16) | 1, "fuzz");
+			if(ref)
+				ref = lv2_osc_forge_message_head(forge, osc_urid, msg, "/tuio2/alv");
+			if(ref)
+				lv2_osc_forge_pop(forge, msg);
+			if(ref)
+				lv2_osc_forge_pop(forge, bndl);
+		} break;
+		case STREAM_XPRESS:
+		{
+			for(unsigned s = 0; s < FUZZ_NSOURCES; s++)
+				fuzz->alive[s] = 0;
+		} break;
+		case STREAM_CV:
+		case STREAM_NONE:
+			break;
+	}
+
+	if(ref)
+		lv2_atom_forge_pop(forge, &frame);
+	else
+		_fail(fuzz, "quiesce sequence overflow");
+
+	for(unsigned slot = 0; slot < 4; slot++)
+	{
+		fuzz->gates[slot] = false;
+		memset(fuzz->cv[2 + 3*slot], 0x0, sizeof(fuzz->cv[0]));
+	}
+}
+
+// nested atoms must not reach beyond their container
+static bool
+_check_atom(fuzz_t *fuzz, const LV2_Atom *atom, const uint8_t *end, unsigned depth)
+{
+	if( ((const uint8_t *)atom + sizeof(LV2_Atom) > end)
+		|| ((const uint8_t *)LV2_ATOM_BODY_CONST(atom) + atom->size > end) )
+	{
+		return false;
+	}
+
+	if(depth > 8)
+		return true;
+
+	const uint8_t *body_end = (const uint8_t *)LV2_ATOM_BODY_CONST(atom) + atom->size;
+
+	if(atom->type == fuzz->forge.Object)
+	{
+		const LV2_Atom_Object *obj = (const LV2_Atom_Object *)atom;
+
+		if(atom->size < sizeof(LV2_Atom_Object_Body))
+			return false;
+
+		LV2_ATOM_OBJECT_FOREACH(obj, prop)
+		{
+			if(!_check_atom(fuzz, &prop->value, body_end, depth + 1))
+				return false;
+		}
+	}
+	else if(atom->type == fuzz->forge.Tuple)
+	{
+		LV2_ATOM_TUPLE_FOREACH((const LV2_Atom_Tuple *)atom, item)
+		{
+			if(!_check_atom(fuzz, item, body_end, depth + 1))
+				return false;
+		}
+	}
+
+	return true;
+}
+
+static void
+_check_midi(fuzz_t *fuzz, const LV2_Atom *atom)
+{
+	const uint8_t *m = LV2_ATOM_BODY_CONST(atom);
+
+	if(atom->size < 1)
+	{
+		_fail(fuzz, "empty MIDI event");
+		return;
+	}
+
+	const uint8_t comm = m[0] & 0xf0;
+	const uint8_t chan = m[0] & 0x0f;
+
+	if( (comm == LV2_MIDI_MSG_NOTE_ON) || (comm == LV2_MIDI_MSG_NOTE_OFF) )
+	{
+		if( (atom->size != 3) || (m[1] & 0x80) || (m[2] & 0x80) )
+		{
+			_fail(fuzz, "malformed MIDI note event");
+			return;
+		}
+
+		fuzz->notes[chan][m[1]] = (comm == LV2_MIDI_MSG_NOTE_ON) && m[2];
+	}
+	else if( (comm == LV2_MIDI_MSG_CONTROLLER) && (atom->size == 3)
+		&& (m[1] == LV2_MIDI_CTL_ALL_NOTES_OFF) )
+	{
+		memset(fuzz->notes[chan], 0x0, sizeof(fuzz->notes[chan]));
+	}
+}
+
+static void
+_check(fuzz_t *fuzz, sink_t sink, const LV2_Atom_Sequence *seq, uint32_t capacity)
+{
+	const uint8_t *canary = (const uint8_t *)seq + OUT_SIZE;
+
+	for(unsigned i = 0; i < CANARY_SIZE; i++)
+	{
+		if(canary[i] != CANARY)
+		{
+			_fail(fuzz, "write beyond output capacity");
+			break;
+		}
+	}
+
+	if(seq->atom.size > capacity)
+	{
+		_fail(fuzz, "sequence size %"PRIu32" exceeds capacity %"PRIu32,
+			seq->atom.size, capacity);
+		return;
+	}
+
+	if(seq->atom.size < sizeof(LV2_Atom_Sequence_Body))
+	{
+		_fail(fuzz, "truncated sequence");
+		return;
+	}
+
+	xpress_pre(fuzz->xpress);
+
+	const uint8_t *end = (const uint8_t *)LV2_ATOM_BODY_CONST(&seq->atom) + seq->atom.size;
+	int64_t last = 0;
+
+	LV2_ATOM_SEQUENCE_FOREACH(seq, ev)
+	{
+		const LV2_Atom *atom = &ev->body;
+
+		if(!_check_atom(fuzz, atom, end, 0))
+		{
+			_fail(fuzz, "malformed output event");
+			break;
+		}
+
+		if( (ev->time.frames < last) || (ev->time.frames >= fuzz->nsamples) )
+		{
+			_fail(fuzz, "event frame time %"PRIi64" out of order or range",
+				ev->time.frames);
+		}
+		last = ev->time.frames;
+
+		if(sink == SINK_MIDI)
+		{
+			if(atom->type == fuzz->midi_MidiEvent)
+				_check_midi(fuzz, atom);
+		}
+		else if(sink == SINK_XPRESS)
+		{
+			xpress_advance(fuzz->xpress, &fuzz->forge, ev->time.frames,
+				(const LV2_Atom_Object *)atom, NULL);
+		}
+	}
+
+	xpress_post(fuzz->xpress, fuzz->nsamples - 1);
+
+	// other plugins only read the CV buffers, which may hold non-finite input
+	for(unsigned p = 2; (p < MAX_NPORTS) && (sink == SINK_CV); p++)
+	{
+		for(unsigned i = 0; i < fuzz->nsamples; i++)
+		{
+			if(!isfinite(fuzz->cv[p][i]))
+			{
+				_fail(fuzz, "non-finite sample on port %u", p);
+				return;
+			}
+		}
+	}
+}
+
+static void
+_check_quiet(fuzz_t *fuzz, sink_t sink)
+{
+	switch(sink)
+	{
+		case SINK_XPRESS:
+		{
+			if(fuzz->xpress->nvoices)
+				_fail(fuzz, "%u stuck voices", fuzz->xpress->nvoices);
+		} break;
+		case SINK_MIDI:
+		{
+			unsigned n = 0;
+
+			for(unsigned chan = 0; chan < 0x10; chan++)
+			{
+				for(unsigned key = 0; key < 0x80; key++)
+					n += fuzz->notes[chan][key];
+			}
+
+			if(n)
+				_fail(fuzz, "%u stuck notes", n);
+		} break;
+		case SINK_CV:
+		{
+			for(unsigned slot = 0; slot < 4; slot++)
+			{
+				if(fuzz->cv[2 + 4*slot][fuzz->nsamples - 1] != 0.f)
+					_fail(fuzz, "gate of slot %u stuck open", slot);
+			}
+		} break;
+		case SINK_OTHER:
+			break;
+	}
+}
+
+static void
+_props_collect(fuzz_t *fuzz)
+{
+	static const char prefix [] = ESPRESSIVO_URI"#";
+
+	fuzz->nprops = 0;
+
+	for(LV2_URID i = 0; (i < nuris) && (fuzz->nprops < MAX_NPROPS); i++)
+	{
+		if(!strncmp(uris[i], prefix, sizeof(prefix) - 1))
+			fuzz->props[fuzz->nprops++] = i + 1;
+	}
+}
+
+static int
+_downstream_init(fuzz_t *fuzz)
+{
+	static const xpress_iface_t iface = {
+		.size = sizeof(uint64_t)
+	};
+
+	fuzz->xpress = calloc(1, XPRESS_SIZE(MAX_NVOICES_LIMIT));
+	fuzz->targets = calloc(MAX_NVOICES_LIMIT, sizeof(uint64_t));
+	if(!fuzz->xpress || !fuzz->targets)
+		return -1;
+
+	if(!xpress_init(fuzz->xpress, MAX_NVOICES_LIMIT, &map, &voice_map,
+		XPRESS_EVENT_NONE, &iface, fuzz->targets, NULL))
+	{
+		return -1;
+	}
+
+	return 0;
+}
+
+static void
+_downstream_deinit(fuzz_t *fuzz)
+{
+	if(fuzz->xpress)
+		xpress_deinit(fuzz->xpress);
+	free(fuzz->targets);
+	free(fuzz->xpress);
+	fuzz->xpress = NULL;
+	fuzz->targets = NULL;
+}
+
+static void
+_run(fuzz_t *fuzz, const LV2_Descriptor *desc, LV2_Handle instance,
+	LV2_Atom_Sequence *out, sink_t sink)
+{
+	// copy input to a buffer of exact size, thus overreads are caught
+	const size_t in_size = sizeof(LV2_Atom) + fuzz->in.seq.atom.size;
+	LV2_Atom_Sequence *in = malloc(in_size);
+	if(!in)
+	{
+		_fail(fuzz, "out of memory");
+		return;
+	}
+	memcpy(in, &fuzz->in.seq, in_size);
+
+	out->atom.type = 0;
+	out->atom.size = OUT_SIZE - sizeof(LV2_Atom);
+	memset((uint8_t *)out + OUT_SIZE, CANARY, CANARY_SIZE);
+
+	desc->connect_port(instance, 0, in);
+	desc->run(instance, fuzz->nsamples);
+	desc->connect_port(instance, 0, NULL);
+	free(in);
+
+	_check(fuzz, sink, out, OUT_SIZE - sizeof(LV2_Atom));
+}
+
+static void
+_fuzz(fuzz_t *fuzz, const LV2_Descriptor *desc, const LV2_Feature *const *features)
+{
+	const stream_t stream = _stream(desc->URI);
+	const sink_t sink = _sink(desc->URI);
+	const char *name = strrchr(desc->URI, '#');
+
+	fuzz->name = name ? name + 1 : desc->URI;
+
+	for(fuzz->session = 0; fuzz->session < fuzz->nsessions; fuzz->session++)
+	{
+		LV2_Atom_Sequence *out = malloc(OUT_SIZE + CANARY_SIZE);
+		LV2_Handle instance = out
+			? desc->instantiate(desc, 48000.0, "/tmp", features)
+			: NULL;
+		if(!instance)
+		{
+			_fail(fuzz, "failed to instantiate");
+			free(out);
+			return;
+		}
+
+		_props_collect(fuzz);
+		memset(fuzz->notes, 0x0, sizeof(fuzz->notes));
+		memset(fuzz->alive, 0x0, sizeof(fuzz->alive));
+		memset(fuzz->gates, 0x0, sizeof(fuzz->gates));
+		memset(fuzz->cv, 0x0, sizeof(fuzz->cv));
+		fuzz->fid = 0;
+		fuzz->max_fid = 0;
+
+		if(_downstream_init(fuzz))
+		{
+			_fail(fuzz, "out of memory");
+			_downstream_deinit(fuzz);
+			desc->cleanup(instance);
+			free(out);
+			return;
+		}
+
+		desc->connect_port(instance, 1, out);
+		for(uint32_t port = 2; port < MAX_NPORTS; port++)
+			desc->connect_port(instance, port, fuzz->cv[port]);
+		if(desc->activate)
+			desc->activate(instance);
+
+		for(fuzz->cycle = 0; fuzz->cycle < fuzz->ncycles; fuzz->cycle++)
+		{
+			fuzz->nsamples = _chance(fuzz, 90) ? 64 : 1 + _below(fuzz, MAX_NSAMPLES);
+
+			_cycle(fuzz, stream);
+			_run(fuzz, desc, instance, out, sink);
+		}
+
+		for(unsigned q = 0; q < NQUIESCE; q++, fuzz->cycle++)
+		{
+			fuzz->nsamples = 64;
+
+			_quiesce(fuzz, stream, q);
+			_run(fuzz, desc, instance, out, sink);
+		}
+
+		_check_quiet(fuzz, sink);
+
+		if(desc->deactivate)
+			desc->deactivate(instance);
+		desc->cleanup(instance);
+		_downstream_deinit(fuzz);
+		free(out);
+	}
+
+	if(fuzz->verbose)
+		printf("%-12s done\n", fuzz->name);
+}
+
+static void
+_usage(const char *argv0)
+{
+	fprintf(stderr,
+		"usage: %s [OPTIONS] MODULE [PLUGIN ...]\n"
+		"\n"
+		"OPTIONS\n"
+		"  [-s] SEED      seed of the random streams (1)\n"
+		"  [-c] NCYCLES   cycles per session (2000)\n"
+		"  [-i] NSESSIONS instantiations per plugin (4)\n"
+		"  [-v]           report each plugin\n"
+		"  [-h]           print usage information\n"
+		"\n"
+		"PLUGIN is the URI fragment, e.g. through, all plugins if none given\n",
+		argv0);
+}
+
+int
+main(int argc, char **argv)
+{
+	static fuzz_t fuzz = {
+		.rng = 1,
+		.ncycles = 2000,
+		.nsessions = 4,
+		.verbose = false
+	};
+
+	int c;
+	while( (c = getopt(argc, argv, "s:c:i:vh")) != -1)
+	{
+		switch(c)
+		{
+			case 's':
+				fuzz.rng = strtoull(optarg, NULL, 0);
+				break;
+			case 'c':
+				fuzz.ncycles = atoi(optarg);
+				break;
+			case 'i':
+				fuzz.nsessions = atoi(optarg);
+				break;
+			case 'v':
+				fuzz.verbose = true;
+				break;
+			case 'h':
+			default:
+				_usage(argv[0]);
+				return c == 'h' ? 0 : -1;
+		}
+	}
+
+	if( (optind >= argc) || !fuzz.rng || !fuzz.nsessions)
+	{
+		_usage(argv[0]);
+		return -1;
+	}
+
+	void *lib = dlopen(argv[optind], RTLD_NOW | RTLD_LOCAL);
+	if(!lib)
+	{
+		fprintf(stderr, "failed to open module: %s\n", dlerror());
+		return -1;
+	}
+
+	LV2_Descriptor_Function lv2_descriptor = (LV2_Descriptor_Function)
+		dlsym(lib, "lv2_descriptor");
+	if(!lv2_descriptor)
+	{
+		fprintf(stderr, "module has no lv2_descriptor\n");
+		dlclose(lib);
+		return -1;
+	}
+
+	lv2_atom_forge_init(&fuzz.forge, &map);
+	lv2_osc_urid_init(&fuzz.osc_urid, &map);
+	fuzz.patch_Set = map.map(map.handle, LV2_PATCH__Set);
+	fuzz.patch_Get = map.map(map.handle, LV2_PATCH__Get);
+	fuzz.patch_property = map.map(map.handle, LV2_PATCH__property);
+	fuzz.patch_value = map.map(map.handle, LV2_PATCH__value);
+	fuzz.patch_sequence = map.map(map.handle, LV2_PATCH__sequenceNumber);
+	fuzz.midi_MidiEvent = map.map(map.handle, LV2_MIDI__MidiEvent);
+	fuzz.xpress_Token = map.map(map.handle, XPRESS__Token);
+	fuzz.xpress_Delta = map.map(map.handle, XPRESS__Delta);
+	fuzz.xpress_Alive = map.map(map.handle, XPRESS__Alive);
+	fuzz.xpress_Release = map.map(map.handle, XPRESS__Release);
+	fuzz.xpress_Packed = map.map(map.handle, XPRESS__Packed);
+	fuzz.xpress_Batch = map.map(map.handle, XPRESS__Batch);
+	fuzz.xpress_source = map.map(map.handle, XPRESS__source);
+	fuzz.xpress_uuid = map.map(map.handle, XPRESS__uuid);
+	fuzz.xpress_zone = map.map(map.handle, XPRESS__zone);
+	fuzz.xpress_body = map.map(map.handle, XPRESS__body);
+	fuzz.xpress_pitch = map.map(map.handle, XPRESS__pitch);
+	fuzz.xpress_pressure = map.map(map.handle, XPRESS__pressure);
+	fuzz.xpress_timbre = map.map(map.handle, XPRESS__timbre);
+	fuzz.snh_sample = map.map(map.handle, ESPRESSIVO_URI"#snh_sample");
+	fuzz.cv_in_threshold = map.map(map.handle, ESPRESSIVO_URI"#cv_in_threshold");
+
+	for(unsigned s = 0; s < FUZZ_NSOURCES; s++)
+	{
+		char uri [32];
+
+		snprintf(uri, sizeof(uri), "urn:fuzz:source#%u", s);
+		fuzz.sources[s] = map.map(map.handle, uri);
+	}
+
+	const int32_t max_nvoices = FUZZ_NVOICES;
+	const LV2_Options_Option opts [] = {
+		{
+			.key = map.map(map.handle, XPRESS__maxNVoices),
+			.size = sizeof(int32_t),
+			.type = fuzz.forge.Int,
+			.value = &max_nvoices
+		},
+		{
+			.key = 0,
+			.value = NULL
+		}
+	};
+
+	const LV2_Feature feature_map = {
+		.URI = LV2_URID__map,
+		.data = &map
+	};
+	const LV2_Feature feature_unmap = {
+		.URI = LV2_URID__unmap,
+		.data = &unmap
+	};
+	const LV2_Feature feature_voice_map = {
+		.URI = XPRESS__voiceMap,
+		.data = &voice_map
+	};
+	const LV2_Feature feature_opts = {
+		.URI = LV2_OPTIONS__options,
+		.data = (void *)opts
+	};
+	const LV2_Feature feature_default_state = {
+		.URI = LV2_STATE__loadDefaultState,
+		.data = NULL
+	};
+	const LV2_Feature *const features [] = {
+		&feature_map,
+		&feature_unmap,
+		&feature_voice_map,
+		&feature_opts,
+		&feature_default_state,
+		NULL
+	};
+
+	const LV2_Descriptor *desc;
+	for(uint32_t i = 0; (desc = lv2_descriptor(i)); i++)
+	{
+		const char *name = strrchr(desc->URI, '#');
+		bool selected = optind + 1 >= argc;
+
+		for(int a = optind + 1; a < argc; a++)
+		{
+			if(name && !strcmp(name + 1, argv[a]))
+				selected = true;
+		}
+
+		if(selected)
+			_fuzz(&fuzz, desc, features);
+	}
+
+	dlclose(lib);
+
+	for(LV2_URID i = 0; i < nuris; i++)
+		free(uris[i]);
+
+	if(fuzz.nfailures)
+	{
+		fprintf(stderr, "%u failures\n", fuzz.nfailures);
+		return -1;
+	}
+
+	return 0;
+}
@@ -22,7 +22,7 @@
 #include <espressivo.h>
 #include <props.h>
 
-#define MAX_NPROPS (4*0x10)
+#define MAX_NPROPS (4 + 2 + LIMIT_NPROPS + PERF_NPROPS)
 
 typedef struct _targetO_t targetO_t;
 typedef struct _plugstate_t plugstate_t;
@@ -57,13 +57,18 @@ struct _plugstate_t {
 	int32_t pressure [0x10];
 	int32_t timbre [0x10];
 	int32_t mode [0x10];
+	int32_t coalesce;
+	int32_t delta;
+
+	limit_state_t limit;
+	perf_state_t perf;
 };
 
 struct _plughandle_t {
 	LV2_URID_Map *map;
 	struct {
 		LV2_URID midi_MidiEvent;
-		LV2_URID range [0x10];
+		LV2_URID range;
 	} uris;
 	LV2_Atom_Forge forge;
 	LV2_Atom_Forge_Ref ref;
@@ -73,11 +78,14 @@ struct _plughandle_t {
 
 	PROPS_T(props, MAX_NPROPS);
 
-	XPRESS_T(xpressO, MAX_NVOICES);
-	targetO_t targetO [MAX_NVOICES];
+	xpress_t *xpressO;
+	targetO_t *targetO;
+	void *pool;
 
 	plugstate_t state;
 	plugstate_t stash;
+	plugstate_t restore [PROPS_NRESTORE];
+	perf_t perf;
 
 	uint16_t midi_rpn [0x10];
 	uint16_t midi_data [0x10];
@@ -94,102 +102,77 @@ _get_pitch(plughandle_t *handle, targetO_t *target)
 	return ((float)target->key + offset) / 0x7f;
 }
 
-#define RANGE(NUM) \
-{ \
-	.property = ESPRESSIVO_URI"#midi_range_"#NUM, \
-	.offset = offsetof(plugstate_t, range) + (NUM-1)*sizeof(float), \
-	.type = LV2_ATOM__Float, \
-}
+static void
+_intercept_limit(void *data, int64_t frames, props_impl_t *impl)
+{
+	plughandle_t *handle = data;
 
-#define PRESSURE(NUM) \
-{ \
-	.property = ESPRESSIVO_URI"#midi_pressure_controller_"#NUM, \
-	.offset = offsetof(plugstate_t, pressure) + (NUM-1)*sizeof(int32_t), \
-	.type = LV2_ATOM__Int, \
+	_limit_apply(handle->xpressO, &handle->state.limit, handle->perf.period);
 }
 
-#define TIMBRE(NUM) \
-{ \
-	.property = ESPRESSIVO_URI"#midi_timbre_controller_"#NUM, \
-	.offset = offsetof(plugstate_t, timbre) + (NUM-1)*sizeof(int32_t), \
-	.type = LV2_ATOM__Int, \
+static void
+_intercept_coalesce(void *data, int64_t frames, props_impl_t *impl)
+{
+	plughandle_t *handle = data;
+
+	xpress_coalesce(handle->xpressO, handle->state.coalesce);
 }
 
-#define MODE(NUM) \
-{ \
-	.property = ESPRESSIVO_URI"#midi_pressure_mode_"#NUM, \
-	.offset = offsetof(plugstate_t, mode) + (NUM-1)*sizeof(int32_t), \
-	.type = LV2_ATOM__Int, \
+static void
+_intercept_delta(void *data, int64_t frames, props_impl_t *impl)
+{
+	plughandle_t *handle = data;
+
+	xpress_delta(handle->xpressO, handle->state.delta);
 }
 
 static const props_def_t defs [MAX_NPROPS] = {
-	RANGE(1),
-	RANGE(2),
-	RANGE(3),
-	RANGE(4),
-	RANGE(5),
-	RANGE(6),
-	RANGE(7),
-	RANGE(8),
-	RANGE(9),
-	RANGE(10),
-	RANGE(11),
-	RANGE(12),
-	RANGE(13),
-	RANGE(14),
-	RANGE(15),
-	RANGE(16),
-
-	PRESSURE(1),
-	PRESSURE(2),
-	PRESSURE(3),
-	PRESSURE(4),
-	PRESSURE(5),
-	PRESSURE(6),
-	PRESSURE(7),
-	PRESSURE(8),
-	PRESSURE(9),
-	PRESSURE(10),
-	PRESSURE(11),
-	PRESSURE(12),
-	PRESSURE(13),
-	PRESSURE(14),
-	PRESSURE(15),
-	PRESSURE(16),
-
-	TIMBRE(1),
-	TIMBRE(2),
-	TIMBRE(3),
-	TIMBRE(4),
-	TIMBRE(5),
-	TIMBRE(6),
-	TIMBRE(7),
-	TIMBRE(8),
-	TIMBRE(9),
-	TIMBRE(10),
-	TIMBRE(11),
-	TIMBRE(12),
-	TIMBRE(13),
-	TIMBRE(14),
-	TIMBRE(15),
-	TIMBRE(16),
-
-	MODE(1),
-	MODE(2),
-	MODE(3),
-	MODE(4),
-	MODE(5),
-	MODE(6),
-	MODE(7),
-	MODE(8),
-	MODE(9),
-	MODE(10),
-	MODE(11),
-	MODE(12),
-	MODE(13),
-	MODE(14),
-	MODE(15),
-	MODE(16)
+	{
+		.property = ESPRESSIVO_URI"#midi_range",
+		.offset = offsetof(plugstate_t, range),
+		.type = LV2_ATOM__Vector,
+		.child_type = LV2_ATOM__Float,
+		.nelems = 0x10,
+		.alias = ESPRESSIVO_URI"#midi_range_"
+	},
+	{
+		.property = ESPRESSIVO_URI"#midi_pressure_controller",
+		.offset = offsetof(plugstate_t, pressure),
+		.type = LV2_ATOM__Vector,
+		.child_type = LV2_ATOM__Int,
+		.nelems = 0x10,
+		.alias = ESPRESSIVO_URI"#midi_pressure_controller_"
+	},
+	{
+		.property = ESPRESSIVO_URI"#midi_timbre_controller",
+		.offset = offsetof(plugstate_t, timbre),
+		.type = LV2_ATOM__Vector,
+		.child_type = LV2_ATOM__Int,
+		.nelems = 0x10,
+		.alias = ESPRESSIVO_URI"#midi_timbre_controller_"
+	},
+	{
+		.property = ESPRESSIVO_URI"#midi_pressure_mode",
+		.offset = offsetof(plugstate_t, mode),
+		.type = LV2_ATOM__Vector,
+		.child_type = LV2_ATOM__Int,
+		.nelems = 0x10,
+		.alias = ESPRESSIVO_URI"#midi_pressure_mode_"
+	},
+	{
+		.property = ESPRESSIVO_URI"#coalesce_policy",
+		.offset = offsetof(plugstate_t, coalesce),
+		.type = LV2_ATOM__Int,
+		.event_cb = _intercept_coalesce
+	},
+	{
+		.property = ESPRESSIVO_URI"#delta_tokens",
+		.offset = offsetof(plugstate_t, delta),
+		.type = LV2_ATOM__Bool,
+		.event_cb = _intercept_delta
+	},
+	LIMIT_DEFS(plugstate_t, limit, _intercept_limit),
+	PERF_DEFS(plugstate_t, perf)
 };
 
 static const xpress_iface_t ifaceO = {
@@ -221,42 +204,53 @@ instantiate(const LV2_Descriptor* descriptor, double rate,
 		return NULL;
 	}
 
+	handle->map = espressivo_map_ref(handle->map);
+
+	const unsigned max_nvoices = xpress_max_nvoices(handle->map, features,
+		MAX_NVOICES, MAX_NVOICES_LIMIT);
+	const size_t pool_size = _pool_size(max_nvoices, sizeof(targetO_t))
+		+ POOL_ALIGN(XPRESS_STAGE_SIZE(max_nvoices));
+	uint8_t *pool = handle->pool = calloc(1, pool_size);
+	if(!pool)
+	{
+		espressivo_map_unref(handle->map);
+		free(handle);
+		return NULL;
+	}
+
+	handle->xpressO = _pool_alloc(&pool, XPRESS_SIZE(max_nvoices));
+	handle->targetO = _pool_alloc(&pool, max_nvoices*sizeof(targetO_t));
+	xpress_stage_t *stageO = _pool_alloc(&pool, XPRESS_STAGE_SIZE(max_nvoices));
+
 	handle->uris.midi_MidiEvent = handle->map->map(handle->map->handle, LV2_MIDI__MidiEvent);
-	handle->uris.range[0x0] = handle->map->map(handle->map->handle, ESPRESSIVO_URI"#midi_range_1");
-	handle->uris.range[0x1] = handle->map->map(handle->map->handle, ESPRESSIVO_URI"#midi_range_2");
-	handle->uris.range[0x2] = handle->map->map(handle->map->handle, ESPRESSIVO_URI"#midi_range_3");
-	handle->uris.range[0x3] = handle->map->map(handle->map->handle, ESPRESSIVO_URI"#midi_range_4");
-	handle->uris.range[0x4] = handle->map->map(handle->map->handle, ESPRESSIVO_URI"#midi_range_5");
-	handle->uris.range[0x5] = handle->map->map(handle->map->handle, ESPRESSIVO_URI"#midi_range_6");
-	handle->uris.range[0x6] = handle->map->map(handle->map->handle, ESPRESSIVO_URI"#midi_range_7");
-	handle->uris.range[0x7] = handle->map->map(handle->map->handle, ESPRESSIVO_URI"#midi_range_8");
-	handle->uris.range[0x8] = handle->map->map(handle->map->handle, ESPRESSIVO_URI"#midi_range_9");
-	handle->uris.range[0x9] = handle->map->map(handle->map->handle, ESPRESSIVO_URI"#midi_range_10");
-	handle->uris.range[0xa] = handle->map->map(handle->map->handle, ESPRESSIVO_URI"#midi_range_11");
-	handle->uris.range[0xb] = handle->map->map(handle->map->handle, ESPRESSIVO_URI"#midi_range_12");
-	handle->uris.range[0xc] = handle->map->map(handle->map->handle, ESPRESSIVO_URI"#midi_range_13");
-	handle->uris.range[0xd] = handle->map->map(handle->map->handle, ESPRESSIVO_URI"#midi_range_14");
-	handle->uris.range[0xe] = handle->map->map(handle->map->handle, ESPRESSIVO_URI"#midi_range_15");
-	handle->uris.range[0xf] = handle->map->map(handle->map->handle, ESPRESSIVO_URI"#midi_range_16");
+	handle->uris.range = handle->map->map(handle->map->handle, ESPRESSIVO_URI"#midi_range");
 
 	lv2_atom_forge_init(&handle->forge, handle->map);
 	
-	if(  !xpress_init(&handle->xpressO, MAX_NVOICES, handle->map, voice_map,
+	if(  !xpress_init(handle->xpressO, max_nvoices, handle->map, voice_map,
 			XPRESS_EVENT_NONE, &ifaceO, handle->targetO, handle) )
 	{
+		free(handle->pool);
+		espressivo_map_unref(handle->map);
 		free(handle);
 		return NULL;
 	}
 
+	xpress_stage(handle->xpressO, stageO); // needed for coalescing and limiting
+
 	if(!props_init(&handle->props, descriptor->URI,
 		defs, MAX_NPROPS, &handle->state, &handle->stash,
-		handle->map, handle))
+		handle->restore, sizeof(plugstate_t), handle->map, handle))
 	{
 		fprintf(stderr, "failed to allocate property structure\n");
+		free(handle->pool);
+		espressivo_map_unref(handle->map);
 		free(handle);
 		return NULL;
 	}
 
+	_perf_init(&handle->perf, &handle->props, rate);
+
 	return handle;
 }
 
@@ -281,7 +275,7 @@ connect_port(LV2_Handle instance, uint32_t port, void *data)
 static targetO_t *
 _midi_get(plughandle_t *handle, uint8_t chan, uint8_t key, xpress_uuid_t *uuid)
 {
-	XPRESS_VOICE_FOREACH(&handle->xpressO, voice)
+	XPRESS_VOICE_FOREACH(handle->xpressO, voice)
 	{
 		targetO_t *dst = voice->target;
 
@@ -296,6 +290,24 @@ _midi_get(plughandle_t *handle, uint8_t chan, uint8_t key, xpress_uuid_t *uuid)
 	return NULL;
 }
 
+static void
+_handle_midi_note_off(plughandle_t *handle, LV2_Atom_Forge *forge, int64_t frames,
+	const uint8_t *m)
+{
+	const uint8_t chan = m[0] & 0x0f;
+	const uint8_t key = m[1];
+
+	xpress_uuid_t uuid;
+	targetO_t *target = _midi_get(handle, chan, key, &uuid);
+	if(target)
+	{
+		xpress_free(handle->xpressO, uuid);
+
+		if(handle->ref)
+			handle->ref = xpress_release(handle->xpressO, forge, frames, &uuid, 1);
+	}
+}
+
 static void
 _handle_midi_note_on(plughandle_t *handle, LV2_Atom_Forge *forge, int64_t frames,
 	const uint8_t *m)
@@ -303,8 +315,11 @@ _handle_midi_note_on(plughandle_t *handle, LV2_Atom_Forge *forge, int64_t frames
 	const uint8_t chan = m[0] & 0x0f;
 	const uint8_t key = m[1];
 
+	// a repeated note on retriggers, as only one note off will follow
+	_handle_midi_note_off(handle, forge, frames, m);
+
 	xpress_uuid_t uuid;
-	targetO_t *target = xpress_create(&handle->xpressO, &uuid);
+	targetO_t *target = xpress_create(handle->xpressO, &uuid);
 	if(target)
 	{
 		*target = targetO_vanilla;
@@ -327,25 +342,7 @@ _handle_midi_note_on(plughandle_t *handle, LV2_Atom_Forge *forge, int64_t frames
 		target->state.pressure = pressure;
 
 		if(handle->ref)
-			handle->ref = xpress_token(&handle->xpressO, forge, frames, target->uuid, &target->state);
-	}
-}
-
-static void
-_handle_midi_note_off(plughandle_t *handle, LV2_Atom_Forge *forge, int64_t frames,
-	const uint8_t *m)
-{
-	const uint8_t chan = m[0] & 0x0f;
-	const uint8_t key = m[1];
-
-	xpress_uuid_t uuid;
-	targetO_t *target = _midi_get(handle, chan, key, &uuid);
-	if(target)
-	{
-		xpress_free(&handle->xpressO, uuid);
-
-		if(handle->ref)
-			handle->ref = xpress_alive(&handle->xpressO, forge, frames);
+			handle->ref = xpress_token(handle->xpressO, forge, frames, target->uuid, &target->state);
 	}
 }
 
@@ -364,7 +361,7 @@ _handle_midi_note_pressure(plughandle_t *handle, LV2_Atom_Forge *forge, int64_t
 		target->state.pressure = pressure;
 
 		if(handle->ref)
-			handle->ref = xpress_token(&handle->xpressO, forge, frames, target->uuid, &target->state);
+			handle->ref = xpress_token(handle->xpressO, forge, frames, target->uuid, &target->state);
 	}
 }
 
@@ -373,9 +370,16 @@ _handle_midi_channel_pressure(plughandle_t *handle, LV2_Atom_Forge *forge, int64
 	const uint8_t *m)
 {
 	const uint8_t chan = m[0] & 0x0f;
+	LV2_Atom_Forge_Frame frame;
+
+	if(handle->xpressO->nvoices == 0)
+		return; // nothing to update
+
+	if(handle->ref)
+		handle->ref = xpress_batch_head(handle->xpressO, forge, frames, &frame);
 
 	// set pressure on all notes with matching channel
-	XPRESS_VOICE_FOREACH(&handle->xpressO, voice)
+	XPRESS_VOICE_FOREACH(handle->xpressO, voice)
 	{
 		targetO_t *target = voice->target;
 
@@ -385,9 +389,12 @@ _handle_midi_channel_pressure(plughandle_t *handle, LV2_Atom_Forge *forge, int64
 			target->state.pressure = pressure;
 
 			if(handle->ref)
-				handle->ref = xpress_token(&handle->xpressO, forge, frames, target->uuid, &target->state);
+				handle->ref = xpress_batch_token(handle->xpressO, forge, target->uuid, &target->state);
 		}
 	}
+
+	if(handle->ref)
+		xpress_batch_pop(handle->xpressO, forge, &frame);
 }
 
 static void
@@ -398,7 +405,15 @@ _handle_midi_bender(plughandle_t *handle, LV2_Atom_Forge *forge, int64_t frames,
 
 	handle->midi_bender[chan] = (((int16_t)m[2] << 7) | m[1]) - 0x2000;
 
-	XPRESS_VOICE_FOREACH(&handle->xpressO, voice)
+	LV2_Atom_Forge_Frame frame;
+
+	if(handle->xpressO->nvoices == 0)
+		return; // nothing to update
+
+	if(handle->ref)
+		handle->ref = xpress_batch_head(handle->xpressO, forge, frames, &frame);
+
+	XPRESS_VOICE_FOREACH(handle->xpressO, voice)
 	{
 		targetO_t *target = voice->target;
 
@@ -408,8 +423,11 @@ _handle_midi_bender(plughandle_t *handle, LV2_Atom_Forge *forge, int64_t frames,
 		target->state.pitch = _get_pitch(handle, target);
 
 		if(handle->ref)
-			handle->ref = xpress_token(&handle->xpressO, forge, frames, target->uuid, &target->state);
+			handle->ref = xpress_batch_token(handle->xpressO, forge, target->uuid, &target->state);
 	}
+
+	if(handle->ref)
+		xpress_batch_pop(handle->xpressO, forge, &frame);
 }
 
 static void
@@ -453,14 +471,14 @@ _handle_midi_controller(plughandle_t *handle, LV2_Atom_Forge *forge, int64_t fra
 					handle->state.range[chan] = (float)semi + cent*0.01f;
 
 					props_set(&handle->props, &handle->forge, frames,
-						handle->uris.range[chan], &handle->ref);
+						handle->uris.range, &handle->ref);
 				} break;
 			}
 		} break;
 
 		default:
 		{
-			XPRESS_VOICE_FOREACH(&handle->xpressO, voice)
+			XPRESS_VOICE_FOREACH(handle->xpressO, voice)
 			{
 				targetO_t *target = voice->target;
 				bool put = false;
@@ -492,7 +510,7 @@ _handle_midi_controller(plughandle_t *handle, LV2_Atom_Forge *forge, int64_t fra
 				if(put)
 				{
 					if(handle->ref)
-						handle->ref = xpress_token(&handle->xpressO, forge, frames, target->uuid, &target->state);
+						handle->ref = xpress_token(handle->xpressO, forge, frames, target->uuid, &target->state);
 				}
 			}
 		} break;
@@ -539,6 +557,8 @@ run(LV2_Handle instance, uint32_t nsamples)
 {
 	plughandle_t *handle = instance;
 
+	_perf_begin(&handle->perf);
+
 	// prepare midi atom forge
 	const uint32_t capacity = handle->notify->atom.size;
 	LV2_Atom_Forge *forge = &handle->forge;
@@ -547,7 +567,7 @@ run(LV2_Handle instance, uint32_t nsamples)
 	handle->ref = lv2_atom_forge_sequence_head(forge, &frame, 0);
 
 	props_idle(&handle->props, forge, 0, &handle->ref);
-	xpress_rst(&handle->xpressO);
+	xpress_rst(handle->xpressO);
 
 	LV2_ATOM_SEQUENCE_FOREACH(handle->control, ev)
 	{
@@ -558,7 +578,8 @@ run(LV2_Handle instance, uint32_t nsamples)
 		{
 			const uint8_t *m = LV2_ATOM_BODY_CONST(&obj->atom);
 
-			_handle_midi(handle, forge, frames, m);
+			if(_midi_is_voice_message(&obj->atom))
+				_handle_midi(handle, forge, frames, m);
 		}
 		else
 		{
@@ -566,13 +587,21 @@ run(LV2_Handle instance, uint32_t nsamples)
 		}
 	}
 
-	if(handle->ref && !xpress_synced(&handle->xpressO))
-		handle->ref = xpress_alive(&handle->xpressO, forge, nsamples-1);
+	xpress_flush(handle->xpressO, forge, nsamples, &handle->ref);
+
+	if(handle->ref && !xpress_synced(handle->xpressO))
+		handle->ref = xpress_alive(handle->xpressO, forge, nsamples-1);
+
+	_perf_end(&handle->perf, &handle->state.perf, &handle->props, forge, nsamples,
+		handle->control, handle->notify, handle->xpressO, &handle->ref);
 
 	if(handle->ref)
 		lv2_atom_forge_pop(forge, &frame);
 	else
+	{
 		lv2_atom_sequence_clear(handle->notify);
+		xpress_discard(handle->xpressO);
+	}
 }
 
 static void
@@ -582,7 +611,9 @@ cleanup(LV2_Handle instance)
 
 	if(handle)
 	{
-		xpress_deinit(&handle->xpressO);
+		xpress_deinit(handle->xpressO);
+		free(handle->pool);
+		espressivo_map_unref(handle->map);
 		free(handle);
 	}
 }
@@ -24,7 +24,7 @@
 
 #include <mpe.h>
 
-#define MAX_NPROPS (4*0x10)
+#define MAX_NPROPS (4 + PERF_NPROPS)
 
 typedef struct _targetI_t targetI_t;
 typedef struct _plugstate_t plugstate_t;
@@ -39,6 +39,7 @@ typedef enum _pressure_mode_t
 } pressure_mode_t;
 
 struct _targetI_t {
+	bool valid;
 	uint8_t chan;
 	uint8_t key;
 
@@ -53,6 +54,8 @@ struct _plugstate_t {
 	int32_t pressure [0x10];
 	int32_t timbre [0x10];
 	int32_t mode [0x10];
+
+	perf_state_t perf;
 };
 
 struct _plughandle_t {
@@ -64,8 +67,9 @@ struct _plughandle_t {
 	LV2_Atom_Forge forge;
 	LV2_Atom_Forge_Ref ref;
 
-	XPRESS_T(xpressI, MAX_NVOICES);
-	targetI_t targetI [MAX_NVOICES];
+	xpress_t *xpressI;
+	targetI_t *targetI;
+	void *pool;
 
 	const LV2_Atom_Sequence *event_in;
 	LV2_Atom_Sequence *event_out;
@@ -74,6 +78,11 @@ struct _plughandle_t {
 
 	plugstate_t state;
 	plugstate_t stash;
+	plugstate_t restore [PROPS_NRESTORE];
+	perf_t perf;
+
+	uint32_t offs [0x10][0x80/32]; // note-offs not yet delivered
+	bool offs_pending;
 };
 
 static inline LV2_Atom_Forge_Ref
@@ -92,150 +101,84 @@ _midi_event(plughandle_t *handle, int64_t frames, const uint8_t *m, size_t len)
 }
 
 static void
-_intercept_midi_range(void *data, int64_t frames, props_impl_t *impl)
+_intercept_midi_range(void *data, int64_t frames, props_impl_t *impl,
+	uint32_t chan)
 {
 	plughandle_t *handle = data;
 
-	const size_t chan = (float *)impl->value.body - handle->state.range;
-
-	if( (chan >= 0x0) && (chan < 0xf) )
-	{
-		const uint8_t rpn_lsb [3] = {
-			LV2_MIDI_MSG_CONTROLLER | chan,
-			LV2_MIDI_CTL_RPN_LSB,
-			0x0
-		};
-
-		const uint8_t rpn_msb [3] = {
-			LV2_MIDI_MSG_CONTROLLER | chan,
-			LV2_MIDI_CTL_RPN_MSB,
-			0x0
-		};
-
-		const float range = handle->state.range[chan];
-		const uint8_t semis = floorf(range);
-		const uint8_t cents = floorf( (range - semis) * 100.f);
-
-		const uint8_t data_lsb [3] = {
-			LV2_MIDI_MSG_CONTROLLER | chan,
-			LV2_MIDI_CTL_LSB_DATA_ENTRY,
-			cents
-		};
-
-		const uint8_t data_msb [3] = {
-			LV2_MIDI_MSG_CONTROLLER | chan,
-			LV2_MIDI_CTL_MSB_DATA_ENTRY,
-			semis
-		};
+	const uint8_t rpn_lsb [3] = {
+		LV2_MIDI_MSG_CONTROLLER | chan,
+		LV2_MIDI_CTL_RPN_LSB,
+		0x0
+	};
 
-		if(handle->ref)
-			handle->ref = _midi_event(handle, frames, rpn_lsb, 3);
-		if(handle->ref)
-			handle->ref = _midi_event(handle, frames, rpn_msb, 3);
-		if(handle->ref)
-			handle->ref = _midi_event(handle, frames, data_lsb, 3);
-		if(handle->ref)
-			handle->ref = _midi_event(handle, frames, data_msb, 3);
-	}
-}
+	const uint8_t rpn_msb [3] = {
+		LV2_MIDI_MSG_CONTROLLER | chan,
+		LV2_MIDI_CTL_RPN_MSB,
+		0x0
+	};
 
-#define RANGE(NUM) \
-{ \
-	.property = ESPRESSIVO_URI"#midi_range_"#NUM, \
-	.offset = offsetof(plugstate_t, range) + (NUM-1)*sizeof(float), \
-	.type = LV2_ATOM__Float, \
-	.event_cb = _intercept_midi_range, \
-}
+	const float range = fmaxf(0.f, fminf(handle->state.range[chan], 0x7f));
+	const uint8_t semis = floorf(range);
+	const uint8_t cents = floorf( (range - semis) * 100.f);
 
-#define PRESSURE(NUM) \
-{ \
-	.property = ESPRESSIVO_URI"#midi_pressure_"#NUM, \
-	.offset = offsetof(plugstate_t, pressure) + (NUM-1)*sizeof(int32_t), \
-	.type = LV2_ATOM__Int, \
-}
+	const uint8_t data_lsb [3] = {
+		LV2_MIDI_MSG_CONTROLLER | chan,
+		LV2_MIDI_CTL_LSB_DATA_ENTRY,
+		cents
+	};
 
-#define TIMBRE(NUM) \
-{ \
-	.property = ESPRESSIVO_URI"#midi_timbre_"#NUM, \
-	.offset = offsetof(plugstate_t, timbre) + (NUM-1)*sizeof(int32_t), \
-	.type = LV2_ATOM__Int, \
-}
+	const uint8_t data_msb [3] = {
+		LV2_MIDI_MSG_CONTROLLER | chan,
+		LV2_MIDI_CTL_MSB_DATA_ENTRY,
+		semis
+	};
 
-#define MODE(NUM) \
-{ \
-	.property = ESPRESSIVO_URI"#midi_pressure_mode_"#NUM, \
-	.offset = offsetof(plugstate_t, mode) + (NUM-1)*sizeof(int32_t), \
-	.type = LV2_ATOM__Int, \
+	if(handle->ref)
+		handle->ref = _midi_event(handle, frames, rpn_lsb, 3);
+	if(handle->ref)
+		handle->ref = _midi_event(handle, frames, rpn_msb, 3);
+	if(handle->ref)
+		handle->ref = _midi_event(handle, frames, data_lsb, 3);
+	if(handle->ref)
+		handle->ref = _midi_event(handle, frames, data_msb, 3);
 }
 
 static const props_def_t defs [MAX_NPROPS] = {
-	RANGE(1),
-	RANGE(2),
-	RANGE(3),
-	RANGE(4),
-	RANGE(5),
-	RANGE(6),
-	RANGE(7),
-	RANGE(8),
-	RANGE(9),
-	RANGE(10),
-	RANGE(11),
-	RANGE(12),
-	RANGE(13),
-	RANGE(14),
-	RANGE(15),
-	RANGE(16),
-
-	PRESSURE(1),
-	PRESSURE(2),
-	PRESSURE(3),
-	PRESSURE(4),
-	PRESSURE(5),
-	PRESSURE(6),
-	PRESSURE(7),
-	PRESSURE(8),
-	PRESSURE(9),
-	PRESSURE(10),
-	PRESSURE(11),
-	PRESSURE(12),
-	PRESSURE(13),
-	PRESSURE(14),
-	PRESSURE(15),
-	PRESSURE(16),
-
-	TIMBRE(1),
-	TIMBRE(2),
-	TIMBRE(3),
-	TIMBRE(4),
-	TIMBRE(5),
-	TIMBRE(6),
-	TIMBRE(7),
-	TIMBRE(8),
-	TIMBRE(9),
-	TIMBRE(10),
-	TIMBRE(11),
-	TIMBRE(12),
-	TIMBRE(13),
-	TIMBRE(14),
-	TIMBRE(15),
-	TIMBRE(16),
-
-	MODE(1),
-	MODE(2),
-	MODE(3),
-	MODE(4),
-	MODE(5),
-	MODE(6),
-	MODE(7),
-	MODE(8),
-	MODE(9),
-	MODE(10),
-	MODE(11),
-	MODE(12),
-	MODE(13),
-	MODE(14),
-	MODE(15),
-	MODE(16)
+	{
+		.property = ESPRESSIVO_URI"#midi_range",
+		.offset = offsetof(plugstate_t, range),
+		.type = LV2_ATOM__Vector,
+		.child_type = LV2_ATOM__Float,
+		.nelems = 0x10,
+		.elem_cb = _intercept_midi_range,
+		.alias = ESPRESSIVO_URI"#midi_range_"
+	},
+	{
+		.property = ESPRESSIVO_URI"#midi_pressure_controller",
+		.offset = offsetof(plugstate_t, pressure),
+		.type = LV2_ATOM__Vector,
+		.child_type = LV2_ATOM__Int,
+		.nelems = 0x10,
+		.alias = ESPRESSIVO_URI"#midi_pressure_"
+	},
+	{
+		.property = ESPRESSIVO_URI"#midi_timbre_controller",
+		.offset = offsetof(plugstate_t, timbre),
+		.type = LV2_ATOM__Vector,
+		.child_type = LV2_ATOM__Int,
+		.nelems = 0x10,
+		.alias = ESPRESSIVO_URI"#midi_timbre_"
+	},
+	{
+		.property = ESPRESSIVO_URI"#midi_pressure_mode",
+		.offset = offsetof(plugstate_t, mode),
+		.type = LV2_ATOM__Vector,
+		.child_type = LV2_ATOM__Int,
+		.nelems = 0x10,
+		.alias = ESPRESSIVO_URI"#midi_pressure_mode_"
+	},
+	PERF_DEFS(plugstate_t, perf)
 };
 
 static inline void
@@ -244,7 +187,7 @@ _upd(plughandle_t *handle, int64_t frames, const xpress_state_t *state,
 {
 	// bender
 	{
-		const uint16_t bnd = (val - src->key) * src->range * 0x1fff + 0x2000;
+		const uint16_t bnd = _midi_14bit( (val - src->key) * src->range * 0x1fff + 0x2000);
 		const uint8_t bnd_msb = bnd >> 7;
 		const uint8_t bnd_lsb = bnd & 0x7f;
 
@@ -260,7 +203,7 @@ _upd(plughandle_t *handle, int64_t frames, const xpress_state_t *state,
 
 	// pressure
 	{
-		const uint16_t z = state->pressure * 0x3fff;
+		const uint16_t z = _midi_14bit(state->pressure * 0x3fff);
 		const uint8_t z_msb = z >> 7;
 		const uint8_t z_lsb = z & 0x7f;
 
@@ -315,7 +258,7 @@ _upd(plughandle_t *handle, int64_t frames, const xpress_state_t *state,
 
 	// timbre
 	{
-		const uint16_t z = state->timbre * 0x3fff;
+		const uint16_t z = _midi_14bit(state->timbre * 0x3fff);
 		const uint8_t z_msb = z >> 7;
 		const uint8_t z_lsb = z & 0x7f;
 
@@ -348,17 +291,25 @@ _add(void *data, int64_t frames, const xpress_state_t *state,
 	targetI_t *src = target;
 
 	const float val = state->pitch * 0x7f;
+	const float key = floorf(val);
+
+	// voices beyond the MIDI channel and key range stay silent, as do voices
+	// whose note-off could not be forged anymore
+	src->valid = _zone_valid(state->zone, 0x10) && (key >= 0x0) && (key <= 0x7f)
+		&& !_midi_tight(&handle->forge, handle->xpressI->nvoices + 1);
+	if(!src->valid)
+		return;
 
 	// these will remain fixed per note
 	src->chan = state->zone;
-	src->key = floorf(val);
+	src->key = key;
 	src->mode = handle->state.mode[state->zone];
 	src->range = handle->state.range[state->zone];
-	src->pressure = handle->state.pressure[state->zone];
-	src->timbre = handle->state.timbre[state->zone];
+	src->pressure = _clamp_int(handle->state.pressure[state->zone], 0x0, 0x1f);
+	src->timbre = _clamp_int(handle->state.timbre[state->zone], 0x0, 0x1f);
 
 	const uint8_t vel = (src->mode == MODE_NOTE_VELOCITY)
-		? state->pressure * 0x7f
+		? _midi_14bit(state->pressure * 0x3fff) >> 7
 		: 0x7f; //FIXME make this configurable
 
 	const uint8_t note_on [3] = {
@@ -370,7 +321,8 @@ _add(void *data, int64_t frames, const xpress_state_t *state,
 	if(handle->ref)
 		handle->ref = _midi_event(handle, frames, note_on, 3);
 
-	_upd(handle, frames, state, val, src);
+	if(!_midi_tight(&handle->forge, handle->xpressI->nvoices))
+		_upd(handle, frames, state, val, src);
 }
 
 static void
@@ -382,7 +334,9 @@ _set(void *data, int64_t frames, const xpress_state_t *state,
 
 	const float val = state->pitch * 0x7f;
 
-	_upd(handle, frames, state, val, src);
+	// continuous updates are shed first when running out of space
+	if(src->valid && !_midi_tight(&handle->forge, handle->xpressI->nvoices))
+		_upd(handle, frames, state, val, src);
 }
 
 static void
@@ -392,6 +346,13 @@ _del(void *data, int64_t frames,
 	plughandle_t *handle = data;
 	targetI_t *src = target;
 
+	if(!src->valid)
+		return;
+
+	// resent next cycle if this one overflows
+	handle->offs[src->chan][src->key >> 5] |= 1U << (src->key & 0x1f);
+	handle->offs_pending = true;
+
 	const uint8_t vel = 0x0; //FIXME maybe we want src->pressure here ?
 
 	const uint8_t note_off [3] = {
@@ -404,6 +365,28 @@ _del(void *data, int64_t frames,
 		handle->ref = _midi_event(handle, frames, note_off, 3);
 }
 
+static void
+_note_offs(plughandle_t *handle)
+{
+	for(unsigned chan = 0; chan < 0x10; chan++)
+	{
+		for(unsigned key = 0; key < 0x80; key++)
+		{
+			if(!(handle->offs[chan][key >> 5] & (1U << (key & 0x1f))))
+				continue;
+
+			const uint8_t note_off [3] = {
+				LV2_MIDI_MSG_NOTE_OFF | chan,
+				key,
+				0x0
+			};
+
+			if(handle->ref)
+				handle->ref = _midi_event(handle, 0, note_off, 3);
+		}
+	}
+}
+
 static const xpress_iface_t ifaceI = {
 	.size = sizeof(targetI_t),
 
@@ -437,25 +420,47 @@ instantiate(const LV2_Descriptor* descriptor, double rate,
 		return NULL;
 	}
 
+	handle->map = espressivo_map_ref(handle->map);
+
+	const unsigned max_nvoices = xpress_max_nvoices(handle->map, features,
+		MAX_NVOICES, MAX_NVOICES_LIMIT);
+	const size_t pool_size = _pool_size(max_nvoices, sizeof(targetI_t));
+	uint8_t *pool = handle->pool = calloc(1, pool_size);
+	if(!pool)
+	{
+		espressivo_map_unref(handle->map);
+		free(handle);
+		return NULL;
+	}
+
+	handle->xpressI = _pool_alloc(&pool, XPRESS_SIZE(max_nvoices));
+	handle->targetI = _pool_alloc(&pool, max_nvoices*sizeof(targetI_t));
+
 	handle->uris.midi_MidiEvent = handle->map->map(handle->map->handle, LV2_MIDI__MidiEvent);
 
 	lv2_atom_forge_init(&handle->forge, handle->map);
 
-	if(!xpress_init(&handle->xpressI, MAX_NVOICES, handle->map, voice_map,
+	if(!xpress_init(handle->xpressI, max_nvoices, handle->map, voice_map,
 			XPRESS_EVENT_ALL, &ifaceI, handle->targetI, handle))
 	{
+		free(handle->pool);
+		espressivo_map_unref(handle->map);
 		free(handle);
 		return NULL;
 	}
 
 	if(!props_init(&handle->props, descriptor->URI,
 		defs, MAX_NPROPS, &handle->state, &handle->stash,
-		handle->map, handle))
+		handle->restore, sizeof(plugstate_t), handle->map, handle))
 	{
+		free(handle->pool);
+		espressivo_map_unref(handle->map);
 		free(handle);
 		return NULL;
 	}
 
+	_perf_init(&handle->perf, &handle->props, rate);
+
 	return handle;
 }
 
@@ -482,6 +487,8 @@ run(LV2_Handle instance, uint32_t nsamples)
 {
 	plughandle_t *handle = instance;
 
+	_perf_begin(&handle->perf);
+
 	// prepare midi atom forge
 	const uint32_t capacity = handle->event_out->atom.size;
 	LV2_Atom_Forge *forge = &handle->forge;
@@ -489,8 +496,12 @@ run(LV2_Handle instance, uint32_t nsamples)
 	LV2_Atom_Forge_Frame frame;
 	handle->ref = lv2_atom_forge_sequence_head(forge, &frame, 0);
 
+	// note-offs of an overflown and thus cleared cycle are not to be lost
+	if(handle->offs_pending)
+		_note_offs(handle);
+
 	props_idle(&handle->props, forge, 0, &handle->ref);
-	xpress_pre(&handle->xpressI);
+	xpress_pre(handle->xpressI);
 
 	LV2_ATOM_SEQUENCE_FOREACH(handle->event_in, ev)
 	{
@@ -499,14 +510,25 @@ run(LV2_Handle instance, uint32_t nsamples)
 
 		if(!props_advance(&handle->props, forge, frames, obj, &handle->ref))
 		{
-			xpress_advance(&handle->xpressI, forge, frames, obj, &handle->ref);
+			xpress_advance(handle->xpressI, forge, frames, obj, &handle->ref);
 		}
 	}
 
-	xpress_post(&handle->xpressI, nsamples-1);
+	xpress_post(handle->xpressI, nsamples-1);
+
+	_perf_end(&handle->perf, &handle->state.perf, &handle->props, forge, nsamples,
+		handle->event_in, handle->event_out, handle->xpressI, &handle->ref);
 
 	if(handle->ref)
+	{
 		lv2_atom_forge_pop(forge, &frame);
+
+		if(handle->offs_pending)
+		{
+			memset(handle->offs, 0x0, sizeof(handle->offs));
+			handle->offs_pending = false;
+		}
+	}
 	else
 		lv2_atom_sequence_clear(handle->event_out);
 }
@@ -518,7 +540,9 @@ cleanup(LV2_Handle instance)
 
 	if(handle)
 	{
-		xpress_deinit(&handle->xpressI);
+		xpress_deinit(handle->xpressI);
+		free(handle->pool);
+		espressivo_map_unref(handle->map);
 		free(handle);
 	}
 }
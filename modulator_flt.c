@@ -22,35 +22,15 @@
 #include <espressivo.h>
 #include <props.h>
 
-#define MAX_NPROPS 9
+#define MAX_NPROPS (9 + PERF_NPROPS)
 
-typedef enum _enum_t enum_t;
-typedef enum _op_t op_t;
 typedef struct _targetI_t targetI_t;
 typedef struct _targetO_t targetO_t;
 typedef struct _plugstate_t plugstate_t;
 typedef struct _plughandle_t plughandle_t;
 
-enum _enum_t {
-	ENUM_PITCH = 0,
-	ENUM_PRESSURE,
-	ENUM_TIMBRE,
-	ENUM_DPITCH,
-	ENUM_DPRESSURE,
-	ENUM_DTIMBRE
-};
-
-enum _op_t {
-	OP_ADD = 0,
-	OP_SUB,
-	OP_MUL,
-	OP_DIV,
-	OP_POW,
-	OP_SET
-};
-
 struct _targetI_t {
-	xpress_uuid_t uuid;
+	xpress_handle_t voice;
 	int32_t zone_mask;
 };
 
@@ -62,12 +42,10 @@ struct _plugstate_t {
 	int32_t zone_mask_src;
 	int32_t zone_mask_mod;;
 	int32_t zone_offset;;
-	int32_t enum_src;
-	int32_t enum_mod;
-	float multiplier;
-	float adder;
-	int32_t op;
+	modulator_state_t mod;
 	int32_t reset;
+
+	perf_state_t perf;
 };
 
 struct _plughandle_t {
@@ -76,16 +54,19 @@ struct _plughandle_t {
 	LV2_Atom_Forge_Ref ref;
 
 	PROPS_T(props, MAX_NPROPS);
-	XPRESS_T(xpressI, MAX_NVOICES);
-	XPRESS_T(xpressO, MAX_NVOICES);
-	targetI_t targetI [MAX_NVOICES];
-	targetO_t targetO [MAX_NVOICES];
+	xpress_t *xpressI;
+	xpress_t *xpressO;
+	targetI_t *targetI;
+	targetO_t *targetO;
+	void *pool;
 
 	const LV2_Atom_Sequence *event_in;
 	LV2_Atom_Sequence *event_out;
 
 	plugstate_t state;
 	plugstate_t stash;
+	plugstate_t restore [PROPS_NRESTORE];
+	perf_t perf;
 
 	xpress_uuid_t uuid;
 	xpress_state_t modu;
@@ -103,122 +84,32 @@ static const xpress_state_t empty_state = {
 	.dTimbre = 0.f
 };
 
-static inline float
-_clip(float min, float val, float max)
-{
-	if(val < min)
-		return min;
-	else if(val > max)
-		return max;
-	return val;
-}
-
-static inline float
-_op(plughandle_t *handle, float dst, float val)
-{
-	switch((op_t)handle->state.op)
-	{
-		case OP_ADD:
-			return dst + val;
-		case OP_SUB:
-			return dst - val;
-		case OP_MUL:
-			return dst * val;
-		case OP_DIV:
-			return (val == 0.f) ? 0.f : dst / val;
-		case OP_POW:
-			return powf(dst, val);
-		case OP_SET:
-			return val;
-	}
-
-	return 0.f;
-}
-
 static inline void
-_modulate(plughandle_t *handle, xpress_state_t *state)
+_upd(plughandle_t *handle, int64_t frames)
 {
-	float val = 0.f;
-
-	switch((enum_t)handle->state.enum_mod)
-	{
-		case ENUM_PITCH:
-		{
-			val = handle->modu.pitch;
-		}	break;
-		case ENUM_PRESSURE:
-		{
-			val = handle->modu.pressure;
-		}	break;
-		case ENUM_TIMBRE:
-		{
-			val = handle->modu.timbre;
-		}	break;
-		case ENUM_DPITCH:
-		{
-			val = handle->modu.dPitch;
-		}	break;
-		case ENUM_DPRESSURE:
-		{
-			val = handle->modu.dPressure;
-		}	break;
-		case ENUM_DTIMBRE:
-		{
-			val = handle->modu.dTimbre;
-		}	break;
-	}
+	LV2_Atom_Forge *forge = &handle->forge;
+	LV2_Atom_Forge_Frame frame;
 
-	val *= handle->state.multiplier;
-	val += handle->state.adder;
+	if(handle->xpressO->nvoices == 0)
+		return; // nothing to update
 
-	switch((enum_t)handle->state.enum_src)
-	{
-		case ENUM_PITCH:
-		{
-			state->pitch = _op(handle, state->pitch, val);
-			state->pitch = _clip(0.f, state->pitch, 1.f);
-		}	break;
-		case ENUM_PRESSURE:
-		{
-			state->pressure = _op(handle, state->pressure, val);
-			state->pressure = _clip(0.f, state->pressure, 1.f);
-		}	break;
-		case ENUM_TIMBRE:
-		{
-			state->timbre = _op(handle, state->timbre, val);
-			state->timbre = _clip(0.f, state->timbre, 1.f);
-		}	break;
-		case ENUM_DPITCH:
-		{
-			state->dPitch = _op(handle, state->dPitch, val);
-		}	break;
-		case ENUM_DPRESSURE:
-		{
-			state->dPressure = _op(handle, state->dPressure, val);
-		}	break;
-		case ENUM_DTIMBRE:
-		{
-			state->dTimbre = _op(handle, state->dTimbre, val);
-		}	break;
-	}
-}
+	if(handle->ref)
+		handle->ref = xpress_batch_head(handle->xpressO, forge, frames, &frame);
 
-static inline void
-_upd(plughandle_t *handle, int64_t frames)
-{
-	XPRESS_VOICE_FOREACH(&handle->xpressO, voice)
+	XPRESS_VOICE_FOREACH(handle->xpressO, voice)
 	{
-		LV2_Atom_Forge *forge = &handle->forge;
-
 		targetO_t *dst = voice->target;
 
 		xpress_state_t new_state = dst->state;
-		new_state.zone += handle->state.zone_offset;
-		_modulate(handle, &new_state);
+		new_state.zone = _zone_shift(new_state.zone, handle->state.zone_offset);
+		_modulator_apply(&handle->state.mod, &handle->modu, &new_state);
 
 		if(handle->ref)
-			handle->ref = xpress_token(&handle->xpressO, forge, frames, voice->uuid, &new_state);
+			handle->ref = xpress_batch_token(handle->xpressO, forge, voice->uuid, &new_state);
 	}
+
+	if(handle->ref)
+		xpress_batch_pop(handle->xpressO, forge, &frame);
 }
 
 static void
@@ -242,13 +133,13 @@ static const props_def_t defs [MAX_NPROPS] = {
 	},
 	{
 		.property = ESPRESSIVO_URI"#modulator_enum_src",
-		.offset = offsetof(plugstate_t, enum_src),
+		.offset = offsetof(plugstate_t, mod.enum_src),
 		.type = LV2_ATOM__Int,
 		.event_cb = _intercept
 	},
 	{
 		.property = ESPRESSIVO_URI"#modulator_enum_mod",
-		.offset = offsetof(plugstate_t, enum_mod),
+		.offset = offsetof(plugstate_t, mod.enum_mod),
 		.type = LV2_ATOM__Int,
 		.event_cb = _intercept
 	},
@@ -259,19 +150,19 @@ static const props_def_t defs [MAX_NPROPS] = {
 	},
 	{
 		.property = ESPRESSIVO_URI"#modulator_multiplier",
-		.offset = offsetof(plugstate_t, multiplier),
+		.offset = offsetof(plugstate_t, mod.multiplier),
 		.type = LV2_ATOM__Float,
 		.event_cb = _intercept
 	},
 	{
 		.property = ESPRESSIVO_URI"#modulator_adder",
-		.offset = offsetof(plugstate_t, adder),
+		.offset = offsetof(plugstate_t, mod.adder),
 		.type = LV2_ATOM__Float,
 		.event_cb = _intercept
 	},
 	{
 		.property = ESPRESSIVO_URI"#modulator_op",
-		.offset = offsetof(plugstate_t, op),
+		.offset = offsetof(plugstate_t, mod.op),
 		.type = LV2_ATOM__Int,
 		.event_cb = _intercept
 	},
@@ -279,7 +170,8 @@ static const props_def_t defs [MAX_NPROPS] = {
 		.property = ESPRESSIVO_URI"#modulator_reset",
 		.offset = offsetof(plugstate_t, reset),
 		.type = LV2_ATOM__Bool
-	}
+	},
+	PERF_DEFS(plugstate_t, perf)
 };
 
 static void
@@ -288,21 +180,24 @@ _add(void *data, int64_t frames, const xpress_state_t *state,
 {
 	plughandle_t *handle = data;
 	targetI_t *src = target;
-	src->zone_mask = 1 << state->zone;
+	src->zone_mask = _zone_bit(state->zone);
 
 	if(src->zone_mask & handle->state.zone_mask_src)
 	{
 		LV2_Atom_Forge *forge = &handle->forge;
 
-		targetO_t *dst = xpress_create(&handle->xpressO, &src->uuid);
-		dst->state = *state;
+		targetO_t *dst = xpress_create_h(handle->xpressO, &src->voice);
+		if(dst)
+		{
+			dst->state = *state;
 
-		xpress_state_t new_state = dst->state;
-		new_state.zone += handle->state.zone_offset;
-		_modulate(handle, &new_state);
+			xpress_state_t new_state = dst->state;
+			new_state.zone = _zone_shift(new_state.zone, handle->state.zone_offset);
+			_modulator_apply(&handle->state.mod, &handle->modu, &new_state);
 
-		if(handle->ref)
-			handle->ref = xpress_token(&handle->xpressO, forge, frames, src->uuid, &new_state);
+			if(handle->ref)
+				handle->ref = xpress_token_h(handle->xpressO, forge, frames, &src->voice, &new_state);
+		}
 	}
 
 	if(src->zone_mask & handle->state.zone_mask_mod)
@@ -328,15 +223,18 @@ _set(void *data, int64_t frames, const xpress_state_t *state,
 	{
 		LV2_Atom_Forge *forge = &handle->forge;
 
-		targetO_t *dst = xpress_get(&handle->xpressO, src->uuid);
-		dst->state = *state;
+		targetO_t *dst = xpress_get_h(handle->xpressO, &src->voice);
+		if(dst)
+		{
+			dst->state = *state;
 
-		xpress_state_t new_state = dst->state;
-		new_state.zone += handle->state.zone_offset;
-		_modulate(handle, &new_state);
+			xpress_state_t new_state = dst->state;
+			new_state.zone = _zone_shift(new_state.zone, handle->state.zone_offset);
+			_modulator_apply(&handle->state.mod, &handle->modu, &new_state);
 
-		if(handle->ref)
-			handle->ref = xpress_token(&handle->xpressO, forge, frames, src->uuid, &new_state);
+			if(handle->ref)
+				handle->ref = xpress_token_h(handle->xpressO, forge, frames, &src->voice, &new_state);
+		}
 	}
 
 	if(src->zone_mask & handle->state.zone_mask_mod)
@@ -357,14 +255,13 @@ _del(void *data, int64_t frames,
 	plughandle_t *handle = data;
 	targetI_t *src = target;
 
-	if(src->zone_mask & handle->state.zone_mask_src)
+	// release forwarded voices, even if the zone mask has changed meanwhile
+	if(xpress_free_h(handle->xpressO, &src->voice))
 	{
 		LV2_Atom_Forge *forge = &handle->forge;
 
-		xpress_free(&handle->xpressO, src->uuid);
-
 		if(handle->ref)
-			handle->ref = xpress_alive(&handle->xpressO, forge, frames);
+			handle->ref = xpress_release(handle->xpressO, forge, frames, &src->voice.uuid, 1);
 	}
 
 	if(src->zone_mask & handle->state.zone_mask_mod)
@@ -417,26 +314,51 @@ instantiate(const LV2_Descriptor* descriptor, double rate,
 		return NULL;
 	}
 
+	handle->map = espressivo_map_ref(handle->map);
+
+	const unsigned max_nvoices = xpress_max_nvoices(handle->map, features,
+		MAX_NVOICES, MAX_NVOICES_LIMIT);
+	const size_t pool_size = _pool_size(max_nvoices, sizeof(targetI_t))
+		+ _pool_size(max_nvoices, sizeof(targetO_t));
+	uint8_t *pool = handle->pool = calloc(1, pool_size);
+	if(!pool)
+	{
+		espressivo_map_unref(handle->map);
+		free(handle);
+		return NULL;
+	}
+
+	handle->xpressI = _pool_alloc(&pool, XPRESS_SIZE(max_nvoices));
+	handle->targetI = _pool_alloc(&pool, max_nvoices*sizeof(targetI_t));
+	handle->xpressO = _pool_alloc(&pool, XPRESS_SIZE(max_nvoices));
+	handle->targetO = _pool_alloc(&pool, max_nvoices*sizeof(targetO_t));
+
 	lv2_atom_forge_init(&handle->forge, handle->map);
 
-	if(  !xpress_init(&handle->xpressI, MAX_NVOICES, handle->map, voice_map,
+	if(  !xpress_init(handle->xpressI, max_nvoices, handle->map, voice_map,
 			XPRESS_EVENT_ALL, &ifaceI, handle->targetI, handle)
-		|| !xpress_init(&handle->xpressO, MAX_NVOICES, handle->map, voice_map,
+		|| !xpress_init(handle->xpressO, max_nvoices, handle->map, voice_map,
 			XPRESS_EVENT_NONE, &ifaceO, handle->targetO, handle) )
 	{
+		free(handle->pool);
+		espressivo_map_unref(handle->map);
 		free(handle);
 		return NULL;
 	}
 
 	if(!props_init(&handle->props, descriptor->URI,
 		defs, MAX_NPROPS, &handle->state, &handle->stash,
-		handle->map, handle))
+		handle->restore, sizeof(plugstate_t), handle->map, handle))
 	{
 		fprintf(stderr, "failed to allocate property structure\n");
+		free(handle->pool);
+		espressivo_map_unref(handle->map);
 		free(handle);
 		return NULL;
 	}
 
+	_perf_init(&handle->perf, &handle->props, rate);
+
 	return handle;
 }
 
@@ -463,6 +385,8 @@ run(LV2_Handle instance, uint32_t nsamples)
 {
 	plughandle_t *handle = instance;
 
+	_perf_begin(&handle->perf);
+
 	// prepare midi atom forge
 	const uint32_t capacity = handle->event_out->atom.size;
 	LV2_Atom_Forge *forge = &handle->forge;
@@ -471,8 +395,8 @@ run(LV2_Handle instance, uint32_t nsamples)
 	handle->ref = lv2_atom_forge_sequence_head(forge, &frame, 0);
 
 	props_idle(&handle->props, forge, 0, &handle->ref);
-	xpress_pre(&handle->xpressI);
-	xpress_rst(&handle->xpressO);
+	xpress_pre(handle->xpressI);
+	xpress_rst(handle->xpressO);
 
 	LV2_ATOM_SEQUENCE_FOREACH(handle->event_in, ev)
 	{
@@ -481,18 +405,26 @@ run(LV2_Handle instance, uint32_t nsamples)
 
 		if(!props_advance(&handle->props, forge, frames, obj, &handle->ref))
 		{
-			xpress_advance(&handle->xpressI, forge, frames, obj, &handle->ref);
+			xpress_advance(handle->xpressI, forge, frames, obj, &handle->ref);
 		}
 	}
 
-	xpress_post(&handle->xpressI, nsamples-1);
-	if(handle->ref && !xpress_synced(&handle->xpressO))
-		handle->ref = xpress_alive(&handle->xpressO, forge, nsamples-1);
+	xpress_flush(handle->xpressO, forge, nsamples, &handle->ref);
+
+	xpress_post(handle->xpressI, nsamples-1);
+	if(handle->ref && !xpress_synced(handle->xpressO))
+		handle->ref = xpress_alive(handle->xpressO, forge, nsamples-1);
+
+	_perf_end(&handle->perf, &handle->state.perf, &handle->props, forge, nsamples,
+		handle->event_in, handle->event_out, handle->xpressO, &handle->ref);
 
 	if(handle->ref)
 		lv2_atom_forge_pop(forge, &frame);
 	else
+	{
 		lv2_atom_sequence_clear(handle->event_out);
+		xpress_discard(handle->xpressO);
+	}
 }
 
 static void
@@ -502,8 +434,10 @@ cleanup(LV2_Handle instance)
 
 	if(handle)
 	{
-		xpress_deinit(&handle->xpressI);
-		xpress_deinit(&handle->xpressO);
+		xpress_deinit(handle->xpressI);
+		xpress_deinit(handle->xpressO);
+		free(handle->pool);
+		espressivo_map_unref(handle->map);
 		free(handle);
 	}
 }
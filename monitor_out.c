@@ -30,7 +30,7 @@
 #include <canvas.lv2/forge.h>
 
 #define MAX_GRAPH 0x20000 //FIXME actually measure this
-#define MAX_NPROPS 2
+#define MAX_NPROPS (2 + PERF_NPROPS)
 
 typedef struct _targetI_t targetI_t;
 typedef struct _plugstate_t plugstate_t;
@@ -42,9 +42,13 @@ struct _targetI_t {
 
 struct _plugstate_t {
 	float aspect_ratio;
-	uint8_t graph [MAX_GRAPH];
+	perf_state_t perf;
+
+	uint8_t graph [MAX_GRAPH]; // read-only, keep last to stay out of restore
 };
 
+#define RESTORE_SIZE offsetof(plugstate_t, graph)
+
 struct _plughandle_t {
 	LV2_URID_Map *map;
 	LV2_Atom_Forge forge;
@@ -64,14 +68,17 @@ struct _plughandle_t {
 
 	plugstate_t state;
 	plugstate_t stash;
+	uint8_t restore [PROPS_NRESTORE][RESTORE_SIZE];
+	perf_t perf;
 
 	uint32_t overflow;
 	uint32_t overflowsec;
 	uint32_t counter;
 
 	PROPS_T(props, MAX_NPROPS);
-	XPRESS_T(xpressI, MAX_NVOICES);
-	targetI_t targetI [MAX_NVOICES];
+	xpress_t *xpressI;
+	targetI_t *targetI;
+	void *pool;
 };
 
 static const props_def_t defs [MAX_NPROPS] = {
@@ -86,7 +93,8 @@ static const props_def_t defs [MAX_NPROPS] = {
 		.property = CANVAS__aspectRatio,
 		.offset = offsetof(plugstate_t, aspect_ratio),
 		.type = LV2_ATOM__Float
-	}
+	},
+	PERF_DEFS(plugstate_t, perf)
 };
 
 static void
@@ -156,6 +164,22 @@ instantiate(const LV2_Descriptor* descriptor, double rate,
 		return NULL;
 	}
 
+	handle->map = espressivo_map_ref(handle->map);
+
+	const unsigned max_nvoices = xpress_max_nvoices(handle->map, features,
+		MAX_NVOICES, MAX_NVOICES_LIMIT);
+	const size_t pool_size = _pool_size(max_nvoices, sizeof(targetI_t));
+	uint8_t *pool = handle->pool = calloc(1, pool_size);
+	if(!pool)
+	{
+		espressivo_map_unref(handle->map);
+		free(handle);
+		return NULL;
+	}
+
+	handle->xpressI = _pool_alloc(&pool, XPRESS_SIZE(max_nvoices));
+	handle->targetI = _pool_alloc(&pool, max_nvoices*sizeof(targetI_t));
+
 	if(handle->log)
 		lv2_log_logger_init(&handle->logger, handle->map, handle->log);
 
@@ -167,22 +191,28 @@ instantiate(const LV2_Descriptor* descriptor, double rate,
 	lv2_osc_urid_init(&handle->osc_urid, handle->map);
 	lv2_canvas_urid_init(&handle->canvas_urid, handle->map);
 
-	if(  !xpress_init(&handle->xpressI, MAX_NVOICES, handle->map, voice_map,
+	if(  !xpress_init(handle->xpressI, max_nvoices, handle->map, voice_map,
 			XPRESS_EVENT_ALL, &ifaceI, handle->targetI, handle) )
 	{
+		free(handle->pool);
+		espressivo_map_unref(handle->map);
 		free(handle);
 		return NULL;
 	}
 
 	if(!props_init(&handle->props, descriptor->URI,
 		defs, MAX_NPROPS, &handle->state, &handle->stash,
-		handle->map, handle))
+		handle->restore, RESTORE_SIZE, handle->map, handle))
 	{
 		fprintf(stderr, "failed to initialize property structure\n");
+		free(handle->pool);
+		espressivo_map_unref(handle->map);
 		free(handle);
 		return NULL;
 	}
 
+	_perf_init(&handle->perf, &handle->props, rate);
+
 	return handle;
 }
 
@@ -247,7 +277,7 @@ _render(plughandle_t *handle, uint32_t frames)
 			if(ref)
 				ref = lv2_canvas_forge_lineWidth(forge, canvas_urid, 0.005f);
 
-			XPRESS_VOICE_FOREACH(&handle->xpressI, voice)
+			XPRESS_VOICE_FOREACH(handle->xpressI, voice)
 			{
 				targetI_t *src = voice->target;
 
@@ -299,13 +329,15 @@ run(LV2_Handle instance, uint32_t nsamples)
 {
 	plughandle_t *handle = instance;
 
+	_perf_begin(&handle->perf);
+
 	const uint32_t capacity = handle->event_out->atom.size;
 	lv2_atom_forge_set_buffer(&handle->forge, (uint8_t *)handle->event_out, capacity);
 	LV2_Atom_Forge_Frame frame;
 	handle->ref = lv2_atom_forge_sequence_head(&handle->forge, &frame, 0);
 
 	props_idle(&handle->props, &handle->forge, 0, &handle->ref);
-	xpress_pre(&handle->xpressI);
+	xpress_pre(handle->xpressI);
 
 	LV2_ATOM_SEQUENCE_FOREACH(handle->event_in, ev)
 	{
@@ -314,11 +346,11 @@ run(LV2_Handle instance, uint32_t nsamples)
 
 		if(!props_advance(&handle->props, &handle->forge, frames, obj, &handle->ref))
 		{
-			xpress_advance(&handle->xpressI, &handle->forge, frames, obj, &handle->ref);
+			xpress_advance(handle->xpressI, &handle->forge, frames, obj, &handle->ref);
 		}
 	}
 
-	xpress_post(&handle->xpressI, nsamples-1);
+	xpress_post(handle->xpressI, nsamples-1);
 
 	handle->counter += nsamples;
 
@@ -338,6 +370,9 @@ run(LV2_Handle instance, uint32_t nsamples)
 		handle->needs_sync = false;
 	}
 
+	_perf_end(&handle->perf, &handle->state.perf, &handle->props, &handle->forge, nsamples,
+		handle->event_in, handle->event_out, handle->xpressI, &handle->ref);
+
 	if(handle->ref)
 		lv2_atom_forge_pop(&handle->forge, &frame);
 	else
@@ -355,7 +390,9 @@ cleanup(LV2_Handle instance)
 
 	if(handle)
 	{
-		xpress_deinit(&handle->xpressI);
+		xpress_deinit(handle->xpressI);
+		free(handle->pool);
+		espressivo_map_unref(handle->map);
 		free(handle);
 	}
 }
@@ -25,7 +25,7 @@
 
 #include <mpe.h>
 
-#define MAX_NPROPS (1 + MPE_ZONE_MAX*2)
+#define MAX_NPROPS (3 + 2 + LIMIT_NPROPS + PERF_NPROPS)
 #define MAX_ZONES 8
 #define MAX_CHANNELS 16
 
@@ -60,6 +60,11 @@ struct _plugstate_t {
 	int32_t num_zones;
 	int32_t master_range [MPE_ZONE_MAX];
 	int32_t voice_range [MPE_ZONE_MAX];
+	int32_t coalesce;
+	int32_t delta;
+
+	limit_state_t limit;
+	perf_state_t perf;
 };
 
 struct _plughandle_t {
@@ -75,40 +80,52 @@ struct _plughandle_t {
 
 	PROPS_T(props, MAX_NPROPS);
 
-	XPRESS_T(xpressO, MAX_NVOICES);
-	targetO_t targetO [MAX_NVOICES];
+	xpress_t *xpressO;
+	targetO_t *targetO;
+	void *pool;
 
 	uint16_t data;
 	uint16_t rpn;
 
 	slot_t slots [MAX_ZONES];
 	slot_t *index [MAX_CHANNELS];
+	xpress_uuid_t uuids [MAX_CHANNELS];
 
 	plugstate_t state;
 	plugstate_t stash;
+	plugstate_t restore [PROPS_NRESTORE];
+	perf_t perf;
 	struct {
 		LV2_URID num_zones;
-		LV2_URID master_range [MPE_ZONE_MAX];
-		LV2_URID voice_range [MPE_ZONE_MAX];
+		LV2_URID master_range;
+		LV2_URID voice_range;
 	} urid;
 };
 
 static const targetO_t targetO_vanilla;
 
-#define MASTER_RANGE(NUM) \
-{ \
-	.property = ESPRESSIVO_URI"#mpe_master_range_"#NUM, \
-	.offset = offsetof(plugstate_t, master_range) + (NUM-1)*sizeof(int32_t), \
-	.access = LV2_PATCH__readable, \
-	.type = LV2_ATOM__Int, \
+static void
+_intercept_limit(void *data, int64_t frames, props_impl_t *impl)
+{
+	plughandle_t *handle = data;
+
+	_limit_apply(handle->xpressO, &handle->state.limit, handle->perf.period);
+}
+
+static void
+_intercept_coalesce(void *data, int64_t frames, props_impl_t *impl)
+{
+	plughandle_t *handle = data;
+
+	xpress_coalesce(handle->xpressO, handle->state.coalesce);
 }
 
-#define VOICE_RANGE(NUM) \
-{ \
-	.property = ESPRESSIVO_URI"#mpe_voice_range_"#NUM, \
-	.offset = offsetof(plugstate_t, voice_range) + (NUM-1)*sizeof(int32_t), \
-	.access = LV2_PATCH__readable, \
-	.type = LV2_ATOM__Int, \
+static void
+_intercept_delta(void *data, int64_t frames, props_impl_t *impl)
+{
+	plughandle_t *handle = data;
+
+	xpress_delta(handle->xpressO, handle->state.delta);
 }
 
 static const props_def_t defs [MAX_NPROPS] = {
@@ -119,23 +136,36 @@ static const props_def_t defs [MAX_NPROPS] = {
 		.type = LV2_ATOM__Int,
 	},
 
-	MASTER_RANGE(1),
-	MASTER_RANGE(2),
-	MASTER_RANGE(3),
-	MASTER_RANGE(4),
-	MASTER_RANGE(5),
-	MASTER_RANGE(6),
-	MASTER_RANGE(7),
-	MASTER_RANGE(8),
-
-	VOICE_RANGE(1),
-	VOICE_RANGE(2),
-	VOICE_RANGE(3),
-	VOICE_RANGE(4),
-	VOICE_RANGE(5),
-	VOICE_RANGE(6),
-	VOICE_RANGE(7),
-	VOICE_RANGE(8)
+	{
+		.property = ESPRESSIVO_URI"#mpe_master_range",
+		.offset = offsetof(plugstate_t, master_range),
+		.access = LV2_PATCH__readable,
+		.type = LV2_ATOM__Vector,
+		.child_type = LV2_ATOM__Int,
+		.nelems = MPE_ZONE_MAX
+	},
+	{
+		.property = ESPRESSIVO_URI"#mpe_voice_range",
+		.offset = offsetof(plugstate_t, voice_range),
+		.access = LV2_PATCH__readable,
+		.type = LV2_ATOM__Vector,
+		.child_type = LV2_ATOM__Int,
+		.nelems = MPE_ZONE_MAX
+	},
+	{
+		.property = ESPRESSIVO_URI"#coalesce_policy",
+		.offset = offsetof(plugstate_t, coalesce),
+		.type = LV2_ATOM__Int,
+		.event_cb = _intercept_coalesce
+	},
+	{
+		.property = ESPRESSIVO_URI"#delta_tokens",
+		.offset = offsetof(plugstate_t, delta),
+		.type = LV2_ATOM__Bool,
+		.event_cb = _intercept_delta
+	},
+	LIMIT_DEFS(plugstate_t, limit, _intercept_limit),
+	PERF_DEFS(plugstate_t, perf)
 };
 
 
@@ -242,10 +272,7 @@ _zone_notify(plughandle_t *handle, int64_t frames)
 		//printf("%u: %u %i %i\n", i, slot->num_voices, slot->master_bend_range, slot->voice_bend_range);
 
 		handle->state.master_range[i] = slot->master_bend_range;
-		props_set(&handle->props, &handle->forge, frames, handle->urid.master_range[i], &handle->ref);
-
 		handle->state.voice_range[i] = slot->voice_bend_range;
-		props_set(&handle->props, &handle->forge, frames, handle->urid.voice_range[i], &handle->ref);
 
 		if(slot->num_voices == 0)
 			continue; // invalid
@@ -253,13 +280,15 @@ _zone_notify(plughandle_t *handle, int64_t frames)
 		handle->state.num_zones += 1;
 	}
 
+	props_set(&handle->props, &handle->forge, frames, handle->urid.master_range, &handle->ref);
+	props_set(&handle->props, &handle->forge, frames, handle->urid.voice_range, &handle->ref);
 	props_set(&handle->props, &handle->forge, frames, handle->urid.num_zones, &handle->ref);
 }
 
 static inline void
 _zone_register(plughandle_t *handle, int64_t frames, uint8_t master_channel, uint8_t num_voices)
 {
-	if( (num_voices < 1) || (master_channel + num_voices > MAX_CHANNELS) )
+	if( (num_voices < 1) || (master_channel + num_voices >= MAX_CHANNELS) )
 		return; // invalid
 
 	// make copy of current zone layout
@@ -371,38 +400,61 @@ instantiate(const LV2_Descriptor* descriptor, double rate,
 		return NULL;
 	}
 
+	handle->map = espressivo_map_ref(handle->map);
+
+	const unsigned max_nvoices = xpress_max_nvoices(handle->map, features,
+		MAX_NVOICES, MAX_NVOICES_LIMIT);
+	const size_t pool_size = _pool_size(max_nvoices, sizeof(targetO_t))
+		+ POOL_ALIGN(XPRESS_STAGE_SIZE(max_nvoices));
+	uint8_t *pool = handle->pool = calloc(1, pool_size);
+	if(!pool)
+	{
+		espressivo_map_unref(handle->map);
+		free(handle);
+		return NULL;
+	}
+
+	handle->xpressO = _pool_alloc(&pool, XPRESS_SIZE(max_nvoices));
+	handle->targetO = _pool_alloc(&pool, max_nvoices*sizeof(targetO_t));
+	xpress_stage_t *stageO = _pool_alloc(&pool, XPRESS_STAGE_SIZE(max_nvoices));
+
 	handle->uris.midi_MidiEvent = handle->map->map(handle->map->handle, LV2_MIDI__MidiEvent);
 
 	lv2_atom_forge_init(&handle->forge, handle->map);
 	
-	if(  !xpress_init(&handle->xpressO, MAX_NVOICES, handle->map, voice_map,
+	if(  !xpress_init(handle->xpressO, max_nvoices, handle->map, voice_map,
 			XPRESS_EVENT_NONE, &ifaceO, handle->targetO, handle) )
 	{
+		free(handle->pool);
+		espressivo_map_unref(handle->map);
 		free(handle);
 		return NULL;
 	}
 
+	xpress_stage(handle->xpressO, stageO); // needed for coalescing and limiting
+
 	if(!props_init(&handle->props, descriptor->URI,
 		defs, MAX_NPROPS, &handle->state, &handle->stash,
-		handle->map, handle))
+		handle->restore, sizeof(plugstate_t), handle->map, handle))
 	{
 		fprintf(stderr, "failed to allocate property structure\n");
+		free(handle->pool);
+		espressivo_map_unref(handle->map);
 		free(handle);
 		return NULL;
 	}
 
+	_perf_init(&handle->perf, &handle->props, rate);
+
 	unsigned p = 0;
 	handle->urid.num_zones = props_map(&handle->props, defs[p++].property);
 	handle->state.num_zones = 1;
 
+	handle->urid.master_range = props_map(&handle->props, defs[p++].property);
+	handle->urid.voice_range = props_map(&handle->props, defs[p++].property);
 	for(unsigned z=0; z<MPE_ZONE_MAX; z++)
 	{
-		handle->urid.master_range[z] = props_map(&handle->props, defs[p++].property);
 		handle->state.master_range[z] = 2;
-	}
-	for(unsigned z=0; z<MPE_ZONE_MAX; z++)
-	{
-		handle->urid.voice_range[z] = props_map(&handle->props, defs[p++].property);
 		handle->state.voice_range[z] = 48;
 	}
 
@@ -430,12 +482,6 @@ connect_port(LV2_Handle instance, uint32_t port, void *data)
 	}
 }
 
-static inline xpress_uuid_t
-_uuid_create(slot_t *slot, uint8_t chan)
-{
-	return ((int32_t)slot->zone << 8) | chan;
-}
-
 static inline bool 
 _mpe_in(plughandle_t *handle, int64_t frames, const LV2_Atom *atom)
 {
@@ -456,15 +502,17 @@ _mpe_in(plughandle_t *handle, int64_t frames, const LV2_Atom *atom)
 			{
 				const unsigned voice = _slot_voice(slot, chan);
 				const uint8_t key = m[1];
-				const xpress_uuid_t uuid = _uuid_create(slot, chan);
 
-				targetO_t *target = xpress_add(&handle->xpressO, uuid);
+				// one voice per channel, thus release any dangling one
+				xpress_free(handle->xpressO, handle->uuids[chan]);
+
+				targetO_t *target = xpress_create(handle->xpressO, &handle->uuids[chan]);
 				if(target)
 				{
 					*target = targetO_vanilla;
 					target->key = key;
 					target->voice = voice;
-					target->uuid = xpress_map(&handle->xpressO);
+					target->uuid = handle->uuids[chan];
 
 					const float offset_master = slot->master_bender * 0x1p-13 * slot->master_bend_range;
 					const float offset_voice = slot->voice_bender[voice] * 0x1p-13 * slot->voice_bend_range;
@@ -472,7 +520,7 @@ _mpe_in(plughandle_t *handle, int64_t frames, const LV2_Atom *atom)
 					target->state.pitch = ((float)target->key + offset_master + offset_voice) / 0x7f;
 
 					if(handle->ref)
-						handle->ref = xpress_token(&handle->xpressO, forge, frames, target->uuid, &target->state);
+						handle->ref = xpress_token(handle->xpressO, forge, frames, target->uuid, &target->state);
 				}
 			}
 
@@ -480,24 +528,17 @@ _mpe_in(plughandle_t *handle, int64_t frames, const LV2_Atom *atom)
 		}
 		case LV2_MIDI_MSG_NOTE_OFF:
 		{
-			slot_t *slot = handle->index[chan];
+			// the zone layout may have changed since note on, release anyway
+			const xpress_uuid_t uuid = handle->uuids[chan];
 
-			if(slot && _slot_is_voice(slot, chan))
+			if(uuid && xpress_free(handle->xpressO, uuid))
 			{
-				const xpress_uuid_t uuid = _uuid_create(slot, chan);
-
-				targetO_t *target = xpress_get(&handle->xpressO, uuid);
-				if(target)
-				{
-#if 0
-					if(handle->ref)
-						handle->ref = xpress_del(&handle->xpressO, forge, frames, target->uuid);
-#endif
-				}
-
-				xpress_free(&handle->xpressO, uuid);
+				if(handle->ref)
+					handle->ref = xpress_release(handle->xpressO, forge, frames, &uuid, 1);
 			}
 
+			handle->uuids[chan] = 0;
+
 			break;
 		}
 		case LV2_MIDI_MSG_CHANNEL_PRESSURE:
@@ -506,19 +547,19 @@ _mpe_in(plughandle_t *handle, int64_t frames, const LV2_Atom *atom)
 
 			if(slot && _slot_is_voice(slot, chan))
 			{
-				const xpress_uuid_t uuid = _uuid_create(slot, chan);
+				const xpress_uuid_t uuid = handle->uuids[chan];
 				const unsigned voice = _slot_voice(slot, chan);
 
 				slot->voice_pressure[voice] = m[1] << 7;
 
-				targetO_t *target = xpress_get(&handle->xpressO, uuid);
+				targetO_t *target = xpress_get(handle->xpressO, uuid);
 				if(target)
 				{
 					const float pressure = slot->voice_pressure[voice] / 0x3fff;
 					target->state.pressure = pressure;
 
 					if(handle->ref)
-						handle->ref = xpress_token(&handle->xpressO, forge, frames, target->uuid, &target->state);
+						handle->ref = xpress_token(handle->xpressO, forge, frames, target->uuid, &target->state);
 				}
 			}
 
@@ -534,9 +575,17 @@ _mpe_in(plughandle_t *handle, int64_t frames, const LV2_Atom *atom)
 
 				if(_slot_is_master(slot, chan))
 				{
+					LV2_Atom_Forge_Frame frame;
+
 					slot->master_bender = bender;
 
-					XPRESS_VOICE_FOREACH(&handle->xpressO, voice)
+					if(handle->xpressO->nvoices == 0)
+						break; // nothing to update
+
+					if(handle->ref)
+						handle->ref = xpress_batch_head(handle->xpressO, forge, frames, &frame);
+
+					XPRESS_VOICE_FOREACH(handle->xpressO, voice)
 					{
 						targetO_t *target = voice->target;
 
@@ -548,17 +597,20 @@ _mpe_in(plughandle_t *handle, int64_t frames, const LV2_Atom *atom)
 						target->state.pitch = ((float)target->key + offset_master + offset_voice) / 0x7f;
 
 						if(handle->ref)
-							handle->ref = xpress_token(&handle->xpressO, forge, frames, target->uuid, &target->state);
+							handle->ref = xpress_batch_token(handle->xpressO, forge, target->uuid, &target->state);
 					}
+
+					if(handle->ref)
+						xpress_batch_pop(handle->xpressO, forge, &frame);
 				}
 				else if(_slot_is_voice(slot, chan))
 				{
-					const xpress_uuid_t uuid = _uuid_create(slot, chan);
+					const xpress_uuid_t uuid = handle->uuids[chan];
 					const unsigned voice = _slot_voice(slot, chan);
 
 					slot->voice_bender[voice] = bender;
 
-					targetO_t *target = xpress_get(&handle->xpressO, uuid);
+					targetO_t *target = xpress_get(handle->xpressO, uuid);
 					if(target)
 					{
 						const float offset_master = slot->master_bender * 0x1p-13 * slot->master_bend_range;
@@ -566,7 +618,7 @@ _mpe_in(plughandle_t *handle, int64_t frames, const LV2_Atom *atom)
 						target->state.pitch = ((float)target->key + offset_master + offset_voice) / 0x7f;
 
 						if(handle->ref)
-							handle->ref = xpress_token(&handle->xpressO, forge, frames, target->uuid, &target->state);
+							handle->ref = xpress_token(handle->xpressO, forge, frames, target->uuid, &target->state);
 					}
 				}
 			}
@@ -609,14 +661,14 @@ _mpe_in(plughandle_t *handle, int64_t frames, const LV2_Atom *atom)
 								slot->master_bend_range = bend_range;
 
 								handle->state.master_range[slot->zone] = slot->master_bend_range;
-								props_set(&handle->props, &handle->forge, frames, handle->urid.master_range[slot->zone], &handle->ref);
+								props_set(&handle->props, &handle->forge, frames, handle->urid.master_range, &handle->ref);
 							}
 							else if(_slot_is_first(slot, chan))
 							{
 								slot->voice_bend_range = bend_range;
 
 								handle->state.voice_range[slot->zone] = slot->voice_bend_range;
-								props_set(&handle->props, &handle->forge, frames, handle->urid.voice_range[slot->zone], &handle->ref);
+								props_set(&handle->props, &handle->forge, frames, handle->urid.voice_range, &handle->ref);
 							}
 						}
 					}
@@ -656,18 +708,18 @@ _mpe_in(plughandle_t *handle, int64_t frames, const LV2_Atom *atom)
 					if(slot && _slot_is_voice(slot, chan))
 					{
 						const unsigned voice = _slot_voice(slot, chan);
-						const xpress_uuid_t uuid = _uuid_create(slot, chan);
+						const xpress_uuid_t uuid = handle->uuids[chan];
 
 						slot->voice_pressure[voice] = (slot->voice_pressure[voice] & 0x7f) | ((uint16_t)value << 7);
 
-						targetO_t *target = xpress_get(&handle->xpressO, uuid);
+						targetO_t *target = xpress_get(handle->xpressO, uuid);
 						if(target)
 						{
 							const float pressure = slot->voice_pressure[voice] / 0x3fff;
 							target->state.pressure = pressure;
 
 							if(handle->ref)
-								handle->ref = xpress_token(&handle->xpressO, forge, frames, target->uuid, &target->state);
+								handle->ref = xpress_token(handle->xpressO, forge, frames, target->uuid, &target->state);
 						}
 					}
 
@@ -693,18 +745,18 @@ _mpe_in(plughandle_t *handle, int64_t frames, const LV2_Atom *atom)
 					if(slot && _slot_is_voice(slot, chan))
 					{
 						const unsigned voice = _slot_voice(slot, chan);
-						const xpress_uuid_t uuid = _uuid_create(slot, chan);
+						const xpress_uuid_t uuid = handle->uuids[chan];
 
 						slot->voice_timbre[voice] = (slot->voice_timbre[voice] & 0x7f) | ((uint16_t)value << 7);
 
-						targetO_t *target = xpress_get(&handle->xpressO, uuid);
+						targetO_t *target = xpress_get(handle->xpressO, uuid);
 						if(target)
 						{
 							const float timbre = slot->voice_timbre[voice] / 0x3fff;
 							target->state.timbre = timbre;
 
 							if(handle->ref)
-								handle->ref = xpress_token(&handle->xpressO, forge, frames, target->uuid, &target->state);
+								handle->ref = xpress_token(handle->xpressO, forge, frames, target->uuid, &target->state);
 						}
 					}
 
@@ -724,6 +776,8 @@ run(LV2_Handle instance, uint32_t nsamples)
 {
 	plughandle_t *handle = instance;
 
+	_perf_begin(&handle->perf);
+
 	// prepare midi atom forge
 	const uint32_t capacity = handle->event_out->atom.size;
 	LV2_Atom_Forge *forge = &handle->forge;
@@ -732,7 +786,7 @@ run(LV2_Handle instance, uint32_t nsamples)
 	handle->ref = lv2_atom_forge_sequence_head(forge, &frame, 0);
 
 	props_idle(&handle->props, forge, 0, &handle->ref);
-	xpress_rst(&handle->xpressO);
+	xpress_rst(handle->xpressO);
 
 	bool zone_notify = false;
 
@@ -743,7 +797,7 @@ run(LV2_Handle instance, uint32_t nsamples)
 
 		if(obj->atom.type == handle->uris.midi_MidiEvent)
 		{
-			if(_mpe_in(handle, frames, &obj->atom))
+			if(_midi_is_voice_message(&obj->atom) && _mpe_in(handle, frames, &obj->atom))
 				zone_notify = true;
 		}
 		else
@@ -752,16 +806,24 @@ run(LV2_Handle instance, uint32_t nsamples)
 		}
 	}
 
+	xpress_flush(handle->xpressO, forge, nsamples, &handle->ref);
+
 	if(zone_notify)
 		_zone_notify(handle, nsamples - 1);
 
-	if(handle->ref && !xpress_synced(&handle->xpressO))
-		handle->ref = xpress_alive(&handle->xpressO, forge, nsamples-1);
+	if(handle->ref && !xpress_synced(handle->xpressO))
+		handle->ref = xpress_alive(handle->xpressO, forge, nsamples-1);
+
+	_perf_end(&handle->perf, &handle->state.perf, &handle->props, forge, nsamples,
+		handle->midi_in, handle->event_out, handle->xpressO, &handle->ref);
 
 	if(handle->ref)
 		lv2_atom_forge_pop(forge, &frame);
 	else
+	{
 		lv2_atom_sequence_clear(handle->event_out);
+		xpress_discard(handle->xpressO);
+	}
 }
 
 static void
@@ -771,7 +833,9 @@ cleanup(LV2_Handle instance)
 
 	if(handle)
 	{
-		xpress_deinit(&handle->xpressO);
+		xpress_deinit(handle->xpressO);
+		free(handle->pool);
+		espressivo_map_unref(handle->map);
 		free(handle);
 	}
 }
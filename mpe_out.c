@@ -24,13 +24,14 @@
 
 #include <mpe.h>
 
-#define MAX_NPROPS (2 + MPE_ZONE_MAX*4)
+#define MAX_NPROPS (2 + 4 + PERF_NPROPS)
 
 typedef struct _targetI_t targetI_t;
 typedef struct _plugstate_t plugstate_t;
 typedef struct _plughandle_t plughandle_t;
 
 struct _targetI_t {
+	bool valid;
 	uint8_t chan;
 	uint8_t zone;
 	uint8_t key;
@@ -43,6 +44,8 @@ struct _plugstate_t {
 	int32_t voice_range [MPE_ZONE_MAX];
 	int32_t pressure_controller [MPE_ZONE_MAX];
 	int32_t timbre_controller [MPE_ZONE_MAX];
+
+	perf_state_t perf;
 };
 
 struct _plughandle_t {
@@ -54,8 +57,9 @@ struct _plughandle_t {
 	LV2_Atom_Forge forge;
 	LV2_Atom_Forge_Ref ref;
 
-	XPRESS_T(xpressI, MAX_NVOICES);
-	targetI_t targetI [MAX_NVOICES];
+	xpress_t *xpressI;
+	targetI_t *targetI;
+	void *pool;
 
 	const LV2_Atom_Sequence *event_in;
 	LV2_Atom_Sequence *midi_out;
@@ -65,6 +69,8 @@ struct _plughandle_t {
 
 	plugstate_t state;
 	plugstate_t stash;
+	plugstate_t restore [PROPS_NRESTORE];
+	perf_t perf;
 };
 
 static inline void
@@ -91,8 +97,8 @@ mpe_populate(mpe_t *mpe, uint8_t n_zones)
 		zones[i].span = span;
 		if(rem > 0)
 			zones[i].span += 1;
-		zones[i].master_range = handle->state.master_range[i];
-		zones[i].voice_range = handle->state.voice_range[i];
+		zones[i].master_range = _clamp_int(handle->state.master_range[i], 0x0, 0x7f);
+		zones[i].voice_range = _clamp_int(handle->state.voice_range[i], 0x0, 0x7f);
 	}
 
 	for(uint8_t i=0; i<MPE_CHAN_MAX; i++)
@@ -134,7 +140,7 @@ mpe_range_1(mpe_t *mpe, uint8_t zone_idx)
 {
 	zone_idx %= mpe->n_zones; // wrap around if zone_idx > n_zones
 	zone_t *zone = &mpe->zones[zone_idx];
-	return 1.f / (float)zone->voice_range;
+	return zone->voice_range ? 1.f / (float)zone->voice_range : 0.f;
 }
 
 static inline void
@@ -296,65 +302,35 @@ _intercept_zones(void *data, int64_t frames, props_impl_t *impl)
 {
 	plughandle_t *handle = data;
 
-	mpe_populate(&handle->mpe, handle->state.zones);
+	mpe_populate(&handle->mpe, _clamp_int(handle->state.zones, 1, MPE_ZONE_MAX));
 	if(handle->ref)
 		handle->ref = _full_update(handle, frames);
 }
 
 static void
-_intercept_master(void *data, int64_t frames, props_impl_t *impl)
+_intercept_master(void *data, int64_t frames, props_impl_t *impl,
+	uint32_t zone_idx)
 {
 	plughandle_t *handle = data;
 
-	const int zone_idx = (int32_t *)impl->value.body - handle->state.master_range; //TODO check
-	handle->mpe.zones[zone_idx].master_range = handle->state.master_range[zone_idx];
+	handle->mpe.zones[zone_idx].master_range = _clamp_int(handle->state.master_range[zone_idx], 0x0, 0x7f);
 
-	if( (zone_idx < handle->state.zones) && handle->ref) // update active zones only
+	if( (zone_idx < handle->mpe.n_zones) && handle->ref) // update active zones only
 		handle->ref = _master_range_update(handle, frames, zone_idx);
 }
 
 static void
-_intercept_voice(void *data, int64_t frames, props_impl_t *impl)
+_intercept_voice(void *data, int64_t frames, props_impl_t *impl,
+	uint32_t zone_idx)
 {
 	plughandle_t *handle = data;
 
-	const int zone_idx = (int32_t *)impl->value.body - handle->state.voice_range; //TODO check
-	handle->mpe.zones[zone_idx].voice_range = handle->state.voice_range[zone_idx];
+	handle->mpe.zones[zone_idx].voice_range = _clamp_int(handle->state.voice_range[zone_idx], 0x0, 0x7f);
 
-	if( (zone_idx < handle->state.zones) && handle->ref) // update active zones only
+	if( (zone_idx < handle->mpe.n_zones) && handle->ref) // update active zones only
 		handle->ref = _voice_range_update(handle, frames, zone_idx);
 }
 
-#define MASTER_RANGE(NUM) \
-{ \
-	.property = ESPRESSIVO_URI"#mpe_master_range_"#NUM, \
-	.offset = offsetof(plugstate_t, master_range) + (NUM-1)*sizeof(int32_t), \
-	.type = LV2_ATOM__Int, \
-	.event_cb = _intercept_master \
-}
-
-#define VOICE_RANGE(NUM) \
-{ \
-	.property = ESPRESSIVO_URI"#mpe_voice_range_"#NUM, \
-	.offset = offsetof(plugstate_t, voice_range) + (NUM-1)*sizeof(int32_t), \
-	.type = LV2_ATOM__Int, \
-	.event_cb = _intercept_voice \
-}
-
-#define PRESSURE_CONTROLLER(NUM) \
-{ \
-	.property = ESPRESSIVO_URI"#mpe_pressure_controller_"#NUM, \
-	.offset = offsetof(plugstate_t, pressure_controller) + (NUM-1)*sizeof(int32_t), \
-	.type = LV2_ATOM__Int, \
-}
-
-#define TIMBRE_CONTROLLER(NUM) \
-{ \
-	.property = ESPRESSIVO_URI"#mpe_timbre_controller_"#NUM, \
-	.offset = offsetof(plugstate_t, timbre_controller) + (NUM-1)*sizeof(int32_t), \
-	.type = LV2_ATOM__Int, \
-}
-
 static const props_def_t defs [MAX_NPROPS] = {
 	{
 		.property = ESPRESSIVO_URI"#mpe_zones",
@@ -368,41 +344,41 @@ static const props_def_t defs [MAX_NPROPS] = {
 		.type = LV2_ATOM__Int
 	},
 
-	MASTER_RANGE(1),
-	MASTER_RANGE(2),
-	MASTER_RANGE(3),
-	MASTER_RANGE(4),
-	MASTER_RANGE(5),
-	MASTER_RANGE(6),
-	MASTER_RANGE(7),
-	MASTER_RANGE(8),
-
-	VOICE_RANGE(1),
-	VOICE_RANGE(2),
-	VOICE_RANGE(3),
-	VOICE_RANGE(4),
-	VOICE_RANGE(5),
-	VOICE_RANGE(6),
-	VOICE_RANGE(7),
-	VOICE_RANGE(8),
-
-	PRESSURE_CONTROLLER(1),
-	PRESSURE_CONTROLLER(2),
-	PRESSURE_CONTROLLER(3),
-	PRESSURE_CONTROLLER(4),
-	PRESSURE_CONTROLLER(5),
-	PRESSURE_CONTROLLER(6),
-	PRESSURE_CONTROLLER(7),
-	PRESSURE_CONTROLLER(8),
-
-	TIMBRE_CONTROLLER(1),
-	TIMBRE_CONTROLLER(2),
-	TIMBRE_CONTROLLER(3),
-	TIMBRE_CONTROLLER(4),
-	TIMBRE_CONTROLLER(5),
-	TIMBRE_CONTROLLER(6),
-	TIMBRE_CONTROLLER(7),
-	TIMBRE_CONTROLLER(8)
+	{
+		.property = ESPRESSIVO_URI"#mpe_master_range",
+		.offset = offsetof(plugstate_t, master_range),
+		.type = LV2_ATOM__Vector,
+		.child_type = LV2_ATOM__Int,
+		.nelems = MPE_ZONE_MAX,
+		.elem_cb = _intercept_master,
+		.alias = ESPRESSIVO_URI"#mpe_master_range_"
+	},
+	{
+		.property = ESPRESSIVO_URI"#mpe_voice_range",
+		.offset = offsetof(plugstate_t, voice_range),
+		.type = LV2_ATOM__Vector,
+		.child_type = LV2_ATOM__Int,
+		.nelems = MPE_ZONE_MAX,
+		.elem_cb = _intercept_voice,
+		.alias = ESPRESSIVO_URI"#mpe_voice_range_"
+	},
+	{
+		.property = ESPRESSIVO_URI"#mpe_pressure_controller",
+		.offset = offsetof(plugstate_t, pressure_controller),
+		.type = LV2_ATOM__Vector,
+		.child_type = LV2_ATOM__Int,
+		.nelems = MPE_ZONE_MAX,
+		.alias = ESPRESSIVO_URI"#mpe_pressure_controller_"
+	},
+	{
+		.property = ESPRESSIVO_URI"#mpe_timbre_controller",
+		.offset = offsetof(plugstate_t, timbre_controller),
+		.type = LV2_ATOM__Vector,
+		.child_type = LV2_ATOM__Int,
+		.nelems = MPE_ZONE_MAX,
+		.alias = ESPRESSIVO_URI"#mpe_timbre_controller_"
+	},
+	PERF_DEFS(plugstate_t, perf)
 };
 
 static inline bool
@@ -421,7 +397,7 @@ _upd(plughandle_t *handle, int64_t frames, const xpress_state_t *state,
 	// bender
 	if(_notes_enabled(handle, src))
 	{
-		const uint16_t bnd = (val - src->key) * mpe_range_1(&handle->mpe, state->zone) * 0x2000 + 0x1fff;
+		const uint16_t bnd = _midi_14bit( (val - src->key) * mpe_range_1(&handle->mpe, src->zone) * 0x2000 + 0x1fff);
 		const uint8_t bnd_msb = bnd >> 7;
 		const uint8_t bnd_lsb = bnd & 0x7f;
 
@@ -435,22 +411,25 @@ _upd(plughandle_t *handle, int64_t frames, const xpress_state_t *state,
 			handle->ref = _midi_event(handle, frames, bend, 3);
 	}
 
+	const int32_t pressure_controller = _clamp_int(handle->state.pressure_controller[src->zone], -1, 0x7f);
+	const int32_t timbre_controller = _clamp_int(handle->state.timbre_controller[src->zone], -1, 0x7f);
+
 	// pressure
-	if(handle->state.pressure_controller[state->zone] >= 0)
+	if(pressure_controller >= 0)
 	{
-		const uint16_t z = state->pressure * 0x3fff;
+		const uint16_t z = _midi_14bit(state->pressure * 0x3fff);
 		const uint8_t z_msb = z >> 7;
 		const uint8_t z_lsb = z & 0x7f;
 
 		const uint8_t pressure_lsb [3] = {
 			LV2_MIDI_MSG_CONTROLLER | src->chan,
-			handle->state.pressure_controller[state->zone] | 0x20,
+			pressure_controller | 0x20,
 			z_lsb
 		};
 
 		const uint8_t pressure_msb [3] = {
 			LV2_MIDI_MSG_CONTROLLER | src->chan,
-			handle->state.pressure_controller[state->zone],
+			pressure_controller,
 			z_msb
 		};
 
@@ -461,7 +440,7 @@ _upd(plughandle_t *handle, int64_t frames, const xpress_state_t *state,
 	}
 
 	// timbre
-	if(handle->state.timbre_controller[state->zone] >= 0)
+	if(timbre_controller >= 0)
 	{
 		float pos2 = state->timbre;
 		if(pos2 < -1.f) pos2 = -1.f;
@@ -472,13 +451,13 @@ _upd(plughandle_t *handle, int64_t frames, const xpress_state_t *state,
 
 		const uint8_t timbre_lsb [3] = {
 			LV2_MIDI_MSG_CONTROLLER | src->chan,
-			handle->state.timbre_controller[state->zone] | 0x20,
+			timbre_controller | 0x20,
 			vx_lsb
 		};
 
 		const uint8_t timbre_msb [3] = {
 			LV2_MIDI_MSG_CONTROLLER | src->chan,
-			handle->state.timbre_controller[state->zone],
+			timbre_controller,
 			vx_msb
 		};
 
@@ -499,14 +478,22 @@ _add(void *data, int64_t frames, const xpress_state_t *state,
 	targetI_t *src = target;
 
 	const float val = state->pitch * 0x7f;
+	const float key = floorf(val);
+
+	// voices beyond the configurable zones and MIDI key range stay silent, as
+	// do voices whose note-off could not be forged anymore
+	src->valid = _zone_valid(state->zone, MPE_ZONE_MAX) && (key >= 0x0) && (key <= 0x7f)
+		&& !_midi_tight(&handle->forge, handle->xpressI->nvoices + 1);
+	if(!src->valid)
+		return;
 
 	src->chan = mpe_acquire(&handle->mpe, state->zone);
 	src->zone = state->zone;
-	src->key = floor(val);
+	src->key = key;
 
 	if(_notes_enabled(handle, src))
 	{
-		const uint8_t vel = handle->state.velocity;
+		const uint8_t vel = _clamp_int(handle->state.velocity, 0x0, 0x7f);
 
 		const uint8_t note_on [3] = {
 			LV2_MIDI_MSG_NOTE_ON | src->chan,
@@ -518,7 +505,8 @@ _add(void *data, int64_t frames, const xpress_state_t *state,
 			handle->ref = _midi_event(handle, frames, note_on, 3);
 	}
 
-	_upd(handle, frames, state, val, src);
+	if(!_midi_tight(&handle->forge, handle->xpressI->nvoices))
+		_upd(handle, frames, state, val, src);
 }
 
 static void
@@ -530,7 +518,9 @@ _set(void *data, int64_t frames, const xpress_state_t *state,
 
 	const float val = state->pitch * 0x7f;
 
-	_upd(handle, frames, state, val, src);
+	// continuous updates are shed first when running out of space
+	if(src->valid && !_midi_tight(&handle->forge, handle->xpressI->nvoices))
+		_upd(handle, frames, state, val, src);
 }
 
 static void
@@ -540,6 +530,9 @@ _del(void *data, int64_t frames,
 	plughandle_t *handle = data;
 	targetI_t *src = target;
 
+	if(!src->valid)
+		return;
+
 	if(_notes_enabled(handle, src))
 	{
 		const uint8_t vel = 0x0;
@@ -590,25 +583,47 @@ instantiate(const LV2_Descriptor* descriptor, double rate,
 		return NULL;
 	}
 
+	handle->map = espressivo_map_ref(handle->map);
+
+	const unsigned max_nvoices = xpress_max_nvoices(handle->map, features,
+		MAX_NVOICES, MAX_NVOICES_LIMIT);
+	const size_t pool_size = _pool_size(max_nvoices, sizeof(targetI_t));
+	uint8_t *pool = handle->pool = calloc(1, pool_size);
+	if(!pool)
+	{
+		espressivo_map_unref(handle->map);
+		free(handle);
+		return NULL;
+	}
+
+	handle->xpressI = _pool_alloc(&pool, XPRESS_SIZE(max_nvoices));
+	handle->targetI = _pool_alloc(&pool, max_nvoices*sizeof(targetI_t));
+
 	handle->uris.midi_MidiEvent = handle->map->map(handle->map->handle, LV2_MIDI__MidiEvent);
 
 	lv2_atom_forge_init(&handle->forge, handle->map);
 
-	if(!xpress_init(&handle->xpressI, MAX_NVOICES, handle->map, voice_map,
+	if(!xpress_init(handle->xpressI, max_nvoices, handle->map, voice_map,
 			XPRESS_EVENT_ALL, &ifaceI, handle->targetI, handle))
 	{
+		free(handle->pool);
+		espressivo_map_unref(handle->map);
 		free(handle);
 		return NULL;
 	}
 
 	if(!props_init(&handle->props, descriptor->URI,
 		defs, MAX_NPROPS, &handle->state, &handle->stash,
-		handle->map, handle))
+		handle->restore, sizeof(plugstate_t), handle->map, handle))
 	{
+		free(handle->pool);
+		espressivo_map_unref(handle->map);
 		free(handle);
 		return NULL;
 	}
 
+	_perf_init(&handle->perf, &handle->props, rate);
+
 	return handle;
 }
 
@@ -644,6 +659,8 @@ run(LV2_Handle instance, uint32_t nsamples)
 {
 	plughandle_t *handle = instance;
 
+	_perf_begin(&handle->perf);
+
 	// prepare midi atom forge
 	const uint32_t capacity = handle->midi_out->atom.size;
 	LV2_Atom_Forge *forge = &handle->forge;
@@ -652,7 +669,7 @@ run(LV2_Handle instance, uint32_t nsamples)
 	handle->ref = lv2_atom_forge_sequence_head(forge, &frame, 0);
 
 	props_idle(&handle->props, forge, 0, &handle->ref);
-	xpress_pre(&handle->xpressI);
+	xpress_pre(handle->xpressI);
 
 	LV2_ATOM_SEQUENCE_FOREACH(handle->event_in, ev)
 	{
@@ -661,11 +678,14 @@ run(LV2_Handle instance, uint32_t nsamples)
 
 		if(!props_advance(&handle->props, forge, frames, obj, &handle->ref))
 		{
-			xpress_advance(&handle->xpressI, forge, frames, obj, &handle->ref);
+			xpress_advance(handle->xpressI, forge, frames, obj, &handle->ref);
 		}
 	}
 
-	xpress_post(&handle->xpressI, nsamples-1);
+	xpress_post(handle->xpressI, nsamples-1);
+
+	_perf_end(&handle->perf, &handle->state.perf, &handle->props, forge, nsamples,
+		handle->event_in, handle->midi_out, handle->xpressI, &handle->ref);
 
 	if(handle->ref)
 		lv2_atom_forge_pop(forge, &frame);
@@ -680,7 +700,9 @@ cleanup(LV2_Handle instance)
 
 	if(handle)
 	{
-		xpress_deinit(&handle->xpressI);
+		xpress_deinit(handle->xpressI);
+		free(handle->pool);
+		espressivo_map_unref(handle->map);
 		free(handle);
 	}
 }
@@ -37,6 +37,13 @@ extern "C" {
  * API START
  *****************************************************************************/
 
+// number of state copies needed for restoring, one written to by the host,
+// one published and one being picked up by the plugin
+#define PROPS_NRESTORE 3
+
+// number of slots of the property lookup table
+#define PROPS_HASH_SIZE 256
+
 // structures
 typedef struct _props_def_t props_def_t;
 typedef struct _props_impl_t props_impl_t;
@@ -55,6 +62,12 @@ typedef void (*props_event_cb_t)(
 	int64_t frames,
 	props_impl_t *impl);
 
+typedef void (*props_elem_cb_t)(
+	void *data,
+	int64_t frames,
+	props_impl_t *impl,
+	uint32_t idx);
+
 typedef void (*props_dyn_prop_cb_t)(
 	void *data,
 	props_dyn_ev_t ev,
@@ -71,12 +84,20 @@ struct _props_def_t {
 
 	uint32_t max_size;
 	props_event_cb_t event_cb;
+
+	// atom:Vector of a fixed number of fixed-size elements, stored as plain array
+	const char *child_type;
+	uint32_t nelems;
+	props_elem_cb_t elem_cb; // per changed element
+	const char *alias; // prefix of former per-element properties, suffixed 1..nelems
 };
 
 struct _props_impl_t {
 	LV2_URID property;
 	LV2_URID type;
 	LV2_URID access;
+	LV2_URID child_type;
+	uint32_t child_size; // 0 if not a vector of fixed element count
 
 	struct {
 		uint32_t size;
@@ -91,6 +112,10 @@ struct _props_impl_t {
 
 	atomic_int state;
 	bool stashing;
+	struct {
+		uint32_t size;
+		bool valid; // whether the value was part of the restored state
+	} restored [PROPS_NRESTORE];
 };
 
 struct _props_dyn_t {
@@ -125,6 +150,8 @@ struct _props_t {
 		LV2_URID atom_bool;
 		LV2_URID atom_urid;
 		LV2_URID atom_path;
+		LV2_URID atom_string;
+		LV2_URID atom_uri;
 		LV2_URID atom_literal;
 		LV2_URID atom_vector;
 		LV2_URID atom_object;
@@ -134,14 +161,29 @@ struct _props_t {
 	} urid;
 
 	void *data;
+	LV2_URID_Map *map; // for aliases on restore
 
 	bool stashing;
-	atomic_bool restoring;
+
+	struct {
+		uint8_t *base;
+		size_t stride;
+		unsigned write; // owned by props_restore
+		unsigned read; // owned by props_idle
+		atomic_uint middle; // published, PROPS_RESTORE_FRESH if not yet picked up
+	} restore;
 
 	uint32_t max_size;
 
 	const props_dyn_t *dyn;
 
+	struct {
+		LV2_URID base;
+		uint32_t mul; // 0 if no collision-free table could be built
+		uint32_t shift;
+		uint8_t slots [PROPS_HASH_SIZE];
+	} hash;
+
 	unsigned nimpls;
 	props_impl_t impls [1];
 };
@@ -154,7 +196,7 @@ struct _props_t {
 static inline int
 props_init(props_t *props, const char *subject,
 	const props_def_t *defs, int nimpls,
-	void *value_base, void *stash_base,
+	void *value_base, void *stash_base, void *restore_base, size_t size,
 	LV2_URID_Map *map, void *data);
 
 // rt-safe
@@ -210,10 +252,14 @@ props_restore(props_t *props, LV2_State_Retrieve_Function retrieve,
 // enumerations
 typedef enum _props_state_t {
 	PROP_STATE_NONE    = 0,
-	PROP_STATE_LOCK    = 1,
-	PROP_STATE_RESTORE = 2
+	PROP_STATE_LOCK    = 1
 } props_state_t;
 
+#define PROPS_RESTORE_FRESH 0x4
+
+#define PROPS_HASH_NIL 0xff
+#define PROPS_HASH_TRIALS 256
+
 static inline void
 _props_impl_spin_lock(props_impl_t *impl, int from, int to)
 {
@@ -243,16 +289,36 @@ _props_impl_unlock(props_impl_t *impl, int to)
 	atomic_store_explicit(&impl->state, to, memory_order_release);
 }
 
+// swap the restore buffer written to for the published one, never blocks
+static inline void
+_props_restore_publish(props_t *props)
+{
+	const unsigned write = props->restore.write | PROPS_RESTORE_FRESH;
+
+	props->restore.write = atomic_exchange_explicit(&props->restore.middle, write,
+		memory_order_acq_rel) & ~PROPS_RESTORE_FRESH;
+}
+
+// swap the restore buffer read from for a freshly published one, never blocks
 static inline bool
-_props_restoring_get(props_t *props)
+_props_restore_pickup(props_t *props)
 {
-	return atomic_exchange_explicit(&props->restoring, false, memory_order_acquire);
+	if(!(atomic_load_explicit(&props->restore.middle, memory_order_relaxed)
+		& PROPS_RESTORE_FRESH))
+	{
+		return false;
+	}
+
+	props->restore.read = atomic_exchange_explicit(&props->restore.middle,
+		props->restore.read, memory_order_acq_rel) & ~PROPS_RESTORE_FRESH;
+
+	return true;
 }
 
-static inline void
-_props_restoring_set(props_t *props)
+static inline void *
+_props_restore_body(props_t *props, unsigned idx, props_impl_t *impl)
 {
-	atomic_store_explicit(&props->restoring, true, memory_order_release);
+	return props->restore.base + idx*props->restore.stride + impl->def->offset;
 }
 
 static inline void
@@ -288,9 +354,90 @@ _props_qsort(props_impl_t *A, int n)
 	_props_qsort(A + j + 1, n - j - 1);
 }
 
+static inline uint32_t
+_props_hash(props_t *props, LV2_URID property)
+{
+	return ((property - props->hash.base) * props->hash.mul) >> props->hash.shift;
+}
+
+// whether the current hash parameters map all properties to distinct slots
+static inline bool
+_props_hash_fill(props_t *props)
+{
+	memset(props->hash.slots, PROPS_HASH_NIL, PROPS_HASH_SIZE);
+
+	for(unsigned i = 0; i < props->nimpls; i++)
+	{
+		const uint32_t idx = _props_hash(props, props->impls[i].property);
+
+		if( (idx >= PROPS_HASH_SIZE) || (props->hash.slots[idx] != PROPS_HASH_NIL) )
+			return false;
+
+		props->hash.slots[idx] = i;
+	}
+
+	return true;
+}
+
+// build a collision-free lookup table, either indexed directly by a
+// contiguous range of URIDs or via a multiplicative hash
+static inline void
+_props_hash_init(props_t *props)
+{
+	if( (props->nimpls == 0) || (props->nimpls >= PROPS_HASH_NIL) )
+	{
+		props->hash.mul = 0;
+		return;
+	}
+
+	// impls are sorted by now
+	props->hash.base = props->impls[0].property;
+	props->hash.mul = 1;
+	props->hash.shift = 0;
+
+	if(_props_hash_fill(props))
+		return;
+
+	props->hash.base = 0;
+
+	unsigned bits = 1;
+	while((1U << bits) < props->nimpls)
+		bits++;
+
+	for( ; (1U << bits) <= PROPS_HASH_SIZE; bits++)
+	{
+		props->hash.shift = 32 - bits;
+
+		for(uint32_t i = 0; i < PROPS_HASH_TRIALS; i++)
+		{
+			props->hash.mul = 0x9e3779b1 + 2*i; // odd multipliers around 2^32/phi
+
+			if(_props_hash_fill(props))
+				return;
+		}
+	}
+
+	props->hash.mul = 0; // fall back to binary search
+}
+
 static inline props_impl_t *
 _props_impl_get(props_t *props, LV2_URID property)
 {
+	if(props->hash.mul)
+	{
+		const uint32_t idx = _props_hash(props, property);
+
+		if(idx < PROPS_HASH_SIZE)
+		{
+			const uint8_t slot = props->hash.slots[idx];
+
+			if( (slot != PROPS_HASH_NIL) && (props->impls[slot].property == property) )
+				return &props->impls[slot];
+		}
+
+		return NULL;
+	}
+
 	props_impl_t *base = props->impls;
 
 	for(int N = props->nimpls, half; N > 1; N -= half)
@@ -303,11 +450,39 @@ _props_impl_get(props_t *props, LV2_URID property)
 	return (base->property == property) ? base : NULL;
 }
 
+// undo a partially forged event and return the reference of the enclosing
+// frame, e.g. the sequence, which thus keeps all events forged before it
+static inline LV2_Atom_Forge_Ref
+_props_rollback(LV2_Atom_Forge *forge, LV2_Atom_Forge_Frame *stack,
+	uint32_t offset)
+{
+	if(!forge->buf || !stack)
+	{
+		return 0; // cannot be undone
+	}
+
+	const uint32_t size = forge->offset - offset;
+
+	for(LV2_Atom_Forge_Frame *frame = stack; frame; frame = frame->parent)
+	{
+		LV2_Atom *atom = lv2_atom_forge_deref(forge, frame->ref);
+
+		atom->size -= size;
+	}
+
+	forge->stack = stack; // drops frames left open by the partial event
+	forge->offset = offset;
+
+	return stack->ref;
+}
+
 static inline LV2_Atom_Forge_Ref
 _props_patch_set(props_t *props, LV2_Atom_Forge *forge, uint32_t frames,
 	props_impl_t *impl, int32_t sequence_num)
 {
 	LV2_Atom_Forge_Frame obj_frame;
+	LV2_Atom_Forge_Frame *stack = forge->stack;
+	const uint32_t offset = forge->offset;
 
 	LV2_Atom_Forge_Ref ref = lv2_atom_forge_frame_time(forge, frames);
 
@@ -336,11 +511,30 @@ _props_patch_set(props_t *props, LV2_Atom_Forge *forge, uint32_t frames,
 			ref = lv2_atom_forge_urid(forge, impl->property);
 
 		if(ref)
-			lv2_atom_forge_key(forge, props->urid.patch_value);
-		if(ref)
-			ref = lv2_atom_forge_atom(forge, impl->value.size, impl->type);
-		if(ref)
-			ref = lv2_atom_forge_write(forge, impl->value.body, impl->value.size);
+			ref = lv2_atom_forge_key(forge, props->urid.patch_value);
+		if(impl->child_size)
+		{
+			// forged piecewise, as lv2_atom_forge_vector ignores elements not fitting
+			const LV2_Atom_Vector_Body vec = {
+				.child_size = impl->child_size,
+				.child_type = impl->child_type
+			};
+
+			if(ref)
+				ref = lv2_atom_forge_atom(forge, sizeof(vec) + impl->value.size,
+					props->urid.atom_vector);
+			if(ref)
+				ref = lv2_atom_forge_raw(forge, &vec, sizeof(vec));
+			if(ref)
+				ref = lv2_atom_forge_write(forge, impl->value.body, impl->value.size);
+		}
+		else
+		{
+			if(ref)
+				ref = lv2_atom_forge_atom(forge, impl->value.size, impl->type);
+			if(ref)
+				ref = lv2_atom_forge_write(forge, impl->value.body, impl->value.size);
+		}
 	}
 	if(ref)
 		lv2_atom_forge_pop(forge, &obj_frame);
@@ -352,6 +546,10 @@ _props_patch_set(props_t *props, LV2_Atom_Forge *forge, uint32_t frames,
 	if(ref)
 		lv2_atom_forge_pop(forge, &obj_frame);
 
+	// a notification that does not fit is dropped, not the whole sequence
+	if(!ref)
+		ref = _props_rollback(forge, stack, offset);
+
 	return ref;
 }
 
@@ -455,17 +653,50 @@ _props_impl_stash(props_t *props, props_impl_t *impl)
 	}
 }
 
+// update the elements of a vector property, reporting changed or all of them
+static inline void
+_props_impl_elems_set(props_t *props, int64_t frames, props_impl_t *impl,
+	const void *elems, bool all)
+{
+	const props_def_t *def = impl->def;
+	const uint32_t child_size = impl->child_size;
+	uint8_t *dst = impl->value.body;
+	const uint8_t *src = elems;
+
+	for(uint32_t i = 0; i < def->nelems; i++, dst += child_size, src += child_size)
+	{
+		if(!all && !memcmp(dst, src, child_size))
+			continue;
+
+		memcpy(dst, src, child_size);
+
+		if(def->elem_cb)
+			def->elem_cb(props->data, frames, impl, i);
+	}
+}
+
 static inline void
 _props_impl_restore(props_t *props, LV2_Atom_Forge *forge, uint32_t frames,
 	props_impl_t *impl, LV2_Atom_Forge_Ref *ref)
 {
-	if(_props_impl_try_lock(impl, PROP_STATE_RESTORE, PROP_STATE_LOCK))
+	const unsigned idx = props->restore.read;
+
+	if(impl->restored[idx].valid)
 	{
-		impl->stashing = false; // makes no sense to stash a recently restored value
-		impl->value.size = impl->stash.size;
-		memcpy(impl->value.body, impl->stash.body, impl->stash.size);
+		const uint32_t size = impl->restored[idx].size;
+		const void *body = _props_restore_body(props, idx, impl);
 
-		_props_impl_unlock(impl, PROP_STATE_NONE);
+		if(impl->child_size)
+		{
+			_props_impl_elems_set(props, 0, impl, body, true);
+		}
+		else
+		{
+			impl->value.size = size;
+			memcpy(impl->value.body, body, size);
+		}
+
+		_props_impl_stash(props, impl);
 
 		if(*ref && !impl->def->hidden)
 			*ref = _props_patch_set(props, forge, frames, impl, 0);
@@ -476,15 +707,106 @@ _props_impl_restore(props_t *props, LV2_Atom_Forge *forge, uint32_t frames,
 	}
 }
 
+// size of values of fixed-size types, 0 otherwise
+static inline uint32_t
+_props_prim_size(props_t *props, LV2_URID type)
+{
+	if(  (type == props->urid.atom_int)
+		|| (type == props->urid.atom_float)
+		|| (type == props->urid.atom_bool)
+		|| (type == props->urid.atom_urid) )
+	{
+		return 4;
+	}
+	else if((type == props->urid.atom_long)
+		|| (type == props->urid.atom_double) )
+	{
+		return 8;
+	}
+
+	return 0;
+}
+
+// size of values of fixed-size types, size of the body header otherwise
+static inline uint32_t
+_props_type_size(props_t *props, LV2_URID type)
+{
+	const uint32_t size = _props_prim_size(props, type);
+
+	if(size)
+	{
+		return size;
+	}
+	else if(type == props->urid.atom_literal)
+	{
+		return sizeof(LV2_Atom_Literal_Body);
+	}
+	else if(type == props->urid.atom_vector)
+	{
+		return sizeof(LV2_Atom_Vector_Body);
+	}
+	else if(type == props->urid.atom_object)
+	{
+		return sizeof(LV2_Atom_Object_Body);
+	}
+	else if(type == props->urid.atom_sequence)
+	{
+		return sizeof(LV2_Atom_Sequence_Body);
+	}
+	else
+	{
+		return 0; // assume everything else as having size 0
+	}
+}
+
+// values of fixed-size types must match exactly, others must not exceed max_size,
+// strings must be null-terminated
+static inline bool
+_props_impl_fits(props_t *props, props_impl_t *impl, uint32_t size,
+	const void *body)
+{
+	if(impl->child_size)
+	{
+		const LV2_Atom_Vector_Body *vec = body;
+
+		return (size == sizeof(LV2_Atom_Vector_Body) + impl->value.size)
+			&& (vec->child_type == impl->child_type)
+			&& (vec->child_size == impl->child_size);
+	}
+
+	if(  (impl->type == props->urid.atom_string)
+		|| (impl->type == props->urid.atom_path)
+		|| (impl->type == props->urid.atom_uri) )
+	{
+		const char *str = body;
+
+		if(!size || str[size - 1])
+			return false;
+	}
+
+	if(impl->def->max_size)
+		return size <= impl->def->max_size;
+
+	return size == _props_type_size(props, impl->type);
+}
+
 static inline void
-_props_impl_set(props_t *props, props_impl_t *impl, LV2_URID type,
-	uint32_t size, const void *body)
+_props_impl_set(props_t *props, int64_t frames, props_impl_t *impl,
+	LV2_URID type, uint32_t size, const void *body)
 {
-	if(  (impl->type == type)
-		&& ( (impl->def->max_size == 0) || (size <= impl->def->max_size)) )
+	if( (impl->type == type) && _props_impl_fits(props, impl, size, body) )
 	{
-		impl->value.size = size;
-		memcpy(impl->value.body, body, size);
+		if(impl->child_size)
+		{
+			const LV2_Atom_Vector_Body *vec = body;
+
+			_props_impl_elems_set(props, frames, impl, vec + 1, false);
+		}
+		else
+		{
+			impl->value.size = size;
+			memcpy(impl->value.body, body, size);
+		}
 
 		_props_impl_stash(props, impl);
 	}
@@ -492,7 +814,7 @@ _props_impl_set(props_t *props, props_impl_t *impl, LV2_URID type,
 
 static inline int
 _props_impl_init(props_t *props, props_impl_t *impl, const props_def_t *def,
-	void *value_base, void *stash_base, LV2_URID_Map *map)
+	void *value_base, void *stash_base, size_t stride, LV2_URID_Map *map)
 {
 	if(!def->property || !def->type)
 		return 0;
@@ -512,40 +834,34 @@ _props_impl_init(props_t *props, props_impl_t *impl, const props_def_t *def,
 	impl->value.body = (uint8_t *)value_base + def->offset;
 	impl->stash.body = (uint8_t *)stash_base + def->offset;
 
-	uint32_t size;
-	if(  (type == props->urid.atom_int)
-		|| (type == props->urid.atom_float)
-		|| (type == props->urid.atom_bool)
-		|| (type == props->urid.atom_urid) )
-	{
-		size = 4;
-	}
-	else if((type == props->urid.atom_long)
-		|| (type == props->urid.atom_double) )
-	{
-		size = 8;
-	}
-	else if(type == props->urid.atom_literal)
-	{
-		size = sizeof(LV2_Atom_Literal_Body);
-	}
-	else if(type == props->urid.atom_vector)
-	{
-		size = sizeof(LV2_Atom_Vector_Body);
-	}
-	else if(type == props->urid.atom_object)
-	{
-		size = sizeof(LV2_Atom_Object_Body);
-	}
-	else if(type == props->urid.atom_sequence)
-	{
-		size = sizeof(LV2_Atom_Sequence_Body);
-	}
-	else
+	uint32_t size = _props_type_size(props, type);
+	uint32_t max_size = def->max_size
+		? def->max_size
+		: size;
+
+	if(def->nelems) // vector of fixed element count
 	{
-		size = 0; // assume everything else as having size 0
+		const LV2_URID child_type = def->child_type
+			? map->map(map->handle, def->child_type)
+			: 0;
+		const uint32_t child_size = _props_prim_size(props, child_type);
+
+		if( (type != props->urid.atom_vector) || !child_size )
+			return 0;
+
+		impl->child_type = child_type;
+		impl->child_size = child_size;
+
+		size = def->nelems * child_size;
+		max_size = sizeof(LV2_Atom_Vector_Body) + size; // as stored by props_save
 	}
 
+	// restored values must fit into each restore buffer, read-only ones are
+	// never restored and may lie beyond it
+	if( (access != props->urid.patch_readable)
+		&& (def->offset + (def->nelems ? size : max_size) > stride) )
+		return 0;
+
 	impl->type = type;
 	impl->value.size = size;
 	impl->stash.size = size;
@@ -553,10 +869,6 @@ _props_impl_init(props_t *props, props_impl_t *impl, const props_def_t *def,
 	atomic_init(&impl->state, PROP_STATE_NONE);
 
 	// update maximal value size
-	const uint32_t max_size = def->max_size
-		? def->max_size
-		: size;
-
 	if(max_size > props->max_size)
 	{
 		props->max_size = max_size;
@@ -568,14 +880,15 @@ _props_impl_init(props_t *props, props_impl_t *impl, const props_def_t *def,
 static inline int
 props_init(props_t *props, const char *subject,
 	const props_def_t *defs, int nimpls,
-	void *value_base, void *stash_base,
+	void *value_base, void *stash_base, void *restore_base, size_t size,
 	LV2_URID_Map *map, void *data)
 {
-	if(!props || !defs || !value_base || !stash_base || !map)
+	if(!props || !defs || !value_base || !stash_base || !restore_base || !map)
 		return 0;
 
 	props->nimpls = nimpls;
 	props->data = data;
+	props->map = map;
 
 	props->urid.subject = subject ? map->map(map->handle, subject) : 0;
 
@@ -603,6 +916,8 @@ props_init(props_t *props, const char *subject,
 	props->urid.atom_bool = map->map(map->handle, LV2_ATOM__Bool);
 	props->urid.atom_urid = map->map(map->handle, LV2_ATOM__URID);
 	props->urid.atom_path = map->map(map->handle, LV2_ATOM__Path);
+	props->urid.atom_string = map->map(map->handle, LV2_ATOM__String);
+	props->urid.atom_uri = map->map(map->handle, LV2_ATOM__URI);
 	props->urid.atom_literal = map->map(map->handle, LV2_ATOM__Literal);
 	props->urid.atom_vector = map->map(map->handle, LV2_ATOM__Vector);
 	props->urid.atom_object = map->map(map->handle, LV2_ATOM__Object);
@@ -610,7 +925,11 @@ props_init(props_t *props, const char *subject,
 
 	props->urid.state_StateChanged = map->map(map->handle, LV2_STATE__StateChanged);
 
-	atomic_init(&props->restoring, false);
+	props->restore.base = restore_base;
+	props->restore.stride = size;
+	props->restore.write = 0;
+	props->restore.read = 2;
+	atomic_init(&props->restore.middle, 1);
 
 	int status = 1;
 	for(unsigned i = 0; i < props->nimpls; i++)
@@ -618,10 +937,11 @@ props_init(props_t *props, const char *subject,
 		props_impl_t *impl = &props->impls[i];
 
 		status = status
-			&& _props_impl_init(props, impl, &defs[i], value_base, stash_base, map);
+			&& _props_impl_init(props, impl, &defs[i], value_base, stash_base, size, map);
 	}
 
 	_props_qsort(props->impls, props->nimpls);
+	_props_hash_init(props);
 
 	return status;
 }
@@ -636,7 +956,7 @@ static inline void
 props_idle(props_t *props, LV2_Atom_Forge *forge, uint32_t frames,
 	LV2_Atom_Forge_Ref *ref)
 {
-	if(_props_restoring_get(props))
+	if(_props_restore_pickup(props))
 	{
 		for(unsigned i = 0; i < props->nimpls; i++)
 		{
@@ -762,7 +1082,7 @@ props_advance(props_t *props, LV2_Atom_Forge *forge, uint32_t frames,
 		{
 			if(sequence_num)
 			{
-				if(ref)
+				if(*ref)
 					*ref = _props_patch_error(props, forge, frames, sequence_num);
 			}
 
@@ -772,7 +1092,7 @@ props_advance(props_t *props, LV2_Atom_Forge *forge, uint32_t frames,
 		props_impl_t *impl = _props_impl_get(props, property->body);
 		if(impl)
 		{
-			_props_impl_set(props, impl, value->type, value->size,
+			_props_impl_set(props, frames, impl, value->type, value->size,
 				LV2_ATOM_BODY_CONST(value));
 
 			// send on (e.g. to UI)
@@ -850,7 +1170,7 @@ props_advance(props_t *props, LV2_Atom_Forge *forge, uint32_t frames,
 			props_impl_t *impl = _props_impl_get(props, property);
 			if(impl)
 			{
-				_props_impl_set(props, impl, value->type, value->size,
+				_props_impl_set(props, frames, impl, value->type, value->size,
 					LV2_ATOM_BODY_CONST(value));
 
 				// send on (e.g. to UI)
@@ -1091,11 +1411,23 @@ props_save(props_t *props, LV2_State_Store_Function store,
 			// always clear memory
 			memset(body, 0x0, props->max_size);
 
+			// vectors of fixed element count are stored as proper atom:Vector
+			LV2_Atom_Vector_Body *vec = body;
+			const uint32_t offset = impl->child_size
+				? sizeof(LV2_Atom_Vector_Body)
+				: 0;
+
+			if(impl->child_size)
+			{
+				vec->child_size = impl->child_size;
+				vec->child_type = impl->child_type;
+			}
+
 			_props_impl_spin_lock(impl, PROP_STATE_NONE, PROP_STATE_LOCK);
 
 			// create temporary copy of value, store() may well be blocking
-			const uint32_t size = impl->stash.size;
-			memcpy(body, impl->stash.body, size);
+			const uint32_t size = offset + impl->stash.size;
+			memcpy((uint8_t *)body + offset, impl->stash.body, impl->stash.size);
 
 			_props_impl_unlock(impl, PROP_STATE_NONE);
 
@@ -1148,6 +1480,41 @@ props_save(props_t *props, LV2_State_Store_Function store,
 	return LV2_STATE_SUCCESS;
 }
 
+// fill a vector from the per-element properties of a former state, elements
+// not found keep their current value
+static inline bool
+_props_restore_alias(props_t *props, unsigned idx, props_impl_t *impl,
+	LV2_State_Retrieve_Function retrieve, LV2_State_Handle state)
+{
+	const props_def_t *def = impl->def;
+	uint8_t *dst = _props_restore_body(props, idx, impl);
+	bool found = false;
+
+	_props_impl_spin_lock(impl, PROP_STATE_NONE, PROP_STATE_LOCK);
+	memcpy(dst, impl->stash.body, impl->value.size);
+	_props_impl_unlock(impl, PROP_STATE_NONE);
+
+	for(uint32_t i = 0; i < def->nelems; i++, dst += impl->child_size)
+	{
+		char uri [512];
+		snprintf(uri, sizeof(uri), "%s%u", def->alias, (unsigned)i + 1);
+
+		size_t size;
+		uint32_t type;
+		uint32_t _flags;
+		const void *body = retrieve(state, props->map->map(props->map->handle, uri),
+			&size, &type, &_flags);
+
+		if(body && (type == impl->child_type) && (size == impl->child_size) )
+		{
+			memcpy(dst, body, size);
+			found = true;
+		}
+	}
+
+	return found;
+}
+
 static inline LV2_State_Status
 props_restore(props_t *props, LV2_State_Retrieve_Function retrieve,
 	LV2_State_Handle state, uint32_t flags __attribute__((unused)),
@@ -1168,10 +1535,15 @@ props_restore(props_t *props, LV2_State_Retrieve_Function retrieve,
 		}
 	}
 
+	// fill the restore buffer only this thread writes to
+	const unsigned idx = props->restore.write;
+
 	for(unsigned i = 0; i < props->nimpls; i++)
 	{
 		props_impl_t *impl = &props->impls[i];
 
+		impl->restored[idx].valid = false;
+
 		if(impl->access == props->urid.patch_readable)
 			continue; // skip read-only, as it makes no sense to restore them
 
@@ -1182,39 +1554,48 @@ props_restore(props_t *props, LV2_State_Retrieve_Function retrieve,
 
 		if(  body
 			&& (type == impl->type)
-			&& ( (impl->def->max_size == 0) || (size <= impl->def->max_size) ) )
+			&& _props_impl_fits(props, impl, size, body) )
 		{
 			if(  map_path && map_path->absolute_path
 				&& (type == props->urid.atom_path) )
 			{
 				char *absolute = map_path->absolute_path(map_path->handle, body);
-				if(absolute)
+				const uint32_t sz = absolute ? strlen(absolute) + 1 : 0;
+				if(absolute && _props_impl_fits(props, impl, sz, absolute))
 				{
-					const uint32_t sz = strlen(absolute) + 1;
-
-					_props_impl_spin_lock(impl, PROP_STATE_NONE, PROP_STATE_LOCK);
-
-					impl->stash.size = sz;
-					memcpy(impl->stash.body, absolute, sz);
-
-					_props_impl_unlock(impl, PROP_STATE_RESTORE);
+					memcpy(_props_restore_body(props, idx, impl), absolute, sz);
+					impl->restored[idx].size = sz;
+					impl->restored[idx].valid = true;
+				}
 
+				if(absolute)
 					_free_path(free_path, absolute);
-				}
 			}
-			else // !Path
+			else if(impl->child_size)
 			{
-				_props_impl_spin_lock(impl, PROP_STATE_NONE, PROP_STATE_LOCK);
-
-				impl->stash.size = size;
-				memcpy(impl->stash.body, body, size);
+				const LV2_Atom_Vector_Body *vec = body;
 
-				_props_impl_unlock(impl, PROP_STATE_RESTORE);
+				memcpy(_props_restore_body(props, idx, impl), vec + 1, impl->value.size);
+				impl->restored[idx].size = impl->value.size;
+				impl->restored[idx].valid = true;
 			}
+			else // !Path
+			{
+				memcpy(_props_restore_body(props, idx, impl), body, size);
+				impl->restored[idx].size = size;
+				impl->restored[idx].valid = true;
+			}
+		}
+		else if(impl->child_size && impl->def->alias
+			&& _props_restore_alias(props, idx, impl, retrieve, state) )
+		{
+			impl->restored[idx].size = impl->value.size;
+			impl->restored[idx].valid = true;
 		}
 	}
 
-	_props_restoring_set(props);
+	// hand it over to be picked up by props_idle as a whole
+	_props_restore_publish(props);
 
 	return LV2_STATE_SUCCESS;
 }
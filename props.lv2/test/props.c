@@ -51,6 +51,7 @@ struct _plughandle_t {
 	PROPS_T(props, MAX_NPROPS);
 	plugstate_t state;
 	plugstate_t stash;
+	plugstate_t restore [PROPS_NRESTORE];
 
 	struct {
 		LV2_URID val2;
@@ -196,7 +197,7 @@ instantiate(const LV2_Descriptor* descriptor,
 
 	if(!props_init(&handle->props, descriptor->URI,
 		defs, MAX_NPROPS, &handle->state, &handle->stash,
-		handle->map, handle))
+		handle->restore, sizeof(plugstate_t), handle->map, handle))
 	{
 		lv2_log_error(&handle->logger, "failed to initialize property structure\n");
 		free(handle);
@@ -0,0 +1,260 @@
+/*
+ * Copyright (c) 2015 Hanspeter Portner (dev@open-music-kontrollers.ch)
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the Artistic License 2.0 as published by
+ * The Perl Foundation.
+ *
+ * This source is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Artistic License 2.0 for more details.
+ *
+ * You should have received a copy of the Artistic License 2.0
+ * along the source as a COPYING file. If not, obtain it from
+ * http://www.perlfoundation.org/artistic_license_2_0.
+ */
+
+// reports the cost of property lookups and of patch:Set events handled by
+// props_advance, e.g. as flooded by a control surface during automation
+
+#include <assert.h>
+#include <time.h>
+#include <inttypes.h>
+
+#include <props.h>
+
+#define MAX_URIDS 4096
+#define MAX_NPROPS 64
+#define NSPACERS 16
+#define NEVENTS 256
+#define NRUNS 4096
+#define SEQ_SIZE 0x10000
+
+#define PROPS_PREFIX "http://open-music-kontrollers.ch/lv2/props#"
+
+typedef struct _plugstate_t plugstate_t;
+typedef struct _handle_t handle_t;
+
+struct _plugstate_t {
+	float val [MAX_NPROPS];
+};
+
+struct _handle_t {
+	PROPS_T(props, MAX_NPROPS);
+	plugstate_t state;
+	plugstate_t stash;
+	plugstate_t restore [PROPS_NRESTORE];
+
+	LV2_URID_Map map;
+	LV2_Atom_Forge forge;
+
+	char *uris [MAX_URIDS];
+	LV2_URID urid;
+
+	char names [MAX_NPROPS][64];
+	props_def_t defs [MAX_NPROPS];
+	LV2_URID properties [MAX_NPROPS];
+
+	union {
+		LV2_Atom_Sequence seq;
+		uint8_t buf [SEQ_SIZE];
+	} in;
+	union {
+		LV2_Atom_Sequence seq;
+		uint8_t buf [SEQ_SIZE];
+	} out;
+};
+
+static LV2_URID
+_map(LV2_URID_Map_Handle instance, const char *uri)
+{
+	handle_t *handle = instance;
+
+	for(LV2_URID urid = 1; urid <= handle->urid; urid++)
+	{
+		if(!strcmp(handle->uris[urid - 1], uri))
+			return urid;
+	}
+
+	assert(handle->urid < MAX_URIDS);
+
+	handle->uris[handle->urid] = strdup(uri);
+
+	return ++handle->urid;
+}
+
+static inline int64_t
+_now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec*INT64_C(1000000000) + ts.tv_nsec;
+}
+
+static void
+_init(handle_t *handle, unsigned nspacers)
+{
+	for(LV2_URID urid = 0; urid < handle->urid; urid++)
+		free(handle->uris[urid]);
+	handle->urid = 0;
+
+	handle->map.handle = handle;
+	handle->map.map = _map;
+
+	lv2_atom_forge_init(&handle->forge, &handle->map);
+
+	for(unsigned i = 0; i < MAX_NPROPS; i++)
+	{
+		snprintf(handle->names[i], sizeof(handle->names[i]),
+			PROPS_PREFIX"val_%u", i);
+
+		handle->defs[i].property = handle->names[i];
+		handle->defs[i].type = LV2_ATOM__Float;
+		handle->defs[i].offset = offsetof(plugstate_t, val) + i*sizeof(float);
+
+		// map other URIs in-between, as e.g. other plugin instances would
+		handle->properties[i] = _map(handle, handle->names[i]);
+
+		for(unsigned j = 0; j < nspacers; j++)
+		{
+			char uri [64];
+
+			snprintf(uri, sizeof(uri), PROPS_PREFIX"spacer_%u_%u", i, j);
+			_map(handle, uri);
+		}
+	}
+
+	assert(props_init(&handle->props, PROPS_PREFIX"bench", handle->defs,
+		MAX_NPROPS, &handle->state, &handle->stash, handle->restore,
+		sizeof(plugstate_t), &handle->map, handle) == 1);
+}
+
+static void
+_forge_sets(handle_t *handle)
+{
+	LV2_Atom_Forge *forge = &handle->forge;
+	LV2_Atom_Forge_Frame frame;
+	LV2_Atom_Forge_Frame obj;
+
+	lv2_atom_forge_set_buffer(forge, handle->in.buf, SEQ_SIZE);
+	LV2_Atom_Forge_Ref ref = lv2_atom_forge_sequence_head(forge, &frame, 0);
+
+	for(unsigned i = 0; (i < NEVENTS) && ref; i++)
+	{
+		const LV2_URID property = handle->properties[(i*7) % MAX_NPROPS];
+
+		if(ref)
+			ref = lv2_atom_forge_frame_time(forge, i);
+		if(ref)
+			ref = lv2_atom_forge_object(forge, &obj, 0, handle->props.urid.patch_set);
+		if(ref)
+			ref = lv2_atom_forge_key(forge, handle->props.urid.patch_property);
+		if(ref)
+			ref = lv2_atom_forge_urid(forge, property);
+		if(ref)
+			ref = lv2_atom_forge_key(forge, handle->props.urid.patch_value);
+		if(ref)
+			ref = lv2_atom_forge_float(forge, i);
+		if(ref)
+			lv2_atom_forge_pop(forge, &obj);
+	}
+
+	assert(ref);
+	lv2_atom_forge_pop(forge, &frame);
+}
+
+static double
+_bench_lookup(handle_t *handle)
+{
+	props_t *props = &handle->props;
+	unsigned found = 0;
+
+	const int64_t t0 = _now();
+
+	for(unsigned run = 0; run < NRUNS; run++)
+	{
+		for(unsigned i = 0; i < MAX_NPROPS; i++)
+		{
+			found += _props_impl_get(props, handle->properties[(i*7) % MAX_NPROPS])
+				!= NULL;
+		}
+	}
+
+	const int64_t t1 = _now();
+
+	assert(found == NRUNS*MAX_NPROPS);
+
+	return (double)(t1 - t0) / (NRUNS*MAX_NPROPS);
+}
+
+static double
+_bench_advance(handle_t *handle)
+{
+	props_t *props = &handle->props;
+	LV2_Atom_Forge *forge = &handle->forge;
+
+	const int64_t t0 = _now();
+
+	for(unsigned run = 0; run < NRUNS; run++)
+	{
+		LV2_Atom_Forge_Frame frame;
+
+		lv2_atom_forge_set_buffer(forge, handle->out.buf, SEQ_SIZE);
+		LV2_Atom_Forge_Ref ref = lv2_atom_forge_sequence_head(forge, &frame, 0);
+
+		props_idle(props, forge, 0, &ref);
+
+		LV2_ATOM_SEQUENCE_FOREACH(&handle->in.seq, ev)
+		{
+			const LV2_Atom_Object *obj = (const LV2_Atom_Object *)&ev->body;
+
+			props_advance(props, forge, ev->time.frames, obj, &ref);
+		}
+
+		assert(ref);
+		lv2_atom_forge_pop(forge, &frame);
+	}
+
+	const int64_t t1 = _now();
+
+	return (double)(t1 - t0) / (NRUNS*NEVENTS);
+}
+
+static void
+_run(handle_t *handle, const char *name, unsigned nspacers, bool bsearch)
+{
+	_init(handle, nspacers);
+
+	if(bsearch)
+		handle->props.hash.mul = 0; // force fall back
+
+	const char *mode = handle->props.hash.mul == 0
+		? "bsearch"
+		: (handle->props.hash.mul == 1 ? "direct" : "hash");
+
+	_forge_sets(handle);
+
+	printf("%-12s %-8s %12.1f %12.1f\n", name, mode,
+		_bench_lookup(handle), _bench_advance(handle));
+}
+
+int
+main(int argc __attribute__((unused)), char **argv __attribute__((unused)))
+{
+	static handle_t handle;
+
+	printf("# %u properties, %u patch:Set/run\n", MAX_NPROPS, NEVENTS);
+	printf("%-12s %-8s %12s %12s\n", "# urids", "lookup", "[ns/get]", "[ns/set]");
+
+	_run(&handle, "contiguous", 0, true);
+	_run(&handle, "contiguous", 0, false);
+	_run(&handle, "scattered", NSPACERS, true);
+	_run(&handle, "scattered", NSPACERS, false);
+
+	for(LV2_URID urid = 0; urid < handle.urid; urid++)
+		free(handle.uris[urid]);
+
+	return 0;
+}
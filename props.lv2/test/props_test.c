@@ -23,6 +23,7 @@
 #define STR_SIZE 32
 #define CHUNK_SIZE 16
 #define VEC_SIZE 13
+#define ELEMS_SIZE 4
 
 #define PROPS_PREFIX		"http://open-music-kontrollers.ch/lv2/props#"
 #define PROPS_TEST_URI	PROPS_PREFIX"test"
@@ -53,6 +54,7 @@ struct _plugstate_t {
 		int32_t vec_body [VEC_SIZE];
 	LV2_Atom_Object_Body obj; //FIXME
 	LV2_Atom_Sequence_Body seq; //FIXME
+	int32_t elems [ELEMS_SIZE];
 };
 
 struct _urid_t {
@@ -75,6 +77,7 @@ enum {
 	PROP_vec,
 	PROP_obj,
 	PROP_seq,
+	PROP_elems,
 
 	MAX_NPROPS
 };
@@ -83,9 +86,20 @@ struct _handle_t {
 	PROPS_T(props, MAX_NPROPS);
 	plugstate_t state;
 	plugstate_t stash;
+	plugstate_t restore [PROPS_NRESTORE];
 
 	LV2_URID_Map map;
 
+	int32_t retrieve_i32;
+
+	uint32_t elems_changed; // mask of elements reported as changed
+
+	struct {
+		uint32_t size;
+		uint32_t type;
+		uint8_t body [64];
+	} stored;
+
 	urid_t urids [MAX_URIDS];
 	LV2_URID urid;
 };
@@ -262,6 +276,16 @@ _map(LV2_URID_Map_Handle instance, const char *uri)
 	return itm->urid;
 }
 
+static void
+_intercept_elem(void *data, int64_t frames __attribute__((unused)),
+	props_impl_t *impl __attribute__((unused)), uint32_t idx)
+{
+	handle_t *handle = data;
+
+	assert(idx < ELEMS_SIZE);
+	handle->elems_changed |= 1U << idx;
+}
+
 static const props_def_t defs [MAX_NPROPS] = {
 	[PROP_b32] = {
 		.property = PROPS_PREFIX"b32",
@@ -340,6 +364,15 @@ static const props_def_t defs [MAX_NPROPS] = {
 		.offset = offsetof(plugstate_t, seq),
 		.type = LV2_ATOM__Sequence,
 		.max_size = sizeof(LV2_Atom_Sequence_Body) + 0 //FIXME
+	},
+	[PROP_elems] = {
+		.property = PROPS_PREFIX"elems",
+		.offset = offsetof(plugstate_t, elems),
+		.type = LV2_ATOM__Vector,
+		.child_type = LV2_ATOM__Int,
+		.nelems = ELEMS_SIZE,
+		.elem_cb = _intercept_elem,
+		.alias = PROPS_PREFIX"elem_"
 	}
 };
 
@@ -493,6 +526,17 @@ _test_1(handle_t *handle)
 				assert(impl->stash.size == sizeof(stash->seq));
 				assert(impl->stash.body == &stash->seq);
 			} break;
+			case PROP_elems:
+			{
+				assert(impl->value.size == sizeof(state->elems));
+				assert(impl->value.body == &state->elems);
+
+				assert(impl->stash.size == sizeof(stash->elems));
+				assert(impl->stash.body == &stash->elems);
+
+				assert(impl->child_type == map->map(map->handle, LV2_ATOM__Int));
+				assert(impl->child_size == sizeof(int32_t));
+			} break;
 			default:
 			{
 				assert(false);
@@ -614,9 +658,515 @@ _test_2(handle_t *handle)
 	assert(ser_atom_deinit(&ser) == 0);
 }
 
+static const LV2_Atom_Object *
+_patch_set(handle_t *handle, LV2_Atom_Forge *forge, uint8_t *buf, size_t size,
+	LV2_URID property, LV2_URID type, const void *body, uint32_t body_size)
+{
+	props_t *props = &handle->props;
+	LV2_Atom_Forge_Frame frame;
+
+	lv2_atom_forge_set_buffer(forge, buf, size);
+
+	LV2_Atom_Forge_Ref ref = lv2_atom_forge_object(forge, &frame, 0,
+		props->urid.patch_set);
+	if(ref)
+		ref = lv2_atom_forge_key(forge, props->urid.patch_property);
+	if(ref)
+		ref = lv2_atom_forge_urid(forge, property);
+	if(ref)
+		ref = lv2_atom_forge_key(forge, props->urid.patch_value);
+	if(ref)
+		ref = lv2_atom_forge_atom(forge, body_size, type);
+	if(ref)
+		ref = lv2_atom_forge_write(forge, body, body_size);
+	assert(ref);
+	lv2_atom_forge_pop(forge, &frame);
+
+	return (const LV2_Atom_Object *)buf;
+}
+
+static void
+_test_3(handle_t *handle)
+{
+	assert(handle);
+
+	props_t *props = &handle->props;
+	plugstate_t *state = &handle->state;
+	plugstate_t *stash = &handle->stash;
+	LV2_URID_Map *map = &handle->map;
+
+	LV2_Atom_Forge forge;
+	uint8_t buf [256];
+	uint8_t out [256];
+	const uint8_t body [64] = {0x1, 0x2, 0x3, 0x4, 0x5, 0x6, 0x7, 0x8};
+	LV2_Atom_Forge_Ref ref = 1;
+
+	lv2_atom_forge_init(&forge, map);
+
+	const LV2_URID i32 = props_map(props, defs[PROP_i32].property);
+	const LV2_URID str = props_map(props, defs[PROP_str].property);
+	const LV2_URID urid = props_map(props, defs[PROP_urid].property);
+	assert(i32 && str && urid);
+
+	state->i32 = 0;
+	state->urid = 0;
+	memset(state->str, 0x0, STR_SIZE);
+
+	// values of fixed-size types must match in size
+	const LV2_Atom_Object *obj = _patch_set(handle, &forge, buf, sizeof(buf),
+		i32, forge.Int, body, 16);
+	lv2_atom_forge_set_buffer(&forge, out, sizeof(out));
+	props_advance(props, &forge, 0, obj, &ref);
+	assert(state->i32 == 0);
+	assert(state->i64 == 0);
+	assert(stash->i32 == 0);
+
+	obj = _patch_set(handle, &forge, buf, sizeof(buf), i32, forge.Int, body, 2);
+	lv2_atom_forge_set_buffer(&forge, out, sizeof(out));
+	props_advance(props, &forge, 0, obj, &ref);
+	assert(state->i32 == 0);
+
+	obj = _patch_set(handle, &forge, buf, sizeof(buf), urid, forge.URID, body, 64);
+	lv2_atom_forge_set_buffer(&forge, out, sizeof(out));
+	props_advance(props, &forge, 0, obj, &ref);
+	assert(state->urid == 0);
+	assert(state->str[0] == 0);
+
+	obj = _patch_set(handle, &forge, buf, sizeof(buf), i32, forge.Int, body, 4);
+	lv2_atom_forge_set_buffer(&forge, out, sizeof(out));
+	assert(props_advance(props, &forge, 0, obj, &ref) == 1);
+	assert(state->i32 == 0x04030201);
+	assert(stash->i32 == 0x04030201);
+
+	// variable-sized values must not exceed their maximal size
+	obj = _patch_set(handle, &forge, buf, sizeof(buf), str, forge.String, body,
+		STR_SIZE + 1);
+	lv2_atom_forge_set_buffer(&forge, out, sizeof(out));
+	props_advance(props, &forge, 0, obj, &ref);
+	assert(state->str[0] == 0);
+	assert(state->uri[0] == 0);
+
+	// strings must be null-terminated
+	obj = _patch_set(handle, &forge, buf, sizeof(buf), str, forge.String, body, 8);
+	lv2_atom_forge_set_buffer(&forge, out, sizeof(out));
+	props_advance(props, &forge, 0, obj, &ref);
+	assert(state->str[0] == 0);
+
+	obj = _patch_set(handle, &forge, buf, sizeof(buf), str, forge.String, body,
+		STR_SIZE);
+	lv2_atom_forge_set_buffer(&forge, out, sizeof(out));
+	assert(props_advance(props, &forge, 0, obj, &ref) == 1);
+	assert(state->str[0] == 0x1);
+}
+
+static void
+_test_4(handle_t *handle)
+{
+	assert(handle);
+
+	props_t *props = &handle->props;
+	LV2_URID_Map *map = &handle->map;
+
+	LV2_Atom_Forge forge;
+	LV2_Atom_Forge_Frame frame;
+	uint8_t out [128];
+
+	lv2_atom_forge_init(&forge, map);
+
+	const LV2_URID str = props_map(props, defs[PROP_str].property);
+	assert(str);
+
+	lv2_atom_forge_set_buffer(&forge, out, sizeof(out));
+	LV2_Atom_Forge_Ref ref = lv2_atom_forge_sequence_head(&forge, &frame, 0);
+	if(ref)
+		ref = lv2_atom_forge_frame_time(&forge, 0);
+	if(ref)
+		ref = lv2_atom_forge_int(&forge, 1);
+	assert(ref);
+
+	const LV2_Atom_Sequence *seq = (const LV2_Atom_Sequence *)out;
+	const uint32_t offset = forge.offset;
+	const uint32_t size = seq->atom.size;
+
+	// a notification that does not fit must leave preceding events intact
+	props_set(props, &forge, 0, str, &ref);
+	assert(ref);
+	assert(forge.offset == offset);
+	assert(forge.stack == &frame);
+	assert(seq->atom.size == size);
+
+	lv2_atom_forge_pop(&forge, &frame);
+
+	unsigned n = 0;
+	LV2_ATOM_SEQUENCE_FOREACH(seq, ev)
+	{
+		assert(ev->body.type == forge.Int);
+		n++;
+	}
+	assert(n == 1);
+}
+
+static const void *
+_retrieve(LV2_State_Handle instance, uint32_t key, size_t *size,
+	uint32_t *type, uint32_t *flags)
+{
+	handle_t *handle = instance;
+	props_t *props = &handle->props;
+
+	if(key != props_map(props, defs[PROP_i32].property))
+		return NULL;
+
+	*size = sizeof(handle->retrieve_i32);
+	*type = props->urid.atom_int;
+	*flags = LV2_STATE_IS_POD;
+
+	return &handle->retrieve_i32;
+}
+
+static void
+_test_5(handle_t *handle)
+{
+	assert(handle);
+
+	props_t *props = &handle->props;
+	plugstate_t *state = &handle->state;
+	plugstate_t *stash = &handle->stash;
+	const LV2_Feature *const features [] = { NULL };
+
+	LV2_Atom_Forge forge;
+	LV2_Atom_Forge_Frame frame;
+	uint8_t out [1024];
+
+	lv2_atom_forge_init(&forge, &handle->map);
+
+	state->i32 = 1;
+	state->f32 = 1.f;
+
+	// restored values only show up at the next props_idle, the latest one wins
+	handle->retrieve_i32 = 2;
+	assert(props_restore(props, _retrieve, handle, 0, features) == LV2_STATE_SUCCESS);
+	handle->retrieve_i32 = 3;
+	assert(props_restore(props, _retrieve, handle, 0, features) == LV2_STATE_SUCCESS);
+	assert(state->i32 == 1);
+
+	lv2_atom_forge_set_buffer(&forge, out, sizeof(out));
+	LV2_Atom_Forge_Ref ref = lv2_atom_forge_sequence_head(&forge, &frame, 0);
+	props_idle(props, &forge, 0, &ref);
+	assert(ref);
+	assert(state->i32 == 3);
+	assert(stash->i32 == 3);
+	assert(state->f32 == 1.f); // not part of the restored state
+
+	// picked up only once
+	state->i32 = 4;
+	props_idle(props, &forge, 0, &ref);
+	assert(state->i32 == 4);
+
+	// all buffers get reused
+	for(int32_t i = 5; i < 5 + 2*PROPS_NRESTORE; i++)
+	{
+		handle->retrieve_i32 = i;
+		assert(props_restore(props, _retrieve, handle, 0, features) == LV2_STATE_SUCCESS);
+
+		lv2_atom_forge_set_buffer(&forge, out, sizeof(out));
+		ref = lv2_atom_forge_sequence_head(&forge, &frame, 0);
+		props_idle(props, &forge, 0, &ref);
+		assert(ref);
+		assert(state->i32 == i);
+	}
+}
+
+static void
+_test_6(handle_t *handle)
+{
+	assert(handle);
+
+	props_t *props = &handle->props;
+	LV2_URID_Map *map = &handle->map;
+	char uri [64];
+
+	// contiguous URIDs are indexed directly
+	assert(props->hash.mul == 1);
+
+	// start over with property URIDs scattered beyond the directly indexable range
+	for(urid_t *itm=handle->urids; itm->urid; itm++)
+	{
+		free(itm->uri);
+	}
+	memset(handle->urids, 0x0, sizeof(handle->urids));
+	handle->urid = 0;
+
+	for(unsigned i = 0; i < MAX_NPROPS; i++)
+	{
+		map->map(map->handle, defs[i].property);
+
+		for(unsigned j = 0; j < 24; j++)
+		{
+			snprintf(uri, sizeof(uri), PROPS_PREFIX"spacer_%u_%u", i, j);
+			map->map(map->handle, uri);
+		}
+	}
+
+	assert(props_init(props, PROPS_PREFIX"subj", defs, MAX_NPROPS,
+		&handle->state, &handle->stash, handle->restore, sizeof(plugstate_t),
+		map, NULL) == 1);
+	assert(props->hash.mul > 1);
+
+	for(unsigned i = 0; i < MAX_NPROPS; i++)
+	{
+		const LV2_URID property = map->map(map->handle, defs[i].property);
+
+		props_impl_t *impl = _props_impl_get(props, property);
+		assert(impl);
+		assert(impl->property == property);
+		assert(impl->def == &defs[i]);
+
+		snprintf(uri, sizeof(uri), PROPS_PREFIX"spacer_%u_0", i);
+		assert(_props_impl_get(props, map->map(map->handle, uri)) == NULL);
+	}
+
+	assert(_props_impl_get(props, 0) == NULL);
+	assert(_props_impl_get(props, UINT32_MAX) == NULL);
+}
+
+static LV2_State_Status
+_store(LV2_State_Handle instance, uint32_t key, const void *value,
+	size_t size, uint32_t type, uint32_t flags __attribute__((unused)))
+{
+	handle_t *handle = instance;
+	props_t *props = &handle->props;
+
+	if(key == props_map(props, defs[PROP_elems].property))
+	{
+		assert(size <= sizeof(handle->stored.body));
+
+		handle->stored.size = size;
+		handle->stored.type = type;
+		memcpy(handle->stored.body, value, size);
+	}
+
+	return LV2_STATE_SUCCESS;
+}
+
+static const void *
+_retrieve_stored(LV2_State_Handle instance, uint32_t key, size_t *size,
+	uint32_t *type, uint32_t *flags)
+{
+	handle_t *handle = instance;
+	props_t *props = &handle->props;
+
+	if(key != props_map(props, defs[PROP_elems].property))
+		return NULL;
+
+	*size = handle->stored.size;
+	*type = handle->stored.type;
+	*flags = LV2_STATE_IS_POD;
+
+	return handle->stored.body;
+}
+
+static void
+_test_7(handle_t *handle)
+{
+	assert(handle);
+
+	props_t *props = &handle->props;
+	plugstate_t *state = &handle->state;
+	plugstate_t *stash = &handle->stash;
+	LV2_URID_Map *map = &handle->map;
+	const LV2_Feature *const features [] = { NULL };
+
+	LV2_Atom_Forge forge;
+	LV2_Atom_Forge_Frame frame;
+	uint8_t buf [256];
+	uint8_t out [512];
+	LV2_Atom_Forge_Ref ref = 1;
+
+	lv2_atom_forge_init(&forge, map);
+
+	const LV2_URID elems = props_map(props, defs[PROP_elems].property);
+	assert(elems);
+
+	struct {
+		LV2_Atom_Vector_Body head;
+		int32_t body [ELEMS_SIZE];
+	} vec = {
+		.head = {
+			.child_size = sizeof(int32_t),
+			.child_type = forge.Int
+		},
+		.body = {1, 0, 3, 0}
+	};
+
+	// only changed elements are reported
+	const LV2_Atom_Object *obj = _patch_set(handle, &forge, buf, sizeof(buf),
+		elems, forge.Vector, &vec, sizeof(vec));
+	lv2_atom_forge_set_buffer(&forge, out, sizeof(out));
+	ref = lv2_atom_forge_sequence_head(&forge, &frame, 0);
+	assert(props_advance(props, &forge, 0, obj, &ref) == 1);
+	assert(ref);
+	lv2_atom_forge_pop(&forge, &frame);
+	assert(handle->elems_changed == 0x5);
+	assert(state->elems[0] == 1);
+	assert(state->elems[2] == 3);
+	assert(stash->elems[2] == 3);
+
+	// the notification carries the whole vector
+	unsigned nvecs = 0;
+	LV2_ATOM_SEQUENCE_FOREACH((const LV2_Atom_Sequence *)out, ev)
+	{
+		const LV2_Atom_Object *msg = (const LV2_Atom_Object *)&ev->body;
+		const LV2_Atom_Vector *value = NULL;
+
+		if(msg->body.otype != props->urid.patch_set)
+			continue;
+
+		lv2_atom_object_get(msg, props->urid.patch_value, &value, 0);
+		assert(value);
+		assert(value->atom.type == forge.Vector);
+		assert(value->body.child_type == forge.Int);
+		assert(value->atom.size == sizeof(vec));
+		assert(!memcmp(&value->body, &vec, sizeof(vec)));
+		nvecs++;
+	}
+	assert(nvecs == 1);
+
+	// vectors of other element type or count are rejected
+	handle->elems_changed = 0;
+	vec.head.child_type = forge.Float;
+	vec.body[1] = 2;
+	obj = _patch_set(handle, &forge, buf, sizeof(buf), elems, forge.Vector,
+		&vec, sizeof(vec));
+	lv2_atom_forge_set_buffer(&forge, out, sizeof(out));
+	props_advance(props, &forge, 0, obj, &ref);
+	vec.head.child_type = forge.Int;
+	obj = _patch_set(handle, &forge, buf, sizeof(buf), elems, forge.Vector,
+		&vec, sizeof(vec) - sizeof(int32_t));
+	lv2_atom_forge_set_buffer(&forge, out, sizeof(out));
+	props_advance(props, &forge, 0, obj, &ref);
+	assert(handle->elems_changed == 0);
+	assert(state->elems[1] == 0);
+
+	// saved as atom:Vector, all elements reported when restored
+	assert(props_save(props, _store, handle, 0, features) == LV2_STATE_SUCCESS);
+	assert(handle->stored.type == forge.Vector);
+	assert(handle->stored.size == sizeof(vec));
+	assert(!memcmp(handle->stored.body + sizeof(LV2_Atom_Vector_Body),
+		state->elems, sizeof(state->elems)));
+
+	memset(state->elems, 0x0, sizeof(state->elems));
+	assert(props_restore(props, _retrieve_stored, handle, 0, features)
+		== LV2_STATE_SUCCESS);
+	lv2_atom_forge_set_buffer(&forge, out, sizeof(out));
+	ref = lv2_atom_forge_sequence_head(&forge, &frame, 0);
+	props_idle(props, &forge, 0, &ref);
+	assert(ref);
+	assert(handle->elems_changed == 0xf);
+	assert(state->elems[0] == 1);
+	assert(state->elems[2] == 3);
+}
+
+// a former state with per-element properties elem_1 and elem_3 only
+static const void *
+_retrieve_alias(LV2_State_Handle instance, uint32_t key, size_t *size,
+	uint32_t *type, uint32_t *flags)
+{
+	handle_t *handle = instance;
+	LV2_URID_Map *map = &handle->map;
+	static const int32_t elem_1 = 7;
+	static const int32_t elem_3 = 9;
+	static const float elem_4 = 1.f;
+
+	*size = sizeof(int32_t);
+	*type = map->map(map->handle, LV2_ATOM__Int);
+	*flags = LV2_STATE_IS_POD;
+
+	if(key == map->map(map->handle, PROPS_PREFIX"elem_1"))
+		return &elem_1;
+	if(key == map->map(map->handle, PROPS_PREFIX"elem_3"))
+		return &elem_3;
+	if(key == map->map(map->handle, PROPS_PREFIX"elem_4"))
+	{
+		*type = map->map(map->handle, LV2_ATOM__Float);
+		return &elem_4;
+	}
+
+	return NULL;
+}
+
+static void
+_test_8(handle_t *handle)
+{
+	assert(handle);
+
+	props_t *props = &handle->props;
+	plugstate_t *state = &handle->state;
+	plugstate_t *stash = &handle->stash;
+	LV2_URID_Map *map = &handle->map;
+	const LV2_Feature *const features [] = { NULL };
+
+	LV2_Atom_Forge forge;
+	LV2_Atom_Forge_Frame frame;
+	uint8_t out [512];
+	LV2_Atom_Forge_Ref ref = 1;
+
+	lv2_atom_forge_init(&forge, map);
+
+	state->elems[1] = 5;
+	stash->elems[1] = 5;
+	state->elems[3] = 6;
+	stash->elems[3] = 6;
+
+	// missing vector is assembled from the aliases, mistyped ones are ignored
+	assert(props_restore(props, _retrieve_alias, handle, 0, features)
+		== LV2_STATE_SUCCESS);
+	lv2_atom_forge_set_buffer(&forge, out, sizeof(out));
+	ref = lv2_atom_forge_sequence_head(&forge, &frame, 0);
+	props_idle(props, &forge, 0, &ref);
+	assert(ref);
+	assert(handle->elems_changed == 0xf);
+	assert(state->elems[0] == 7);
+	assert(state->elems[1] == 5);
+	assert(state->elems[2] == 9);
+	assert(state->elems[3] == 6);
+}
+
+static void
+_test_9(handle_t *handle)
+{
+	assert(handle);
+
+	props_t *props = &handle->props;
+	LV2_URID_Map *map = &handle->map;
+	const size_t stride = offsetof(plugstate_t, chunk);
+
+	props_def_t sub [2] = {
+		defs[PROP_i32],
+		defs[PROP_chunk]
+	};
+
+	// restore buffers only need to hold what can be restored
+	assert(props_init(props, PROPS_PREFIX"subj", sub, 2,
+		&handle->state, &handle->stash, handle->restore, stride,
+		map, handle) == 0);
+
+	sub[1].access = LV2_PATCH__readable;
+	assert(props_init(props, PROPS_PREFIX"subj", sub, 2,
+		&handle->state, &handle->stash, handle->restore, stride,
+		map, handle) == 1);
+	assert(props->restore.stride == stride);
+}
+
 static const test_t tests [] = {
 	_test_1,
 	_test_2,
+	_test_3,
+	_test_4,
+	_test_5,
+	_test_6,
+	_test_7,
+	_test_8,
+	_test_9,
 	NULL
 };
 
@@ -633,7 +1183,8 @@ main(int argc __attribute__((unused)), char **argv __attribute__((unused)))
 		handle.map.map = _map;
 
 		assert(props_init(&handle.props, PROPS_PREFIX"subj", defs, MAX_NPROPS,
-			&handle.state, &handle.stash, &handle.map, NULL) == 1);
+			&handle.state, &handle.stash, handle.restore, sizeof(plugstate_t),
+			&handle.map, &handle) == 1);
 
 		(*test)(&handle);
 	}
@@ -22,7 +22,7 @@
 #include <espressivo.h>
 #include <props.h>
 
-#define MAX_NPROPS 7
+#define MAX_NPROPS (7 + PERF_NPROPS)
 
 typedef struct _targetI_t targetI_t;
 typedef struct _targetO_t targetO_t;
@@ -30,7 +30,7 @@ typedef struct _plugstate_t plugstate_t;
 typedef struct _plughandle_t plughandle_t;
 
 struct _targetI_t {
-	xpress_uuid_t uuid;
+	xpress_handle_t voice;
 };
 
 struct _targetO_t {
@@ -40,12 +40,9 @@ struct _targetO_t {
 
 struct _plugstate_t {
 	int32_t sample;
-	int32_t hold_pitch;
-	int32_t hold_pressure;
-	int32_t hold_timbre;
-	int32_t hold_dPitch;
-	int32_t hold_dPressure;
-	int32_t hold_dTimbre;
+	hold_state_t hold;
+
+	perf_state_t perf;
 };
 
 struct _plughandle_t {
@@ -54,10 +51,11 @@ struct _plughandle_t {
 	LV2_Atom_Forge_Ref ref;
 
 	PROPS_T(props, MAX_NPROPS);
-	XPRESS_T(xpressI, MAX_NVOICES);
-	targetI_t targetI [MAX_NVOICES];
-	XPRESS_T(xpressO, MAX_NVOICES);
-	targetO_t targetO [MAX_NVOICES];
+	xpress_t *xpressI;
+	targetI_t *targetI;
+	xpress_t *xpressO;
+	targetO_t *targetO;
+	void *pool;
 
 	const LV2_Atom_Sequence *event_in;
 	LV2_Atom_Sequence *event_out;
@@ -66,6 +64,8 @@ struct _plughandle_t {
 
 	plugstate_t state;
 	plugstate_t stash;
+	plugstate_t restore [PROPS_NRESTORE];
+	perf_t perf;
 };
 
 static void
@@ -76,27 +76,18 @@ _intercept_sample(void *data, int64_t frames, props_impl_t *impl)
 	if(!handle->state.sample)
 	{
 		// release all events on hold
-		unsigned freed = 0;
-
-		XPRESS_VOICE_FOREACH(&handle->xpressO, voice)
+		XPRESS_VOICE_FOREACH(handle->xpressO, voice)
 		{
 			targetO_t *dst = voice->target;
 
 			if(!dst->on_hold)
 				continue; // still playing
 
-			voice->uuid = 0; // mark for removal
-			freed += 1;
-		}
-
-		if(freed > 0)
-		{
-			_xpress_sort(&handle->xpressO);
-			handle->xpressO.nvoices -= freed;
+			xpress_free(handle->xpressO, voice->uuid);
 		}
 
 		if(handle->ref)
-			handle->ref = xpress_alive(&handle->xpressO, &handle->forge, frames);
+			handle->ref = xpress_alive(handle->xpressO, &handle->forge, frames);
 	}
 }
 
@@ -109,34 +100,35 @@ static const props_def_t defs [MAX_NPROPS] = {
 	},
 	{
 		.property = ESPRESSIVO_URI"#snh_hold_pitch",
-		.offset = offsetof(plugstate_t, hold_pitch),
+		.offset = offsetof(plugstate_t, hold.pitch),
 		.type = LV2_ATOM__Bool,
 	},
 	{
 		.property = ESPRESSIVO_URI"#snh_hold_pressure",
-		.offset = offsetof(plugstate_t, hold_pressure),
+		.offset = offsetof(plugstate_t, hold.pressure),
 		.type = LV2_ATOM__Bool,
 	},
 	{
 		.property = ESPRESSIVO_URI"#snh_hold_timbre",
-		.offset = offsetof(plugstate_t, hold_timbre),
+		.offset = offsetof(plugstate_t, hold.timbre),
 		.type = LV2_ATOM__Bool,
 	},
 	{
 		.property = ESPRESSIVO_URI"#snh_hold_dPitch",
-		.offset = offsetof(plugstate_t, hold_dPitch),
+		.offset = offsetof(plugstate_t, hold.dPitch),
 		.type = LV2_ATOM__Bool,
 	},
 	{
 		.property = ESPRESSIVO_URI"#snh_hold_dPressure",
-		.offset = offsetof(plugstate_t, hold_dPressure),
+		.offset = offsetof(plugstate_t, hold.dPressure),
 		.type = LV2_ATOM__Bool,
 	},
 	{
 		.property = ESPRESSIVO_URI"#snh_hold_dTimbre",
-		.offset = offsetof(plugstate_t, hold_dTimbre),
+		.offset = offsetof(plugstate_t, hold.dTimbre),
 		.type = LV2_ATOM__Bool,
-	}
+	},
+	PERF_DEFS(plugstate_t, perf)
 };
 
 static void
@@ -147,13 +139,13 @@ _add(void *data, int64_t frames, const xpress_state_t *state,
 	targetI_t *src = target;
 	targetO_t *dst;
 
-	if((dst = xpress_create(&handle->xpressO, &src->uuid)))
+	if((dst = xpress_create_h(handle->xpressO, &src->voice)))
 	{
 		dst->on_hold = false;
 		dst->state = *state;
 
 		if(handle->ref)
-			handle->ref = xpress_token(&handle->xpressO, &handle->forge, frames, src->uuid, &dst->state);
+			handle->ref = xpress_token_h(handle->xpressO, &handle->forge, frames, &src->voice, &dst->state);
 	}
 }
 
@@ -165,28 +157,12 @@ _set(void *data, int64_t frames, const xpress_state_t *state,
 	targetI_t *src = target;
 	targetO_t *dst;
 	
-	if((dst = xpress_get(&handle->xpressO, src->uuid)))
+	if((dst = xpress_get_h(handle->xpressO, &src->voice)))
 	{
-		if(!(handle->state.hold_pitch && (state->pitch < dst->state.pitch) ))
-			dst->state.pitch = state->pitch;
-
-		if(!(handle->state.hold_pressure && (state->pressure < dst->state.pressure) ))
-			dst->state.pressure = state->pressure;
-
-		if(!(handle->state.hold_timbre && (state->timbre < dst->state.timbre) ))
-			dst->state.timbre = state->timbre;
-
-		if(!(handle->state.hold_dPitch && (state->dPitch < dst->state.dPitch) ))
-			dst->state.dPitch = state->dPitch;
-
-		if(!(handle->state.hold_dPressure && (state->dPressure < dst->state.dPressure) ))
-			dst->state.dPressure = state->dPressure;
-
-		if(!(handle->state.hold_dTimbre && (state->dTimbre < dst->state.dTimbre) ))
-			dst->state.dTimbre = state->dTimbre;
+		_hold_apply(&handle->state.hold, state, &dst->state);
 
 		if(handle->ref)
-			handle->ref = xpress_token(&handle->xpressO, &handle->forge, frames, src->uuid, &dst->state);
+			handle->ref = xpress_token_h(handle->xpressO, &handle->forge, frames, &src->voice, &dst->state);
 	}
 }
 
@@ -200,15 +176,15 @@ _del(void *data, int64_t frames,
 
 	if(handle->state.sample)
 	{
-		if((dst = xpress_get(&handle->xpressO, src->uuid)))
+		if((dst = xpress_get_h(handle->xpressO, &src->voice)))
 			dst->on_hold = true;
 		return;
 	}
 
-	xpress_free(&handle->xpressO, src->uuid);
+	xpress_free_h(handle->xpressO, &src->voice);
 
 	if(handle->ref)
-		handle->ref = xpress_alive(&handle->xpressO, &handle->forge, frames);
+		handle->ref = xpress_release(handle->xpressO, &handle->forge, frames, &src->voice.uuid, 1);
 }
 
 static const xpress_iface_t ifaceI = {
@@ -248,26 +224,51 @@ instantiate(const LV2_Descriptor* descriptor, double rate,
 		return NULL;
 	}
 
+	handle->map = espressivo_map_ref(handle->map);
+
+	const unsigned max_nvoices = xpress_max_nvoices(handle->map, features,
+		MAX_NVOICES, MAX_NVOICES_LIMIT);
+	const size_t pool_size = _pool_size(max_nvoices, sizeof(targetI_t))
+		+ _pool_size(max_nvoices, sizeof(targetO_t));
+	uint8_t *pool = handle->pool = calloc(1, pool_size);
+	if(!pool)
+	{
+		espressivo_map_unref(handle->map);
+		free(handle);
+		return NULL;
+	}
+
+	handle->xpressI = _pool_alloc(&pool, XPRESS_SIZE(max_nvoices));
+	handle->targetI = _pool_alloc(&pool, max_nvoices*sizeof(targetI_t));
+	handle->xpressO = _pool_alloc(&pool, XPRESS_SIZE(max_nvoices));
+	handle->targetO = _pool_alloc(&pool, max_nvoices*sizeof(targetO_t));
+
 	lv2_atom_forge_init(&handle->forge, handle->map);
 
-	if(  !xpress_init(&handle->xpressI, MAX_NVOICES, handle->map, voice_map,
+	if(  !xpress_init(handle->xpressI, max_nvoices, handle->map, voice_map,
 			XPRESS_EVENT_ALL, &ifaceI, handle->targetI, handle)
-		|| !xpress_init(&handle->xpressO, MAX_NVOICES, handle->map, voice_map,
+		|| !xpress_init(handle->xpressO, max_nvoices, handle->map, voice_map,
 			XPRESS_EVENT_NONE, &ifaceO, handle->targetO, handle) )
 	{
+		free(handle->pool);
+		espressivo_map_unref(handle->map);
 		free(handle);
 		return NULL;
 	}
 
 	if(!props_init(&handle->props, descriptor->URI,
 		defs, MAX_NPROPS, &handle->state, &handle->stash,
-		handle->map, handle))
+		handle->restore, sizeof(plugstate_t), handle->map, handle))
 	{
 		fprintf(stderr, "failed to allocate property structure\n");
+		free(handle->pool);
+		espressivo_map_unref(handle->map);
 		free(handle);
 		return NULL;
 	}
 
+	_perf_init(&handle->perf, &handle->props, rate);
+
 	return handle;
 }
 
@@ -294,6 +295,8 @@ run(LV2_Handle instance, uint32_t nsamples)
 {
 	plughandle_t *handle = instance;
 
+	_perf_begin(&handle->perf);
+
 	// prepare midi atom forge
 	const uint32_t capacity = handle->event_out->atom.size;
 	LV2_Atom_Forge *forge = &handle->forge;
@@ -302,8 +305,8 @@ run(LV2_Handle instance, uint32_t nsamples)
 	handle->ref = lv2_atom_forge_sequence_head(forge, &frame, 0);
 
 	props_idle(&handle->props, forge, 0, &handle->ref);
-	xpress_pre(&handle->xpressI);
-	xpress_rst(&handle->xpressO);
+	xpress_pre(handle->xpressI);
+	xpress_rst(handle->xpressO);
 
 	LV2_ATOM_SEQUENCE_FOREACH(handle->event_in, ev)
 	{
@@ -312,18 +315,26 @@ run(LV2_Handle instance, uint32_t nsamples)
 
 		if(!props_advance(&handle->props, forge, frames, obj, &handle->ref))
 		{
-			xpress_advance(&handle->xpressI, forge, frames, obj, &handle->ref);
+			xpress_advance(handle->xpressI, forge, frames, obj, &handle->ref);
 		}
 	}
 
-	xpress_post(&handle->xpressI, nsamples-1);
-	if(handle->ref && !xpress_synced(&handle->xpressO))
-		handle->ref = xpress_alive(&handle->xpressO, forge, nsamples-1);
+	xpress_flush(handle->xpressO, forge, nsamples, &handle->ref);
+
+	xpress_post(handle->xpressI, nsamples-1);
+	if(handle->ref && !xpress_synced(handle->xpressO))
+		handle->ref = xpress_alive(handle->xpressO, forge, nsamples-1);
+
+	_perf_end(&handle->perf, &handle->state.perf, &handle->props, forge, nsamples,
+		handle->event_in, handle->event_out, handle->xpressO, &handle->ref);
 
 	if(handle->ref)
 		lv2_atom_forge_pop(forge, &frame);
 	else
+	{
 		lv2_atom_sequence_clear(handle->event_out);
+		xpress_discard(handle->xpressO);
+	}
 }
 
 static void
@@ -333,8 +344,10 @@ cleanup(LV2_Handle instance)
 
 	if(handle)
 	{
-		xpress_deinit(&handle->xpressI);
-		xpress_deinit(&handle->xpressO);
+		xpress_deinit(handle->xpressI);
+		xpress_deinit(handle->xpressO);
+		free(handle->pool);
+		espressivo_map_unref(handle->map);
 		free(handle);
 	}
 }
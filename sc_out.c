@@ -24,13 +24,14 @@
 
 #define SYNTH_NAMES 8
 #define STRING_SIZE 256
-#define MAX_NPROPS (SYNTH_NAMES + 8)
+#define MAX_NPROPS (SYNTH_NAMES + 8 + PERF_NPROPS)
 
 typedef struct _targetI_t targetI_t;
 typedef struct _plugstate_t plugstate_t;
 typedef struct _plughandle_t plughandle_t;
 
 struct _targetI_t {
+	bool valid;
 	int32_t sid;
 	int32_t zone;
 };
@@ -45,6 +46,8 @@ struct _plugstate_t {
 	int32_t allocate;
 	int32_t gate;
 	int32_t group;
+
+	perf_state_t perf;
 };
 
 struct _plughandle_t {
@@ -54,8 +57,9 @@ struct _plughandle_t {
 	LV2_Atom_Forge_Ref ref;
 
 	PROPS_T(props, MAX_NPROPS);
-	XPRESS_T(xpressI, MAX_NVOICES);
-	targetI_t targetI [MAX_NVOICES];
+	xpress_t *xpressI;
+	targetI_t *targetI;
+	void *pool;
 
 	const LV2_Atom_Sequence *event_in;
 	LV2_Atom_Sequence *osc_out;
@@ -64,6 +68,8 @@ struct _plughandle_t {
 
 	plugstate_t state;
 	plugstate_t stash;
+	plugstate_t restore [PROPS_NRESTORE];
+	perf_t perf;
 };
 
 #define SYNTH_NAME(NUM) \
@@ -123,7 +129,8 @@ static const props_def_t defs [MAX_NPROPS] = {
 	SYNTH_NAME(5),
 	SYNTH_NAME(6),
 	SYNTH_NAME(7),
-	SYNTH_NAME(8)
+	SYNTH_NAME(8),
+	PERF_DEFS(plugstate_t, perf)
 };
 
 static LV2_State_Status
@@ -151,6 +158,19 @@ static const LV2_State_Interface state_iface = {
 	.restore = _state_restore
 };
 
+// integer properties arrive unchecked via patch:Set, keep them within their ranges
+static inline int32_t
+_gid(plughandle_t *handle, int32_t zone)
+{
+	return _clamp_int(handle->state.gid_offset, 0, 10000) + zone;
+}
+
+static inline int32_t
+_arg_offset(plughandle_t *handle)
+{
+	return _clamp_int(handle->state.arg_offset, 0, 4);
+}
+
 static void
 _add(void *data, int64_t frames, const xpress_state_t *state,
 	xpress_uuid_t uuid, void *target)
@@ -159,13 +179,20 @@ _add(void *data, int64_t frames, const xpress_state_t *state,
 	LV2_Atom_Forge *forge = &handle->forge;
 	targetI_t *src = target;
 
-	const int32_t sid = handle->state.sid_offset + (handle->state.sid_wrap
-		? handle->sid++ % handle->state.sid_wrap
+	// voices beyond the named zones stay silent
+	src->valid = _zone_valid(state->zone, SYNTH_NAMES);
+	if(!src->valid)
+		return;
+
+	const int32_t sid_offset = _clamp_int(handle->state.sid_offset, 0, 10000);
+	const int32_t sid_wrap = _clamp_int(handle->state.sid_wrap, 0, 10000);
+	const int32_t sid = sid_offset + (sid_wrap
+		? handle->sid++ % sid_wrap
 		: handle->sid++);
 	src->sid = sid;
 	src->zone = state->zone;
-	const int32_t gid = handle->state.gid_offset + state->zone;
-	const int32_t out = handle->state.out_offset + state->zone;
+	const int32_t gid = _gid(handle, state->zone);
+	const int32_t out = _clamp_int(handle->state.out_offset, 0, 8) + state->zone;
 	const int32_t id = handle->state.group ? gid : sid;
 	const int32_t arg_num = 4;
 
@@ -179,7 +206,7 @@ _add(void *data, int64_t frames, const xpress_state_t *state,
 				handle->ref = lv2_osc_forge_message_vararg(forge, &handle->osc_urid,
 					"/s_new", "siiiiisisi",
 					handle->state.synth_name[state->zone], id, 0, gid,
-					handle->state.arg_offset + 4, 128,
+					_arg_offset(handle) + 4, 128,
 					"gate", 1,
 					"out", out);
 		}
@@ -189,7 +216,7 @@ _add(void *data, int64_t frames, const xpress_state_t *state,
 				handle->ref = lv2_osc_forge_message_vararg(forge, &handle->osc_urid,
 					"/s_new", "siiiiisi",
 					handle->state.synth_name[state->zone], id, 0, gid,
-					handle->state.arg_offset + 4, 128,
+					_arg_offset(handle) + 4, 128,
 					"out", out);
 		}
 	}
@@ -209,7 +236,7 @@ _add(void *data, int64_t frames, const xpress_state_t *state,
 	if(handle->ref)
 		handle->ref = lv2_osc_forge_message_vararg(forge, &handle->osc_urid,
 			"/n_setn", "iiiffff",
-			id, handle->state.arg_offset, arg_num,
+			id, _arg_offset(handle), arg_num,
 			_midi2cps(state->pitch * 0x7f), state->pressure,
 			state->dPitch, state->dPressure);
 }
@@ -222,8 +249,11 @@ _set(void *data, int64_t frames, const xpress_state_t *state,
 	LV2_Atom_Forge *forge = &handle->forge;
 	targetI_t *src = target;
 
+	if(!src->valid)
+		return;
+
 	const int32_t sid = src->sid;
-	const int32_t gid = handle->state.gid_offset + state->zone;
+	const int32_t gid = _gid(handle, src->zone);
 	const int32_t id = handle->state.group ? gid : sid;
 	const int32_t arg_num = 4;
 
@@ -232,7 +262,7 @@ _set(void *data, int64_t frames, const xpress_state_t *state,
 	if(handle->ref)
 		handle->ref = lv2_osc_forge_message_vararg(forge, &handle->osc_urid,
 			"/n_setn", "iiiffff",
-			id, handle->state.arg_offset, arg_num,
+			id, _arg_offset(handle), arg_num,
 			_midi2cps(state->pitch * 0x7f), state->pressure,
 			state->dPitch, state->dPressure);
 }
@@ -245,8 +275,11 @@ _del(void *data, int64_t frames,
 	LV2_Atom_Forge *forge = &handle->forge;
 	targetI_t *src = target;
 
+	if(!src->valid)
+		return;
+
 	const int32_t sid = src->sid;
-	const int32_t gid = handle->state.gid_offset + src->zone;
+	const int32_t gid = _gid(handle, src->zone);
 	const int32_t id = handle->state.group ? gid : sid;
 
 	if(handle->state.gate)
@@ -294,24 +327,46 @@ instantiate(const LV2_Descriptor* descriptor, double rate,
 		return NULL;
 	}
 
+	handle->map = espressivo_map_ref(handle->map);
+
+	const unsigned max_nvoices = xpress_max_nvoices(handle->map, features,
+		MAX_NVOICES, MAX_NVOICES_LIMIT);
+	const size_t pool_size = _pool_size(max_nvoices, sizeof(targetI_t));
+	uint8_t *pool = handle->pool = calloc(1, pool_size);
+	if(!pool)
+	{
+		espressivo_map_unref(handle->map);
+		free(handle);
+		return NULL;
+	}
+
+	handle->xpressI = _pool_alloc(&pool, XPRESS_SIZE(max_nvoices));
+	handle->targetI = _pool_alloc(&pool, max_nvoices*sizeof(targetI_t));
+
 	lv2_atom_forge_init(&handle->forge, handle->map);
 	lv2_osc_urid_init(&handle->osc_urid, handle->map);
 
-	if(!xpress_init(&handle->xpressI, MAX_NVOICES, handle->map, voice_map,
+	if(!xpress_init(handle->xpressI, max_nvoices, handle->map, voice_map,
 			XPRESS_EVENT_ALL, &ifaceI, handle->targetI, handle) )
 	{
+		free(handle->pool);
+		espressivo_map_unref(handle->map);
 		free(handle);
 		return NULL;
 	}
 
 	if(!props_init(&handle->props, descriptor->URI,
 		defs, MAX_NPROPS, &handle->state, &handle->stash,
-		handle->map, handle))
+		handle->restore, sizeof(plugstate_t), handle->map, handle))
 	{
+		free(handle->pool);
+		espressivo_map_unref(handle->map);
 		free(handle);
 		return NULL;
 	}
 
+	_perf_init(&handle->perf, &handle->props, rate);
+
 	return handle;
 }
 
@@ -337,6 +392,8 @@ static void
 run(LV2_Handle instance, uint32_t nsamples)
 {
 	plughandle_t *handle = (plughandle_t *)instance;
+
+	_perf_begin(&handle->perf);
 	
 	// prepare osc atom forge
 	const uint32_t capacity = handle->osc_out->atom.size;
@@ -346,7 +403,7 @@ run(LV2_Handle instance, uint32_t nsamples)
 	handle->ref = lv2_atom_forge_sequence_head(forge, &frame, 0);
 
 	props_idle(&handle->props, forge, 0, &handle->ref);
-	xpress_pre(&handle->xpressI);
+	xpress_pre(handle->xpressI);
 
 	LV2_ATOM_SEQUENCE_FOREACH(handle->event_in, ev)
 	{
@@ -355,11 +412,14 @@ run(LV2_Handle instance, uint32_t nsamples)
 
 		if(!props_advance(&handle->props, forge, frames, obj, &handle->ref))
 		{
-			xpress_advance(&handle->xpressI, forge, frames, obj, &handle->ref);
+			xpress_advance(handle->xpressI, forge, frames, obj, &handle->ref);
 		}
 	}
 
-	xpress_post(&handle->xpressI, nsamples-1);
+	xpress_post(handle->xpressI, nsamples-1);
+
+	_perf_end(&handle->perf, &handle->state.perf, &handle->props, forge, nsamples,
+		handle->event_in, handle->osc_out, handle->xpressI, &handle->ref);
 
 	if(handle->ref)
 		lv2_atom_forge_pop(forge, &frame);
@@ -374,7 +434,9 @@ cleanup(LV2_Handle instance)
 
 	if(handle)
 	{
-		xpress_deinit(&handle->xpressI);
+		xpress_deinit(handle->xpressI);
+		free(handle->pool);
+		espressivo_map_unref(handle->map);
 		free(handle);
 	}
 }
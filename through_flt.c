@@ -22,7 +22,7 @@
 #include <espressivo.h>
 #include <props.h>
 
-#define MAX_NPROPS 2
+#define MAX_NPROPS (2 + LIMIT_NPROPS + PERF_NPROPS)
 
 typedef struct _targetI_t targetI_t;
 typedef struct _targetO_t targetO_t;
@@ -30,7 +30,7 @@ typedef struct _plugstate_t plugstate_t;
 typedef struct _plughandle_t plughandle_t;
 
 struct _targetI_t {
-	xpress_uuid_t uuid;
+	xpress_handle_t voice;
 	int32_t zone_mask;
 };
 
@@ -41,6 +41,9 @@ struct _targetO_t {
 struct _plugstate_t {
 	int32_t zone_mask;
 	int32_t zone_offset;
+
+	limit_state_t limit;
+	perf_state_t perf;
 };
 
 struct _plughandle_t {
@@ -49,18 +52,29 @@ struct _plughandle_t {
 	LV2_Atom_Forge_Ref ref;
 
 	PROPS_T(props, MAX_NPROPS);
-	XPRESS_T(xpressI, MAX_NVOICES);
-	XPRESS_T(xpressO, MAX_NVOICES);
-	targetI_t targetI [MAX_NVOICES];
-	targetO_t targetO [MAX_NVOICES];
+	xpress_t *xpressI;
+	xpress_t *xpressO;
+	targetI_t *targetI;
+	targetO_t *targetO;
+	void *pool;
 
 	const LV2_Atom_Sequence *event_in;
 	LV2_Atom_Sequence *event_out;
 
 	plugstate_t state;
 	plugstate_t stash;
+	plugstate_t restore [PROPS_NRESTORE];
+	perf_t perf;
 };
 
+static void
+_intercept_limit(void *data, int64_t frames, props_impl_t *impl)
+{
+	plughandle_t *handle = data;
+
+	_limit_apply(handle->xpressO, &handle->state.limit, handle->perf.period);
+}
+
 static const props_def_t defs [MAX_NPROPS] = {
 	{
 		.property = ESPRESSIVO_URI"#through_zone_mask",
@@ -71,7 +85,9 @@ static const props_def_t defs [MAX_NPROPS] = {
 		.property = ESPRESSIVO_URI"#through_zone_offset",
 		.offset = offsetof(plugstate_t, zone_offset),
 		.type = LV2_ATOM__Int,
-	}
+	},
+	LIMIT_DEFS(plugstate_t, limit, _intercept_limit),
+	PERF_DEFS(plugstate_t, perf)
 };
 
 static void
@@ -80,20 +96,20 @@ _add(void *data, int64_t frames, const xpress_state_t *state,
 {
 	plughandle_t *handle = data;
 	targetI_t *src = target;
-	src->zone_mask = 1 << state->zone;
+	src->zone_mask = _zone_bit(state->zone);
 
 	if(src->zone_mask & handle->state.zone_mask)
 	{
 		LV2_Atom_Forge *forge = &handle->forge;
 
-		targetO_t *dst = xpress_create(&handle->xpressO, &src->uuid);
+		targetO_t *dst = xpress_create_h(handle->xpressO, &src->voice);
 		(void)dst;
 
 		xpress_state_t new_state = *state;
-		new_state.zone += handle->state.zone_offset;
+		new_state.zone = _zone_shift(new_state.zone, handle->state.zone_offset);
 
 		if(handle->ref)
-			handle->ref = xpress_token(&handle->xpressO, forge, frames, src->uuid, &new_state);
+			handle->ref = xpress_token_h(handle->xpressO, forge, frames, &src->voice, &new_state);
 	}
 }
 
@@ -109,10 +125,10 @@ _set(void *data, int64_t frames, const xpress_state_t *state,
 		LV2_Atom_Forge *forge = &handle->forge;
 
 		xpress_state_t new_state = *state;
-		new_state.zone += handle->state.zone_offset;
+		new_state.zone = _zone_shift(new_state.zone, handle->state.zone_offset);
 
 		if(handle->ref)
-			handle->ref = xpress_token(&handle->xpressO, forge, frames, src->uuid, &new_state);
+			handle->ref = xpress_token_h(handle->xpressO, forge, frames, &src->voice, &new_state);
 	}
 }
 
@@ -123,14 +139,13 @@ _del(void *data, int64_t frames,
 	plughandle_t *handle = data;
 	targetI_t *src = target;
 
-	if(src->zone_mask & handle->state.zone_mask)
+	// release forwarded voices, even if the zone mask has changed meanwhile
+	if(xpress_free_h(handle->xpressO, &src->voice))
 	{
 		LV2_Atom_Forge *forge = &handle->forge;
 
-		xpress_free(&handle->xpressO, src->uuid);
-
 		if(handle->ref)
-			handle->ref = xpress_alive(&handle->xpressO, forge, frames);
+			handle->ref = xpress_release(handle->xpressO, forge, frames, &src->voice.uuid, 1);
 	}
 }
 
@@ -171,26 +186,55 @@ instantiate(const LV2_Descriptor* descriptor, double rate,
 		return NULL;
 	}
 
+	handle->map = espressivo_map_ref(handle->map);
+
+	const unsigned max_nvoices = xpress_max_nvoices(handle->map, features,
+		MAX_NVOICES, MAX_NVOICES_LIMIT);
+	const size_t pool_size = _pool_size(max_nvoices, sizeof(targetI_t))
+		+ _pool_size(max_nvoices, sizeof(targetO_t))
+		+ POOL_ALIGN(XPRESS_STAGE_SIZE(max_nvoices));
+	uint8_t *pool = handle->pool = calloc(1, pool_size);
+	if(!pool)
+	{
+		espressivo_map_unref(handle->map);
+		free(handle);
+		return NULL;
+	}
+
+	handle->xpressI = _pool_alloc(&pool, XPRESS_SIZE(max_nvoices));
+	handle->targetI = _pool_alloc(&pool, max_nvoices*sizeof(targetI_t));
+	handle->xpressO = _pool_alloc(&pool, XPRESS_SIZE(max_nvoices));
+	handle->targetO = _pool_alloc(&pool, max_nvoices*sizeof(targetO_t));
+	xpress_stage_t *stageO = _pool_alloc(&pool, XPRESS_STAGE_SIZE(max_nvoices));
+
 	lv2_atom_forge_init(&handle->forge, handle->map);
 
-	if(  !xpress_init(&handle->xpressI, MAX_NVOICES, handle->map, voice_map,
+	if(  !xpress_init(handle->xpressI, max_nvoices, handle->map, voice_map,
 			XPRESS_EVENT_ALL, &ifaceI, handle->targetI, handle)
-		|| !xpress_init(&handle->xpressO, MAX_NVOICES, handle->map, voice_map,
+		|| !xpress_init(handle->xpressO, max_nvoices, handle->map, voice_map,
 			XPRESS_EVENT_NONE, &ifaceO, handle->targetO, handle) )
 	{
+		free(handle->pool);
+		espressivo_map_unref(handle->map);
 		free(handle);
 		return NULL;
 	}
 
+	xpress_stage(handle->xpressO, stageO); // needed for limiting
+
 	if(!props_init(&handle->props, descriptor->URI,
 		defs, MAX_NPROPS, &handle->state, &handle->stash,
-		handle->map, handle))
+		handle->restore, sizeof(plugstate_t), handle->map, handle))
 	{
 		fprintf(stderr, "failed to allocate property structure\n");
+		free(handle->pool);
+		espressivo_map_unref(handle->map);
 		free(handle);
 		return NULL;
 	}
 
+	_perf_init(&handle->perf, &handle->props, rate);
+
 	return handle;
 }
 
@@ -217,6 +261,8 @@ run(LV2_Handle instance, uint32_t nsamples)
 {
 	plughandle_t *handle = instance;
 
+	_perf_begin(&handle->perf);
+
 	// prepare midi atom forge
 	const uint32_t capacity = handle->event_out->atom.size;
 	LV2_Atom_Forge *forge = &handle->forge;
@@ -225,8 +271,8 @@ run(LV2_Handle instance, uint32_t nsamples)
 	handle->ref = lv2_atom_forge_sequence_head(forge, &frame, 0);
 
 	props_idle(&handle->props, forge, 0, &handle->ref);
-	xpress_pre(&handle->xpressI);
-	xpress_rst(&handle->xpressO);
+	xpress_pre(handle->xpressI);
+	xpress_rst(handle->xpressO);
 
 	LV2_ATOM_SEQUENCE_FOREACH(handle->event_in, ev)
 	{
@@ -235,18 +281,26 @@ run(LV2_Handle instance, uint32_t nsamples)
 
 		if(!props_advance(&handle->props, forge, frames, obj, &handle->ref))
 		{
-			xpress_advance(&handle->xpressI, forge, frames, obj, &handle->ref);
+			xpress_advance(handle->xpressI, forge, frames, obj, &handle->ref);
 		}
 	}
 
-	xpress_post(&handle->xpressI, nsamples-1);
-	if(handle->ref && !xpress_synced(&handle->xpressO))
-		handle->ref = xpress_alive(&handle->xpressO, forge, nsamples-1);
+	xpress_flush(handle->xpressO, forge, nsamples, &handle->ref);
+
+	xpress_post(handle->xpressI, nsamples-1);
+	if(handle->ref && !xpress_synced(handle->xpressO))
+		handle->ref = xpress_alive(handle->xpressO, forge, nsamples-1);
+
+	_perf_end(&handle->perf, &handle->state.perf, &handle->props, forge, nsamples,
+		handle->event_in, handle->event_out, handle->xpressO, &handle->ref);
 
 	if(handle->ref)
 		lv2_atom_forge_pop(forge, &frame);
 	else
+	{
 		lv2_atom_sequence_clear(handle->event_out);
+		xpress_discard(handle->xpressO);
+	}
 }
 
 static void
@@ -256,8 +310,10 @@ cleanup(LV2_Handle instance)
 
 	if(handle)
 	{
-		xpress_deinit(&handle->xpressI);
-		xpress_deinit(&handle->xpressO);
+		xpress_deinit(handle->xpressI);
+		xpress_deinit(handle->xpressO);
+		free(handle->pool);
+		espressivo_map_unref(handle->map);
 		free(handle);
 	}
 }
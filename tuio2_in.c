@@ -24,7 +24,7 @@
 #include <osc.lv2/util.h>
 #include <props.h>
 
-#define MAX_NPROPS 6
+#define MAX_NPROPS (7 + LIMIT_NPROPS + PERF_NPROPS)
 #define MAX_STRLEN 128
 
 typedef struct _pos_t pos_t;
@@ -68,6 +68,10 @@ struct _plugstate_t {
 	int32_t octave;
 	int32_t sensors_per_semitone;
 	int32_t filter_stiffness;
+	int32_t delta;
+
+	limit_state_t limit;
+	perf_state_t perf;
 };
 
 struct _plughandle_t {
@@ -78,8 +82,9 @@ struct _plughandle_t {
 	LV2_Log_Log *log;
 	LV2_Log_Logger logger;
 	
-	XPRESS_T(xpressO, MAX_NVOICES);
-	targetO_t targetO [MAX_NVOICES];
+	xpress_t *xpressO;
+	targetO_t *targetO;
+	void *pool;
 	
 	float rate;
 	float s;
@@ -114,6 +119,8 @@ struct _plughandle_t {
 
 	plugstate_t state;
 	plugstate_t stash;
+	plugstate_t restore [PROPS_NRESTORE];
+	perf_t perf;
 };
 
 static const targetO_t targetO_vanilla;
@@ -132,7 +139,23 @@ _intercept_filter_stiffness(void *data, int64_t frames, props_impl_t *impl)
 {
 	plughandle_t *handle = data;
 
-	_stiffness_set(handle, handle->state.filter_stiffness);
+	_stiffness_set(handle, _clamp_int(handle->state.filter_stiffness, 1, 128));
+}
+
+static void
+_intercept_limit(void *data, int64_t frames, props_impl_t *impl)
+{
+	plughandle_t *handle = data;
+
+	_limit_apply(handle->xpressO, &handle->state.limit, handle->perf.period);
+}
+
+static void
+_intercept_delta(void *data, int64_t frames, props_impl_t *impl)
+{
+	plughandle_t *handle = data;
+
+	xpress_delta(handle->xpressO, handle->state.delta);
 }
 
 static const props_def_t defs [MAX_NPROPS] = {
@@ -170,7 +193,15 @@ static const props_def_t defs [MAX_NPROPS] = {
 		.offset = offsetof(plugstate_t, filter_stiffness),
 		.type = LV2_ATOM__Int,
 		.event_cb = _intercept_filter_stiffness
-	}
+	},
+	{
+		.property = ESPRESSIVO_URI"#delta_tokens",
+		.offset = offsetof(plugstate_t, delta),
+		.type = LV2_ATOM__Bool,
+		.event_cb = _intercept_delta
+	},
+	LIMIT_DEFS(plugstate_t, limit, _intercept_limit),
+	PERF_DEFS(plugstate_t, perf)
 };
 
 static inline void
@@ -229,10 +260,37 @@ _pos_deriv(plughandle_t *handle, pos_t *neu, pos_t *old)
 	}
 }
 
+// number of leading arguments matching the given OSC types, strings must be
+// null-terminated, as the OSC getters do not check types nor the tuple end
+static unsigned
+_tuio2_types(plughandle_t *handle, const LV2_Atom_Tuple *args, const char *fmt)
+{
+	LV2_OSC_URID *osc_urid= &handle->osc_urid;
+	unsigned n = 0;
+
+	LV2_ATOM_TUPLE_FOREACH(args, atom)
+	{
+		if(!fmt[n] || (lv2_osc_argument_type(osc_urid, atom) != (LV2_OSC_Type)fmt[n]))
+			break;
+
+		if(fmt[n] == LV2_OSC_STRING)
+		{
+			const char *str = LV2_ATOM_BODY_CONST(atom);
+
+			if(!atom->size || str[atom->size - 1])
+				break;
+		}
+
+		n++;
+	}
+
+	return n;
+}
+
 static targetO_t *
 _tuio2_get(plughandle_t *handle, uint32_t sid, xpress_uuid_t *uuid)
 {
-	XPRESS_VOICE_FOREACH(&handle->xpressO, voice)
+	XPRESS_VOICE_FOREACH(handle->xpressO, voice)
 	{
 		targetO_t *dst = voice->target;
 
@@ -250,7 +308,7 @@ _tuio2_get(plughandle_t *handle, uint32_t sid, xpress_uuid_t *uuid)
 static void
 _tuio2_reset(plughandle_t *handle)
 {
-	XPRESS_VOICE_FREE(&handle->xpressO, voice)
+	XPRESS_VOICE_FREE(handle->xpressO, voice)
 	{}
 
 	handle->tuio2.fid = 0;
@@ -270,6 +328,10 @@ _tuio2_frm(const char *path, const LV2_Atom_Tuple *args,
 	LV2_OSC_URID *osc_urid= &handle->osc_urid;
 	LV2_Atom_Forge *forge = &handle->forge;
 
+	const unsigned n = _tuio2_types(handle, args, "itis");
+	if(n < 2)
+		return 1;
+
 	const LV2_Atom *ptr = lv2_atom_tuple_begin(args);
 	uint32_t fid;
 	uint64_t last;
@@ -307,9 +369,10 @@ _tuio2_frm(const char *path, const LV2_Atom_Tuple *args,
 		handle->tuio2.fid = fid;
 		handle->tuio2.last = last;
 
-		ptr = lv2_osc_int32_get(osc_urid, ptr, (int32_t *)&dim);
-		if(ptr)
+		if(n > 2)
 		{
+			ptr = lv2_osc_int32_get(osc_urid, ptr, (int32_t *)&dim);
+
 			handle->tuio2.width = dim >> 16;
 			handle->tuio2.height = dim & 0xffff;
 
@@ -325,19 +388,23 @@ _tuio2_frm(const char *path, const LV2_Atom_Tuple *args,
 				props_set(&handle->props, forge, handle->frames, handle->urid.device_height, &handle->ref);
 			}
 			
-			const int n = handle->tuio2.width;
-			const float oct = handle->state.octave;
-			const int sps = handle->state.sensors_per_semitone; 
+			const int w = handle->tuio2.width;
+			const float oct = _clamp_int(handle->state.octave, 0, 8);
+			const int sps = _clamp_int(handle->state.sensors_per_semitone, 1, 160);
 
-			handle->ran = (float)n / sps;
-			handle->bot = oct*12.f - 0.5 - (n % (6*sps) / (2.f*sps));
+			handle->ran = (float)w / sps;
+			handle->bot = oct*12.f - 0.5 - (w % (6*sps) / (2.f*sps));
 		}
 		
-		ptr = lv2_osc_string_get(osc_urid, ptr, &source);
-		if(ptr && strcmp(handle->state.device_name, source))
+		if(n > 3)
 		{
-			strncpy(handle->state.device_name, source, MAX_STRLEN - 1);
-			props_set(&handle->props, forge, handle->frames, handle->urid.device_name, &handle->ref);
+			ptr = lv2_osc_string_get(osc_urid, ptr, &source);
+
+			if(strcmp(handle->state.device_name, source))
+			{
+				strncpy(handle->state.device_name, source, MAX_STRLEN - 1);
+				props_set(&handle->props, forge, handle->frames, handle->urid.device_name, &handle->ref);
+			}
 		}
 
 		// process this bundle
@@ -367,7 +434,7 @@ _tuio2_frm(const char *path, const LV2_Atom_Tuple *args,
 		}
 	}
 
-	XPRESS_VOICE_FOREACH(&handle->xpressO, voice)
+	XPRESS_VOICE_FOREACH(handle->xpressO, voice)
 	{
 		targetO_t *dst = voice->target;
 
@@ -389,10 +456,10 @@ _tuio2_tok(const char *path, const LV2_Atom_Tuple *args,
 	pos_t pos;
 	_pos_init(&pos, handle->tuio2.last);
 
-	unsigned n = 0;
-	LV2_ATOM_TUPLE_FOREACH(args, atom)
-		n++;
-	const bool has_derivatives = n == 1;
+	const unsigned n = _tuio2_types(handle, args, "iiiffffffff");
+	if(n < 6)
+		return 1;
+	const bool has_derivatives = n == 11;
 
 	const LV2_Atom *ptr = lv2_atom_tuple_begin(args);
 
@@ -408,7 +475,7 @@ _tuio2_tok(const char *path, const LV2_Atom_Tuple *args,
 	targetO_t *dst = _tuio2_get(handle, sid, &uuid);
 	if(!dst)
 	{
-		if((dst = xpress_create(&handle->xpressO, &uuid)))
+		if((dst = xpress_create(handle->xpressO, &uuid)))
 		{
 			*dst = targetO_vanilla;
 			dst->sid = sid;
@@ -450,7 +517,7 @@ _tuio2_tok(const char *path, const LV2_Atom_Tuple *args,
 	};
 
 	if(handle->ref)
-		handle->ref = xpress_token(&handle->xpressO, forge, handle->frames, uuid, &state);
+		handle->ref = xpress_token(handle->xpressO, forge, handle->frames, uuid, &state);
 
 	return 1;
 }
@@ -467,23 +534,21 @@ _tuio2_alv(const char *path, const LV2_Atom_Tuple *args,
 	if(handle->tuio2.ignore)
 		return 1;
 
-	unsigned n = 0;
 	LV2_ATOM_TUPLE_FOREACH(args, atom)
-		n++;
-
-	const LV2_Atom *ptr = lv2_atom_tuple_begin(args);
-	for(unsigned i=0; (i<n) && ptr; i++)
 	{
 		uint32_t sid;
 
-		ptr = lv2_osc_int32_get(osc_urid, ptr, (int32_t *)&sid);
+		if(lv2_osc_argument_type(osc_urid, atom) != LV2_OSC_INT32)
+			continue;
+
+		lv2_osc_int32_get(osc_urid, atom, (int32_t *)&sid);
 
 		// already registered in this step?
 		xpress_uuid_t uuid;
 		targetO_t *dst = _tuio2_get(handle, sid, &uuid);
 		if(!dst)
 		{
-			if((dst = xpress_create(&handle->xpressO, &uuid)))
+			if((dst = xpress_create(handle->xpressO, &uuid)))
 			{
 				*dst = targetO_vanilla;
 				dst->sid = sid;
@@ -498,7 +563,7 @@ _tuio2_alv(const char *path, const LV2_Atom_Tuple *args,
 	// iterate over inactive blobs
 	unsigned freed = 0;
 
-	XPRESS_VOICE_FOREACH(&handle->xpressO, voice)
+	XPRESS_VOICE_FOREACH(handle->xpressO, voice)
 	{
 		targetO_t *dst = voice->target;
 
@@ -507,17 +572,14 @@ _tuio2_alv(const char *path, const LV2_Atom_Tuple *args,
 			continue;
 
 		// has it disappeared?
-		voice->uuid = 0; // mark for removal
+		xpress_free(handle->xpressO, voice->uuid);
 		freed += 1;
 	}
 
 	if(freed > 0)
 	{
-		_xpress_sort(&handle->xpressO);
-		handle->xpressO.nvoices -= freed;
-
 		if(handle->ref)
-			handle->ref = xpress_alive(&handle->xpressO, forge, handle->frames);
+			handle->ref = xpress_alive(handle->xpressO, forge, handle->frames);
 	}
 
 	return 1;
@@ -557,28 +619,54 @@ instantiate(const LV2_Descriptor* descriptor, double rate,
 		return NULL;
 	}
 
+	handle->map = espressivo_map_ref(handle->map);
+
+	const unsigned max_nvoices = xpress_max_nvoices(handle->map, features,
+		MAX_NVOICES, MAX_NVOICES_LIMIT);
+	const size_t pool_size = _pool_size(max_nvoices, sizeof(targetO_t))
+		+ POOL_ALIGN(XPRESS_STAGE_SIZE(max_nvoices));
+	uint8_t *pool = handle->pool = calloc(1, pool_size);
+	if(!pool)
+	{
+		espressivo_map_unref(handle->map);
+		free(handle);
+		return NULL;
+	}
+
+	handle->xpressO = _pool_alloc(&pool, XPRESS_SIZE(max_nvoices));
+	handle->targetO = _pool_alloc(&pool, max_nvoices*sizeof(targetO_t));
+	xpress_stage_t *stageO = _pool_alloc(&pool, XPRESS_STAGE_SIZE(max_nvoices));
+
 	lv2_atom_forge_init(&handle->forge, handle->map);
 	lv2_osc_urid_init(&handle->osc_urid, handle->map);
 
 	if(handle->log)
 		lv2_log_logger_init(&handle->logger, handle->map, handle->log);
 
-	if(  !xpress_init(&handle->xpressO, MAX_NVOICES, handle->map, voice_map,
+	if(  !xpress_init(handle->xpressO, max_nvoices, handle->map, voice_map,
 			XPRESS_EVENT_NONE, &ifaceO, handle->targetO, handle) )
 	{
+		free(handle->pool);
+		espressivo_map_unref(handle->map);
 		free(handle);
 		return NULL;
 	}
 
+	xpress_stage(handle->xpressO, stageO); // needed for limiting
+
 	if(!props_init(&handle->props, descriptor->URI,
 		defs, MAX_NPROPS, &handle->state, &handle->stash,
-		handle->map, handle))
+		handle->restore, sizeof(plugstate_t), handle->map, handle))
 	{
 		fprintf(stderr, "failed to allocate property structure\n");
+		free(handle->pool);
+		espressivo_map_unref(handle->map);
 		free(handle);
 		return NULL;
 	}
 
+	_perf_init(&handle->perf, &handle->props, rate);
+
 	handle->urid.device_width = props_map(&handle->props, ESPRESSIVO_URI"#tuio2_deviceWidth");
 	handle->urid.device_height = props_map(&handle->props, ESPRESSIVO_URI"#tuio2_deviceHeight");
 	handle->urid.device_name = props_map(&handle->props, ESPRESSIVO_URI"#tuio2_deviceName");
@@ -648,6 +736,8 @@ static void
 run(LV2_Handle instance, uint32_t nsamples)
 {
 	plughandle_t *handle = (plughandle_t *)instance;
+
+	_perf_begin(&handle->perf);
 	
 	LV2_Atom_Forge *forge = &handle->forge;
 	uint32_t capacity = handle->event_out->atom.size;
@@ -656,7 +746,7 @@ run(LV2_Handle instance, uint32_t nsamples)
 	handle->ref = lv2_atom_forge_sequence_head(forge, &frame, 0);
 
 	props_idle(&handle->props, forge, 0, &handle->ref);
-	xpress_rst(&handle->xpressO);
+	xpress_rst(handle->xpressO);
 
 	// read incoming OSC
 	LV2_ATOM_SEQUENCE_FOREACH(handle->osc_in, ev)
@@ -668,13 +758,21 @@ run(LV2_Handle instance, uint32_t nsamples)
 			lv2_osc_unroll(&handle->osc_urid, obj, _message_cb, handle);
 	}
 
-	if(handle->ref && !xpress_synced(&handle->xpressO))
-		handle->ref = xpress_alive(&handle->xpressO, forge, nsamples-1);
+	xpress_flush(handle->xpressO, forge, nsamples, &handle->ref);
+
+	if(handle->ref && !xpress_synced(handle->xpressO))
+		handle->ref = xpress_alive(handle->xpressO, forge, nsamples-1);
+
+	_perf_end(&handle->perf, &handle->state.perf, &handle->props, forge, nsamples,
+		handle->osc_in, handle->event_out, handle->xpressO, &handle->ref);
 
 	if(handle->ref)
 		lv2_atom_forge_pop(forge, &frame);
 	else
+	{
 		lv2_atom_sequence_clear(handle->event_out);
+		xpress_discard(handle->xpressO);
+	}
 }
 
 static void
@@ -684,7 +782,9 @@ cleanup(LV2_Handle instance)
 
 	if(handle)
 	{
-		xpress_deinit(&handle->xpressO);
+		xpress_deinit(handle->xpressO);
+		free(handle->pool);
+		espressivo_map_unref(handle->map);
 		free(handle);
 	}
 }
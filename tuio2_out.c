@@ -23,7 +23,7 @@
 #include <props.h>
 #include <osc.lv2/forge.h>
 
-#define MAX_NPROPS 6
+#define MAX_NPROPS (6 + PERF_NPROPS)
 #define MAX_STRLEN 128
 
 typedef struct _targetI_t targetI_t;
@@ -44,6 +44,8 @@ struct _plugstate_t {
 	int32_t octave;
 	int32_t sensors_per_semitone;
 	float timestamp_offset;
+
+	perf_state_t perf;
 };
 
 struct _plughandle_t {
@@ -54,8 +56,9 @@ struct _plughandle_t {
 	LV2_OSC_Schedule *osc_sched;
 
 	PROPS_T(props, MAX_NPROPS);
-	XPRESS_T(xpressI, MAX_NVOICES);
-	targetI_t targetI [MAX_NVOICES];
+	xpress_t *xpressI;
+	targetI_t *targetI;
+	void *pool;
 
 	const LV2_Atom_Sequence *event_in;
 	LV2_Atom_Sequence *event_out;
@@ -69,6 +72,8 @@ struct _plughandle_t {
 
 	plugstate_t state;
 	plugstate_t stash;
+	plugstate_t restore [PROPS_NRESTORE];
+	perf_t perf;
 };
 
 static void
@@ -127,7 +132,8 @@ static const props_def_t defs [MAX_NPROPS] = {
 		.property = ESPRESSIVO_URI"#tuio2_timestampOffset",
 		.offset = offsetof(plugstate_t, timestamp_offset),
 		.type = LV2_ATOM__Float,
-	}
+	},
+	PERF_DEFS(plugstate_t, perf)
 };
 
 static inline LV2_Atom_Forge_Ref
@@ -140,7 +146,8 @@ _frm(plughandle_t *handle, uint64_t ttag)
 
 	return lv2_osc_forge_message_vararg(&handle->forge, &handle->osc_urid,
 		"/tuio2/frm", "itis",
-		++handle->fid, ttag, handle->dim, handle->state.device_name);
+		++handle->fid, (uint32_t)(ttag >> 32), (uint32_t)(ttag & 0xffffffff),
+		handle->dim, handle->state.device_name);
 }
 
 static inline LV2_Atom_Forge_Ref
@@ -182,7 +189,7 @@ _alv(plughandle_t *handle)
 	ref = lv2_osc_forge_message_head(&handle->forge, &handle->osc_urid, msg_frame,
 		"/tuio2/alv");
 
-	XPRESS_VOICE_FOREACH(&handle->xpressI, voice)
+	XPRESS_VOICE_FOREACH(handle->xpressI, voice)
 	{
 		targetI_t *src = voice->target;
 
@@ -235,7 +242,7 @@ _tuio2_2d(plughandle_t *handle, int64_t from, int64_t to)
 	if(ref)
 		ref = _frm(handle, ttag0);
 
-	XPRESS_VOICE_FOREACH(&handle->xpressI, voice)
+	XPRESS_VOICE_FOREACH(handle->xpressI, voice)
 	{
 		targetI_t *src = voice->target;
 
@@ -278,7 +285,7 @@ _add(void *data, int64_t frames, const xpress_state_t *state,
 
 	_upd(handle, frames);
 
-	src->uuid = xpress_map(&handle->xpressI);
+	src->uuid = xpress_map(handle->xpressI);
 	src->state = *state;
 	src->state.pitch = (state->pitch*0x7f - handle->bot) * handle->ran_1;
 	src->dirty = true;
@@ -350,25 +357,47 @@ instantiate(const LV2_Descriptor* descriptor, double rate,
 		return NULL;
 	}
 
+	handle->map = espressivo_map_ref(handle->map);
+
+	const unsigned max_nvoices = xpress_max_nvoices(handle->map, features,
+		MAX_NVOICES, MAX_NVOICES_LIMIT);
+	const size_t pool_size = _pool_size(max_nvoices, sizeof(targetI_t));
+	uint8_t *pool = handle->pool = calloc(1, pool_size);
+	if(!pool)
+	{
+		espressivo_map_unref(handle->map);
+		free(handle);
+		return NULL;
+	}
+
+	handle->xpressI = _pool_alloc(&pool, XPRESS_SIZE(max_nvoices));
+	handle->targetI = _pool_alloc(&pool, max_nvoices*sizeof(targetI_t));
+
 	lv2_atom_forge_init(&handle->forge, handle->map);
 	lv2_osc_urid_init(&handle->osc_urid, handle->map);
 
-	if(!xpress_init(&handle->xpressI, MAX_NVOICES, handle->map, voice_map,
+	if(!xpress_init(handle->xpressI, max_nvoices, handle->map, voice_map,
 			XPRESS_EVENT_ALL, &ifaceI, handle->targetI, handle))
 	{
+		free(handle->pool);
+		espressivo_map_unref(handle->map);
 		free(handle);
 		return NULL;
 	}
 
 	if(!props_init(&handle->props, descriptor->URI,
 		defs, MAX_NPROPS, &handle->state, &handle->stash,
-		handle->map, handle))
+		handle->restore, sizeof(plugstate_t), handle->map, handle))
 	{
 		fprintf(stderr, "failed to allocate property structure\n");
+		free(handle->pool);
+		espressivo_map_unref(handle->map);
 		free(handle);
 		return NULL;
 	}
 
+	_perf_init(&handle->perf, &handle->props, rate);
+
 	return handle;
 }
 
@@ -395,6 +424,8 @@ run(LV2_Handle instance, uint32_t nsamples)
 {
 	plughandle_t *handle = instance;
 
+	_perf_begin(&handle->perf);
+
 	// prepare midi atom forge
 	const uint32_t capacity = handle->event_out->atom.size;
 	LV2_Atom_Forge *forge = &handle->forge;
@@ -403,7 +434,7 @@ run(LV2_Handle instance, uint32_t nsamples)
 	handle->ref = lv2_atom_forge_sequence_head(forge, &frame, 0);
 
 	props_idle(&handle->props, forge, 0, &handle->ref);
-	xpress_pre(&handle->xpressI);
+	xpress_pre(handle->xpressI);
 
 	handle->last = -1;
 	LV2_ATOM_SEQUENCE_FOREACH(handle->event_in, ev)
@@ -416,12 +447,17 @@ run(LV2_Handle instance, uint32_t nsamples)
 
 		if(!props_advance(&handle->props, forge, handle->last, obj, &handle->ref)) //XXX frame time
 		{
-			xpress_advance(&handle->xpressI, forge, frames, obj, &handle->ref);
+			xpress_advance(handle->xpressI, forge, frames, obj, &handle->ref);
 		}
 	}
+	if(handle->last == -1) // voices may still be dirty from the previous sweep
+		handle->last = 0;
 	_upd(handle, nsamples - 1);
 
-	xpress_post(&handle->xpressI, nsamples-1);
+	xpress_post(handle->xpressI, nsamples-1);
+
+	_perf_end(&handle->perf, &handle->state.perf, &handle->props, forge, nsamples,
+		handle->event_in, handle->event_out, handle->xpressI, &handle->ref);
 
 	if(handle->ref)
 		lv2_atom_forge_pop(forge, &frame);
@@ -436,7 +472,9 @@ cleanup(LV2_Handle instance)
 
 	if(handle)
 	{
-		xpress_deinit(&handle->xpressI);
+		xpress_deinit(handle->xpressI);
+		free(handle->pool);
+		espressivo_map_unref(handle->map);
 		free(handle);
 	}
 }
@@ -0,0 +1,360 @@
+#include <assert.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include <xpress.lv2/xpress.h>
+
+#define MAX_NVOICES 256
+#define MAX_URIDS 512
+#define NROUNDS 100000
+#define NLOOKUPS 8
+#define NPARSEVOICES 64
+#define NUPDATES 10
+#define NCYCLES 1000
+#define SEQ_SIZE 0x40000
+
+typedef struct _target_t target_t;
+typedef struct _legacy_voice_t legacy_voice_t;
+typedef struct _legacy_t legacy_t;
+typedef struct _plughandle_t plughandle_t;
+typedef struct _urid_t urid_t;
+
+struct _target_t {
+	xpress_uuid_t uuid;
+};
+
+// copy of the former voice layout, for reference
+struct _legacy_voice_t {
+	LV2_URID source;
+	xpress_uuid_t uuid;
+	bool alive;
+	void *target;
+};
+
+// copy of the former sorted voice table, for reference
+struct _legacy_t {
+	unsigned max_nvoices;
+	unsigned nvoices;
+	legacy_voice_t voices [MAX_NVOICES];
+};
+
+struct _plughandle_t {
+	XPRESS_T(xpress, MAX_NVOICES);
+	target_t target [MAX_NVOICES];
+	legacy_t legacy;
+
+	XPRESS_T(xpressI, MAX_NVOICES);
+	target_t targetI [MAX_NVOICES];
+	LV2_Atom_Forge forge;
+	union {
+		LV2_Atom_Sequence seq;
+		uint8_t buf [SEQ_SIZE];
+	};
+};
+
+struct _urid_t {
+	LV2_URID urid;
+	char *uri;
+};
+
+static urid_t urids [MAX_URIDS];
+static LV2_URID urid;
+
+static LV2_URID
+_map(LV2_URID_Map_Handle instance __attribute__((unused)), const char *uri)
+{
+	urid_t *itm;
+	for(itm=urids; itm->urid; itm++)
+	{
+		if(!strcmp(itm->uri, uri))
+			return itm->urid;
+	}
+
+	assert(urid + 1 < MAX_URIDS);
+
+	// create new
+	itm->urid = ++urid;
+	itm->uri = strdup(uri);
+
+	return itm->urid;
+}
+
+static LV2_URID_Map map = {
+	.handle = NULL,
+	.map = _map
+};
+
+static xpress_uuid_t counter = 1;
+
+static xpress_uuid_t
+_new_uuid(void *handle __attribute__((unused)),
+	uint32_t flag __attribute__((unused)))
+{
+	return counter++;
+}
+
+static xpress_map_t voice_map = {
+	.handle = NULL,
+	.new_uuid = _new_uuid
+};
+
+static const xpress_iface_t iface = {
+	.size = sizeof(target_t)
+};
+
+static inline void
+_legacy_qsort(legacy_voice_t *A, int n)
+{
+	if(n < 2)
+		return;
+
+	const legacy_voice_t *p = A;
+
+	int i = -1;
+	int j = n;
+
+	while(true)
+	{
+		do {
+			i += 1;
+		} while(A[i].uuid > p->uuid);
+
+		do {
+			j -= 1;
+		} while(A[j].uuid < p->uuid);
+
+		if(i >= j)
+			break;
+
+		const legacy_voice_t tmp = A[i];
+		A[i] = A[j];
+		A[j] = tmp;
+	}
+
+	_legacy_qsort(A, j + 1);
+	_legacy_qsort(A + j + 1, n - j - 1);
+}
+
+static inline legacy_voice_t *
+_legacy_bsearch(xpress_uuid_t p, legacy_voice_t *a, int n)
+{
+	legacy_voice_t *base = a;
+
+	for(int N = n, half; N > 1; N -= half)
+	{
+		half = N/2;
+		legacy_voice_t *dst = &base[half];
+		base = (dst->uuid < p) ? base : dst;
+	}
+
+	return (base->uuid == p) ? base : NULL;
+}
+
+static inline void *
+_legacy_get(legacy_t *legacy, xpress_uuid_t uuid)
+{
+	legacy_voice_t *voice = _legacy_bsearch(uuid, legacy->voices, legacy->nvoices);
+
+	return voice ? voice->target : NULL;
+}
+
+static inline void *
+_legacy_add(legacy_t *legacy, xpress_uuid_t uuid)
+{
+	if(legacy->nvoices >= legacy->max_nvoices)
+		return NULL;
+
+	legacy_voice_t *voice = &legacy->voices[legacy->nvoices++];
+	voice->uuid = uuid;
+	void *target = voice->target;
+
+	_legacy_qsort(legacy->voices, legacy->nvoices);
+
+	return target;
+}
+
+static inline int
+_legacy_free(legacy_t *legacy, xpress_uuid_t uuid)
+{
+	legacy_voice_t *voice = _legacy_bsearch(uuid, legacy->voices, legacy->nvoices);
+	if(!voice)
+		return 0;
+
+	voice->uuid = 0;
+
+	_legacy_qsort(legacy->voices, legacy->nvoices);
+
+	legacy->nvoices--;
+
+	return 1;
+}
+
+static inline double
+_now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec + ts.tv_nsec*1e-9;
+}
+
+static volatile uintptr_t sink;
+
+// note-off of oldest voice, note-on of new voice, a few lookups of live voices
+static double
+_bench_xpress(plughandle_t *handle, unsigned nvoices)
+{
+	xpress_uuid_t ring [MAX_NVOICES];
+
+	assert(xpress_init(&handle->xpress, nvoices, &map, &voice_map,
+		XPRESS_EVENT_NONE, &iface, handle->target, handle) == 1);
+
+	for(unsigned i = 0; i < nvoices; i++)
+		assert(xpress_create(&handle->xpress, &ring[i]));
+
+	const double t0 = _now();
+	for(unsigned r = 0; r < NROUNDS; r++)
+	{
+		const unsigned idx = r % nvoices;
+
+		xpress_free(&handle->xpress, ring[idx]);
+		xpress_create(&handle->xpress, &ring[idx]);
+
+		for(unsigned l = 0; l < NLOOKUPS; l++)
+			sink += (uintptr_t)xpress_get(&handle->xpress, ring[(idx + l*7) % nvoices]);
+	}
+	const double t1 = _now();
+
+	xpress_deinit(&handle->xpress);
+
+	return (t1 - t0) * 1e9 / NROUNDS;
+}
+
+static double
+_bench_legacy(plughandle_t *handle, unsigned nvoices)
+{
+	legacy_t *legacy = &handle->legacy;
+	xpress_uuid_t ring [MAX_NVOICES];
+
+	legacy->max_nvoices = nvoices;
+	legacy->nvoices = 0;
+	for(unsigned i = 0; i < nvoices; i++)
+		legacy->voices[i].target = &handle->target[i];
+
+	for(unsigned i = 0; i < nvoices; i++)
+		assert(_legacy_add(legacy, ring[i] = counter++));
+
+	const double t0 = _now();
+	for(unsigned r = 0; r < NROUNDS; r++)
+	{
+		const unsigned idx = r % nvoices;
+
+		_legacy_free(legacy, ring[idx]);
+		_legacy_add(legacy, ring[idx] = counter++);
+
+		for(unsigned l = 0; l < NLOOKUPS; l++)
+			sink += (uintptr_t)_legacy_get(legacy, ring[(idx + l*7) % nvoices]);
+	}
+	const double t1 = _now();
+
+	return (t1 - t0) * 1e9 / NROUNDS;
+}
+
+// one cycle of NUPDATES tokens per voice for NPARSEVOICES voices
+static double
+_bench_parse(plughandle_t *handle, bool packed, uint32_t *size)
+{
+	LV2_Atom_Forge *forge = &handle->forge;
+	LV2_Atom_Forge_Frame frame;
+	xpress_uuid_t uuids [NPARSEVOICES];
+
+	assert(xpress_init(&handle->xpress, NPARSEVOICES, &map, &voice_map,
+		XPRESS_EVENT_NONE, &iface, handle->target, handle) == 1);
+	assert(xpress_init(&handle->xpressI, NPARSEVOICES, &map, &voice_map,
+		XPRESS_EVENT_NONE, &iface, handle->targetI, handle) == 1);
+	xpress_packed(&handle->xpress, packed);
+
+	for(unsigned i = 0; i < NPARSEVOICES; i++)
+		assert(xpress_create(&handle->xpress, &uuids[i]));
+
+	lv2_atom_forge_init(forge, &map);
+	lv2_atom_forge_set_buffer(forge, handle->buf, SEQ_SIZE);
+
+	LV2_Atom_Forge_Ref ref = lv2_atom_forge_sequence_head(forge, &frame, 0);
+	for(unsigned u = 0; u < NUPDATES; u++)
+	{
+		for(unsigned i = 0; i < NPARSEVOICES; i++)
+		{
+			const xpress_state_t state = {
+				.zone = i % 4,
+				.pitch = (float)i / NPARSEVOICES,
+				.pressure = (float)u / NUPDATES
+			};
+
+			if(ref)
+				ref = xpress_token(&handle->xpress, forge, u, uuids[i], &state);
+		}
+	}
+	if(ref)
+		lv2_atom_forge_pop(forge, &frame);
+	assert(ref);
+
+	*size = handle->seq.atom.size;
+
+	const double t0 = _now();
+	for(unsigned c = 0; c < NCYCLES; c++)
+	{
+		LV2_ATOM_SEQUENCE_FOREACH(&handle->seq, ev)
+		{
+			const LV2_Atom_Object *obj = (const LV2_Atom_Object *)&ev->body;
+
+			xpress_advance(&handle->xpressI, forge, ev->time.frames, obj, NULL);
+		}
+	}
+	const double t1 = _now();
+
+	assert(handle->xpressI.nvoices == NPARSEVOICES);
+
+	xpress_deinit(&handle->xpressI);
+	xpress_deinit(&handle->xpress);
+
+	return (t1 - t0) * 1e9 / NCYCLES;
+}
+
+int
+main(int argc __attribute__((unused)), char **argv __attribute__((unused)))
+{
+	static plughandle_t handle;
+	static const unsigned nvoices [] = { 16, 64, 256 };
+
+	printf("# voices  qsort/bsearch [ns/round]  hash [ns/round]\n");
+
+	for(unsigned i = 0; i < sizeof(nvoices)/sizeof(*nvoices); i++)
+	{
+		const double legacy = _bench_legacy(&handle, nvoices[i]);
+		const double xpress = _bench_xpress(&handle, nvoices[i]);
+
+		printf("%9u  %26.1f  %15.1f\n", nvoices[i], legacy, xpress);
+	}
+
+	printf("\n# %u voices x %u updates  [ns/cycle]  [bytes/cycle]\n",
+		NPARSEVOICES, NUPDATES);
+
+	for(unsigned i = 0; i < 2; i++)
+	{
+		uint32_t size;
+		const double dt = _bench_parse(&handle, i, &size);
+
+		printf("%-25s  %10.1f  %13"PRIu32"\n", i ? "xpress#Packed" : "xpress#Token",
+			dt, size);
+	}
+
+	for(unsigned i=0; i<urid; i++)
+	{
+		urid_t *itm = &urids[i];
+
+		free(itm->uri);
+	}
+
+	return 0;
+}
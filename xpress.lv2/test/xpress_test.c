@@ -1,4 +1,6 @@
 #include <assert.h>
+#include <sys/wait.h>
+#include <pthread.h>
 
 #include <xpress.lv2/xpress.h>
 
@@ -174,9 +176,1388 @@ _test_2(xpress_t *xpressI)
 	}
 }
 
+static void
+_test_3(xpress_t *xpressI)
+{
+	xpress_uuid_t uuids [MAX_NVOICES] = { 0 };
+	targetI_t *srcs [MAX_NVOICES] = { NULL };
+
+	for(unsigned i = 0; i < MAX_NVOICES; i++)
+	{
+		srcs[i] = xpress_create(xpressI, &uuids[i]);
+		assert(srcs[i] != NULL);
+	}
+
+	// free every other voice, remaining voices must not move
+	for(unsigned i = 0; i < MAX_NVOICES; i += 2)
+	{
+		assert(xpress_free(xpressI, uuids[i]) == 1);
+	}
+
+	for(unsigned i = 0; i < MAX_NVOICES; i++)
+	{
+		assert(xpress_get(xpressI, uuids[i]) == ((i % 2) ? srcs[i] : NULL));
+	}
+
+	unsigned nvoices = 0;
+	XPRESS_VOICE_FOREACH(xpressI, voice)
+	{
+		assert(voice->uuid % 2 == uuids[1] % 2);
+		nvoices++;
+	}
+	assert(nvoices == MAX_NVOICES/2);
+
+	// refill freed slots
+	for(unsigned i = 0; i < MAX_NVOICES; i += 2)
+	{
+		srcs[i] = xpress_create(xpressI, &uuids[i]);
+		assert(srcs[i] != NULL);
+	}
+
+	for(unsigned i = 0; i < MAX_NVOICES; i++)
+	{
+		assert(xpress_get(xpressI, uuids[i]) == srcs[i]);
+	}
+
+	XPRESS_VOICE_FREE(xpressI, voice)
+	{}
+
+	for(unsigned i = 0; i < MAX_NVOICES; i++)
+	{
+		assert(xpress_get(xpressI, uuids[i]) == NULL);
+	}
+}
+
+static void
+_test_4(xpress_t *xpressI)
+{
+	static struct {
+		XPRESS_T(xpressO, MAX_NVOICES);
+		targetI_t targetO [MAX_NVOICES];
+	} sender;
+	xpress_t *xpressO = &sender.xpressO;
+	uint8_t buf [2048];
+	LV2_Atom_Forge forge;
+	LV2_Atom_Forge_Frame frame;
+	LV2_Atom_Forge_Ref ref;
+
+	assert(xpress_init(xpressO, MAX_NVOICES, &map, &voice_map,
+			XPRESS_EVENT_NONE, &ifaceI, sender.targetO, NULL) == 1);
+	xpress_delta(xpressO, true);
+
+	xpress_uuid_t uuid = 0;
+	assert(xpress_create(xpressO, &uuid) != NULL);
+
+	xpress_state_t state = {
+		.zone = 1,
+		.pitch = 0.5f,
+		.pressure = 0.25f
+	};
+
+	lv2_atom_forge_init(&forge, &map);
+	lv2_atom_forge_set_buffer(&forge, buf, sizeof(buf));
+
+	ref = lv2_atom_forge_sequence_head(&forge, &frame, 0);
+	assert(ref);
+	uint32_t offset = forge.offset;
+	ref = xpress_token(xpressO, &forge, 0, uuid, &state); // full token
+	assert(ref);
+	const uint32_t full_size = forge.offset - offset;
+
+	state.pressure = 0.75f;
+	offset = forge.offset;
+	ref = xpress_token(xpressO, &forge, 1, uuid, &state); // delta token
+	assert(ref);
+	const uint32_t delta_size = forge.offset - offset;
+	lv2_atom_forge_pop(&forge, &frame);
+
+	assert(delta_size*2 < full_size);
+
+	const LV2_Atom_Sequence *seq = (const LV2_Atom_Sequence *)buf;
+	const LV2_URID otypes [2] = {
+		map.map(map.handle, XPRESS__Token),
+		map.map(map.handle, XPRESS__Delta) // not taken for a complete token
+	};
+	unsigned nevs = 0;
+	LV2_ATOM_SEQUENCE_FOREACH(seq, ev)
+	{
+		const LV2_Atom_Object *obj = (const LV2_Atom_Object *)&ev->body;
+
+		assert(nevs < 2);
+		assert(obj->body.otype == otypes[nevs]);
+		assert(xpress_advance(xpressI, &forge, ev->time.frames, obj, NULL) == 1);
+		nevs++;
+	}
+	assert(nevs == 2);
+
+	// receiver must have merged delta into cached state
+	targetI_t *src = xpress_get(xpressI, uuid);
+	assert(src != NULL);
+	assert(src->frames == 1);
+	assert(src->state.zone == 1);
+	assert(src->state.pitch == 0.5f);
+	assert(src->state.pressure == 0.75f);
+
+	// after a discarded sequence, sender falls back to a full token, while
+	// the receiver drops deltas of voices it has never seen
+	xpress_uuid_t lost = 0;
+	assert(xpress_create(xpressO, &lost) != NULL);
+
+	for(unsigned c = 0; c < 2; c++)
+	{
+		lv2_atom_forge_set_buffer(&forge, buf, sizeof(buf));
+		ref = lv2_atom_forge_sequence_head(&forge, &frame, 0);
+		assert(ref);
+		if(c == 0)
+		{
+			assert(xpress_token(xpressO, &forge, 0, lost, &state)); // full token
+			state.pressure = 0.5f;
+			assert(xpress_token(xpressO, &forge, 1, lost, &state)); // delta token
+		}
+		else
+		{
+			assert(xpress_token(xpressO, &forge, 0, lost, &state)); // full token
+		}
+		lv2_atom_forge_pop(&forge, &frame);
+
+		nevs = 0;
+		LV2_ATOM_SEQUENCE_FOREACH(seq, ev)
+		{
+			const LV2_Atom_Object *obj = (const LV2_Atom_Object *)&ev->body;
+
+			if(c == 0)
+			{
+				if(nevs++ == 0)
+					continue; // full token gets lost
+
+				assert(obj->body.otype == otypes[1]);
+				assert(xpress_advance(xpressI, &forge, ev->time.frames, obj, NULL) == 0);
+				assert(xpress_get(xpressI, lost) == NULL);
+			}
+			else
+			{
+				assert(obj->body.otype == otypes[0]);
+				assert(xpress_advance(xpressI, &forge, ev->time.frames, obj, NULL) == 1);
+				nevs++;
+			}
+		}
+		assert(nevs == (c == 0 ? 2 : 1));
+
+		if(c == 0)
+			xpress_discard(xpressO);
+	}
+
+	src = xpress_get(xpressI, lost);
+	assert(src != NULL);
+	assert(src->state.zone == 1);
+	assert(src->state.pressure == 0.5f);
+
+	xpress_deinit(xpressO);
+}
+
+static void
+_test_5(xpress_t *xpressI)
+{
+	static struct {
+		XPRESS_T(xpressO, MAX_NVOICES);
+		targetI_t targetO [MAX_NVOICES];
+	} sender;
+	xpress_t *xpressO = &sender.xpressO;
+	uint8_t buf [1024];
+	LV2_Atom_Forge forge;
+	LV2_Atom_Forge_Frame frame;
+	LV2_Atom_Forge_Ref ref;
+
+	assert(xpress_init(xpressO, MAX_NVOICES, &map, &voice_map,
+			XPRESS_EVENT_NONE, &ifaceI, sender.targetO, NULL) == 1);
+	xpress_packed(xpressO, true);
+
+	xpress_uuid_t uuid = 0;
+	assert(xpress_create(xpressO, &uuid) != NULL);
+
+	const xpress_state_t state = {
+		.zone = 2,
+		.pitch = 0.5f,
+		.pressure = 0.25f,
+		.timbre = 0.125f,
+		.dTimbre = -1.f
+	};
+
+	lv2_atom_forge_init(&forge, &map);
+	lv2_atom_forge_set_buffer(&forge, buf, sizeof(buf));
+
+	ref = lv2_atom_forge_sequence_head(&forge, &frame, 0);
+	assert(ref);
+	ref = xpress_token(xpressO, &forge, 3, uuid, &state);
+	assert(ref);
+	lv2_atom_forge_pop(&forge, &frame);
+
+	const LV2_Atom_Sequence *seq = (const LV2_Atom_Sequence *)buf;
+	unsigned nevs = 0;
+	LV2_ATOM_SEQUENCE_FOREACH(seq, ev)
+	{
+		const LV2_Atom_Object *obj = (const LV2_Atom_Object *)&ev->body;
+
+		assert(obj->atom.size == sizeof(xpress_packed_t));
+		assert(xpress_advance(xpressI, &forge, ev->time.frames, obj, NULL) == 1);
+		nevs++;
+	}
+	assert(nevs == 1);
+
+	targetI_t *src = xpress_get(xpressI, uuid);
+	assert(src != NULL);
+	assert(src->frames == 3);
+	assert(src->uuid == uuid);
+	assert(!memcmp(&src->state, &state, sizeof(state)));
+
+	// truncated packed atoms must be rejected
+	const struct {
+		LV2_Atom atom;
+		uint32_t body [2];
+	} truncated = {
+		.atom = {
+			.size = sizeof(truncated.body),
+			.type = xpressI->urid.xpress_Packed
+		}
+	};
+	assert(xpress_advance(xpressI, &forge, 0, (const LV2_Atom_Object *)&truncated, NULL) == 0);
+
+	// as must packed atoms with non-finite values or zones out of range
+	struct {
+		LV2_Atom atom;
+		xpress_packed_t body;
+	} corrupt = {
+		.atom = {
+			.size = sizeof(corrupt.body),
+			.type = xpressI->urid.xpress_Packed
+		},
+		.body = {
+			.source = xpressO->source,
+			.uuid = uuid,
+			.state = state
+		}
+	};
+	corrupt.body.state.pitch = NAN;
+	assert(xpress_advance(xpressI, &forge, 0, (const LV2_Atom_Object *)&corrupt, NULL) == 0);
+	corrupt.body.state.pitch = 0.5f;
+	corrupt.body.state.dPressure = -INFINITY;
+	assert(xpress_advance(xpressI, &forge, 0, (const LV2_Atom_Object *)&corrupt, NULL) == 0);
+	corrupt.body.state.dPressure = 0.f;
+	corrupt.body.state.zone = -1;
+	assert(xpress_advance(xpressI, &forge, 0, (const LV2_Atom_Object *)&corrupt, NULL) == 0);
+	assert(!memcmp(&src->state, &state, sizeof(state)));
+
+	xpress_deinit(xpressO);
+}
+
+static void
+_test_6(xpress_t *xpressI)
+{
+	static struct {
+		XPRESS_T(xpressO, MAX_NVOICES);
+		targetI_t targetO [MAX_NVOICES];
+	} sender;
+	xpress_t *xpressO = &sender.xpressO;
+	uint8_t buf [1024];
+	LV2_Atom_Forge forge;
+	LV2_Atom_Forge_Frame frame;
+	LV2_Atom_Forge_Frame batch_frame;
+	LV2_Atom_Forge_Ref ref;
+	xpress_uuid_t uuids [3];
+
+	assert(xpress_init(xpressO, MAX_NVOICES, &map, &voice_map,
+			XPRESS_EVENT_NONE, &ifaceI, sender.targetO, NULL) == 1);
+
+	lv2_atom_forge_init(&forge, &map);
+	lv2_atom_forge_set_buffer(&forge, buf, sizeof(buf));
+
+	ref = lv2_atom_forge_sequence_head(&forge, &frame, 0);
+	assert(ref);
+	ref = xpress_batch_head(xpressO, &forge, 4, &batch_frame);
+	assert(ref);
+	for(unsigned i = 0; i < 3; i++)
+	{
+		const xpress_state_t state = {
+			.zone = i,
+			.pitch = 0.25f * i
+		};
+
+		assert(xpress_create(xpressO, &uuids[i]) != NULL);
+		ref = xpress_batch_token(xpressO, &forge, uuids[i], &state);
+		assert(ref);
+	}
+	xpress_batch_pop(xpressO, &forge, &batch_frame);
+	lv2_atom_forge_pop(&forge, &frame);
+
+	const LV2_Atom_Sequence *seq = (const LV2_Atom_Sequence *)buf;
+	unsigned nevs = 0;
+	LV2_ATOM_SEQUENCE_FOREACH(seq, ev)
+	{
+		const LV2_Atom_Object *obj = (const LV2_Atom_Object *)&ev->body;
+
+		assert(obj->atom.size == sizeof(xpress_batch_t) + 3*sizeof(xpress_batch_item_t));
+		assert(xpress_advance(xpressI, &forge, ev->time.frames, obj, NULL) == 1);
+		nevs++;
+	}
+	assert(nevs == 1);
+
+	for(unsigned i = 0; i < 3; i++)
+	{
+		targetI_t *src = xpress_get(xpressI, uuids[i]);
+		assert(src != NULL);
+		assert(src->frames == 4);
+		assert(src->state.zone == (int32_t)i);
+		assert(src->state.pitch == 0.25f * i);
+	}
+
+	xpress_deinit(xpressO);
+}
+
+static void
+_test_7(xpress_t *xpressI)
+{
+	static struct {
+		XPRESS_T(xpressO, MAX_NVOICES);
+		targetI_t targetO [MAX_NVOICES];
+	} sender;
+	xpress_t *xpressO = &sender.xpressO;
+	uint8_t buf [1024];
+	LV2_Atom_Forge forge;
+	LV2_Atom_Forge_Frame frame;
+	LV2_Atom_Forge_Ref ref;
+	xpress_uuid_t uuids [3];
+
+	assert(xpress_init(xpressO, MAX_NVOICES, &map, &voice_map,
+			XPRESS_EVENT_NONE, &ifaceI, sender.targetO, NULL) == 1);
+
+	lv2_atom_forge_init(&forge, &map);
+	lv2_atom_forge_set_buffer(&forge, buf, sizeof(buf));
+
+	ref = lv2_atom_forge_sequence_head(&forge, &frame, 0);
+	assert(ref);
+	for(unsigned i = 0; i < 3; i++)
+	{
+		assert(xpress_create(xpressO, &uuids[i]) != NULL);
+		ref = xpress_token(xpressO, &forge, 0, uuids[i], &xpress_vanilla);
+		assert(ref);
+	}
+	assert(xpress_free(xpressO, uuids[1]) == 1);
+	ref = xpress_release(xpressO, &forge, 5, &uuids[1], 1);
+	assert(ref);
+	lv2_atom_forge_pop(&forge, &frame);
+
+	const LV2_Atom_Sequence *seq = (const LV2_Atom_Sequence *)buf;
+	LV2_ATOM_SEQUENCE_FOREACH(seq, ev)
+	{
+		const LV2_Atom_Object *obj = (const LV2_Atom_Object *)&ev->body;
+
+		assert(xpress_advance(xpressI, &forge, ev->time.frames, obj, NULL) == 1);
+	}
+
+	assert(xpressI->nvoices == 2);
+	assert(xpress_get(xpressI, uuids[0]) != NULL);
+	assert(xpress_get(xpressI, uuids[1]) == NULL);
+	assert(xpress_get(xpressI, uuids[2]) != NULL);
+	assert(!xpress_synced(xpressO)); // release must not replace a full alive
+
+	xpress_deinit(xpressO);
+}
+
+static void
+_test_8(xpress_t *xpressI __attribute__((unused)))
+{
+	const int32_t nvoices = 256;
+	const LV2_Options_Option opts [] = {
+		{
+			.key = _map(NULL, XPRESS__maxNVoices),
+			.size = sizeof(int32_t),
+			.type = _map(NULL, LV2_ATOM__Int),
+			.value = &nvoices
+		},
+		{
+			.key = 0,
+			.value = NULL
+		}
+	};
+	const LV2_Feature feature_opts = {
+		.URI = LV2_OPTIONS__options,
+		.data = (void *)opts
+	};
+	const LV2_Feature *const features [] = {
+		&feature_opts,
+		NULL
+	};
+	const LV2_Feature *const no_features [] = {
+		NULL
+	};
+
+	assert(xpress_max_nvoices(&map, no_features, 64, 1024) == 64);
+	assert(xpress_max_nvoices(&map, features, 64, 1024) == 256);
+	assert(xpress_max_nvoices(&map, features, 64, 128) == 128);
+
+	const unsigned max_nvoices = xpress_max_nvoices(&map, features, 64, 1024);
+	xpress_t *xpress = calloc(1, XPRESS_SIZE(max_nvoices));
+	targetI_t *targets = calloc(max_nvoices, sizeof(targetI_t));
+	assert(xpress && targets);
+
+	// capacity beyond the bound of the group words is refused
+	assert(xpress_init(xpress, XPRESS_MAX_NVOICES + 1, &map, &voice_map,
+			XPRESS_EVENT_NONE, &ifaceI, targets, NULL) == 0);
+	assert(xpress_init(xpress, max_nvoices, &map, &voice_map,
+			XPRESS_EVENT_NONE, &ifaceI, targets, NULL) == 1);
+
+	for(unsigned i = 0; i < max_nvoices; i++)
+	{
+		xpress_uuid_t uuid = 0;
+		targetI_t *src = xpress_create(xpress, &uuid);
+		assert(src == &targets[i]);
+		assert(xpress_get(xpress, uuid) == src);
+	}
+
+	xpress_uuid_t uuid = 0;
+	assert(xpress_create(xpress, &uuid) == NULL);
+
+	xpress_deinit(xpress);
+	free(targets);
+	free(xpress);
+}
+
+static void
+_test_9(xpress_t *xpressI __attribute__((unused)))
+{
+	const unsigned max_nvoices = 130; // spans three partially filled groups
+	xpress_t *xpressO = calloc(1, XPRESS_SIZE(max_nvoices));
+	xpress_t *xpress = calloc(1, XPRESS_SIZE(max_nvoices));
+	targetI_t *targetsO = calloc(max_nvoices, sizeof(targetI_t));
+	targetI_t *targets = calloc(max_nvoices, sizeof(targetI_t));
+	xpress_uuid_t *uuids = calloc(max_nvoices, sizeof(xpress_uuid_t));
+	uint8_t *buf = calloc(1, 0x1000);
+	LV2_Atom_Forge forge;
+	LV2_Atom_Forge_Frame frame;
+	assert(xpressO && xpress && targetsO && targets && uuids && buf);
+
+	assert(xpress_init(xpressO, max_nvoices, &map, &voice_map,
+			XPRESS_EVENT_NONE, &ifaceI, targetsO, NULL) == 1);
+	assert(xpress_init(xpress, max_nvoices, &map, &voice_map,
+			XPRESS_EVENT_NONE, &ifaceI, targets, NULL) == 1);
+
+	for(unsigned i = 0; i < max_nvoices; i++)
+	{
+		assert(xpress_create(xpressO, &uuids[i]) != NULL);
+	}
+
+	lv2_atom_forge_init(&forge, &map);
+
+	for(unsigned cycle = 0; cycle < 3; cycle++)
+	{
+		// free every third voice on the sender for the second cycle
+		if(cycle == 1)
+		{
+			for(unsigned i = 0; i < max_nvoices; i += 3)
+				assert(xpress_free(xpressO, uuids[i]) == 1);
+		}
+
+		lv2_atom_forge_set_buffer(&forge, buf, 0x1000);
+		assert(lv2_atom_forge_sequence_head(&forge, &frame, 0));
+		if(cycle < 2) // no heartbeat in third cycle
+			assert(xpress_alive(xpressO, &forge, 0));
+		lv2_atom_forge_pop(&forge, &frame);
+
+		xpress_pre(xpress);
+		const LV2_Atom_Sequence *seq = (const LV2_Atom_Sequence *)buf;
+		LV2_ATOM_SEQUENCE_FOREACH(seq, ev)
+		{
+			const LV2_Atom_Object *obj = (const LV2_Atom_Object *)&ev->body;
+
+			assert(xpress_advance(xpress, &forge, ev->time.frames, obj, NULL) == 1);
+		}
+		xpress_post(xpress, 0);
+
+		assert(xpress->nvoices == xpressO->nvoices*(cycle < 2));
+
+		unsigned nvoices = 0;
+		const xpress_voice_t *last = NULL;
+		XPRESS_VOICE_FOREACH(xpress, voice)
+		{
+			assert(!last || (voice > last) );
+			assert(xpress_get(xpressO, voice->uuid) != NULL);
+			last = voice;
+			nvoices++;
+		}
+		assert(nvoices == xpress->nvoices);
+	}
+
+	xpress_deinit(xpress);
+	xpress_deinit(xpressO);
+	free(buf);
+	free(uuids);
+	free(targets);
+	free(targetsO);
+	free(xpress);
+	free(xpressO);
+}
+
+static void
+_test_10(xpress_t *xpressI)
+{
+	const unsigned nsources = XPRESS_MAX_NSOURCES + 2; // overflow source table
+	xpress_t *xpressO [XPRESS_MAX_NSOURCES + 2];
+	targetI_t targetsO [3];
+	xpress_uuid_t uuids [XPRESS_MAX_NSOURCES + 2][3];
+	uint8_t buf [1024];
+	LV2_Atom_Forge forge;
+	LV2_Atom_Forge_Frame frame;
+
+	lv2_atom_forge_init(&forge, &map);
+
+	for(unsigned s = 0; s < nsources; s++)
+	{
+		xpressO[s] = calloc(1, XPRESS_SIZE(3));
+		assert(xpressO[s]);
+		assert(xpress_init(xpressO[s], 3, &map, &voice_map,
+				XPRESS_EVENT_NONE, &ifaceI, targetsO, NULL) == 1);
+
+		for(unsigned i = 0; i < 3; i++)
+			assert(xpress_create(xpressO[s], &uuids[s][i]) != NULL);
+	}
+
+	for(unsigned round = 0; round < 4; round++)
+	{
+		switch(round)
+		{
+			case 1:
+				// drop a voice of an indexed and an unindexed source
+				assert(xpress_free(xpressO[0], uuids[0][1]) == 1);
+				assert(xpress_free(xpressO[nsources - 1], uuids[nsources - 1][1]) == 1);
+				break;
+			case 2:
+				// drop all voices of unindexed sources
+				XPRESS_VOICE_FREE(xpressO[nsources - 2], voice) {}
+				XPRESS_VOICE_FREE(xpressO[nsources - 1], voice) {}
+				break;
+			case 3:
+				// drop a voice with source lists only
+				assert(xpress_free(xpressO[1], uuids[1][0]) == 1);
+				break;
+		}
+
+		unsigned nvoices = 0;
+		xpress_pre(xpressI);
+		for(unsigned s = 0; s < nsources; s++)
+		{
+			lv2_atom_forge_set_buffer(&forge, buf, sizeof(buf));
+			assert(lv2_atom_forge_sequence_head(&forge, &frame, 0));
+			assert(xpress_alive(xpressO[s], &forge, 0));
+			lv2_atom_forge_pop(&forge, &frame);
+
+			const LV2_Atom_Sequence *seq = (const LV2_Atom_Sequence *)buf;
+			LV2_ATOM_SEQUENCE_FOREACH(seq, ev)
+			{
+				const LV2_Atom_Object *obj = (const LV2_Atom_Object *)&ev->body;
+
+				assert(xpress_advance(xpressI, &forge, ev->time.frames, obj, NULL) == 1);
+			}
+
+			nvoices += xpressO[s]->nvoices;
+		}
+
+		assert(xpressI->nvoices == nvoices);
+		assert(xpressI->nunindexed == (round == 0 ? 6 : round == 1 ? 5 : 0));
+
+		for(unsigned s = 0; s < nsources; s++)
+		{
+			for(unsigned i = 0; i < 3; i++)
+			{
+				const bool alive = xpress_get(xpressO[s], uuids[s][i]) != NULL;
+
+				assert( (xpress_get(xpressI, uuids[s][i]) != NULL) == alive);
+			}
+		}
+
+		xpress_post(xpressI, 0); // xpress#Alive sweeps left nothing to release
+		assert(xpressI->nvoices == nvoices);
+	}
+
+	for(unsigned s = 0; s < nsources; s++)
+	{
+		xpress_deinit(xpressO[s]);
+		free(xpressO[s]);
+	}
+}
+
+static void
+_test_11(xpress_t *xpressI)
+{
+	const xpress_handle_t none = { 0 };
+	xpress_handle_t handle;
+	xpress_handle_t reused;
+
+	assert(xpress_get_h(xpressI, &none) == NULL);
+	assert(xpress_free_h(xpressI, &none) == 0);
+
+	targetI_t *src = xpress_create_h(xpressI, &handle);
+	assert(src != NULL);
+	assert(xpress_get_h(xpressI, &handle) == src);
+	assert(xpress_get(xpressI, handle.uuid) == src);
+
+	assert(xpress_free_h(xpressI, &handle) == 1);
+	assert(xpress_get_h(xpressI, &handle) == NULL);
+	assert(xpress_free_h(xpressI, &handle) == 0);
+
+	// freed slot is reused, old handle must stay stale
+	assert(xpress_create_h(xpressI, &reused) == src);
+	assert(reused.idx == handle.idx);
+	assert(xpress_get_h(xpressI, &handle) == NULL);
+	assert(xpress_get_h(xpressI, &reused) == src);
+
+	// handle and uuid based tokens share the delta cache
+	uint8_t buf [1024];
+	LV2_Atom_Forge forge;
+	const xpress_state_t state = { .zone = 1, .pitch = 0.5f };
+
+	lv2_atom_forge_init(&forge, &map);
+	lv2_atom_forge_set_buffer(&forge, buf, sizeof(buf));
+	xpress_delta(xpressI, true);
+
+	assert(xpress_token_h(xpressI, &forge, 0, &reused, &state));
+	const uint32_t full = forge.offset;
+	assert(xpress_token(xpressI, &forge, 0, reused.uuid, &state));
+	assert(forge.offset - full < full); // only header, source and uuid
+
+	// stale handle still forges a full token
+	const uint32_t offset = forge.offset;
+	assert(xpress_token_h(xpressI, &forge, 0, &handle, &state));
+	assert(forge.offset - offset == full);
+
+	xpress_delta(xpressI, false);
+}
+
+static void
+_test_12(xpress_t *xpressI)
+{
+	static struct {
+		XPRESS_T(xpressO, MAX_NVOICES);
+		targetI_t targetO [MAX_NVOICES];
+	} sender;
+	xpress_t *xpressO = &sender.xpressO;
+	uint8_t buf [2048];
+	LV2_Atom_Forge forge;
+	LV2_Atom_Forge_Frame frame;
+	xpress_uuid_t uuid;
+
+	assert(xpress_init(xpressO, MAX_NVOICES, &map, &voice_map,
+			XPRESS_EVENT_NONE, &ifaceI, sender.targetO, NULL) == 1);
+	assert(xpressO->ntokens == 0);
+	assert(xpressO->nalives == 0);
+
+	lv2_atom_forge_init(&forge, &map);
+	lv2_atom_forge_set_buffer(&forge, buf, sizeof(buf));
+
+	assert(lv2_atom_forge_sequence_head(&forge, &frame, 0));
+	assert(xpress_create(xpressO, &uuid) != NULL);
+	assert(xpress_token(xpressO, &forge, 0, uuid, &xpress_vanilla));
+	assert(xpress_token(xpressO, &forge, 1, uuid, &xpress_vanilla));
+	assert(xpress_alive(xpressO, &forge, 2));
+	lv2_atom_forge_pop(&forge, &frame);
+
+	// forged messages are counted on sender
+	assert(xpressO->ntokens == 2);
+	assert(xpressO->nalives == 1);
+
+	const LV2_Atom_Sequence *seq = (const LV2_Atom_Sequence *)buf;
+	LV2_ATOM_SEQUENCE_FOREACH(seq, ev)
+	{
+		const LV2_Atom_Object *obj = (const LV2_Atom_Object *)&ev->body;
+
+		assert(xpress_advance(xpressI, &forge, ev->time.frames, obj, NULL) == 1);
+	}
+
+	// received messages are counted on receiver
+	assert(xpressI->ntokens == 2);
+	assert(xpressI->nalives == 1);
+
+	xpress_deinit(xpressO);
+}
+
+static void
+_test_15(xpress_t *xpressI)
+{
+	static struct {
+		XPRESS_T(xpressO, MAX_NVOICES);
+		XPRESS_STAGE_T(stageO, MAX_NVOICES);
+		targetI_t targetO [MAX_NVOICES];
+	} sender;
+	xpress_t *xpressO = &sender.xpressO;
+	uint8_t buf [2048];
+	LV2_Atom_Forge forge;
+	LV2_Atom_Forge_Frame frame;
+	LV2_Atom_Forge_Frame batch_frame;
+	xpress_uuid_t a, b, c;
+
+	lv2_atom_forge_init(&forge, &map);
+
+	for(xpress_coalesce_t policy = XPRESS_COALESCE_FIRST;
+		policy <= XPRESS_COALESCE_LAST;
+		policy++)
+	{
+		assert(xpress_init(xpressO, MAX_NVOICES, &map, &voice_map,
+				XPRESS_EVENT_NONE, &ifaceI, sender.targetO, NULL) == 1);
+		xpress_stage(xpressO, &sender.stageO);
+		xpress_delta(xpressO, true);
+		xpress_coalesce(xpressO, policy);
+
+		lv2_atom_forge_set_buffer(&forge, buf, sizeof(buf));
+		LV2_Atom_Forge_Ref ref = lv2_atom_forge_sequence_head(&forge, &frame, 0);
+		assert(ref);
+
+		xpress_state_t state = xpress_vanilla;
+		assert(xpress_create(xpressO, &a) != NULL);
+		assert(xpress_create(xpressO, &b) != NULL);
+		assert(xpress_create(xpressO, &c) != NULL);
+
+		// first token of a voice is forged right away
+		assert(xpress_token(xpressO, &forge, 0, a, &state) != XPRESS_REF_STAGED);
+		assert(xpress_token(xpressO, &forge, 1, b, &state) != XPRESS_REF_STAGED);
+		assert(xpress_token(xpressO, &forge, 2, c, &state) != XPRESS_REF_STAGED);
+		assert(xpressO->ntokens == 3);
+
+		// later updates are staged, last state wins
+		state.pitch = 0.1f;
+		assert(xpress_token(xpressO, &forge, 10, a, &state) == XPRESS_REF_STAGED);
+		state.pitch = 0.2f;
+		assert(xpress_token(xpressO, &forge, 20, a, &state) == XPRESS_REF_STAGED);
+		state.pitch = 0.3f;
+		assert(xpress_token(xpressO, &forge, 15, b, &state) == XPRESS_REF_STAGED);
+		assert(xpress_token(xpressO, &forge, 25, c, &state) == XPRESS_REF_STAGED);
+
+		// batched updates are staged alike
+		assert(xpress_batch_head(xpressO, &forge, 26, &batch_frame));
+		state.pitch = 0.35f;
+		assert(xpress_batch_token(xpressO, &forge, b, &state) == XPRESS_REF_STAGED);
+		xpress_batch_pop(xpressO, &forge, &batch_frame);
+
+		// release supersedes staged update
+		assert(xpress_free(xpressO, c) == 1);
+		assert(xpress_release(xpressO, &forge, 30, &c, 1));
+
+		// staged updates are not flushed before foreign events
+		assert(lv2_atom_forge_frame_time(&forge, 32));
+		assert(lv2_atom_forge_int(&forge, 0));
+
+		state.pitch = 0.4f;
+		assert(xpress_token(xpressO, &forge, 40, a, &state) == XPRESS_REF_STAGED);
+		assert(xpressO->ntokens == 3);
+
+		xpress_flush(xpressO, &forge, 64, &ref);
+		assert(ref);
+		assert(xpressO->ntokens == 5);
+		assert(sender.stageO.head == XPRESS_NIL);
+		lv2_atom_forge_pop(&forge, &frame);
+
+		// sequence stays ordered
+		int64_t last = 0;
+		const LV2_Atom_Sequence *seq = (const LV2_Atom_Sequence *)buf;
+		LV2_ATOM_SEQUENCE_FOREACH(seq, ev)
+		{
+			const LV2_Atom_Object *obj = (const LV2_Atom_Object *)&ev->body;
+
+			assert(ev->time.frames >= last);
+			last = ev->time.frames;
+
+			if(obj->atom.type == forge.Int)
+				continue; // foreign event
+
+			// batch with staged items only is never forged
+			assert(obj->atom.type != xpressI->urid.xpress_Batch);
+			assert(xpress_advance(xpressI, &forge, ev->time.frames, obj, NULL) == 1);
+		}
+
+		const targetI_t *dst = xpress_get(xpressI, a);
+		assert(dst);
+		assert(dst->state.pitch == 0.4f);
+		assert(dst->frames == (policy == XPRESS_COALESCE_FIRST ? 32 : 40));
+
+		dst = xpress_get(xpressI, b);
+		assert(dst);
+		assert(dst->state.pitch == 0.35f);
+		assert(dst->frames == 32);
+
+		assert(xpress_get(xpressI, c) == NULL);
+
+		xpress_deinit(xpressO);
+	}
+}
+
+#define LIMIT_NSAMPLES 64
+
+static void
+_test_16(xpress_t *xpressI)
+{
+	static struct {
+		XPRESS_T(xpressO, MAX_NVOICES);
+		XPRESS_STAGE_T(stageO, MAX_NVOICES);
+		targetI_t targetO [MAX_NVOICES];
+	} sender;
+	xpress_t *xpressO = &sender.xpressO;
+	uint8_t buf [2048];
+	LV2_Atom_Forge forge;
+	LV2_Atom_Forge_Frame frame;
+	LV2_Atom_Forge_Ref ref;
+	xpress_uuid_t a;
+	const xpress_limit_t limit = {
+		.deadband = { .pitch = 0.01f },
+		.interval = LIMIT_NSAMPLES / 2
+	};
+	const float pitch [4][2] = { // updates at frame 0 and 20 per cycle
+		{ 0.000f, 0.005f }, // note on, then within deadband
+		{ 0.500f, 0.600f }, // leaves deadband twice within interval
+		{ 0.605f, 0.605f }, // within deadband
+		{ -1.f, -1.f } // no updates
+	};
+	const struct {
+		unsigned ntokens;
+		float pitch;
+		int64_t frames;
+	} expect [4] = {
+		{ 1, 0.000f, 0 },
+		{ 3, 0.600f, LIMIT_NSAMPLES / 2 }, // held back till interval has passed
+		{ 3, 0.600f, LIMIT_NSAMPLES / 2 }, // waits for value to settle
+		{ 4, 0.605f, 0 } // settled on final value
+	};
+
+	assert(xpress_init(xpressO, MAX_NVOICES, &map, &voice_map,
+			XPRESS_EVENT_NONE, &ifaceI, sender.targetO, NULL) == 1);
+	xpress_stage(xpressO, &sender.stageO);
+	xpress_limit(xpressO, &limit);
+	assert(xpress_create(xpressO, &a) != NULL);
+	lv2_atom_forge_init(&forge, &map);
+
+	unsigned ntokens = 0;
+	for(unsigned c = 0; c < 4; c++)
+	{
+		lv2_atom_forge_set_buffer(&forge, buf, sizeof(buf));
+		ref = lv2_atom_forge_sequence_head(&forge, &frame, 0);
+		assert(ref);
+		xpress_rst(xpressO);
+
+		for(unsigned u = 0; u < 2; u++)
+		{
+			if(pitch[c][u] < 0.f)
+				continue;
+
+			const xpress_state_t state = { .pitch = pitch[c][u] };
+			if(ref)
+				ref = xpress_token(xpressO, &forge, u*20, a, &state);
+		}
+
+		xpress_flush(xpressO, &forge, LIMIT_NSAMPLES, &ref);
+		assert(ref);
+		lv2_atom_forge_pop(&forge, &frame);
+
+		const LV2_Atom_Sequence *seq = (const LV2_Atom_Sequence *)buf;
+		LV2_ATOM_SEQUENCE_FOREACH(seq, ev)
+		{
+			const LV2_Atom_Object *obj = (const LV2_Atom_Object *)&ev->body;
+
+			assert(xpress_advance(xpressI, &forge, ev->time.frames, obj, NULL) == 1);
+		}
+
+		ntokens += xpressO->ntokens;
+		xpressO->ntokens = 0;
+		assert(ntokens == expect[c].ntokens);
+
+		const targetI_t *dst = xpress_get(xpressI, a);
+		assert(dst);
+		assert(dst->state.pitch == expect[c].pitch);
+		assert(dst->frames == expect[c].frames);
+	}
+
+	xpress_deinit(xpressO);
+}
+
+#define OVERFLOW_NVOICES 4
+
+static void
+_test_17(xpress_t *xpressI)
+{
+	static struct {
+		XPRESS_T(xpressO, MAX_NVOICES);
+		XPRESS_STAGE_T(stageO, MAX_NVOICES);
+		targetI_t targetO [MAX_NVOICES];
+	} sender;
+	xpress_t *xpressO = &sender.xpressO;
+	uint8_t buf [1536]; // fits births, release and alive, but not the updates
+	LV2_Atom_Forge forge;
+	LV2_Atom_Forge_Frame frame;
+	LV2_Atom_Forge_Ref ref;
+	xpress_uuid_t uuids [OVERFLOW_NVOICES];
+
+	assert(xpress_init(xpressO, MAX_NVOICES, &map, &voice_map,
+			XPRESS_EVENT_NONE, &ifaceI, sender.targetO, NULL) == 1);
+	xpress_stage(xpressO, &sender.stageO);
+	lv2_atom_forge_init(&forge, &map);
+
+	for(unsigned c = 0; c < 3; c++)
+	{
+		lv2_atom_forge_set_buffer(&forge, buf, sizeof(buf));
+		ref = lv2_atom_forge_sequence_head(&forge, &frame, 0);
+		assert(ref);
+		xpress_rst(xpressO);
+
+		if(c == 0)
+		{
+			for(unsigned i = 0; i < OVERFLOW_NVOICES; i++)
+			{
+				const xpress_state_t state = { .zone = i };
+
+				assert(xpress_create(xpressO, &uuids[i]) != NULL);
+				ref = xpress_token(xpressO, &forge, i, uuids[i], &state);
+				assert(ref && (ref != XPRESS_REF_STAGED));
+			}
+
+			// continuous updates are shed first
+			for(unsigned i = 0; i < OVERFLOW_NVOICES; i++)
+			{
+				const xpress_state_t state = { .zone = i, .pitch = 0.5f };
+
+				ref = xpress_token(xpressO, &forge, 10 + i, uuids[i], &state);
+				assert(ref == XPRESS_REF_STAGED);
+			}
+
+			// releases still make it into the sequence
+			assert(xpress_free(xpressO, uuids[OVERFLOW_NVOICES - 1]) == 1);
+			ref = xpress_release(xpressO, &forge, 20, &uuids[OVERFLOW_NVOICES - 1], 1);
+			assert(ref);
+		}
+		else if(c == 1)
+		{
+			// nothing is unstaged by a flush into an already failed sequence
+			LV2_Atom_Forge_Ref failed = 0;
+
+			xpress_flush(xpressO, &forge, 0, &failed);
+			assert(sender.stageO.head != XPRESS_NIL);
+		}
+
+		xpress_flush(xpressO, &forge, LIMIT_NSAMPLES, &ref);
+		assert(ref);
+		ref = xpress_alive(xpressO, &forge, LIMIT_NSAMPLES - 1);
+		assert(ref);
+		lv2_atom_forge_pop(&forge, &frame);
+
+		const LV2_Atom_Sequence *seq = (const LV2_Atom_Sequence *)buf;
+		LV2_ATOM_SEQUENCE_FOREACH(seq, ev)
+		{
+			const LV2_Atom_Object *obj = (const LV2_Atom_Object *)&ev->body;
+
+			assert(xpress_advance(xpressI, &forge, ev->time.frames, obj, NULL) == 1);
+		}
+
+		// no stuck notes, all births and releases arrived in first cycle
+		for(unsigned i = 0; i < OVERFLOW_NVOICES; i++)
+		{
+			const targetI_t *dst = xpress_get(xpressI, uuids[i]);
+
+			assert( (dst == NULL) == (i == OVERFLOW_NVOICES - 1) );
+		}
+	}
+
+	// shed updates were delivered in the following cycles
+	assert(sender.stageO.head == XPRESS_NIL);
+	for(unsigned i = 0; i < OVERFLOW_NVOICES - 1; i++)
+	{
+		const targetI_t *dst = xpress_get(xpressI, uuids[i]);
+
+		assert(dst);
+		assert(dst->state.zone == (int32_t)i);
+		assert(dst->state.pitch == 0.5f);
+	}
+
+	xpress_deinit(xpressO);
+
+	// without a stage table, updates are shed instead of retried
+	assert(xpress_init(xpressO, MAX_NVOICES, &map, &voice_map,
+			XPRESS_EVENT_NONE, &ifaceI, sender.targetO, NULL) == 1);
+	xpress_coalesce(xpressO, XPRESS_COALESCE_LAST); // ignored
+
+	lv2_atom_forge_set_buffer(&forge, buf, sizeof(buf));
+	ref = lv2_atom_forge_sequence_head(&forge, &frame, 0);
+	assert(ref);
+
+	for(unsigned i = 0; i < OVERFLOW_NVOICES; i++)
+	{
+		const xpress_state_t state = { .zone = i };
+
+		assert(xpress_create(xpressO, &uuids[i]) != NULL);
+		ref = xpress_token(xpressO, &forge, i, uuids[i], &state);
+		assert(ref && (ref != XPRESS_REF_STAGED));
+	}
+
+	for(unsigned i = 0; i < OVERFLOW_NVOICES; i++)
+	{
+		const xpress_state_t state = { .zone = i, .pitch = 0.5f };
+
+		ref = xpress_token(xpressO, &forge, 10 + i, uuids[i], &state);
+		assert(ref == XPRESS_REF_STAGED);
+	}
+
+	xpress_flush(xpressO, &forge, LIMIT_NSAMPLES, &ref);
+	assert(ref);
+	assert(xpressO->ntokens == OVERFLOW_NVOICES);
+
+	xpress_deinit(xpressO);
+}
+
+#define CHORD_NVOICES 8
+
+static void
+_test_18(xpress_t *xpressI)
+{
+	static struct {
+		XPRESS_T(xpressO, MAX_NVOICES);
+		XPRESS_STAGE_T(stageO, MAX_NVOICES);
+		targetI_t targetO [MAX_NVOICES];
+	} sender;
+	xpress_t *xpressO = &sender.xpressO;
+	uint8_t buf [512]; // too small for all births of the chord
+	LV2_Atom_Forge forge;
+	LV2_Atom_Forge_Frame frame;
+	LV2_Atom_Forge_Ref ref;
+	xpress_uuid_t uuids [CHORD_NVOICES];
+
+	assert(xpress_init(xpressO, MAX_NVOICES, &map, &voice_map,
+			XPRESS_EVENT_NONE, &ifaceI, sender.targetO, NULL) == 1);
+	xpress_stage(xpressO, &sender.stageO);
+	lv2_atom_forge_init(&forge, &map);
+
+	unsigned nborn = 0;
+
+	for(unsigned c = 0; (c == 0) || (sender.stageO.head != XPRESS_NIL); c++)
+	{
+		assert(c < CHORD_NVOICES);
+
+		lv2_atom_forge_set_buffer(&forge, buf, sizeof(buf));
+		ref = lv2_atom_forge_sequence_head(&forge, &frame, 0);
+		assert(ref);
+		xpress_rst(xpressO);
+
+		if(c == 0)
+		{
+			// births not fitting are rolled back, never the whole sequence
+			for(unsigned i = 0; i < CHORD_NVOICES; i++)
+			{
+				const xpress_state_t state = { .zone = i };
+
+				assert(xpress_create(xpressO, &uuids[i]) != NULL);
+				ref = xpress_token(xpressO, &forge, i, uuids[i], &state);
+				assert(ref);
+			}
+		}
+
+		xpress_flush(xpressO, &forge, LIMIT_NSAMPLES, &ref);
+		assert(ref);
+		ref = xpress_alive(xpressO, &forge, LIMIT_NSAMPLES - 1);
+		assert(ref);
+		lv2_atom_forge_pop(&forge, &frame);
+
+		const LV2_Atom_Sequence *seq = (const LV2_Atom_Sequence *)buf;
+		LV2_ATOM_SEQUENCE_FOREACH(seq, ev)
+		{
+			const LV2_Atom_Object *obj = (const LV2_Atom_Object *)&ev->body;
+
+			assert(xpress_advance(xpressI, &forge, ev->time.frames, obj, NULL) == 1);
+		}
+
+		unsigned n = 0;
+		for(unsigned i = 0; i < CHORD_NVOICES; i++)
+		{
+			if(xpress_get(xpressI, uuids[i]))
+				n++;
+		}
+
+		// the first cycle kept the births which fitted, later ones add the rest
+		assert( (c == 0) ? ( (n > 0) && (n < CHORD_NVOICES) ) : (n > nborn) );
+		nborn = n;
+	}
+
+	assert(nborn == CHORD_NVOICES);
+
+	// an all-notes-off not fitting is left to the closing xpress#alive
+	uint8_t small [96];
+
+	lv2_atom_forge_set_buffer(&forge, small, sizeof(small));
+	ref = lv2_atom_forge_sequence_head(&forge, &frame, 0);
+	assert(ref);
+	xpress_rst(xpressO);
+
+	for(unsigned i = 0; i < CHORD_NVOICES; i++)
+		assert(xpress_free(xpressO, uuids[i]) == 1);
+
+	ref = xpress_release(xpressO, &forge, 0, uuids, CHORD_NVOICES);
+	assert(ref);
+	assert(forge.offset == sizeof(LV2_Atom_Sequence));
+	assert(!xpress_synced(xpressO));
+
+	ref = xpress_alive(xpressO, &forge, LIMIT_NSAMPLES - 1);
+	assert(ref);
+	assert(xpress_synced(xpressO));
+	lv2_atom_forge_pop(&forge, &frame);
+
+	const LV2_Atom_Sequence *seq = (const LV2_Atom_Sequence *)small;
+	LV2_ATOM_SEQUENCE_FOREACH(seq, ev)
+	{
+		const LV2_Atom_Object *obj = (const LV2_Atom_Object *)&ev->body;
+
+		assert(xpress_advance(xpressI, &forge, ev->time.frames, obj, NULL) == 1);
+	}
+
+	for(unsigned i = 0; i < CHORD_NVOICES; i++)
+		assert(xpress_get(xpressI, uuids[i]) == NULL);
+
+	xpress_deinit(xpressO);
+}
+
+#define BUS_SHM_ID "/lv2_xpress_bus_test"
+#define BUS_NITEMS (XPRESS_BUS_NSLOTS * 8)
+
+static void
+_test_13(xpress_t *xpressI __attribute__((unused)))
+{
+	xpress_bus_item_t item;
+	uint32_t cursor;
+
+	shm_unlink(BUS_SHM_ID);
+	xpress_bus_t *bus = _xpress_bus_open(BUS_SHM_ID);
+	assert(bus != NULL);
+
+	// single producer per channel
+	assert(xpress_bus_claim(bus, 0, 1));
+	assert(xpress_bus_claim(bus, 0, 1));
+	assert(!xpress_bus_claim(bus, 0, 2));
+	xpress_bus_unclaim(bus, 0, 2);
+	assert(!xpress_bus_claim(bus, 0, 2));
+	xpress_bus_unclaim(bus, 0, 1);
+
+	// claims not renewed in time are taken over
+	assert(xpress_bus_claim(bus, 0, 1));
+	atomic_store(&bus->channels[0].beat, _xpress_bus_now() - XPRESS_BUS_TIMEOUT - 1);
+	assert(xpress_bus_claim(bus, 0, 2));
+	assert(!xpress_bus_claim(bus, 0, 1));
+	xpress_bus_unclaim(bus, 0, 2);
+
+	// segments of another layout are rejected
+	atomic_store(&bus->magic, XPRESS_BUS_MAGIC + 1);
+	assert(_xpress_bus_open(BUS_SHM_ID) == NULL);
+	atomic_store(&bus->magic, XPRESS_BUS_MAGIC);
+
+	// as are segments of another size
+	const int fd = shm_open(BUS_SHM_ID"_size", O_RDWR | O_CREAT, S_IRUSR | S_IWUSR);
+	assert(fd != -1);
+	assert(ftruncate(fd, sizeof(xpress_bus_t) / 2) == 0);
+	close(fd);
+	assert(_xpress_bus_open(BUS_SHM_ID"_size") == NULL);
+	shm_unlink(BUS_SHM_ID"_size");
+
+	// consumer lapped by producer skips ahead
+	cursor = xpress_bus_cursor(bus, 1);
+	for(unsigned i = 0; i < XPRESS_BUS_NSLOTS + 1; i++)
+	{
+		item.type = XPRESS_BUS_TOKEN;
+		item.uuid = i + 1;
+		item.state = xpress_vanilla;
+		xpress_bus_publish(bus, 1, &item);
+	}
+	assert(xpress_bus_poll(bus, 1, &cursor, &item) == XPRESS_BUS_OVERRUN);
+	assert(cursor == xpress_bus_cursor(bus, 1));
+	assert(xpress_bus_poll(bus, 1, &cursor, &item) == XPRESS_BUS_EMPTY);
+
+	// producer and consumer in separate processes
+	cursor = xpress_bus_cursor(bus, 0);
+	const pid_t pid = fork();
+	assert(pid != -1);
+
+	if(pid == 0)
+	{
+		xpress_bus_t *child = _xpress_bus_open(BUS_SHM_ID);
+		assert(child != NULL);
+		assert(xpress_bus_claim(child, 0, 2));
+
+		for(unsigned i = 0; i < BUS_NITEMS; i++)
+		{
+			item.type = XPRESS_BUS_TOKEN;
+			item.uuid = i + 1;
+			item.state = xpress_vanilla;
+			item.state.zone = i;
+			item.state.pitch = i;
+			xpress_bus_publish(child, 0, &item);
+
+			if(i % 64 == 0)
+				usleep(100); // give consumer a chance to keep up
+		}
+
+		item.type = XPRESS_BUS_ALIVE;
+		item.uuid = 0;
+		xpress_bus_publish(child, 0, &item);
+
+		xpress_bus_unclaim(child, 0, 2);
+		xpress_bus_deinit(child);
+		_exit(0);
+	}
+
+	uint32_t last = 0;
+	unsigned nitems = 0;
+	unsigned noverruns = 0;
+	for(bool done = false; !done; )
+	{
+		switch(xpress_bus_poll(bus, 0, &cursor, &item))
+		{
+			case XPRESS_BUS_EMPTY:
+				break;
+			case XPRESS_BUS_OVERRUN:
+				noverruns++;
+				break;
+			case XPRESS_BUS_ITEM:
+			{
+				if(item.type == XPRESS_BUS_ALIVE)
+				{
+					done = true;
+					break;
+				}
+
+				// items arrive in order and untorn
+				assert(item.type == XPRESS_BUS_TOKEN);
+				assert(item.uuid > last);
+				assert(item.state.zone == (int32_t)item.uuid - 1);
+				assert(item.state.pitch == (float)item.state.zone);
+				last = item.uuid;
+				nitems++;
+			}	break;
+		}
+	}
+	assert( (nitems == BUS_NITEMS) || (noverruns > 0) );
+
+	int status;
+	assert(waitpid(pid, &status, 0) == pid);
+	assert(WIFEXITED(status) && (WEXITSTATUS(status) == 0) );
+
+	xpress_bus_deinit(bus);
+	shm_unlink(BUS_SHM_ID);
+}
+
+#define UUID_NTHREADS 8
+#define UUID_NINSTANCES 4
+#define UUID_NUUIDS (XPRESS_UUID_BLOCK * 16 + 7) // per instance, not block aligned
+
+typedef struct _uuid_thread_t uuid_thread_t;
+
+struct _uuid_thread_t {
+	pthread_t thread;
+	plughandle_t handles [UUID_NINSTANCES];
+	xpress_uuid_t uuids [UUID_NINSTANCES * UUID_NUUIDS];
+};
+
+static void *
+_uuid_thread(void *data)
+{
+	uuid_thread_t *thread = data;
+	xpress_uuid_t *uuid = thread->uuids;
+
+	// interleave instances, like filters creating voices in one cycle
+	for(unsigned i = 0; i < UUID_NUUIDS; i++)
+	{
+		for(unsigned j = 0; j < UUID_NINSTANCES; j++)
+		{
+			plughandle_t *handle = &thread->handles[j];
+
+			*uuid++ = xpress_map(&handle->xpressI);
+		}
+	}
+
+	return NULL;
+}
+
+static int
+_uuid_cmp(const void *a, const void *b)
+{
+	const xpress_uuid_t *A = a;
+	const xpress_uuid_t *B = b;
+
+	return (*A > *B) - (*A < *B);
+}
+
+static void
+_test_14(xpress_t *xpressI __attribute__((unused)))
+{
+	static uuid_thread_t threads [UUID_NTHREADS];
+	static xpress_uuid_t uuids [UUID_NTHREADS * UUID_NINSTANCES * UUID_NUUIDS];
+	const size_t nuuids = sizeof(uuids) / sizeof(*uuids);
+
+	// instances are initialized up front, as _map is not thread-safe
+	for(unsigned t = 0; t < UUID_NTHREADS; t++)
+	{
+		for(unsigned j = 0; j < UUID_NINSTANCES; j++)
+		{
+			plughandle_t *handle = &threads[t].handles[j];
+
+			// without voice map, uuids come from shared memory
+			assert(xpress_init(&handle->xpressI, MAX_NVOICES, &map, NULL,
+					XPRESS_EVENT_NONE, &ifaceI, handle->targetI, handle) == 1);
+			assert(handle->xpressI.xpress_shm != NULL);
+
+			// one mapping per process, shared by all instances
+			assert(handle->xpressI.xpress_shm == threads[0].handles[0].xpressI.xpress_shm);
+		}
+	}
+
+	assert(_xpress_shm_ref.refs == UUID_NTHREADS * UUID_NINSTANCES);
+
+	for(unsigned t = 0; t < UUID_NTHREADS; t++)
+		assert(pthread_create(&threads[t].thread, NULL, _uuid_thread, &threads[t]) == 0);
+
+	for(unsigned t = 0; t < UUID_NTHREADS; t++)
+	{
+		assert(pthread_join(threads[t].thread, NULL) == 0);
+
+		memcpy(&uuids[t * UUID_NINSTANCES * UUID_NUUIDS], threads[t].uuids,
+			sizeof(threads[t].uuids));
+
+		for(unsigned j = 0; j < UUID_NINSTANCES; j++)
+		{
+			plughandle_t *handle = &threads[t].handles[j];
+
+			xpress_deinit(&handle->xpressI);
+		}
+	}
+
+	// unmapped with the last instance
+	assert(_xpress_shm_ref.refs == 0);
+	assert(_xpress_shm_ref.xpress_shm == NULL);
+
+	// no collisions across threads and instances
+	qsort(uuids, nuuids, sizeof(*uuids), _uuid_cmp);
+	assert(uuids[0] != 0);
+	for(size_t i = 1; i < nuuids; i++)
+		assert(uuids[i] != uuids[i - 1]);
+}
+
 static const test_t tests [] = {
 	_test_1,
 	_test_2,
+	_test_3,
+	_test_4,
+	_test_5,
+	_test_6,
+	_test_7,
+	_test_8,
+	_test_9,
+	_test_10,
+	_test_11,
+	_test_12,
+	_test_13,
+	_test_14,
+	_test_15,
+	_test_16,
+	_test_17,
+	_test_18,
 	NULL
 };
 
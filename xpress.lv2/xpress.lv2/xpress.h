@@ -24,6 +24,8 @@ extern "C" {
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <math.h>
 #include <stdatomic.h>
 #include <time.h>
 #ifndef _WIN32
@@ -37,21 +39,30 @@ extern "C" {
 #include <lv2/lv2plug.in/ns/ext/urid/urid.h>
 #include <lv2/lv2plug.in/ns/ext/atom/atom.h>
 #include <lv2/lv2plug.in/ns/ext/atom/forge.h>
+#include <lv2/lv2plug.in/ns/ext/options/options.h>
 
 /*****************************************************************************
  * API START
  *****************************************************************************/
 
 #define XPRESS_SHM_ID				"/lv2_xpress_shm"
+#define XPRESS_BUS_SHM_ID		"/lv2_xpress_bus"
 #define XPRESS_URI	  			"http://open-music-kontrollers.ch/lv2/xpress"
 #define XPRESS_PREFIX				XPRESS_URI"#"
 
 // Features
 #define XPRESS__voiceMap		XPRESS_PREFIX"voiceMap"
 
+// Options
+#define XPRESS__maxNVoices	XPRESS_PREFIX"maxNVoices"
+
 // Message types
 #define XPRESS__Token				XPRESS_PREFIX"Token"
 #define XPRESS__Alive				XPRESS_PREFIX"Alive"
+#define XPRESS__Release			XPRESS_PREFIX"Release"
+#define XPRESS__Packed			XPRESS_PREFIX"Packed"
+#define XPRESS__Batch				XPRESS_PREFIX"Batch"
+#define XPRESS__Delta				XPRESS_PREFIX"Delta" // xpress#Token with changed properties only
 
 // Properties
 #define XPRESS__source			XPRESS_PREFIX"source"
@@ -65,16 +76,53 @@ extern "C" {
 #define XPRESS__dPressure		XPRESS_PREFIX"dPressure"
 #define XPRESS__dTimbre			XPRESS_PREFIX"dTimbre"
 
+// upper bound of voice capacity, occupancy and alive state is kept as one
+// 64-bit word per group of 64 voices
+#define XPRESS_MAX_NVOICES	1024
+#define XPRESS_MAX_NGROUPS	(XPRESS_MAX_NVOICES / 64)
+
+// maximal number of concurrent upstream sources with an own voice index
+#define XPRESS_MAX_NSOURCES	8
+
+// voice uuids reserved at once from the shared counter
+#define XPRESS_UUID_BLOCK		256
+
+// voice bus channels with one producer each and items per channel ring
+#define XPRESS_BUS_NCHANNELS	8
+#define XPRESS_BUS_NSLOTS		2048 // must be a power of two
+#define XPRESS_BUS_MAGIC		0x78627573 // 'xbus', bump with any layout change
+#define XPRESS_BUS_TIMEOUT		1000 // ms without renewal after which a claim may be taken over
+
+// largest zone of binary tokens, which are copied rather than parsed
+#define XPRESS_MAX_ZONE			0xffff
+
+// tokens worth of output space kept free for voice births and releases, events
+// not fitting nevertheless are rolled back and retried rather than the cycle lost
+#define XPRESS_RESERVE_NTOKENS	2
+
 // types
 typedef uint32_t xpress_uuid_t;
 
 // structures
 typedef struct _xpress_map_t xpress_map_t;
 typedef struct _xpress_shm_t xpress_shm_t;
+typedef struct _xpress_shm_ref_t xpress_shm_ref_t;
 typedef struct _xpress_state_t xpress_state_t;
 typedef struct _xpress_voice_t xpress_voice_t;
+typedef struct _xpress_source_t xpress_source_t;
+typedef struct _xpress_handle_t xpress_handle_t;
+typedef struct _xpress_limit_t xpress_limit_t;
+typedef struct _xpress_staged_t xpress_staged_t;
+typedef struct _xpress_stage_t xpress_stage_t;
+typedef struct _xpress_packed_t xpress_packed_t;
+typedef struct _xpress_batch_t xpress_batch_t;
+typedef struct _xpress_batch_item_t xpress_batch_item_t;
 typedef struct _xpress_iface_t xpress_iface_t;
 typedef struct _xpress_t xpress_t;
+typedef struct _xpress_bus_item_t xpress_bus_item_t;
+typedef struct _xpress_bus_slot_t xpress_bus_slot_t;
+typedef struct _xpress_bus_channel_t xpress_bus_channel_t;
+typedef struct _xpress_bus_t xpress_bus_t;
 
 // function callbacks
 typedef xpress_uuid_t (*xpress_map_new_uuid_t)(void *handle, uint32_t flag);
@@ -96,6 +144,28 @@ typedef enum _xpress_event_t {
 #define XPRESS_EVENT_NONE		(0)
 #define XPRESS_EVENT_ALL		(XPRESS_EVENT_ADD | XPRESS_EVENT_DEL | XPRESS_EVENT_SET)
 
+typedef enum _xpress_coalesce_t {
+	XPRESS_COALESCE_NONE			= 0,
+	XPRESS_COALESCE_FIRST			= 1, // flush at frame time of first update
+	XPRESS_COALESCE_LAST			= 2 // flush at frame time of last update
+} xpress_coalesce_t;
+
+// non-null reference returned for tokens staged and batch heads postponed
+// instead of forged
+#define XPRESS_REF_STAGED ((LV2_Atom_Forge_Ref)1)
+
+typedef enum _xpress_bus_type_t {
+	XPRESS_BUS_TOKEN					= 0,
+	XPRESS_BUS_RELEASE				= 1,
+	XPRESS_BUS_ALIVE					= 2 // ends a snapshot of all live voices
+} xpress_bus_type_t;
+
+typedef enum _xpress_bus_status_t {
+	XPRESS_BUS_EMPTY					= 0,
+	XPRESS_BUS_ITEM						= 1,
+	XPRESS_BUS_OVERRUN				= 2 // consumer was lapped, cursor skipped ahead
+} xpress_bus_status_t;
+
 struct _xpress_state_t {
 	int32_t zone;
 
@@ -108,6 +178,25 @@ struct _xpress_state_t {
 	float dTimbre;
 };
 
+// body of an atom of type xpress#Packed, a compact alternative to xpress#Token
+struct _xpress_packed_t {
+	LV2_URID source;
+	xpress_uuid_t uuid;
+	xpress_state_t state;
+};
+
+// body of an atom of type xpress#Batch, followed by items of given stride,
+// all items share the event's timestamp and the batch's source
+struct _xpress_batch_t {
+	LV2_URID source;
+	uint32_t stride;
+};
+
+struct _xpress_batch_item_t {
+	xpress_uuid_t uuid;
+	xpress_state_t state;
+};
+
 struct _xpress_iface_t {
 	size_t size;
 
@@ -119,8 +208,58 @@ struct _xpress_iface_t {
 struct _xpress_voice_t {
 	LV2_URID source;
 	xpress_uuid_t uuid;
-	bool alive;
 	void *target;
+
+	bool cached; // state was sent or received at least once
+	xpress_state_t state; // last sent or merged received state
+
+	int32_t head; // first voice in hash bucket of same index
+	int32_t next; // next voice in hash bucket or free list
+
+	int32_t part; // index into source table or XPRESS_NIL if unindexed
+	int32_t prev; // previous voice of same source
+	int32_t succ; // next voice of same source
+};
+
+// stable reference to a voice slot, the uuid doubles as generation tag, as
+// uuids are never reused, a zero-initialized handle is always stale
+struct _xpress_handle_t {
+	xpress_uuid_t uuid;
+	int32_t idx;
+};
+
+// per-field deadbands and minimal distance between tokens of a voice
+struct _xpress_limit_t {
+	xpress_state_t deadband; // zone is ignored, any zone change passes
+	uint32_t interval; // in frames
+};
+
+// staging bookkeeping of a voice, kept apart from the voice table
+struct _xpress_staged_t {
+	xpress_state_t state; // latest staged state
+	uint64_t last; // frame time of last token
+	uint32_t frames; // frame time of staged update
+	int32_t prev; // previous dirty voice
+	int32_t next; // next dirty voice
+	bool dirty; // update is staged
+	bool touched; // staged in current cycle
+};
+
+// optional side table of an xpress_t, needed for coalescing, limiting and
+// retrying updates shed for lack of output space, one entry per voice slot
+struct _xpress_stage_t {
+	xpress_coalesce_t coalesce;
+	bool limited;
+	xpress_limit_t limit;
+	int32_t head; // dirty voices in order of frame time
+	int32_t tail;
+	uint64_t clock; // frame time at start of cycle
+	xpress_staged_t voices [1];
+};
+
+struct _xpress_source_t {
+	LV2_URID urid;
+	int32_t head; // first voice of this source, XPRESS_NIL for unused entries
 };
 
 struct _xpress_map_t {
@@ -132,10 +271,47 @@ struct _xpress_shm_t {
 	atomic_uint voice_uuid;
 };
 
+// process-wide mapping of the shared memory segment
+struct _xpress_shm_ref_t {
+	atomic_flag lock; // hosts may instantiate concurrently
+	unsigned refs; // number of xpress_t using the mapping
+	xpress_shm_t *xpress_shm;
+};
+
+struct _xpress_bus_item_t {
+	uint32_t type;
+	xpress_uuid_t uuid;
+	xpress_state_t state;
+};
+
+// seqlock, odd while being written, 2*(pos+1) once item at pos is published
+struct _xpress_bus_slot_t {
+	atomic_uint seq;
+	xpress_bus_item_t item;
+};
+
+// broadcast ring, written by a single producer, read by any number of
+// consumers with private cursors, neither side ever waits for the other
+struct _xpress_bus_channel_t {
+	atomic_uint producer; // claim token of current producer, 0 if unclaimed
+	atomic_uint beat; // monotonic ms of last claim renewal by the producer
+	atomic_uint head; // number of items published
+	xpress_bus_slot_t slots [XPRESS_BUS_NSLOTS];
+};
+
+struct _xpress_bus_t {
+	atomic_uint magic; // XPRESS_BUS_MAGIC once opened
+	xpress_bus_channel_t channels [XPRESS_BUS_NCHANNELS];
+};
+
 struct _xpress_t {
 	struct {
 		LV2_URID xpress_Token;
 		LV2_URID xpress_Alive;
+		LV2_URID xpress_Release;
+		LV2_URID xpress_Packed;
+		LV2_URID xpress_Batch;
+		LV2_URID xpress_Delta;
 
 		LV2_URID xpress_source;
 		LV2_URID xpress_uuid;
@@ -155,8 +331,18 @@ struct _xpress_t {
 	xpress_map_t *voice_map;
 	xpress_shm_t *xpress_shm;
 	atomic_uint voice_uuid;
+	xpress_uuid_t uuid_next; // next uuid of reserved block
+	xpress_uuid_t uuid_end; // end of reserved block
 	bool synced;
 	xpress_uuid_t source;
+	bool delta;
+	bool packed;
+	xpress_stage_t *stage; // optional
+	uint32_t frames; // latest frame time forged in this cycle
+	LV2_Atom_Forge_Frame *batch; // open batch, its head is forged with first item
+
+	uint32_t ntokens; // tokens forged or received, reset by user
+	uint32_t nalives; // alives forged or received, reset by user
 
 	xpress_event_t event_mask;
 	const xpress_iface_t *iface;
@@ -164,6 +350,11 @@ struct _xpress_t {
 
 	unsigned max_nvoices;
 	unsigned nvoices;
+	int32_t free_head;
+	unsigned nunindexed; // number of voices not in any source list
+	xpress_source_t sources [XPRESS_MAX_NSOURCES];
+	uint64_t used [XPRESS_MAX_NGROUPS]; // occupancy bits per voice group
+	uint64_t alive [XPRESS_MAX_NGROUPS]; // alive bits per voice group
 	xpress_voice_t voices [1];
 };
 
@@ -174,15 +365,27 @@ struct _xpress_t {
 	xpress_t (XPRESS); \
 	xpress_voice_t XPRESS_CONCAT(_voices, __COUNTER__) [(MAX_NVOICES - 1)]
 
+// size of a dynamically allocated xpress_t for given voice capacity
+#define XPRESS_SIZE(MAX_NVOICES) \
+	(sizeof(xpress_t) + ((MAX_NVOICES) - 1)*sizeof(xpress_voice_t))
+
+#define XPRESS_STAGE_T(STAGE, MAX_NVOICES) \
+	xpress_stage_t (STAGE); \
+	xpress_staged_t XPRESS_CONCAT(_staged, __COUNTER__) [(MAX_NVOICES - 1)]
+
+// size of a dynamically allocated xpress_stage_t for given voice capacity
+#define XPRESS_STAGE_SIZE(MAX_NVOICES) \
+	(sizeof(xpress_stage_t) + ((MAX_NVOICES) - 1)*sizeof(xpress_staged_t))
+
 #define XPRESS_VOICE_FOREACH(XPRESS, VOICE) \
-	for(xpress_voice_t *(VOICE) = &(XPRESS)->voices[(int)(XPRESS)->nvoices - 1]; \
-		(VOICE) >= (XPRESS)->voices; \
-		(VOICE)--)
+	for(xpress_voice_t *(VOICE) = _xpress_voice_next((XPRESS), NULL); \
+		(VOICE); \
+		(VOICE) = _xpress_voice_next((XPRESS), (VOICE)))
 
 #define XPRESS_VOICE_FREE(XPRESS, VOICE) \
-	for(xpress_voice_t *(VOICE) = &(XPRESS)->voices[(int)(XPRESS)->nvoices - 1]; \
-		(VOICE) >= (XPRESS)->voices; \
-		(VOICE)->uuid = 0, (VOICE)--, (XPRESS)->nvoices--)
+	for(xpress_voice_t *(VOICE) = _xpress_voice_next((XPRESS), NULL); \
+		(VOICE); \
+		_xpress_voice_free((XPRESS), (VOICE)), (VOICE) = _xpress_voice_next((XPRESS), (VOICE)))
 
 // non rt-safe
 static inline int
@@ -193,10 +396,19 @@ xpress_init(xpress_t *xpress, unsigned max_nvoices, LV2_URID_Map *map,
 static inline void
 xpress_deinit(xpress_t *xpress);
 
+// non rt-safe
+static inline unsigned
+xpress_max_nvoices(LV2_URID_Map *map, const LV2_Feature *const *features,
+	unsigned def, unsigned max);
+
 // rt-safe
 static inline void *
 xpress_get(xpress_t *xpress, xpress_uuid_t uuid);
 
+// rt-safe
+static inline void *
+xpress_get_h(xpress_t *xpress, const xpress_handle_t *handle);
+
 // rt-safe
 static inline int
 xpress_advance(xpress_t *xpress, LV2_Atom_Forge *forge, uint32_t frames,
@@ -214,10 +426,41 @@ xpress_rst(xpress_t *xpress);
 static inline bool
 xpress_synced(xpress_t *xpress);
 
+// rt-safe, to be called whenever the sequence forged in this cycle was
+// discarded, e.g. cleared after an overflow
+static inline void
+xpress_discard(xpress_t *xpress);
+
 // rt-safe
 static inline void
 xpress_post(xpress_t *xpress, int64_t frames);
 
+// rt-safe
+static inline void
+xpress_delta(xpress_t *xpress, bool delta);
+
+// rt-safe
+static inline void
+xpress_packed(xpress_t *xpress, bool packed);
+
+// non rt-safe, stage must hold as many voices as xpress, without it updates
+// are neither coalesced nor limited and shed rather than retried
+static inline void
+xpress_stage(xpress_t *xpress, xpress_stage_t *stage);
+
+// rt-safe
+static inline void
+xpress_coalesce(xpress_t *xpress, xpress_coalesce_t coalesce);
+
+// rt-safe
+static inline void
+xpress_limit(xpress_t *xpress, const xpress_limit_t *limit);
+
+// rt-safe
+static inline void
+xpress_flush(xpress_t *xpress, LV2_Atom_Forge *forge, uint32_t nsamples,
+	LV2_Atom_Forge_Ref *ref);
+
 // rt-safe
 static inline void *
 xpress_add(xpress_t *xpress, xpress_uuid_t uuid);
@@ -226,23 +469,94 @@ xpress_add(xpress_t *xpress, xpress_uuid_t uuid);
 static inline void *
 xpress_create(xpress_t *xpress, xpress_uuid_t *uuid);
 
+// rt-safe
+static inline void *
+xpress_add_h(xpress_t *xpress, xpress_uuid_t uuid, xpress_handle_t *handle);
+
+// rt-safe
+static inline void *
+xpress_create_h(xpress_t *xpress, xpress_handle_t *handle);
+
 // rt-safe
 static inline int
 xpress_free(xpress_t *xpress, xpress_uuid_t uuid);
 
+// rt-safe
+static inline int
+xpress_free_h(xpress_t *xpress, const xpress_handle_t *handle);
+
 // rt-safe
 static inline LV2_Atom_Forge_Ref
 xpress_token(xpress_t *xpress, LV2_Atom_Forge *forge, uint32_t frames,
 	xpress_uuid_t uuid, const xpress_state_t *state);
 
+// rt-safe
+static inline LV2_Atom_Forge_Ref
+xpress_token_h(xpress_t *xpress, LV2_Atom_Forge *forge, uint32_t frames,
+	const xpress_handle_t *handle, const xpress_state_t *state);
+
+// rt-safe
+static inline LV2_Atom_Forge_Ref
+xpress_batch_head(xpress_t *xpress, LV2_Atom_Forge *forge, uint32_t frames,
+	LV2_Atom_Forge_Frame *frame);
+
+// rt-safe
+static inline LV2_Atom_Forge_Ref
+xpress_batch_token(xpress_t *xpress, LV2_Atom_Forge *forge,
+	xpress_uuid_t uuid, const xpress_state_t *state);
+
+// rt-safe
+static inline void
+xpress_batch_pop(xpress_t *xpress, LV2_Atom_Forge *forge,
+	LV2_Atom_Forge_Frame *frame);
+
 // rt-safe
 static inline LV2_Atom_Forge_Ref
 xpress_alive(xpress_t *xpress, LV2_Atom_Forge *forge, uint32_t frames);
 
+// rt-safe
+static inline LV2_Atom_Forge_Ref
+xpress_release(xpress_t *xpress, LV2_Atom_Forge *forge, uint32_t frames,
+	const xpress_uuid_t *uuids, unsigned nuuids);
+
 // rt-safe
 static inline int32_t
 xpress_map(xpress_t *xpress);
 
+// rt-safe, holds up under -ffinite-math-only, unlike isfinite
+static inline bool
+xpress_isfinite(float value);
+
+// non rt-safe
+static inline xpress_bus_t *
+xpress_bus_init(void);
+
+// non rt-safe
+static inline void
+xpress_bus_deinit(xpress_bus_t *bus);
+
+// rt-safe, claims or renews, to be called every cycle by the producer
+static inline bool
+xpress_bus_claim(xpress_bus_t *bus, unsigned channel, uint32_t token);
+
+// rt-safe
+static inline void
+xpress_bus_unclaim(xpress_bus_t *bus, unsigned channel, uint32_t token);
+
+// rt-safe
+static inline void
+xpress_bus_publish(xpress_bus_t *bus, unsigned channel,
+	const xpress_bus_item_t *item);
+
+// rt-safe
+static inline uint32_t
+xpress_bus_cursor(xpress_bus_t *bus, unsigned channel);
+
+// rt-safe
+static inline xpress_bus_status_t
+xpress_bus_poll(xpress_bus_t *bus, unsigned channel, uint32_t *cursor,
+	xpress_bus_item_t *item);
+
 /*****************************************************************************
  * API END
  *****************************************************************************/
@@ -273,95 +587,265 @@ _xpress_urn_uuid(LV2_URID_Map *map)
 	return map->map(map->handle, uuid);
 }
 
-static inline void
-_xpress_qsort(xpress_voice_t *A, int n)
+// voices live in fixed slots, indexed by a chained hash table whose bucket
+// heads and links are embedded into the slots themselves, unused slots are
+// kept in a singly-linked free list, thus add/get/free are O(1) on average
+#define XPRESS_NIL (-1)
+
+static inline int32_t
+_xpress_bucket(xpress_t *xpress, xpress_uuid_t uuid)
 {
-	if(n < 2)
-		return;
+	// fibonacci hashing followed by multiplicative range reduction
+	const uint32_t hash = uuid * UINT32_C(0x9e3779b1);
+
+	return ((uint64_t)hash * xpress->max_nvoices) >> 32;
+}
 
-	const xpress_voice_t *p = A;
+// voice group of given voice index and its bit in the group's words
+#define XPRESS_GROUP(IDX) ((IDX) >> 6)
+#define XPRESS_BIT(IDX) (UINT64_C(1) << ((IDX) & 63))
 
-	int i = -1;
-	int j = n;
+static inline unsigned
+_xpress_ngroups(xpress_t *xpress)
+{
+	return XPRESS_GROUP(xpress->max_nvoices + 63);
+}
 
-	while(true)
-	{
-		do {
-			i += 1;
-		} while(A[i].uuid > p->uuid);
+static inline xpress_voice_t *
+_xpress_voice_next(xpress_t *xpress, xpress_voice_t *voice)
+{
+	const unsigned idx = voice ? voice - xpress->voices + 1 : 0;
+	const unsigned ngroups = _xpress_ngroups(xpress);
 
-		do {
-			j -= 1;
-		} while(A[j].uuid < p->uuid);
+	unsigned g = XPRESS_GROUP(idx);
+	if(g >= ngroups)
+		return NULL; // end
 
-		if(i >= j)
-			break;
+	// mask out voices up to and including the current one
+	for(uint64_t used = xpress->used[g] & (~UINT64_C(0) << (idx & 63)); ; )
+	{
+		if(used)
+			return &xpress->voices[(g << 6) + __builtin_ctzll(used)];
 
-		const xpress_voice_t tmp = A[i];
-		A[i] = A[j];
-		A[j] = tmp;
-	}
+		if(++g >= ngroups)
+			return NULL; // end
 
-	_xpress_qsort(A, j + 1);
-	_xpress_qsort(A + j + 1, n - j - 1);
+		used = xpress->used[g];
+	}
 }
 
 static inline xpress_voice_t *
-_xpress_bsearch(xpress_uuid_t p, xpress_voice_t *a, int n)
+_xpress_voice_get(xpress_t *xpress, xpress_uuid_t uuid)
 {
-	xpress_voice_t *base = a;
+	if(!uuid)
+		return NULL; // invalid
+
+	const int32_t bucket = _xpress_bucket(xpress, uuid);
 
-	for(int N = n, half; N > 1; N -= half)
+	for(int32_t i = xpress->voices[bucket].head; i != XPRESS_NIL; )
 	{
-		half = N/2;
-		xpress_voice_t *dst = &base[half];
-		base = (dst->uuid < p) ? base : dst;
+		xpress_voice_t *voice = &xpress->voices[i];
+
+		if(voice->uuid == uuid)
+			return voice;
+
+		i = voice->next;
 	}
 
-	return (base->uuid == p) ? base : NULL;
+	return NULL;
 }
 
-static inline void
-_xpress_sort(xpress_t *xpress)
+static inline xpress_voice_t *
+_xpress_voice_get_h(xpress_t *xpress, const xpress_handle_t *handle)
 {
-	_xpress_qsort(xpress->voices, xpress->nvoices);
+	if(!handle->uuid || (handle->idx < 0)
+			|| ((unsigned)handle->idx >= xpress->max_nvoices) )
+		return NULL; // invalid
+
+	xpress_voice_t *voice = &xpress->voices[handle->idx];
+
+	return (voice->uuid == handle->uuid) ? voice : NULL; // NULL if stale
 }
 
-static inline xpress_voice_t *
-_xpress_voice_get(xpress_t *xpress, xpress_uuid_t uuid)
+// voices of the same source are chained into an intrusive doubly-linked
+// list, thus xpress#Alive reconciliation only touches voices of its source
+static inline int32_t
+_xpress_source_get(xpress_t *xpress, LV2_URID source, bool create)
 {
-	return _xpress_bsearch(uuid, xpress->voices, xpress->nvoices);
+	int32_t unused = XPRESS_NIL;
+
+	for(int32_t i = 0; i < XPRESS_MAX_NSOURCES; i++)
+	{
+		const xpress_source_t *src = &xpress->sources[i];
+
+		if(src->head == XPRESS_NIL)
+		{
+			if(unused == XPRESS_NIL)
+				unused = i;
+		}
+		else if(src->urid == source)
+		{
+			return i;
+		}
+	}
+
+	if(create && (unused != XPRESS_NIL) )
+		xpress->sources[unused].urid = source;
+
+	return create ? unused : XPRESS_NIL;
 }
 
-static inline void *
+static inline xpress_voice_t *
 _xpress_voice_add(xpress_t *xpress, LV2_URID source, xpress_uuid_t uuid, bool alive)
 {
-	if(xpress->nvoices >= xpress->max_nvoices)
+	if(!uuid || (xpress->free_head == XPRESS_NIL) )
 		return NULL; // failed
 
-	xpress_voice_t *voice = &xpress->voices[xpress->nvoices++];
+	// pop slot from free list
+	const int32_t idx = xpress->free_head;
+	xpress_voice_t *voice = &xpress->voices[idx];
+	xpress->free_head = voice->next;
+
+	// push slot to hash bucket
+	xpress_voice_t *head = &xpress->voices[_xpress_bucket(xpress, uuid)];
+	voice->next = head->head;
+	head->head = idx;
+
+	const unsigned g = XPRESS_GROUP(idx);
+	xpress->used[g] |= XPRESS_BIT(idx);
+	if(alive)
+		xpress->alive[g] |= XPRESS_BIT(idx);
+	else
+		xpress->alive[g] &= ~XPRESS_BIT(idx);
+
+	// push slot to source list, if source table is full, leave it unindexed
+	voice->part = _xpress_source_get(xpress, source, true);
+	if(voice->part != XPRESS_NIL)
+	{
+		xpress_source_t *src = &xpress->sources[voice->part];
+
+		voice->prev = XPRESS_NIL;
+		voice->succ = src->head;
+		if(src->head != XPRESS_NIL)
+			xpress->voices[src->head].prev = idx;
+		src->head = idx;
+	}
+	else
+	{
+		xpress->nunindexed++;
+	}
+
 	voice->source = source;
 	voice->uuid = uuid;
-	voice->alive = alive;
-	void *target = voice->target;
+	voice->cached = false;
+	voice->state = xpress_vanilla;
+	if(xpress->stage)
+	{
+		xpress_staged_t *staged = &xpress->stage->voices[idx];
+
+		staged->dirty = false;
+		staged->touched = false;
+		staged->last = 0;
+	}
+	xpress->nvoices++;
+
+	return voice;
+}
+
+// voices with a staged update are chained into an intrusive doubly-linked
+// list, kept sorted by frame time of the update to flush
+static inline void
+_xpress_dirty_unlink(xpress_stage_t *stage, xpress_staged_t *staged)
+{
+	if(staged->prev != XPRESS_NIL)
+		stage->voices[staged->prev].next = staged->next;
+	else
+		stage->head = staged->next;
+
+	if(staged->next != XPRESS_NIL)
+		stage->voices[staged->next].prev = staged->prev;
+	else
+		stage->tail = staged->prev;
+
+	staged->dirty = false;
+}
 
-	_xpress_sort(xpress);
+static inline void
+_xpress_dirty_append(xpress_stage_t *stage, xpress_staged_t *staged)
+{
+	const int32_t idx = staged - stage->voices;
 
-	return target;
+	staged->prev = stage->tail;
+	staged->next = XPRESS_NIL;
+	if(stage->tail != XPRESS_NIL)
+		stage->voices[stage->tail].next = idx;
+	else
+		stage->head = idx;
+	stage->tail = idx;
+
+	staged->dirty = true;
 }
 
 static inline void
 _xpress_voice_free(xpress_t *xpress, xpress_voice_t *voice)
 {
-	voice->uuid = 0;
+	if(!voice->uuid)
+		return; // unused slot
+
+	const int32_t idx = voice - xpress->voices;
+
+	// unlink slot from hash bucket
+	for(int32_t *link = &xpress->voices[_xpress_bucket(xpress, voice->uuid)].head;
+		*link != XPRESS_NIL;
+		link = &xpress->voices[*link].next)
+	{
+		if(*link == idx)
+		{
+			*link = voice->next;
+			break;
+		}
+	}
+
+	const unsigned g = XPRESS_GROUP(idx);
+	xpress->used[g] &= ~XPRESS_BIT(idx);
+	xpress->alive[g] &= ~XPRESS_BIT(idx);
+
+	// unlink slot from source list
+	if(voice->part != XPRESS_NIL)
+	{
+		if(voice->prev != XPRESS_NIL)
+			xpress->voices[voice->prev].succ = voice->succ;
+		else
+			xpress->sources[voice->part].head = voice->succ;
+
+		if(voice->succ != XPRESS_NIL)
+			xpress->voices[voice->succ].prev = voice->prev;
+	}
+	else
+	{
+		xpress->nunindexed--;
+	}
 
-	_xpress_sort(xpress);
+	// drop staged update, it is superseded by the release
+	if(xpress->stage && xpress->stage->voices[idx].dirty)
+		_xpress_dirty_unlink(xpress->stage, &xpress->stage->voices[idx]);
 
+	// push slot to free list
+	voice->uuid = 0; // invalidate
+	voice->next = xpress->free_head;
+	xpress->free_head = idx;
 	xpress->nvoices--;
 }
 
+// weak, thus merged into a single instance across all translation units
+__attribute__((weak)) xpress_shm_ref_t _xpress_shm_ref = {
+	.lock = ATOMIC_FLAG_INIT,
+	.refs = 0,
+	.xpress_shm = NULL
+};
+
 static xpress_shm_t *
-_xpress_shm_init()
+_xpress_shm_map()
 {
 	xpress_shm_t *xpress_shm = NULL;
 #ifndef _WIN32
@@ -401,7 +885,7 @@ _xpress_shm_init()
 }
 
 static void
-_xpress_shm_deinit(xpress_shm_t *xpress_shm)
+_xpress_shm_unmap(xpress_shm_t *xpress_shm)
 {
 #ifndef _WIN32
 	const size_t total_size = sizeof(xpress_shm_t);
@@ -412,6 +896,103 @@ _xpress_shm_deinit(xpress_shm_t *xpress_shm)
 #endif
 }
 
+static inline void
+_xpress_shm_lock(xpress_shm_ref_t *ref)
+{
+	while(atomic_flag_test_and_set_explicit(&ref->lock, memory_order_acquire))
+	{
+		// spin, only contended by concurrent init/deinit
+	}
+}
+
+static inline void
+_xpress_shm_unlock(xpress_shm_ref_t *ref)
+{
+	atomic_flag_clear_explicit(&ref->lock, memory_order_release);
+}
+
+// map segment once per process, shared by all following xpress_t
+static xpress_shm_t *
+_xpress_shm_init()
+{
+	xpress_shm_ref_t *ref = &_xpress_shm_ref;
+
+	_xpress_shm_lock(ref);
+
+	if(!ref->xpress_shm)
+		ref->xpress_shm = _xpress_shm_map();
+
+	if(ref->xpress_shm)
+		ref->refs++;
+
+	xpress_shm_t *xpress_shm = ref->xpress_shm;
+
+	_xpress_shm_unlock(ref);
+
+	return xpress_shm;
+}
+
+// unmap segment with the last xpress_t using it
+static void
+_xpress_shm_deinit(xpress_shm_t *xpress_shm)
+{
+	xpress_shm_ref_t *ref = &_xpress_shm_ref;
+
+	_xpress_shm_lock(ref);
+
+	if( (xpress_shm == ref->xpress_shm) && (--ref->refs == 0) )
+	{
+		_xpress_shm_unmap(ref->xpress_shm);
+		ref->xpress_shm = NULL;
+	}
+
+	_xpress_shm_unlock(ref);
+}
+
+static xpress_bus_t *
+_xpress_bus_open(const char *id)
+{
+	xpress_bus_t *bus = NULL;
+#ifndef _WIN32
+	const size_t total_size = sizeof(xpress_bus_t);
+
+	int fd = shm_open(id, O_RDWR | O_CREAT, S_IRUSR | S_IWUSR);
+	if(fd == -1)
+	{
+		return NULL;
+	}
+
+	// a fresh segment is zero-filled, which is the valid initial state,
+	// segments of another size are left alone
+	struct stat st;
+	if(  (fstat(fd, &st) == -1)
+		|| ( (st.st_size != 0) && (st.st_size != (off_t)total_size) )
+		|| ( (st.st_size == 0) && (ftruncate(fd, total_size) == -1) )
+		|| ((bus = mmap(NULL, total_size, PROT_READ | PROT_WRITE,
+					MAP_SHARED, fd, 0)) == MAP_FAILED) )
+	{
+		close(fd);
+		return NULL;
+	}
+
+	close(fd);
+
+	// stamp a fresh segment, reject one of another layout of the same size
+	uint32_t magic = 0;
+	if(  !atomic_compare_exchange_strong_explicit(&bus->magic, &magic, XPRESS_BUS_MAGIC,
+			memory_order_acq_rel, memory_order_acquire)
+		&& (magic != XPRESS_BUS_MAGIC) )
+	{
+		munmap(bus, total_size);
+		return NULL;
+	}
+#else
+	(void)id;
+#endif
+
+	return bus;
+}
+
 static inline int
 xpress_init(xpress_t *xpress, unsigned max_nvoices, LV2_URID_Map *map,
 	xpress_map_t *voice_map, xpress_event_t event_mask, const xpress_iface_t *iface,
@@ -419,6 +1000,8 @@ xpress_init(xpress_t *xpress, unsigned max_nvoices, LV2_URID_Map *map,
 {
 	if(!map || ( (event_mask != XPRESS_EVENT_NONE) && !iface))
 		return 0;
+	if(max_nvoices > XPRESS_MAX_NVOICES)
+		return 0;
 
 	xpress->nvoices = 0;
 	xpress->max_nvoices = max_nvoices;
@@ -430,6 +1013,10 @@ xpress_init(xpress_t *xpress, unsigned max_nvoices, LV2_URID_Map *map,
 	
 	xpress->urid.xpress_Token = map->map(map->handle, XPRESS__Token);
 	xpress->urid.xpress_Alive = map->map(map->handle, XPRESS__Alive);
+	xpress->urid.xpress_Release = map->map(map->handle, XPRESS__Release);
+	xpress->urid.xpress_Packed = map->map(map->handle, XPRESS__Packed);
+	xpress->urid.xpress_Batch = map->map(map->handle, XPRESS__Batch);
+	xpress->urid.xpress_Delta = map->map(map->handle, XPRESS__Delta);
 
 	xpress->urid.xpress_source = map->map(map->handle, XPRESS__source);
 	xpress->urid.xpress_uuid = map->map(map->handle, XPRESS__uuid);
@@ -445,7 +1032,28 @@ xpress_init(xpress_t *xpress, unsigned max_nvoices, LV2_URID_Map *map,
 	xpress->urid.xpress_dPressure = map->map(map->handle, XPRESS__dPressure);
 	xpress->urid.xpress_dTimbre = map->map(map->handle, XPRESS__dTimbre);
 
-	for(unsigned i = 0; i < xpress->max_nvoices; i++)
+	xpress->free_head = XPRESS_NIL;
+	xpress->nunindexed = 0;
+	xpress->uuid_next = 0;
+	xpress->uuid_end = 0;
+	xpress->stage = NULL;
+	xpress->frames = 0;
+	xpress->ntokens = 0;
+	xpress->nalives = 0;
+
+	for(unsigned i = 0; i < XPRESS_MAX_NSOURCES; i++)
+	{
+		xpress->sources[i].urid = 0;
+		xpress->sources[i].head = XPRESS_NIL;
+	}
+
+	for(unsigned g = 0; g < XPRESS_MAX_NGROUPS; g++)
+	{
+		xpress->used[g] = 0;
+		xpress->alive[g] = 0;
+	}
+
+	for(unsigned i = xpress->max_nvoices; i-- > 0; )
 	{
 		xpress_voice_t *voice = &xpress->voices[i];
 
@@ -453,9 +1061,14 @@ xpress_init(xpress_t *xpress, unsigned max_nvoices, LV2_URID_Map *map,
 		voice->target = target && iface
 			? (uint8_t *)target + i*iface->size
 			: NULL;
+
+		voice->head = XPRESS_NIL;
+		voice->next = xpress->free_head;
+		xpress->free_head = i;
 	}
 
 	xpress->source = _xpress_urn_uuid(map);
+	xpress->xpress_shm = NULL;
 
 	if(!xpress->voice_map)
 	{
@@ -479,7 +1092,46 @@ xpress_deinit(xpress_t *xpress)
 	if(xpress->xpress_shm)
 	{
 		_xpress_shm_deinit(xpress->xpress_shm);
+		xpress->xpress_shm = NULL;
+	}
+}
+
+static inline unsigned
+xpress_max_nvoices(LV2_URID_Map *map, const LV2_Feature *const *features,
+	unsigned def, unsigned max)
+{
+	const LV2_Options_Option *opts = NULL;
+
+	for(unsigned i=0; features[i]; i++)
+	{
+		if(!strcmp(features[i]->URI, LV2_OPTIONS__options))
+			opts = features[i]->data;
+	}
+
+	if(!opts)
+		return def;
+
+	const LV2_URID xpress_maxNVoices = map->map(map->handle, XPRESS__maxNVoices);
+	const LV2_URID atom_Int = map->map(map->handle, LV2_ATOM__Int);
+
+	for(const LV2_Options_Option *opt = opts; opt->key || opt->value; opt++)
+	{
+		if(  (opt->key == xpress_maxNVoices)
+			&& (opt->type == atom_Int)
+			&& (opt->size == sizeof(int32_t)) )
+		{
+			const int32_t nvoices = *(const int32_t *)opt->value;
+
+			if(nvoices < 1)
+				return def;
+
+			return (unsigned)nvoices < max
+				? (unsigned)nvoices
+				: max;
+		}
 	}
+
+	return def;
 }
 
 static inline void *
@@ -492,14 +1144,186 @@ xpress_get(xpress_t *xpress, xpress_uuid_t uuid)
 	return NULL;
 }
 
+static inline void *
+xpress_get_h(xpress_t *xpress, const xpress_handle_t *handle)
+{
+	xpress_voice_t *voice = _xpress_voice_get_h(xpress, handle);
+	if(voice)
+		return voice->target;
+
+	return NULL;
+}
+
+static inline xpress_voice_t *
+_xpress_voice_acquire(xpress_t *xpress, LV2_URID source, xpress_uuid_t uuid,
+	bool *added)
+{
+	xpress_voice_t *voice = _xpress_voice_get(xpress, uuid);
+	if(voice)
+	{
+		*added = false;
+	}
+	else
+	{
+		voice = _xpress_voice_add(xpress, source, uuid, false);
+
+		*added = true;
+	}
+
+	return voice;
+}
+
+static inline void
+_xpress_voice_notify(xpress_t *xpress, int64_t frames, xpress_voice_t *voice,
+	bool added)
+{
+	voice->cached = true;
+	xpress->ntokens++;
+
+	if(added)
+	{
+		if( (xpress->event_mask & XPRESS_EVENT_ADD) && xpress->iface->add)
+			xpress->iface->add(xpress->data, frames, &voice->state, voice->uuid, voice->target);
+	}
+	else
+	{
+		if( (xpress->event_mask & XPRESS_EVENT_SET) && xpress->iface->set)
+			xpress->iface->set(xpress->data, frames, &voice->state, voice->uuid, voice->target);
+	}
+}
+
+static inline void
+_xpress_voice_kill(xpress_t *xpress, xpress_voice_t *voice, int64_t frames)
+{
+	if( (xpress->event_mask & XPRESS_EVENT_DEL) && xpress->iface->del)
+		xpress->iface->del(xpress->data, frames, voice->uuid, voice->target);
+
+	_xpress_voice_free(xpress, voice);
+}
+
+// free all voices (of given source or any source if 0) not marked alive
+static inline void
+_xpress_voice_sweep(xpress_t *xpress, LV2_URID source, int64_t frames)
+{
+	if(source && !xpress->nunindexed)
+	{
+		// walk source list only
+		const int32_t part = _xpress_source_get(xpress, source, false);
+		if(part == XPRESS_NIL)
+			return; // no voices of this source
+
+		for(int32_t i = xpress->sources[part].head; i != XPRESS_NIL; )
+		{
+			xpress_voice_t *voice = &xpress->voices[i];
+			const int32_t succ = voice->succ;
+
+			if(!(xpress->alive[XPRESS_GROUP(i)] & XPRESS_BIT(i)))
+				_xpress_voice_kill(xpress, voice, frames);
+
+			i = succ;
+		}
+
+		return;
+	}
+
+	const unsigned ngroups = _xpress_ngroups(xpress);
+
+	for(unsigned g = 0; g < ngroups; g++)
+	{
+		for(uint64_t dead = xpress->used[g] & ~xpress->alive[g]; dead; dead &= dead - 1)
+		{
+			xpress_voice_t *voice = &xpress->voices[(g << 6) + __builtin_ctzll(dead)];
+
+			if(source && (voice->source != source) )
+				continue;
+
+			_xpress_voice_kill(xpress, voice, frames);
+		}
+	}
+}
+
+// cheap sanity check of a state copied from xpress#Packed or xpress#Batch
+static inline bool
+_xpress_state_valid(const xpress_state_t *state)
+{
+	return (state->zone >= 0) && (state->zone <= XPRESS_MAX_ZONE)
+		&& xpress_isfinite(state->pitch)
+		&& xpress_isfinite(state->pressure)
+		&& xpress_isfinite(state->timbre)
+		&& xpress_isfinite(state->dPitch)
+		&& xpress_isfinite(state->dPressure)
+		&& xpress_isfinite(state->dTimbre);
+}
+
 static inline int
 xpress_advance(xpress_t *xpress, LV2_Atom_Forge *forge, uint32_t frames,
 	const LV2_Atom_Object *obj, LV2_Atom_Forge_Ref *ref __attribute__((unused)))
 {
+	if(obj->atom.type == xpress->urid.xpress_Packed)
+	{
+		xpress_packed_t packed;
+
+		if(obj->atom.size < sizeof(packed))
+			return 0;
+
+		memcpy(&packed, LV2_ATOM_BODY_CONST(&obj->atom), sizeof(packed));
+
+		if(!_xpress_state_valid(&packed.state))
+			return 0;
+
+		bool added;
+		xpress_voice_t *voice = _xpress_voice_acquire(xpress, packed.source,
+			packed.uuid, &added);
+		if(!voice)
+			return 0;
+
+		voice->state = packed.state;
+		_xpress_voice_notify(xpress, frames, voice, added);
+
+		return 1;
+	}
+	else if(obj->atom.type == xpress->urid.xpress_Batch)
+	{
+		xpress_batch_t batch;
+
+		if(obj->atom.size < sizeof(batch))
+			return 0;
+
+		memcpy(&batch, LV2_ATOM_BODY_CONST(&obj->atom), sizeof(batch));
+
+		if(batch.stride < sizeof(xpress_batch_item_t))
+			return 0;
+
+		const uint8_t *ptr = (const uint8_t *)LV2_ATOM_BODY_CONST(&obj->atom) + sizeof(batch);
+		const uint8_t *end = (const uint8_t *)LV2_ATOM_BODY_CONST(&obj->atom) + obj->atom.size;
+
+		for( ; ptr + batch.stride <= end; ptr += batch.stride)
+		{
+			xpress_batch_item_t item;
+
+			memcpy(&item, ptr, sizeof(item));
+
+			if(!_xpress_state_valid(&item.state))
+				continue; // corrupt item
+
+			bool added;
+			xpress_voice_t *voice = _xpress_voice_acquire(xpress, batch.source,
+				item.uuid, &added);
+			if(!voice)
+				continue;
+
+			voice->state = item.state;
+			_xpress_voice_notify(xpress, frames, voice, added);
+		}
+
+		return 1;
+	}
+
 	if(!lv2_atom_forge_is_object_type(forge, obj->atom.type))
 		return 0;
 
-	if(obj->body.otype == xpress->urid.xpress_Token)
+	if(  (obj->body.otype == xpress->urid.xpress_Token)
+		|| (obj->body.otype == xpress->urid.xpress_Delta) )
 	{
 		const LV2_Atom_URID *source = NULL;
 		const LV2_Atom_Int *uuid = NULL;
@@ -529,49 +1353,41 @@ xpress_advance(xpress_t *xpress, LV2_Atom_Forge *forge, uint32_t frames,
 			return 0;
 		}
 
-		bool added;
-		xpress_voice_t *voice = _xpress_voice_get(xpress, uuid->body);
-		void *target;
-		if(voice)
+		bool added = false;
+		xpress_voice_t *voice;
+		if(obj->body.otype == xpress->urid.xpress_Delta)
 		{
-			target = voice->target;
-
-			added = false;
+			// never create a voice from a partial state, e.g. when its full token
+			// was lost, the sender falls back to full tokens then
+			voice = _xpress_voice_get(xpress, uuid->body);
+			if(voice && !voice->cached)
+				voice = NULL;
 		}
 		else
 		{
-			if(!(target = _xpress_voice_add(xpress, source->body, uuid->body, false)))
-				return 0;
-
-			added = true;
+			voice = _xpress_voice_acquire(xpress, source->body, uuid->body, &added);
 		}
+		if(!voice)
+			return 0;
 
-		xpress_state_t state = xpress_vanilla;
+		// merge into cached state, xpress#Delta only carries changed properties
+		xpress_state_t *state = &voice->state;
 		if(zone && (zone->atom.type == forge->Int))
-			state.zone = zone->body;
+			state->zone = zone->body;
 		if(pitch && (pitch->atom.type == forge->Float))
-			state.pitch = pitch->body;
+			state->pitch = pitch->body;
 		if(pressure && (pressure->atom.type == forge->Float))
-			state.pressure = pressure->body;
+			state->pressure = pressure->body;
 		if(timbre && (timbre->atom.type == forge->Float))
-			state.timbre = timbre->body;
+			state->timbre = timbre->body;
 		if(dPitch && (dPitch->atom.type == forge->Float))
-			state.dPitch = dPitch->body;
+			state->dPitch = dPitch->body;
 		if(dPressure && (dPressure->atom.type == forge->Float))
-			state.dPressure = dPressure->body;
+			state->dPressure = dPressure->body;
 		if(dTimbre && (dTimbre->atom.type == forge->Float))
-			state.dTimbre = dTimbre->body;
+			state->dTimbre = dTimbre->body;
 
-		if(added)
-		{
-			if( (xpress->event_mask & XPRESS_EVENT_ADD) && xpress->iface->add)
-				xpress->iface->add(xpress->data, frames, &state, uuid->body, target);
-		}
-		else
-		{
-			if( (xpress->event_mask & XPRESS_EVENT_SET) && xpress->iface->set)
-				xpress->iface->set(xpress->data, frames, &state, uuid->body, target);
-		}
+		_xpress_voice_notify(xpress, frames, voice, added);
 
 		return 1;
 	}
@@ -588,6 +1404,8 @@ xpress_advance(xpress_t *xpress, LV2_Atom_Forge *forge, uint32_t frames,
 		if(  !source || (source->atom.type != forge->URID) )
 			return 0;
 
+		xpress->nalives++;
+
 		if(body && (body->atom.type == forge->Tuple) ) // non-existent body is a valid empty body
 		{
 			LV2_ATOM_TUPLE_FOREACH(body, item)
@@ -599,41 +1417,56 @@ xpress_advance(xpress_t *xpress, LV2_Atom_Forge *forge, uint32_t frames,
 					xpress_voice_t *voice = _xpress_voice_get(xpress, uuid->body);
 					if(voice)
 					{
-						voice->alive = true;
+						const unsigned idx = voice - xpress->voices;
+
+						xpress->alive[XPRESS_GROUP(idx)] |= XPRESS_BIT(idx);
 					}
 					else	
 					{
-						void *target = _xpress_voice_add(xpress, source->body, uuid->body, true);
-						if(target)
+						voice = _xpress_voice_add(xpress, source->body, uuid->body, true);
+						if(voice)
 						{
-							xpress_state_t state = xpress_vanilla;
 							if( (xpress->event_mask & XPRESS_EVENT_ADD) && xpress->iface->add)
-								xpress->iface->add(xpress->data, frames, &state, uuid->body, target);
+								xpress->iface->add(xpress->data, frames, &voice->state, uuid->body, voice->target);
 						}
 					}
 				}
 			}
 		}
 
-		unsigned freed = 0;
+		_xpress_voice_sweep(xpress, source->body, frames);
+
+		return 1;
+	}
+
+	else if(obj->body.otype == xpress->urid.xpress_Release)
+	{
+		const LV2_Atom_URID *source = NULL;
+		const LV2_Atom_Tuple *body = NULL;
+
+		lv2_atom_object_get(obj,
+			xpress->urid.xpress_source, &source,
+			xpress->urid.xpress_body, &body,
+			0);
+
+		if(  !source || (source->atom.type != forge->URID) )
+			return 0;
 
-		XPRESS_VOICE_FOREACH(xpress, voice)
+		if(body && (body->atom.type == forge->Tuple) )
 		{
-			if(  (voice->source == source->body)
-				&& !voice->alive )
+			LV2_ATOM_TUPLE_FOREACH(body, item)
 			{
-				if( (xpress->event_mask & XPRESS_EVENT_DEL) && xpress->iface->del)
-					xpress->iface->del(xpress->data, frames, voice->uuid, voice->target);
+				const LV2_Atom_Int *uuid = (const LV2_Atom_Int *)item;
 
-				freed += 1;
-				voice->uuid = 0; // invalidate
-			}
-		}
+				if(uuid->atom.type != forge->Int)
+					continue;
 
-		if(freed > 0)
-		{
-			_xpress_sort(xpress);
-			xpress->nvoices -= freed;
+				xpress_voice_t *voice = _xpress_voice_get(xpress, uuid->body);
+				if(!voice || (voice->source != source->body) )
+					continue;
+
+				_xpress_voice_kill(xpress, voice, frames);
+			}
 		}
 
 		return 1;
@@ -645,16 +1478,17 @@ xpress_advance(xpress_t *xpress, LV2_Atom_Forge *forge, uint32_t frames,
 static inline void
 xpress_pre(xpress_t *xpress)
 {
-	XPRESS_VOICE_FOREACH(xpress, voice)
-	{
-		voice->alive = false;
-	}
+	const unsigned ngroups = _xpress_ngroups(xpress);
+
+	for(unsigned g = 0; g < ngroups; g++)
+		xpress->alive[g] = 0;
 }
 
 static inline void
 xpress_rst(xpress_t *xpress)
 {
 	xpress->synced = false; // e.g. needs an xpress#alive
+	xpress->frames = 0;
 }
 
 static inline bool
@@ -664,33 +1498,107 @@ xpress_synced(xpress_t *xpress)
 }
 
 static inline void
-xpress_post(xpress_t *xpress, int64_t frames)
+xpress_discard(xpress_t *xpress)
 {
-	unsigned freed = 0;
+	xpress_stage_t *stage = xpress->stage;
 
+	// what was sent in this cycle never arrived, thus fall back to full tokens
 	XPRESS_VOICE_FOREACH(xpress, voice)
 	{
-		if(!voice->alive)
-		{
-			if( (xpress->event_mask & XPRESS_EVENT_DEL) && xpress->iface->del)
-				xpress->iface->del(xpress->data, frames, voice->uuid, voice->target);
+		if(!voice->cached)
+			continue;
+
+		voice->cached = false;
+
+		if(!stage)
+			continue;
+
+		// and resend the last state next cycle, right away
+		xpress_staged_t *staged = &stage->voices[voice - xpress->voices];
 
-			freed += 1;
-			voice->uuid = 0; // invalidate
+		staged->last = 0;
+		if(!staged->dirty)
+		{
+			staged->state = voice->state;
+			staged->frames = 0;
+			_xpress_dirty_append(stage, staged);
 		}
 	}
 
-	if(freed > 0)
+	xpress->synced = false; // e.g. needs an xpress#alive
+}
+
+static inline void
+xpress_post(xpress_t *xpress, int64_t frames)
+{
+	_xpress_voice_sweep(xpress, 0, frames);
+}
+
+static inline void
+xpress_delta(xpress_t *xpress, bool delta)
+{
+	xpress->delta = delta;
+}
+
+static inline void
+xpress_packed(xpress_t *xpress, bool packed)
+{
+	xpress->packed = packed;
+}
+
+static inline void
+xpress_stage(xpress_t *xpress, xpress_stage_t *stage)
+{
+	if(stage)
 	{
-		_xpress_sort(xpress);
-		xpress->nvoices -= freed;
+		stage->coalesce = XPRESS_COALESCE_NONE;
+		stage->limited = false;
+		stage->head = XPRESS_NIL;
+		stage->tail = XPRESS_NIL;
+		stage->clock = 0;
+
+		for(unsigned i = 0; i < xpress->max_nvoices; i++)
+		{
+			xpress_staged_t *staged = &stage->voices[i];
+
+			staged->dirty = false;
+			staged->touched = false;
+			staged->last = 0;
+		}
 	}
+
+	xpress->stage = stage;
+}
+
+static inline void
+xpress_coalesce(xpress_t *xpress, xpress_coalesce_t coalesce)
+{
+	if(xpress->stage)
+		xpress->stage->coalesce = coalesce;
+}
+
+static inline void
+xpress_limit(xpress_t *xpress, const xpress_limit_t *limit)
+{
+	xpress_stage_t *stage = xpress->stage;
+
+	if(!stage)
+		return;
+
+	stage->limited = limit != NULL;
+
+	if(limit)
+		stage->limit = *limit;
 }
 
 static inline void *
 xpress_add(xpress_t *xpress, xpress_uuid_t uuid)
 {
-	return _xpress_voice_add(xpress, xpress->source, uuid, false);
+	xpress_voice_t *voice = _xpress_voice_add(xpress, xpress->source, uuid, false);
+	if(voice)
+		return voice->target;
+
+	return NULL;
 }
 
 static inline void *
@@ -701,6 +1609,26 @@ xpress_create(xpress_t *xpress, xpress_uuid_t *uuid)
 	return xpress_add(xpress, *uuid);
 }
 
+static inline void *
+xpress_add_h(xpress_t *xpress, xpress_uuid_t uuid, xpress_handle_t *handle)
+{
+	xpress_voice_t *voice = _xpress_voice_add(xpress, xpress->source, uuid, false);
+
+	handle->uuid = uuid;
+	handle->idx = voice ? voice - xpress->voices : XPRESS_NIL;
+
+	if(voice)
+		return voice->target;
+
+	return NULL;
+}
+
+static inline void *
+xpress_create_h(xpress_t *xpress, xpress_handle_t *handle)
+{
+	return xpress_add_h(xpress, xpress_map(xpress), handle);
+}
+
 static inline int
 xpress_free(xpress_t *xpress, xpress_uuid_t uuid)
 {
@@ -713,16 +1641,105 @@ xpress_free(xpress_t *xpress, xpress_uuid_t uuid)
 	return 1;
 }
 
+static inline int
+xpress_free_h(xpress_t *xpress, const xpress_handle_t *handle)
+{
+	xpress_voice_t *voice = _xpress_voice_get_h(xpress, handle);
+	if(!voice)
+		return 0; // failed
+
+	_xpress_voice_free(xpress, voice);
+
+	return 1;
+}
+
+// undo a partially forged event and return the reference of the enclosing
+// frame, e.g. the sequence, which thus keeps all events forged before it
 static inline LV2_Atom_Forge_Ref
-xpress_token(xpress_t *xpress, LV2_Atom_Forge *forge, uint32_t frames,
-	xpress_uuid_t uuid, const xpress_state_t *state)
+_xpress_rollback(LV2_Atom_Forge *forge, LV2_Atom_Forge_Frame *stack,
+	uint32_t offset)
+{
+	if(!forge->buf || !stack)
+		return 0; // cannot be undone
+
+	const uint32_t size = forge->offset - offset;
+
+	for(LV2_Atom_Forge_Frame *frame = stack; frame; frame = frame->parent)
+	{
+		LV2_Atom *atom = lv2_atom_forge_deref(forge, frame->ref);
+
+		atom->size -= size;
+	}
+
+	forge->stack = stack; // drops frames left open by the partial event
+	forge->offset = offset;
+
+	return stack->ref;
+}
+
+// remember frame time of last token of a voice for the limiter
+static inline void
+_xpress_sent(xpress_t *xpress, xpress_voice_t *voice, uint32_t frames)
+{
+	xpress_stage_t *stage = xpress->stage;
+
+	if(voice && stage)
+		stage->voices[voice - xpress->voices].last = stage->clock + frames;
+}
+
+static inline LV2_Atom_Forge_Ref
+_xpress_token(xpress_t *xpress, LV2_Atom_Forge *forge, uint32_t frames,
+	xpress_uuid_t uuid, xpress_voice_t *voice, const xpress_state_t *state)
 {
 	LV2_Atom_Forge_Frame obj_frame;
 
+	xpress->ntokens++;
+	xpress->frames = frames;
+	_xpress_sent(xpress, voice, frames);
+
+	if(xpress->packed)
+	{
+		const struct {
+			LV2_Atom atom;
+			xpress_packed_t body;
+		} packed = {
+			.atom = {
+				.size = sizeof(xpress_packed_t),
+				.type = xpress->urid.xpress_Packed
+			},
+			.body = {
+				.source = xpress->source,
+				.uuid = uuid,
+				.state = *state
+			}
+		};
+
+		LV2_Atom_Forge_Ref ref = lv2_atom_forge_frame_time(forge, frames);
+		if(ref)
+			ref = lv2_atom_forge_write(forge, &packed, sizeof(packed));
+
+		if(ref && voice)
+		{
+			voice->state = *state;
+			voice->cached = true;
+		}
+
+		xpress->synced = false; // e.g. needs an xpress#alive
+
+		return ref;
+	}
+
+	// in delta mode, only send properties that changed since last token, as a
+	// distinct type, so that receivers not merging partial tokens ignore them
+	const xpress_state_t *last = xpress->delta && voice && voice->cached
+		? &voice->state
+		: NULL;
+
 	LV2_Atom_Forge_Ref ref = lv2_atom_forge_frame_time(forge, frames);
 
 	if(ref)
-		ref = lv2_atom_forge_object(forge, &obj_frame, 0, xpress->urid.xpress_Token);
+		ref = lv2_atom_forge_object(forge, &obj_frame, 0,
+			last ? xpress->urid.xpress_Delta : xpress->urid.xpress_Token);
 	{
 		if(ref)
 			ref = lv2_atom_forge_key(forge, xpress->urid.xpress_source);
@@ -734,54 +1751,460 @@ xpress_token(xpress_t *xpress, LV2_Atom_Forge *forge, uint32_t frames,
 		if(ref)
 			ref = lv2_atom_forge_int(forge, uuid);
 
-		if(ref)
-			ref = lv2_atom_forge_key(forge, xpress->urid.xpress_zone);
-		if(ref)
-			ref = lv2_atom_forge_int(forge, state->zone);
+		if(!last || (last->zone != state->zone))
+		{
+			if(ref)
+				ref = lv2_atom_forge_key(forge, xpress->urid.xpress_zone);
+			if(ref)
+				ref = lv2_atom_forge_int(forge, state->zone);
+		}
 
-		if(ref)
-			ref = lv2_atom_forge_key(forge, xpress->urid.xpress_pitch);
-		if(ref)
-			ref = lv2_atom_forge_float(forge, state->pitch);
+		if(!last || (last->pitch != state->pitch))
+		{
+			if(ref)
+				ref = lv2_atom_forge_key(forge, xpress->urid.xpress_pitch);
+			if(ref)
+				ref = lv2_atom_forge_float(forge, state->pitch);
+		}
 
-		if(ref)
-			ref = lv2_atom_forge_key(forge, xpress->urid.xpress_pressure);
-		if(ref)
-			ref = lv2_atom_forge_float(forge, state->pressure);
+		if(!last || (last->pressure != state->pressure))
+		{
+			if(ref)
+				ref = lv2_atom_forge_key(forge, xpress->urid.xpress_pressure);
+			if(ref)
+				ref = lv2_atom_forge_float(forge, state->pressure);
+		}
 
-		if(ref)
-			ref = lv2_atom_forge_key(forge, xpress->urid.xpress_timbre);
-		if(ref)
-			ref = lv2_atom_forge_float(forge, state->timbre);
+		if(!last || (last->timbre != state->timbre))
+		{
+			if(ref)
+				ref = lv2_atom_forge_key(forge, xpress->urid.xpress_timbre);
+			if(ref)
+				ref = lv2_atom_forge_float(forge, state->timbre);
+		}
 
-		if(ref)
-			ref = lv2_atom_forge_key(forge, xpress->urid.xpress_dPitch);
-		if(ref)
-			ref = lv2_atom_forge_float(forge, state->dPitch);
+		if(!last || (last->dPitch != state->dPitch))
+		{
+			if(ref)
+				ref = lv2_atom_forge_key(forge, xpress->urid.xpress_dPitch);
+			if(ref)
+				ref = lv2_atom_forge_float(forge, state->dPitch);
+		}
 
-		if(ref)
-			ref = lv2_atom_forge_key(forge, xpress->urid.xpress_dPressure);
-		if(ref)
-			ref = lv2_atom_forge_float(forge, state->dPressure);
+		if(!last || (last->dPressure != state->dPressure))
+		{
+			if(ref)
+				ref = lv2_atom_forge_key(forge, xpress->urid.xpress_dPressure);
+			if(ref)
+				ref = lv2_atom_forge_float(forge, state->dPressure);
+		}
 
-		if(ref)
-			ref = lv2_atom_forge_key(forge, xpress->urid.xpress_dTimbre);
-		if(ref)
-			ref = lv2_atom_forge_float(forge, state->dTimbre);
+		if(!last || (last->dTimbre != state->dTimbre))
+		{
+			if(ref)
+				ref = lv2_atom_forge_key(forge, xpress->urid.xpress_dTimbre);
+			if(ref)
+				ref = lv2_atom_forge_float(forge, state->dTimbre);
+		}
 	}
 	if(ref)
 		lv2_atom_forge_pop(forge, &obj_frame);
 
+	if(ref && voice)
+	{
+		// only cache what actually made it into the sequence, also used by limiter
+		voice->state = *state;
+		voice->cached = true;
+	}
+
 	xpress->synced = false; // e.g. needs an xpress#alive
 
 	return ref;
 }
 
+// upper bound of output space needed by a token
+static inline uint32_t
+_xpress_token_size(xpress_t *xpress)
+{
+	if(xpress->packed)
+		return lv2_atom_pad_size(sizeof(LV2_Atom_Event) + sizeof(xpress_packed_t));
+
+	// source, uuid, zone and 6 floats, each padded to 8 bytes
+	return sizeof(LV2_Atom_Event) + sizeof(LV2_Atom_Object_Body)
+		+ 9*(sizeof(LV2_Atom_Property_Body) + lv2_atom_pad_size(sizeof(int32_t)));
+}
+
+// upper bound of output space needed by an alive or release of nuuids
+static inline uint32_t
+_xpress_alive_size(unsigned nuuids)
+{
+	return sizeof(LV2_Atom_Event) + sizeof(LV2_Atom_Object_Body)
+		+ sizeof(LV2_Atom_Property_Body) + lv2_atom_pad_size(sizeof(LV2_URID))
+		+ sizeof(LV2_Atom_Property_Body)
+		+ nuuids*lv2_atom_pad_size(sizeof(LV2_Atom_Int));
+}
+
+// whether another update would eat into the space kept for structural events,
+// e.g. voice births, releases and the closing alive
+static inline bool
+_xpress_tight(xpress_t *xpress, LV2_Atom_Forge *forge)
+{
+	if(!forge->buf)
+		return false; // forging to a sink, capacity unknown
+
+	const uint32_t reserve = _xpress_alive_size(xpress->nvoices)
+		+ (XPRESS_RESERVE_NTOKENS + 1)*_xpress_token_size(xpress);
+
+	return forge->offset + reserve > forge->size;
+}
+
+static inline bool
+_xpress_exceeds(const xpress_state_t *deadband, const xpress_state_t *a,
+	const xpress_state_t *b)
+{
+	return (a->zone != b->zone)
+		|| (fabsf(a->pitch - b->pitch) > deadband->pitch)
+		|| (fabsf(a->pressure - b->pressure) > deadband->pressure)
+		|| (fabsf(a->timbre - b->timbre) > deadband->timbre)
+		|| (fabsf(a->dPitch - b->dPitch) > deadband->dPitch)
+		|| (fabsf(a->dPressure - b->dPressure) > deadband->dPressure)
+		|| (fabsf(a->dTimbre - b->dTimbre) > deadband->dTimbre);
+}
+
+static inline bool
+_xpress_due(xpress_stage_t *stage, xpress_staged_t *staged, uint32_t frames)
+{
+	return stage->clock + frames >= staged->last + stage->limit.interval;
+}
+
+// stage update of an already sent voice, last state wins, updates are also
+// staged whenever output space runs short, to be retried by xpress_flush
+static inline bool
+_xpress_stage(xpress_t *xpress, LV2_Atom_Forge *forge, uint32_t frames,
+	xpress_voice_t *voice, const xpress_state_t *state)
+{
+	if(!voice || !voice->cached)
+		return false; // voice births are always forged right away
+
+	xpress_stage_t *stage = xpress->stage;
+
+	if(!stage)
+		return _xpress_tight(xpress, forge); // shed, as it cannot be retried
+
+	xpress_staged_t *staged = &stage->voices[voice - xpress->voices];
+
+	if(!stage->coalesce
+		&& !_xpress_tight(xpress, forge)
+		&& ( !stage->limited
+			|| (_xpress_due(stage, staged, frames)
+				&& _xpress_exceeds(&stage->limit.deadband, state, &voice->state)) ) )
+	{
+		if(staged->dirty)
+			_xpress_dirty_unlink(stage, staged); // superseded
+
+		return false; // forge right away whenever allowed
+	}
+
+	if(!staged->dirty)
+	{
+		staged->frames = frames;
+		_xpress_dirty_append(stage, staged);
+	}
+	else if( (stage->coalesce != XPRESS_COALESCE_FIRST) || !staged->touched)
+	{
+		// move to tail to keep list sorted by frame time
+		staged->frames = frames;
+		_xpress_dirty_unlink(stage, staged);
+		_xpress_dirty_append(stage, staged);
+	}
+
+	staged->state = *state;
+	staged->touched = true;
+
+	return true;
+}
+
+// stage a birth or update that did not fit, to be retried by xpress_flush,
+// without a stage it is dropped, a dropped birth is resent with the next token
+static inline void
+_xpress_defer(xpress_t *xpress, uint32_t frames, xpress_voice_t *voice,
+	const xpress_state_t *state)
+{
+	xpress_stage_t *stage = xpress->stage;
+
+	if(!voice || !stage)
+		return;
+
+	xpress_staged_t *staged = &stage->voices[voice - xpress->voices];
+
+	// move to tail to keep list sorted by frame time
+	if(staged->dirty)
+		_xpress_dirty_unlink(stage, staged);
+
+	staged->frames = frames;
+	_xpress_dirty_append(stage, staged);
+
+	staged->state = *state;
+	staged->touched = true;
+}
+
+static inline LV2_Atom_Forge_Ref
+_xpress_token_fit(xpress_t *xpress, LV2_Atom_Forge *forge, uint32_t frames,
+	xpress_uuid_t uuid, xpress_voice_t *voice, const xpress_state_t *state)
+{
+	LV2_Atom_Forge_Frame *stack = forge->stack;
+	const uint32_t offset = forge->offset;
+
+	if(_xpress_stage(xpress, forge, frames, voice, state))
+		return XPRESS_REF_STAGED;
+
+	LV2_Atom_Forge_Ref ref = _xpress_token(xpress, forge, frames, uuid, voice, state);
+
+	// a token that does not fit is deferred, not the whole sequence dropped
+	if(!ref)
+	{
+		ref = _xpress_rollback(forge, stack, offset);
+		_xpress_defer(xpress, frames, voice, state);
+	}
+
+	return ref;
+}
+
+static inline LV2_Atom_Forge_Ref
+xpress_token(xpress_t *xpress, LV2_Atom_Forge *forge, uint32_t frames,
+	xpress_uuid_t uuid, const xpress_state_t *state)
+{
+	// voice is needed to tell births from updates
+	xpress_voice_t *voice = _xpress_voice_get(xpress, uuid);
+
+	return _xpress_token_fit(xpress, forge, frames, uuid, voice, state);
+}
+
+static inline LV2_Atom_Forge_Ref
+xpress_token_h(xpress_t *xpress, LV2_Atom_Forge *forge, uint32_t frames,
+	const xpress_handle_t *handle, const xpress_state_t *state)
+{
+	// a stale handle still forges a token, just without delta cache
+	xpress_voice_t *voice = _xpress_voice_get_h(xpress, handle);
+
+	return _xpress_token_fit(xpress, forge, frames, handle->uuid, voice, state);
+}
+
+// frame time of the last event in the sequence currently being forged,
+// whoever forged it, falls back to the last one forged by us
+static inline uint32_t
+_xpress_sequence_frames(xpress_t *xpress, LV2_Atom_Forge *forge)
+{
+	if(!forge->buf || !forge->stack)
+		return xpress->frames; // forging to a sink, sequence not accessible
+
+	const LV2_Atom_Sequence *seq = (const LV2_Atom_Sequence *)
+		lv2_atom_forge_deref(forge, forge->stack->ref);
+
+	if(seq->atom.type != forge->Sequence)
+		return xpress->frames; // not forging into a sequence
+
+	uint32_t frames = xpress->frames;
+
+	LV2_ATOM_SEQUENCE_FOREACH(seq, ev)
+	{
+		if( (ev->time.frames > 0) && ( (uint64_t)ev->time.frames > frames) )
+			frames = ev->time.frames;
+	}
+
+	return frames;
+}
+
+static inline void
+xpress_flush(xpress_t *xpress, LV2_Atom_Forge *forge, uint32_t nsamples,
+	LV2_Atom_Forge_Ref *ref)
+{
+	xpress_stage_t *stage = xpress->stage;
+
+	if(!stage)
+	{
+		xpress->frames = 0;
+		return; // nothing ever staged
+	}
+
+	// never go back in time behind events forged into the sequence meanwhile,
+	// frames left open by a failed forge are stale, thus only walk it on success
+	if( (stage->head != XPRESS_NIL) && *ref)
+		xpress->frames = _xpress_sequence_frames(xpress, forge);
+
+	bool full = false;
+
+	for(int32_t idx = stage->head; idx != XPRESS_NIL; )
+	{
+		xpress_voice_t *voice = &xpress->voices[idx];
+		xpress_staged_t *staged = &stage->voices[idx];
+		idx = staged->next;
+
+		const bool touched = staged->touched;
+		uint32_t frames = touched ? staged->frames : 0;
+		staged->touched = false;
+
+		if(stage->limited)
+		{
+			const uint64_t due = staged->last + stage->limit.interval;
+
+			if(due >= stage->clock + nsamples)
+				continue; // rate limited, keep staged
+
+			if(due > stage->clock + frames)
+				frames = due - stage->clock;
+
+			// within deadband, wait for the value to settle for a cycle
+			if(touched && !_xpress_exceeds(&stage->limit.deadband, &staged->state, &voice->state))
+				continue;
+		}
+
+		if(frames < xpress->frames)
+			frames = xpress->frames;
+
+		const bool settled = stage->limited
+			&& !_xpress_exceeds(&xpress_vanilla, &staged->state, &voice->state);
+
+		if(settled)
+		{
+			_xpress_dirty_unlink(stage, staged); // settled on what was sent already
+			continue;
+		}
+
+		// deferred births may use the reserve, updates are kept out of it
+		if(!*ref || full || (voice->cached && _xpress_tight(xpress, forge)))
+			continue; // output space short, keep staged until next cycle
+
+		LV2_Atom_Forge_Frame *stack = forge->stack;
+		const uint32_t offset = forge->offset;
+
+		if(_xpress_token(xpress, forge, frames, voice->uuid, voice, &staged->state))
+		{
+			_xpress_dirty_unlink(stage, staged); // only once actually sent
+		}
+		else
+		{
+			*ref = _xpress_rollback(forge, stack, offset); // keep staged
+			full = true;
+		}
+	}
+
+	xpress->frames = 0;
+	stage->clock += nsamples;
+}
+
+static inline LV2_Atom_Forge_Ref
+_xpress_batch_forge(xpress_t *xpress, LV2_Atom_Forge *forge)
+{
+	const struct {
+		LV2_Atom atom;
+		xpress_batch_t body;
+	} batch = {
+		.atom = {
+			.size = sizeof(xpress_batch_t),
+			.type = xpress->urid.xpress_Batch
+		},
+		.body = {
+			.source = xpress->source,
+			.stride = sizeof(xpress_batch_item_t)
+		}
+	};
+
+	LV2_Atom_Forge_Ref ref = lv2_atom_forge_frame_time(forge, xpress->frames);
+
+	if(ref)
+		ref = lv2_atom_forge_push(forge, xpress->batch,
+			lv2_atom_forge_write(forge, &batch, sizeof(batch)));
+
+	xpress->synced = false; // e.g. needs an xpress#alive
+
+	return ref;
+}
+
+static inline LV2_Atom_Forge_Ref
+xpress_batch_head(xpress_t *xpress, LV2_Atom_Forge *forge __attribute__((unused)),
+	uint32_t frames, LV2_Atom_Forge_Frame *frame)
+{
+	// postponed until first item, thus batches without any are never forged
+	xpress->frames = frames;
+	xpress->batch = frame;
+	frame->ref = 0;
+
+	return XPRESS_REF_STAGED;
+}
+
+static inline LV2_Atom_Forge_Ref
+xpress_batch_token(xpress_t *xpress, LV2_Atom_Forge *forge,
+	xpress_uuid_t uuid, const xpress_state_t *state)
+{
+	// items share the frame time of their batch
+	const uint32_t frames = xpress->frames;
+	xpress_voice_t *voice = _xpress_voice_get(xpress, uuid);
+
+	if(_xpress_stage(xpress, forge, frames, voice, state))
+		return XPRESS_REF_STAGED;
+
+	const xpress_batch_item_t item = {
+		.uuid = uuid,
+		.state = *state
+	};
+
+	LV2_Atom_Forge_Frame *stack = forge->stack;
+	const uint32_t offset = forge->offset;
+	const bool head = xpress->batch && !xpress->batch->ref;
+
+	LV2_Atom_Forge_Ref ref = 1;
+
+	if(head)
+		ref = _xpress_batch_forge(xpress, forge); // postponed until now
+
+	if(ref)
+	{
+		xpress->ntokens++;
+		_xpress_sent(xpress, voice, frames);
+
+		ref = lv2_atom_forge_write(forge, &item, sizeof(item));
+	}
+
+	if(!ref)
+	{
+		// an item that does not fit is deferred, not the whole sequence dropped
+		ref = _xpress_rollback(forge, stack, offset);
+		_xpress_defer(xpress, frames, voice, state);
+
+		if(head)
+			xpress->batch->ref = 0; // rolled back along with the item
+	}
+	else if(voice)
+	{
+		// only cache what actually made it into the sequence, also used by limiter
+		voice->state = *state;
+		voice->cached = true;
+	}
+
+	return ref;
+}
+
+static inline void
+xpress_batch_pop(xpress_t *xpress, LV2_Atom_Forge *forge,
+	LV2_Atom_Forge_Frame *frame)
+{
+	if(frame->ref) // head has been forged
+		lv2_atom_forge_pop(forge, frame);
+
+	xpress->batch = NULL;
+}
+
 static inline LV2_Atom_Forge_Ref
 xpress_alive(xpress_t *xpress, LV2_Atom_Forge *forge, uint32_t frames)
 {
 	LV2_Atom_Forge_Frame obj_frame;
 	LV2_Atom_Forge_Frame tup_frame;
+	LV2_Atom_Forge_Frame *stack = forge->stack;
+	const uint32_t offset = forge->offset;
+
+	xpress->nalives++;
+	xpress->frames = frames;
 
 	LV2_Atom_Forge_Ref ref = lv2_atom_forge_frame_time(forge, frames);
 
@@ -810,7 +2233,63 @@ xpress_alive(xpress_t *xpress, LV2_Atom_Forge *forge, uint32_t frames)
 	if(ref)
 		lv2_atom_forge_pop(forge, &obj_frame);
 
-	xpress->synced = true;
+	// an xpress#alive that does not fit is retried next cycle
+	xpress->synced = ref != 0;
+
+	if(!ref)
+		ref = _xpress_rollback(forge, stack, offset);
+
+	return ref;
+}
+
+static inline LV2_Atom_Forge_Ref
+xpress_release(xpress_t *xpress, LV2_Atom_Forge *forge, uint32_t frames,
+	const xpress_uuid_t *uuids, unsigned nuuids)
+{
+	LV2_Atom_Forge_Frame obj_frame;
+	LV2_Atom_Forge_Frame tup_frame;
+	LV2_Atom_Forge_Frame *stack = forge->stack;
+	const uint32_t offset = forge->offset;
+
+	xpress->frames = frames;
+
+	LV2_Atom_Forge_Ref ref = lv2_atom_forge_frame_time(forge, frames);
+
+	if(ref)
+		ref = lv2_atom_forge_object(forge, &obj_frame, 0, xpress->urid.xpress_Release);
+	{
+		if(ref)
+			ref = lv2_atom_forge_key(forge, xpress->urid.xpress_source);
+		if(ref)
+			ref = lv2_atom_forge_urid(forge, xpress->source);
+
+		if(ref)
+			ref = lv2_atom_forge_key(forge, xpress->urid.xpress_body);
+		if(ref)
+			ref = lv2_atom_forge_tuple(forge, &tup_frame);
+		{
+			for(unsigned i = 0; i < nuuids; i++)
+			{
+				if(!uuids[i])
+					continue; // invalid
+
+				if(ref)
+					ref = lv2_atom_forge_int(forge, uuids[i]);
+			}
+		}
+		if(ref)
+			lv2_atom_forge_pop(forge, &tup_frame);
+	}
+	if(ref)
+		lv2_atom_forge_pop(forge, &obj_frame);
+
+	// does not touch synced state, a full xpress#alive is still due after reset,
+	// a release that does not fit is left to the next xpress#alive instead
+	if(!ref)
+	{
+		xpress->synced = false;
+		ref = _xpress_rollback(forge, stack, offset);
+	}
 
 	return ref;
 }
@@ -827,14 +2306,162 @@ xpress_map(xpress_t *xpress)
 	else if(xpress->xpress_shm)
 	{
 		xpress_shm_t *xpress_shm = xpress->xpress_shm;
+		xpress_uuid_t uuid;
+
+		do
+		{
+			if(xpress->uuid_next == xpress->uuid_end)
+			{
+				// touch the shared counter only once per block
+				xpress->uuid_next = atomic_fetch_add_explicit(&xpress_shm->voice_uuid,
+					XPRESS_UUID_BLOCK, memory_order_relaxed);
+				xpress->uuid_end = xpress->uuid_next + XPRESS_UUID_BLOCK;
+			}
 
-		return atomic_fetch_add_explicit(&xpress_shm->voice_uuid, 1, memory_order_relaxed);
+			uuid = xpress->uuid_next++;
+		} while(!uuid); // 0 is reserved for unused voices after wrap-around
+
+		return uuid;
 	}
 
 	// fall-back
 	return atomic_fetch_add_explicit(&xpress->voice_uuid, 1, memory_order_relaxed);
 }
 
+static inline bool
+xpress_isfinite(float value)
+{
+	uint32_t bits;
+	memcpy(&bits, &value, sizeof(bits));
+
+	return (bits & 0x7f800000) != 0x7f800000; // exponent all ones for inf and nan
+}
+
+static inline xpress_bus_t *
+xpress_bus_init(void)
+{
+	return _xpress_bus_open(XPRESS_BUS_SHM_ID);
+}
+
+static inline void
+xpress_bus_deinit(xpress_bus_t *bus)
+{
+#ifndef _WIN32
+	munmap(bus, sizeof(xpress_bus_t));
+#else
+	(void)bus;
+#endif
+}
+
+// monotonic clock in ms, shared by all processes, wraps around
+static inline uint32_t
+_xpress_bus_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec*UINT32_C(1000) + ts.tv_nsec/1000000;
+}
+
+static inline bool
+xpress_bus_claim(xpress_bus_t *bus, unsigned channel, uint32_t token)
+{
+	xpress_bus_channel_t *chan = &bus->channels[channel];
+	const uint32_t now = _xpress_bus_now();
+	uint32_t expected = 0;
+
+	// single attempts, thus wait-free
+	if(  !atomic_compare_exchange_strong_explicit(&chan->producer, &expected, token,
+			memory_order_acquire, memory_order_relaxed)
+		&& (expected != token) )
+	{
+		// take over from a producer that stopped renewing, e.g. as it crashed
+		if(now - atomic_load_explicit(&chan->beat, memory_order_acquire) <= XPRESS_BUS_TIMEOUT)
+			return false;
+
+		if(!atomic_compare_exchange_strong_explicit(&chan->producer, &expected, token,
+			memory_order_acquire, memory_order_relaxed))
+		{
+			return false;
+		}
+	}
+
+	atomic_store_explicit(&chan->beat, now, memory_order_release);
+
+	return true;
+}
+
+static inline void
+xpress_bus_unclaim(xpress_bus_t *bus, unsigned channel, uint32_t token)
+{
+	xpress_bus_channel_t *chan = &bus->channels[channel];
+	uint32_t expected = token;
+
+	atomic_compare_exchange_strong_explicit(&chan->producer, &expected, 0,
+		memory_order_release, memory_order_relaxed);
+}
+
+static inline void
+xpress_bus_publish(xpress_bus_t *bus, unsigned channel,
+	const xpress_bus_item_t *item)
+{
+	xpress_bus_channel_t *chan = &bus->channels[channel];
+	const uint32_t pos = atomic_load_explicit(&chan->head, memory_order_relaxed);
+	xpress_bus_slot_t *slot = &chan->slots[pos & (XPRESS_BUS_NSLOTS - 1)];
+
+	atomic_store_explicit(&slot->seq, 2*pos + 1, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+	slot->item = *item;
+	atomic_store_explicit(&slot->seq, 2*pos + 2, memory_order_release);
+	atomic_store_explicit(&chan->head, pos + 1, memory_order_release);
+}
+
+static inline uint32_t
+xpress_bus_cursor(xpress_bus_t *bus, unsigned channel)
+{
+	xpress_bus_channel_t *chan = &bus->channels[channel];
+
+	return atomic_load_explicit(&chan->head, memory_order_acquire);
+}
+
+static inline xpress_bus_status_t
+xpress_bus_poll(xpress_bus_t *bus, unsigned channel, uint32_t *cursor,
+	xpress_bus_item_t *item)
+{
+	xpress_bus_channel_t *chan = &bus->channels[channel];
+	const uint32_t head = atomic_load_explicit(&chan->head, memory_order_acquire);
+	const uint32_t pos = *cursor;
+
+	if(pos == head)
+		return XPRESS_BUS_EMPTY;
+
+	if(head - pos > XPRESS_BUS_NSLOTS)
+	{
+		*cursor = head;
+		return XPRESS_BUS_OVERRUN;
+	}
+
+	const xpress_bus_slot_t *slot = &chan->slots[pos & (XPRESS_BUS_NSLOTS - 1)];
+	const uint32_t seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+
+	if(seq == 2*pos + 2)
+	{
+		*item = slot->item;
+		atomic_thread_fence(memory_order_acquire);
+
+		// item was not overwritten while copying
+		if(atomic_load_explicit(&slot->seq, memory_order_relaxed) == seq)
+		{
+			*cursor = pos + 1;
+			return XPRESS_BUS_ITEM;
+		}
+	}
+
+	*cursor = atomic_load_explicit(&chan->head, memory_order_acquire);
+	return XPRESS_BUS_OVERRUN;
+}
+
 #ifdef __cplusplus
 }
 #endif